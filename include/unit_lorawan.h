@@ -27,6 +27,7 @@
 #define UNIT_LORAWAN_H
 
 #include "esp_err.h"
+#include "sdkconfig.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -36,6 +37,11 @@ extern "C"
 {
 #endif
 
+// Error codes returned in addition to the standard esp_err_t values
+#define UNIT_LORAWAN_ERR_BASE 0x1c000 ///< First error code of this component
+#define UNIT_LORAWAN_ERR_SPOOLED                                               \
+  ( UNIT_LORAWAN_ERR_BASE + 1 ) ///< Uplink failed and was kept in the spool
+
 // TTN US915 Configuration Constants
 #define UNIT_LORAWAN_TTN_US915_RX2_FREQUENCY                                   \
   923300000 ///< TTN standard RX2 frequency for US915 (Hz)
@@ -52,6 +58,14 @@ extern "C"
 #define UNIT_LORAWAN_TTN_V3_APP_EUI                                            \
   "0000000000000000" ///< Standard AppEUI for TTN v3
 
+// TTN EU868 Configuration Constants
+#define UNIT_LORAWAN_TTN_EU868_RX2_FREQUENCY                                   \
+  869525000 ///< TTN standard RX2 frequency for EU868 (Hz)
+#define UNIT_LORAWAN_TTN_EU868_RX2_DATA_RATE                                   \
+  3 ///< TTN standard RX2 data rate for EU868 (SF9)
+#define UNIT_LORAWAN_TTN_EU868_DATA_RATE_DEFAULT                               \
+  3 ///< Recommended initial data rate for TTN EU868
+
 // LoRaWAN US915 Data Rate Constants
 #define UNIT_LORAWAN_US915_DATA_RATE_MIN                                       \
   0 ///< Minimum US915 data rate (SF10, longest range)
@@ -74,12 +88,74 @@ extern "C"
 #define UNIT_LORAWAN_US915_SUB_BAND_MIN 1 ///< Minimum valid US915 sub-band
 #define UNIT_LORAWAN_US915_SUB_BAND_MAX 8 ///< Maximum valid US915 sub-band
 
+// LoRaWAN EU868 Data Rate Constants
+#define UNIT_LORAWAN_EU868_DATA_RATE_MIN                                       \
+  0 ///< Minimum EU868 data rate (SF12, longest range)
+#define UNIT_LORAWAN_EU868_DATA_RATE_MAX                                       \
+  6 ///< Maximum EU868 LoRa data rate (SF7 250kHz), FSK DR7 is not used
+
+// LoRaWAN EU868 Payload Size Constants (bytes)
+#define UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR0                                     \
+  51 ///< Maximum payload for DR0 (SF12, 125kHz)
+#define UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR1                                     \
+  51 ///< Maximum payload for DR1 (SF11, 125kHz)
+#define UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR2                                     \
+  51 ///< Maximum payload for DR2 (SF10, 125kHz)
+#define UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR3                                     \
+  115 ///< Maximum payload for DR3 (SF9, 125kHz)
+#define UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR4                                     \
+  222 ///< Maximum payload for DR4 (SF8, 125kHz)
+#define UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR5                                     \
+  222 ///< Maximum payload for DR5 (SF7, 125kHz)
+#define UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR6                                     \
+  222 ///< Maximum payload for DR6 (SF7, 250kHz)
+
+// Selected Region Constants
+#ifdef CONFIG_LORAWAN_REGION_EU868
+#define UNIT_LORAWAN_REGION_MAX_PAYLOAD                                        \
+  UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR6 ///< Largest payload of the Kconfig region
+#else
+#define UNIT_LORAWAN_REGION_MAX_PAYLOAD                                        \
+  UNIT_LORAWAN_US915_MAX_PAYLOAD_DR4 ///< Largest payload of the Kconfig region
+#endif
+
 // General LoRaWAN Constants
 #define UNIT_LORAWAN_LOG_LEVEL_MIN 0 ///< Minimum log level (no logging)
 #define UNIT_LORAWAN_LOG_LEVEL_MAX 5 ///< Maximum log level (verbose)
 #define UNIT_LORAWAN_EUI_LENGTH                                                \
   16 ///< Length of DevEUI and AppEUI in hex characters
 #define UNIT_LORAWAN_APP_KEY_LENGTH 32 ///< Length of AppKey in hex characters
+#define UNIT_LORAWAN_DEV_ADDR_LENGTH 8 ///< Length of DevAddr in hex characters
+#define UNIT_LORAWAN_SESSION_KEY_LENGTH                                        \
+  32 ///< Length of NwkSKey and AppSKey in hex characters
+
+// Uplink Option Constants
+#define UNIT_LORAWAN_FPORT_MIN 1 ///< Lowest application port (0 is MAC only)
+#define UNIT_LORAWAN_FPORT_MAX 223 ///< Highest application port
+#define UNIT_LORAWAN_TX_RETRIES_MIN 1 ///< Fewest transmissions per uplink
+#define UNIT_LORAWAN_TX_RETRIES_MAX 15 ///< Most transmissions per uplink
+#define UNIT_LORAWAN_TX_RETRIES_DEFAULT                                        \
+  2 ///< Transmissions used by unit_lorawan_send()
+
+// Uplink Aggregation Constants
+#define UNIT_LORAWAN_AGGREGATE_RECORD_MAX                                      \
+  ( UNIT_LORAWAN_REGION_MAX_PAYLOAD - 1 ) ///< Largest record, fastest DR
+#define UNIT_LORAWAN_AGGREGATE_MAX_DELAY_DEFAULT_MS                            \
+  60000 ///< Default deadline for a partially filled frame
+
+// Instrumentation Constants
+#define UNIT_LORAWAN_STATS_LATENCY_BUCKETS                                     \
+  16 ///< Log2 latency buckets, the last one holds 32.768 s and longer
+
+// Channel Survey Constants
+#define UNIT_LORAWAN_SURVEY_CHANNELS 8 ///< Uplink channels per US915 sub-band
+#define UNIT_LORAWAN_SURVEY_INTERVAL_DEFAULT_MS                                \
+  600000 ///< Suggested time between scans of one sub-band
+
+// Link Quality Constants
+#define UNIT_LORAWAN_LINK_HISTORY 16 ///< Link check answers kept per module
+#define UNIT_LORAWAN_ADR_HINT_MIN_SAMPLES                                      \
+  3 ///< Answers a window needs before unit_lorawan_get_adr_hint() decides
 
 /**
  * @brief The maximum message size for sending LoRaWAN messages safely across
@@ -113,14 +189,14 @@ extern "C"
   } unit_lorwan_uldlmode;
 
   /**
-   * @brief TTN LoRaWAN configuration structure for US915 band
+   * @brief TTN LoRaWAN configuration structure for US915 and EU868
    */
   typedef struct
   {
     const char *dev_eui;
     const char *app_eui;
     const char *app_key;
-    uint8_t sub_band;
+    uint8_t sub_band; /**< US915 sub-band (1-8), ignored in EU868 */
     uint8_t data_rate;
     bool adr_enabled;
     uint32_t rx2_frequency;
@@ -128,12 +204,429 @@ extern "C"
     uint16_t join_timeout_sec;
   } unit_lorawan_ttn_config_t;
 
+  /**
+   * @brief How a device gets its LoRaWAN session
+   */
+  typedef enum
+  {
+    UNIT_LORAWAN_ACTIVATION_OTAA = 0, /**< Join with DevEUI, AppEUI, AppKey */
+    UNIT_LORAWAN_ACTIVATION_ABP,      /**< Personalized DevAddr and session
+                                         keys, no join */
+  } unit_lorawan_activation_t;
+
+  /**
+   * @brief Per-device credentials, see unit_lorawan_provision()
+   *
+   * Values are hex strings without delimiters. Only the fields of the
+   * selected activation are used.
+   */
+  typedef struct
+  {
+    unit_lorawan_activation_t activation;
+    char dev_eui[ UNIT_LORAWAN_EUI_LENGTH + 1 ];      /**< OTAA */
+    char app_eui[ UNIT_LORAWAN_EUI_LENGTH + 1 ];      /**< OTAA */
+    char app_key[ UNIT_LORAWAN_APP_KEY_LENGTH + 1 ];  /**< OTAA */
+    char dev_addr[ UNIT_LORAWAN_DEV_ADDR_LENGTH + 1 ]; /**< ABP */
+    char nwk_skey[ UNIT_LORAWAN_SESSION_KEY_LENGTH + 1 ]; /**< ABP */
+    char app_skey[ UNIT_LORAWAN_SESSION_KEY_LENGTH + 1 ]; /**< ABP */
+  } unit_lorawan_credentials_t;
+
+  /**
+   * @brief Final state reached by an uplink queued with
+   * unit_lorawan_send_async().
+   */
+  typedef enum
+  {
+    UNIT_LORAWAN_TX_QUEUED = 0, /**< Accepted by the module (OK+SEND) but not
+                                   confirmed transmitted before the timeout */
+    UNIT_LORAWAN_TX_SENT,       /**< Transmitted over the air (OK+SENT) */
+    UNIT_LORAWAN_TX_ACKED,      /**< Acknowledged by the network (OK+RECV) */
+    UNIT_LORAWAN_TX_FAILED,     /**< Rejected or not delivered (ERR+SEND,
+                                   ERR+SENT or command failure) */
+    UNIT_LORAWAN_TX_EXPIRED,    /**< Dropped unsent after max_age_ms */
+    UNIT_LORAWAN_TX_SPOOLED,    /**< Failed and kept in the flash spool
+                                   (CONFIG_LORAWAN_SPOOL) for a later retry */
+  } unit_lorawan_tx_status_t;
+
+  /**
+   * @brief Callback function type for asynchronous uplink completion
+   * @param status Final state reached by the uplink
+   * @param user_data User data passed to unit_lorawan_send_async()
+   *
+   * @note Runs in the driver's TX task. Keep it short and do not call
+   * blocking LoRaWAN functions from it.
+   */
+  typedef void ( *unit_lorawan_tx_callback_t )(
+      unit_lorawan_tx_status_t status, void *user_data );
+
+  /**
+   * @brief Per-uplink options for unit_lorawan_send_ex().
+   */
+  typedef struct
+  {
+    bool confirmed;  /**< Ask the network to acknowledge the uplink */
+    uint8_t port;    /**< FPort (UNIT_LORAWAN_FPORT_MIN to
+                        UNIT_LORAWAN_FPORT_MAX), or 0 to keep the module's
+                        current port */
+    uint8_t retries; /**< Transmissions before giving up (confirmed) or
+                        repetitions (unconfirmed), UNIT_LORAWAN_TX_RETRIES_MIN
+                        to UNIT_LORAWAN_TX_RETRIES_MAX */
+    uint32_t max_age_ms; /**< Drop the uplink unsent once it waited this
+                            long for the radio, or 0 to wait indefinitely */
+  } unit_lorawan_tx_opts_t;
+
+  /**
+   * @brief Settings for the uplink aggregator, see
+   * unit_lorawan_aggregator_configure().
+   */
+  typedef struct
+  {
+    uint32_t max_delay_ms; /**< Longest time the first record of a frame
+                              waits before the frame is sent, or 0 to send
+                              only when full or flushed */
+    unit_lorawan_tx_opts_t opts;         /**< Options for every frame */
+    unit_lorawan_tx_callback_t callback; /**< Optional per-frame completion
+                                            callback (can be NULL). With
+                                            CONFIG_LORAWAN_SPOOL a frame
+                                            that failed off the air has its
+                                            records spooled and reports
+                                            UNIT_LORAWAN_TX_SPOOLED */
+    void *user_data; /**< User data passed to the callback */
+  } unit_lorawan_aggregator_config_t;
+
+  /**
+   * @brief How unit_lorawan_encode() sends one field of a record.
+   */
+  typedef enum
+  {
+    UNIT_LORAWAN_FIELD_ABSOLUTE = 0, /**< Value minus the field's base */
+    UNIT_LORAWAN_FIELD_DELTA, /**< Change since the previous record of the
+                                 frame; the first record is sent like
+                                 UNIT_LORAWAN_FIELD_ABSOLUTE */
+  } unit_lorawan_field_coding_t;
+
+  /**
+   * @brief One numeric field of an encoded record.
+   */
+  typedef struct
+  {
+    unit_lorawan_field_coding_t coding; /**< Absolute or delta coding */
+    int32_t base; /**< Subtracted before sending, a typical value keeps the
+                     encoding short */
+  } unit_lorawan_field_t;
+
+  /**
+   * @brief Layout of the records packed by unit_lorawan_encode(). The
+   * decoder needs the same schema, usually one per FPort.
+   */
+  typedef struct
+  {
+    const unit_lorawan_field_t *fields; /**< Fields of every record */
+    size_t field_count;                 /**< Number of fields, at least 1 */
+  } unit_lorawan_schema_t;
+
+  /**
+   * @brief Settings for the background channel survey, see
+   * unit_lorawan_survey_configure().
+   */
+  typedef struct
+  {
+    uint32_t interval_ms;  /**< Time between scans of one sub-band. A full
+                              sweep takes this times the sub-bands served */
+    uint8_t sub_band_mask; /**< Sub-bands the gateways serve, bit n-1 for
+                              sub-band n, or 0 for all eight */
+    uint8_t margin_db;     /**< How much quieter another sub-band must be
+                              before it replaces the current one */
+    bool auto_apply;       /**< Switch to the recommended sub-band while the
+                              device is not joined */
+  } unit_lorawan_survey_config_t;
+
+  /**
+   * @brief Noise floor of one channel over the survey history
+   */
+  typedef struct
+  {
+    int16_t min_dbm;  /**< Quietest reading */
+    int16_t mean_dbm; /**< Average reading */
+    int16_t p90_dbm;  /**< Level 90% of the readings stay at or below */
+  } unit_lorawan_channel_noise_t;
+
+  /**
+   * @brief Survey results for one US915 sub-band
+   */
+  typedef struct
+  {
+    uint8_t sub_band; /**< Sub-band, 1-8 */
+    uint8_t samples;  /**< Scans in the history, 0 if never scanned */
+    uint32_t age_ms;  /**< Time since the latest scan */
+    int16_t score_dbm; /**< Mean of the channels' p90_dbm, lower is quieter */
+    unit_lorawan_channel_noise_t
+        channels[ UNIT_LORAWAN_SURVEY_CHANNELS ]; /**< By channel within the
+                                                     sub-band */
+  } unit_lorawan_sub_band_survey_t;
+
+  /**
+   * @brief Fill level of the flash uplink spool, see
+   * unit_lorawan_get_spool_status()
+   */
+  typedef struct
+  {
+    uint32_t pending;        /**< Uplinks waiting to be delivered */
+    uint32_t dropped;        /**< Undelivered uplinks overwritten by newer
+                                ones since boot */
+    uint32_t capacity_bytes; /**< Size of the spool partition */
+  } unit_lorawan_spool_status_t;
+
+  /**
+   * @brief Link check answers aggregated over a time window, see
+   * unit_lorawan_get_link_quality().
+   *
+   * The RSSI, SNR and margin figures only cover answered checks and are 0
+   * when samples is 0.
+   */
+  typedef struct
+  {
+    uint8_t samples;      /**< Answered link checks in the window */
+    uint8_t missed;       /**< Link checks the network did not answer */
+    uint32_t age_ms;      /**< Time since the latest answer */
+    int16_t rssi_min;     /**< Weakest answer (dBm) */
+    int16_t rssi_mean;    /**< Average answer (dBm) */
+    int16_t rssi_max;     /**< Strongest answer (dBm) */
+    int8_t snr_min;       /**< Lowest SNR (dB) */
+    int8_t snr_mean;      /**< Average SNR (dB) */
+    int8_t snr_max;       /**< Highest SNR (dB) */
+    uint8_t margin_min;   /**< Lowest demodulation margin reported by the
+                             network (dB) */
+    uint8_t margin_mean;  /**< Average demodulation margin (dB) */
+    uint8_t gateways_max; /**< Most gateways that heard one uplink */
+  } unit_lorawan_link_quality_t;
+
+  /**
+   * @brief Data rate and TX power suggested by the link margin, see
+   * unit_lorawan_get_adr_hint().
+   */
+  typedef struct
+  {
+    uint8_t data_rate;         /**< Suggested data rate */
+    uint8_t tx_power;          /**< Suggested TX power index (0 = strongest) */
+    uint8_t current_data_rate; /**< Data rate when the hint was made */
+    uint8_t current_tx_power;  /**< TX power index when the hint was made */
+    int8_t steps; /**< 3 dB steps of spare margin, negative when the link
+                     needs more */
+  } unit_lorawan_adr_hint_t;
+
+  /**
+   * @brief Downlink payload delivered by the network (OK+RECV with data).
+   */
+  typedef struct
+  {
+    uint8_t port;        /**< FPort the downlink was sent on */
+    bool confirmed;      /**< Network asked for the downlink to be ACKed */
+    const uint8_t *data; /**< Decoded payload, valid only during the
+                            callback */
+    size_t length;       /**< Payload length in bytes */
+    bool link_quality_valid; /**< rssi and snr are set. The module only
+                                reports them in link check answers, so this is
+                                true when the downlink carried one */
+    int16_t rssi;            /**< Downlink RSSI (dBm) */
+    int8_t snr;              /**< Downlink SNR (dB) */
+  } unit_lorawan_downlink_t;
+
+  /**
+   * @brief Callback function type for received downlinks
+   * @param downlink Decoded downlink
+   * @param user_data User data passed to unit_lorawan_set_downlink_callback()
+   *
+   * @note Runs in the driver's RX task. Keep it short. Blocking LoRaWAN
+   * functions fail with ESP_ERR_INVALID_STATE when called from it, but
+   * unit_lorawan_send_async() may be used.
+   */
+  typedef void ( *unit_lorawan_downlink_callback_t )(
+      const unit_lorawan_downlink_t *downlink, void *user_data );
+
+  /**
+   * @brief Unsolicited module events reported through
+   * unit_lorawan_set_event_callback().
+   */
+  typedef enum
+  {
+    UNIT_LORAWAN_EVENT_JOINED = 0,  /**< Join accepted (+CJOIN:OK) */
+    UNIT_LORAWAN_EVENT_JOIN_FAILED, /**< Join attempts exhausted
+                                       (+CJOIN:FAIL) */
+    UNIT_LORAWAN_EVENT_TX_DONE,     /**< Uplink transmitted (OK+SENT) */
+    UNIT_LORAWAN_EVENT_TX_FAILED,   /**< Uplink gave up (ERR+SENT) */
+    UNIT_LORAWAN_EVENT_LINK_CHECK,  /**< Link check answer (+CLINKCHECK) */
+  } unit_lorawan_event_id_t;
+
+  /**
+   * @brief Unsolicited module event
+   */
+  typedef struct
+  {
+    unit_lorawan_event_id_t id;
+    uint8_t tx_count; /**< TX_DONE/TX_FAILED: transmissions used */
+    struct
+    {
+      uint8_t result;   /**< 0 when the network answered */
+      uint8_t margin;   /**< Demodulation margin (dB) */
+      uint8_t gateways; /**< Gateways that received the request */
+      int16_t rssi;     /**< RSSI of the answer (dBm) */
+      int8_t snr;       /**< SNR of the answer (dB) */
+    } link_check;       /**< LINK_CHECK only */
+  } unit_lorawan_event_t;
+
+  /**
+   * @brief Callback function type for unsolicited module events
+   * @param event Event that occurred
+   * @param user_data User data passed to unit_lorawan_set_event_callback()
+   *
+   * @note Runs in the driver's RX task, with the same restrictions as
+   * unit_lorawan_downlink_callback_t.
+   */
+  typedef void ( *unit_lorawan_event_callback_t )(
+      const unit_lorawan_event_t *event, void *user_data );
+
+  /**
+   * @brief Byte transport between the driver and the module
+   *
+   * The driver uses the Core2 for AWS expansion port C UART by default. Any
+   * other byte stream that behaves like the module, such as a host-side
+   * emulator replaying recorded AT transcripts, can be installed with
+   * unit_lorawan_set_transport() before unit_lorawan_init().
+   *
+   * wait and set_baud are optional. Without wait the receive task polls
+   * read; without set_baud the module stays at 115200 baud.
+   */
+  typedef struct
+  {
+    esp_err_t ( *begin )( uint32_t baud, void *ctx ); /**< Open the link */
+    esp_err_t ( *write )( const char *data, size_t length, size_t *written,
+                          void *ctx ); /**< Write all of data */
+    esp_err_t ( *read )( uint8_t *buffer, size_t size, size_t *read,
+                         void *ctx ); /**< Copy up to size waiting bytes
+                                         without blocking, 0 when idle */
+    esp_err_t ( *flush )( bool *flushed,
+                          void *ctx ); /**< Drop pending input */
+    esp_err_t ( *wait )( uint32_t timeout_ms,
+                         void *ctx ); /**< Block until a full line may be
+                                         waiting, ESP_ERR_TIMEOUT if none
+                                         came within timeout_ms */
+    esp_err_t ( *set_baud )( uint32_t baud,
+                             void *ctx ); /**< Change the rate of the open
+                                             link */
+    void *ctx; /**< Passed to every operation */
+  } unit_lorawan_transport_t;
+
+  /**
+   * @brief ESP-IDF UART wiring for unit_lorawan_uart_transport()
+   */
+  typedef struct
+  {
+    int uart_num;          /**< UART controller, such as UART_NUM_2 */
+    int tx_pin;            /**< GPIO driving the module's RX line */
+    int rx_pin;            /**< GPIO reading the module's TX line */
+    size_t rx_buffer_size; /**< Driver RX ring buffer, more than the
+                              128 byte hardware FIFO */
+  } unit_lorawan_uart_config_t;
+
+  /**
+   * @brief One LoRaWAN unit and the driver state that serves it
+   *
+   * Every public function has a `_h` variant that takes a handle as its
+   * first argument. The functions without a handle act on the default
+   * instance, the unit on expansion port C. Further units are opened with
+   * unit_lorawan_create().
+   */
+  typedef struct unit_lorawan_s *unit_lorawan_handle_t;
+
+  /**
+   * @brief AT command classes counted separately by unit_lorawan_get_stats()
+   */
+  typedef enum
+  {
+    UNIT_LORAWAN_STATS_COMMAND_PROBE = 0, /**< Bare AT presence probes */
+    UNIT_LORAWAN_STATS_COMMAND_UPLINK,    /**< AT+DTRX uplinks */
+    UNIT_LORAWAN_STATS_COMMAND_JOIN,      /**< AT+CJOIN */
+    UNIT_LORAWAN_STATS_COMMAND_QUERY,     /**< Read commands (AT+<cmd>?) */
+    UNIT_LORAWAN_STATS_COMMAND_SET,       /**< Every other command */
+    UNIT_LORAWAN_STATS_COMMAND_COUNT
+  } unit_lorawan_stats_command_t;
+
+  /**
+   * @brief Counters for one AT command class
+   *
+   * Every attempt written to the UART counts as sent and ends as exactly one
+   * of ok, error or timeout. Latency runs from the UART write to the final
+   * response line and is recorded for answered attempts only.
+   */
+  typedef struct
+  {
+    uint32_t sent;    /**< Attempts written to the UART */
+    uint32_t ok;      /**< Attempts the module accepted */
+    uint32_t error;   /**< Attempts answered with an error, or that could
+                         not be written or parsed */
+    uint32_t timeout; /**< Attempts without a final response in time */
+    uint32_t retries; /**< Attempts after the first for the same command */
+    uint64_t latency_total_us; /**< Sum of answered attempt latencies */
+    uint32_t latency_max_us;   /**< Slowest answered attempt */
+    uint32_t latency_histogram
+        [ UNIT_LORAWAN_STATS_LATENCY_BUCKETS ]; /**< Answered attempts by
+                                                   latency: bucket 0 is under
+                                                   2 ms, bucket n holds 2^n
+                                                   to 2^(n+1) ms */
+  } unit_lorawan_command_stats_t;
+
+  /**
+   * @brief Driver instrumentation snapshot, see unit_lorawan_get_stats()
+   */
+  typedef struct
+  {
+    /** Per command class, indexed by unit_lorawan_stats_command_t */
+    unit_lorawan_command_stats_t commands[ UNIT_LORAWAN_STATS_COMMAND_COUNT ];
+    uint64_t uart_tx_bytes; /**< Bytes written to the module */
+    uint64_t uart_rx_bytes; /**< Bytes read from the module */
+    uint32_t urcs;          /**< Unsolicited lines dispatched to handlers */
+    uint32_t allocations;   /**< Heap allocations on the command path */
+    uint32_t elapsed_ms;    /**< Time since init or the last reset */
+  } unit_lorawan_stats_t;
+
+  /**
+   * @brief Kinds of record kept by the event log, see
+   * unit_lorawan_read_events()
+   */
+  typedef enum
+  {
+    UNIT_LORAWAN_LOG_EVENT_COMMAND = 0, /**< One AT command attempt */
+    UNIT_LORAWAN_LOG_EVENT_UPLINK,      /**< Uplink finished */
+    UNIT_LORAWAN_LOG_EVENT_JOIN,        /**< Join finished */
+  } unit_lorawan_log_event_t;
+
+  /**
+   * @brief Fixed-size binary event record
+   */
+  typedef struct
+  {
+    uint32_t timestamp_ms; /**< Time since boot when the event ended */
+    uint16_t duration_ms;  /**< COMMAND: UART write to answer, UPLINK: call
+                              or queueing to outcome, JOIN: join start to
+                              result; saturates at 65535 */
+    int16_t error;         /**< esp_err_t outcome, ESP_OK on success */
+    uint8_t event;         /**< unit_lorawan_log_event_t */
+    uint8_t command;       /**< unit_lorawan_stats_command_t class */
+    uint8_t detail; /**< COMMAND: retry number, UPLINK:
+                       unit_lorawan_tx_status_t, JOIN: join callback
+                       error_code */
+  } unit_lorawan_log_record_t;
+
   /**
    * @brief Callback function type for TTN join status
    * @param joined True if join was successful, false if failed
    * @param error_code Error code if join failed (0 if successful, 1 for
-   * timeout)
+   * timeout, 2 if the module reported the join failed and no retry fit in
+   * the timeout)
    * @param user_data User data passed to the callback
+   *
+   * @note Runs in the driver task as soon as the module reports the result.
    */
   typedef void ( *unit_lorawan_ttn_join_callback_t )( bool joined,
                                                       uint8_t error_code,
@@ -153,6 +646,11 @@ extern "C"
    *              - 4: Error + info + debug + verbose messages
    *              - 5: All messages
    *
+   * @note The level also gates the driver's own text on the command and
+   * uplink path, when compiled in with CONFIG_LORAWAN_VERBOSE_LOG: level 0
+   * silences it, info lines need level 1 and debug lines level 3. Errors
+   * and warnings are always logged. Until the first call, all of it is on.
+   *
    * @return
    * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
    *  - ESP_OK                : Log level set successfully
@@ -228,6 +726,31 @@ extern "C"
   esp_err_t unit_lorawan_configOTTA( char *devEUI, char *appEUI, char *appKey,
                                      unit_lorwan_uldlmode mode );
 
+  /**
+   * @brief Configures the LoRaWAN device for ABP (Activation By
+   * Personalization).
+   *
+   * Writes the device address and session keys, Class A and the work mode.
+   * An ABP device needs no join, the session is usable once the
+   * configuration is saved. Frequency plan and network parameters are
+   * configured separately, as with unit_lorawan_configOTTA().
+   *
+   * @param dev_addr Device address (8 hex characters, e.g., "260B1234")
+   * @param nwk_skey Network Session Key (32 hex characters)
+   * @param app_skey Application Session Key (32 hex characters)
+   * @param mode Upload/download frequency mode (DIFFERENT_FREQ_MODE
+   * recommended for TTN)
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   *  - ESP_OK                : ABP configuration completed successfully
+   *  - ESP_FAIL              : Failed to configure one or more parameters
+   *  - ESP_ERR_INVALID_ARG   : NULL address or key parameters
+   */
+  esp_err_t unit_lorawan_config_abp( const char *dev_addr, const char *nwk_skey,
+                                     const char *app_skey,
+                                     unit_lorwan_uldlmode mode );
+
   /**
    * @brief Reboots the LoRaWAN module.
    *
@@ -236,15 +759,16 @@ extern "C"
    * - Recovering from error states
    * - Clearing internal buffers
    *
-   * @note The function waits 2 seconds after sending the reboot command to
-   * allow module restart.
+   * @note The function returns as soon as the restarted module answers an
+   * "AT" probe, waiting at most 3 seconds.
    * @note All network connections will be lost and must be re-established after
    * reboot.
    *
    * @return
    * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
-   *  - ESP_OK                : Reboot command sent successfully
+   *  - ESP_OK                : Module rebooted and is responding
    *  - ESP_FAIL              : Failed to send reboot command
+   *  - ESP_ERR_TIMEOUT       : Module did not respond after the reboot
    */
   esp_err_t unit_lorawan_reboot( void );
 
@@ -291,9 +815,325 @@ extern "C"
    * - ESP_ERR_INVALID_SIZE  : Message length exceeds TTN payload limits
    * - ESP_ERR_INVALID_ARG   : message parameter is NULL or length is 0
    * - ESP_ERR_NO_MEM        : Failed to allocate memory for message processing
+   * - ESP_ERR_INVALID_STATE : Airtime budget spent, see
+   *                           unit_lorawan_get_next_tx_delay()
    */
   esp_err_t unit_lorawan_send( char *message, size_t length );
 
+  /**
+   * @brief Sends a binary uplink with explicit message options.
+   *
+   * Like unit_lorawan_send(), but takes raw bytes and lets the caller choose
+   * confirmed or unconfirmed delivery, the FPort and the transmission count.
+   * The port is written to the module only when it differs from the one last
+   * used, and it stays in effect for later uplinks.
+   *
+   * @note Returns once the module accepts the uplink. The outcome over the
+   * air is reported later through the event callback as
+   * UNIT_LORAWAN_EVENT_TX_DONE or UNIT_LORAWAN_EVENT_TX_FAILED.
+   *
+   * @param buf Pointer to the payload bytes
+   * @param len Length of the payload in bytes (max depends on data rate)
+   * @param opts Message options, or NULL for the unit_lorawan_send() defaults
+   * (confirmed, current port, UNIT_LORAWAN_TX_RETRIES_DEFAULT)
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   * - ESP_OK                : Uplink accepted by the module
+   * - ESP_FAIL              : Module rejected the uplink or the port
+   * - ESP_ERR_INVALID_ARG   : buf is NULL, len is 0, or an option is out of
+   *                           range
+   * - ESP_ERR_INVALID_SIZE  : Payload exceeds the current data rate limit
+   * - ESP_ERR_NO_MEM        : Failed to allocate the command buffer
+   * - ESP_ERR_INVALID_STATE : Airtime budget spent, see
+   *                           unit_lorawan_get_next_tx_delay()
+   * - ESP_ERR_TIMEOUT       : opts->max_age_ms passed while other uplinks
+   *                           held the radio, or the module did not answer
+   * - UNIT_LORAWAN_ERR_SPOOLED : Uplink failed and was written to the flash
+   *                           spool (CONFIG_LORAWAN_SPOOL)
+   *
+   * @note With CONFIG_LORAWAN_SPOOL an uplink that would return ESP_FAIL is
+   * written to the flash spool and resent once joined. An uplink the module
+   * accepted (OK+SEND or OK+SENT) or left unanswered may already be on the
+   * air, so it is never spooled and its error is returned as is.
+   */
+  esp_err_t unit_lorawan_send_ex( const uint8_t *buf, size_t len,
+                                  const unit_lorawan_tx_opts_t *opts );
+
+  /**
+   * @brief Queues an uplink message without blocking the caller.
+   *
+   * Copies the message into the driver's bounded TX queue and returns
+   * immediately. A driver-owned task transmits queued messages in order as a
+   * confirmed uplink on port 1, using the same validation and DTRX format as
+   * unit_lorawan_send(), and waits for the network acknowledgement before
+   * reporting the outcome through the callback.
+   *
+   * @param message Pointer to the message data (copied before returning)
+   * @param length Length of the message in bytes (max
+   * UNIT_LORAWAN_REGION_MAX_PAYLOAD, further limited by the data rate at
+   * transmission time)
+   * @param callback Optional completion callback (can be NULL)
+   * @param user_data Optional user data pointer passed to the callback (can be
+   * NULL)
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   * - ESP_OK                : Message added to the TX queue
+   * - ESP_ERR_INVALID_ARG   : message parameter is NULL or length is 0
+   * - ESP_ERR_INVALID_SIZE  : Message length exceeds the largest payload
+   * - ESP_ERR_INVALID_STATE : Driver not initialized with unit_lorawan_init()
+   * - ESP_ERR_NO_MEM        : TX queue is full
+   */
+  esp_err_t unit_lorawan_send_async( const char *message, size_t length,
+                                     unit_lorawan_tx_callback_t callback,
+                                     void *user_data );
+
+  /**
+   * @brief Queues a binary uplink with explicit message options.
+   *
+   * Like unit_lorawan_send_async(), with the options of unit_lorawan_send_ex().
+   * An uplink still waiting for the radio opts->max_age_ms after it was
+   * queued, behind other uplinks or the airtime budget, is dropped unsent and
+   * reported as UNIT_LORAWAN_TX_EXPIRED. With CONFIG_LORAWAN_SPOOL a failed
+   * uplink that cannot have reached the air is written to the flash spool and
+   * reported as UNIT_LORAWAN_TX_SPOOLED.
+   *
+   * @param buf Pointer to the payload bytes (copied before returning)
+   * @param len Length of the payload in bytes
+   * @param opts Message options, or NULL for the unit_lorawan_send_async()
+   * defaults
+   * @param callback Optional completion callback (can be NULL)
+   * @param user_data Optional user data pointer passed to the callback (can be
+   * NULL)
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   * - ESP_OK                : Uplink added to the TX queue
+   * - ESP_ERR_INVALID_ARG   : buf is NULL, len is 0, or an option is out of
+   *                           range
+   * - ESP_ERR_INVALID_SIZE  : Payload exceeds the largest payload
+   * - ESP_ERR_INVALID_STATE : Driver not initialized with unit_lorawan_init()
+   * - ESP_ERR_NO_MEM        : TX queue is full
+   */
+  esp_err_t unit_lorawan_send_async_ex( const uint8_t *buf, size_t len,
+                                        const unit_lorawan_tx_opts_t *opts,
+                                        unit_lorawan_tx_callback_t callback,
+                                        void *user_data );
+
+  /**
+   * @brief Configures the uplink aggregator.
+   *
+   * Records passed to unit_lorawan_aggregate() are packed into one frame,
+   * each as a length byte followed by the record bytes. A frame is queued for
+   * transmission when the next record would not fit the current data rate's
+   * payload limit, when max_delay_ms has passed since its first record, or on
+   * unit_lorawan_aggregate_flush(). Frames travel through the same TX queue as
+   * unit_lorawan_send_async(). If ADR lowers the data rate before a frame is
+   * sent, it is split at record boundaries instead of being rejected.
+   *
+   * @note New settings apply to the frame being collected.
+   *
+   * @param config Aggregator settings, or NULL to restore the defaults
+   * (UNIT_LORAWAN_AGGREGATE_MAX_DELAY_DEFAULT_MS, unit_lorawan_send() options,
+   * no callback)
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   * - ESP_OK                : Settings applied
+   * - ESP_ERR_INVALID_ARG   : An uplink option is out of range
+   * - ESP_ERR_INVALID_STATE : Driver not initialized with unit_lorawan_init()
+   */
+  esp_err_t unit_lorawan_aggregator_configure(
+      const unit_lorawan_aggregator_config_t *config );
+
+  /**
+   * @brief Adds one record to the frame being aggregated.
+   *
+   * The record is copied before returning. If it would overflow the frame,
+   * the frame collected so far is queued first.
+   *
+   * @param record Pointer to the record bytes
+   * @param length Length of the record (at most one byte less than the
+   * current data rate's payload limit, UNIT_LORAWAN_AGGREGATE_RECORD_MAX at
+   * most)
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   * - ESP_OK                : Record buffered
+   * - ESP_ERR_INVALID_ARG   : record parameter is NULL or length is 0
+   * - ESP_ERR_INVALID_SIZE  : Record cannot fit a frame at the current data
+   *                           rate
+   * - ESP_ERR_INVALID_STATE : Driver not initialized with unit_lorawan_init()
+   * - ESP_ERR_NO_MEM        : Frame is full and the TX queue is full
+   */
+  esp_err_t unit_lorawan_aggregate( const uint8_t *record, size_t length );
+
+  /**
+   * @brief Queues the records aggregated so far without waiting for the
+   * frame to fill or its deadline to pass.
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   * - ESP_OK                : Frame queued, or nothing was pending
+   * - ESP_ERR_INVALID_STATE : Driver not initialized with unit_lorawan_init()
+   * - ESP_ERR_NO_MEM        : TX queue is full, records kept
+   */
+  esp_err_t unit_lorawan_aggregate_flush( void );
+
+  /**
+   * @brief Packs numeric records into a compact binary payload.
+   *
+   * Each field is sent as a zigzag varint: its value, less the field's base
+   * or, for UNIT_LORAWAN_FIELD_DELTA, less the same field of the previous
+   * record, mapped so small numbers of either sign take few bytes and
+   * stored seven bits per byte, least significant group first, with the top
+   * bit set on all but the last byte. Differences wrap modulo 2^32. A field
+   * takes 1 to 5 bytes and records follow each other without separators, so
+   * slowly changing readings often fit several per DR0 frame.
+   *
+   * As many whole records are packed as fit size. The README holds a
+   * matching TTN payload formatter.
+   *
+   * @param schema Fields of every record
+   * @param values Field values, records * schema->field_count of them, one
+   * record after another
+   * @param records Number of records in values
+   * @param buf Output buffer
+   * @param size Size of the output buffer
+   * @param length Pointer to store the encoded length in bytes
+   * @param encoded Pointer to store the number of records packed
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   * - ESP_OK               : At least one record packed
+   * - ESP_ERR_INVALID_ARG  : A pointer is NULL, the schema has no fields or a
+   *                          field has an unknown coding, or records is 0
+   * - ESP_ERR_INVALID_SIZE : The first record does not fit size
+   */
+  esp_err_t unit_lorawan_encode( const unit_lorawan_schema_t *schema,
+                                 const int32_t *values, size_t records,
+                                 uint8_t *buf, size_t size, size_t *length,
+                                 size_t *encoded );
+
+  /**
+   * @brief Encodes records and sends them as one uplink.
+   *
+   * Packs as many records as fit the current data rate's payload limit with
+   * unit_lorawan_encode() and sends them with unit_lorawan_send_ex(). Call
+   * again with the records that were left over.
+   *
+   * @param schema Fields of every record
+   * @param values Field values, records * schema->field_count of them
+   * @param records Number of records in values
+   * @param opts Message options, or NULL for the unit_lorawan_send() defaults
+   * @param sent Pointer to store the number of records sent
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   * - ESP_OK               : Uplink with *sent records accepted by the module
+   * - ESP_ERR_INVALID_ARG  : Invalid schema, values or option
+   * - ESP_ERR_INVALID_SIZE : The first record does not fit the current data
+   *                          rate
+   * - UNIT_LORAWAN_ERR_SPOOLED : The *sent records were kept in the spool
+   * - Any other error returned by unit_lorawan_send_ex()
+   */
+  esp_err_t unit_lorawan_send_encoded( const unit_lorawan_schema_t *schema,
+                                       const int32_t *values, size_t records,
+                                       const unit_lorawan_tx_opts_t *opts,
+                                       size_t *sent );
+
+  /**
+   * @brief Computes the time-on-air of one uplink.
+   *
+   * Uses the LoRa modulation of the data rate (SF and bandwidth) in the
+   * region selected in Kconfig and adds the 13 bytes of LoRaWAN framing to
+   * the application payload.
+   *
+   * @param data_rate Data rate (0 to UNIT_LORAWAN_US915_DATA_RATE_MAX or
+   * UNIT_LORAWAN_EU868_DATA_RATE_MAX)
+   * @param length Application payload length in bytes
+   * @param airtime_ms Pointer to store the time-on-air, rounded up
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   * - ESP_OK                : Time-on-air computed
+   * - ESP_ERR_INVALID_ARG   : airtime_ms is NULL, or the data rate or length
+   *                           is out of range
+   */
+  esp_err_t unit_lorawan_get_time_on_air( uint8_t data_rate, size_t length,
+                                          uint32_t *airtime_ms );
+
+  /**
+   * @brief Reports how long until an uplink may go out within the airtime
+   * budget.
+   *
+   * Uplink airtime is charged against a per sub-band budget
+   * (CONFIG_LORAWAN_AIRTIME_BUDGET_MS over a rolling 24 hours, 30 s by default
+   * for the TTN fair use policy) that refills continuously. Queued uplinks are
+   * held until they fit, while unit_lorawan_send() and unit_lorawan_send_ex()
+   * return ESP_ERR_INVALID_STATE instead of blocking. Tasks can sleep for the
+   * returned delay before sending.
+   *
+   * @param length Application payload length in bytes, sent at the current
+   * data rate
+   * @param delay_ms Pointer to store the delay, 0 when the uplink may go now
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   * - ESP_OK                : Delay reported
+   * - ESP_ERR_INVALID_ARG   : delay_ms is NULL or length exceeds
+   *                           UNIT_LORAWAN_REGION_MAX_PAYLOAD
+   */
+  esp_err_t unit_lorawan_get_next_tx_delay( size_t length,
+                                            uint32_t *delay_ms );
+
+  /**
+   * @brief Reports the uplink airtime left on the active sub-band.
+   *
+   * @param remaining_ms Pointer to store the remaining airtime budget
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   * - ESP_OK                : Remaining airtime reported
+   * - ESP_ERR_INVALID_ARG   : remaining_ms is NULL
+   */
+  esp_err_t unit_lorawan_get_airtime_budget( uint32_t *remaining_ms );
+
+  /**
+   * @brief Registers the handler for downlinks received from the network.
+   *
+   * Downlinks are routed to the handler the moment the module reports them,
+   * whether or not a command is in flight. Payloads arrive hex-decoded.
+   *
+   * @param callback Handler to call, or NULL to stop delivering downlinks
+   * @param user_data User data passed to the handler
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   *  - ESP_OK                : Handler registered
+   */
+  esp_err_t
+  unit_lorawan_set_downlink_callback( unit_lorawan_downlink_callback_t callback,
+                                      void *user_data );
+
+  /**
+   * @brief Registers the handler for unsolicited module events.
+   *
+   * Join results, uplink completion and link check answers printed by the
+   * module are routed to the handler as they arrive.
+   *
+   * @param callback Handler to call, or NULL to stop delivering events
+   * @param user_data User data passed to the handler
+   *
+   * @return
+   * [esp_err_t](https://docs.espressif.com/projects/esp-idf/en/release-v4.3/esp32/api-reference/system/esp_err.html#macros).
+   *  - ESP_OK                : Handler registered
+   */
+  esp_err_t
+  unit_lorawan_set_event_callback( unit_lorawan_event_callback_t callback,
+                                   void *user_data );
+
   /**
    * @brief Initializes the LoRaWAN module driver.
    *
@@ -302,11 +1142,15 @@ extern "C"
    * - Module presence detection and verification
    * - Initial configuration and module restart
    * - Buffer clearing and setup
+   * - Background receive task that frames module output into lines
+   * - Driver task that runs AT commands one at a time on the UART
    *
-   * This function must be called before any other LoRaWAN operations.
+   * This function must be called before any other LoRaWAN operations. Once it
+   * returns, the driver API may be called from any task.
    *
    * @note Requires the Core2 for AWS expansion port C to be available.
-   * @note The function will wait up to 2 seconds for module initialization.
+   * @note The function waits for the module to answer after its restart,
+   * for at most 3 seconds.
    * @note Detailed error messages will guide troubleshooting if initialization
    * fails.
    *
@@ -355,6 +1199,7 @@ extern "C"
    *     - ESP_ERR_INVALID_ARG: Invalid configuration parameters
    *     - ESP_ERR_INVALID_STATE: LoRaWAN module not initialized or not
    * responding
+   *     - ESP_ERR_NOT_SUPPORTED: CONFIG_LORAWAN_REGION_EU868 is selected
    *     - ESP_FAIL: TTN configuration failed
    *
    * @note Device credentials (DevEUI, AppEUI, AppKey) must be obtained from TTN
@@ -371,6 +1216,39 @@ extern "C"
       const unit_lorawan_ttn_config_t *config,
       unit_lorawan_ttn_join_callback_t join_callback, void *user_data );
 
+  /**
+   * @brief Initialize and configure LoRaWAN module for The Things Network (TTN)
+   * EU868
+   *
+   * Same as unit_lorawan_configure_ttn_us915() for the EU868 firmware of the
+   * unit. config->sub_band is ignored; the module starts on the three EU868
+   * default channels and the network adds the rest after the join.
+   *
+   * TTN EU868 Configuration Details:
+   * - Frequency Band: 863-870 MHz (EU868)
+   * - RX2: 869.525 MHz, DR3 (SF9, 125kHz)
+   * - Default Data Rate: DR3 (SF9, 125kHz, 115 bytes payload)
+   *
+   * @param[in] config TTN configuration structure with device credentials and
+   * settings
+   * @param[in] join_callback Optional callback function for asynchronous join
+   * status (can be NULL)
+   * @param[in] user_data Optional user data pointer passed to join callback
+   * (can be NULL)
+   *
+   * @return
+   *     - ESP_OK: TTN configuration completed successfully, join process
+   * initiated
+   *     - ESP_ERR_INVALID_ARG: Invalid configuration parameters
+   *     - ESP_ERR_INVALID_STATE: LoRaWAN module not initialized or not
+   * responding
+   *     - ESP_ERR_NOT_SUPPORTED: CONFIG_LORAWAN_REGION_EU868 is not selected
+   *     - ESP_FAIL: TTN configuration failed
+   */
+  esp_err_t unit_lorawan_configure_ttn_eu868(
+      const unit_lorawan_ttn_config_t *config,
+      unit_lorawan_ttn_join_callback_t join_callback, void *user_data );
+
   /**
    * @brief Get current LoRaWAN data rate and maximum payload size
    *
@@ -386,6 +1264,11 @@ extern "C"
    *     - ESP_ERR_INVALID_ARG: NULL pointer parameters
    *     - ESP_ERR_INVALID_STATE: Module not responding or not configured
    *     - ESP_FAIL: Failed to query data rate
+   *
+   * @note The result is cached by the driver together with the values applied
+   * through unit_lorawan_set_data_rate(), so unit_lorawan_send() validates
+   * payloads without querying the module. The cache is dropped on reboot or
+   * restore and refreshed when ADR may have changed the data rate.
    */
   esp_err_t unit_lorawan_get_data_rate_info( uint8_t *current_data_rate,
                                              size_t *max_payload_size );
@@ -403,7 +1286,7 @@ extern "C"
    * - DR3: SF7, 125kHz, ~242 bytes max payload
    * - DR4: SF8, 500kHz, ~242 bytes max payload, shortest range
    *
-   * @param[in] data_rate Data rate to set (0-4 for US915)
+   * @param[in] data_rate Data rate to set (0-4 for US915, 0-6 for EU868)
    *
    * @return
    *     - ESP_OK: Data rate set successfully
@@ -448,14 +1331,16 @@ extern "C"
   /**
    * @brief Get current RSSI (Received Signal Strength Indicator)
    *
-   * Retrieves the RSSI value of the last received packet.
+   * Retrieves the RSSI of the last link check answer. The module reports no
+   * RSSI for other downlinks, so enable link checks with
+   * unit_lorawan_link_check() to keep this current.
    *
    * @param[out] rssi Pointer to store RSSI value in dBm
    *
    * @return
    *     - ESP_OK: RSSI retrieved successfully
    *     - ESP_ERR_INVALID_ARG: NULL pointer parameter
-   *     - ESP_FAIL: Failed to get RSSI
+   *     - ESP_ERR_NOT_FOUND: No link check has been answered yet
    */
   esp_err_t unit_lorawan_get_rssi( int16_t *rssi );
 
@@ -488,6 +1373,78 @@ extern "C"
                                            int16_t *rssi_values,
                                            size_t *channel_count );
 
+  /**
+   * @brief Start, change or stop the background channel survey
+   *
+   * The driver task scans one served US915 sub-band with AT+CRSSI every
+   * interval_ms, only while no command, uplink or join is pending, and keeps
+   * the last CONFIG_LORAWAN_SURVEY_HISTORY readings of every channel. The
+   * sub-band whose channels have the lowest 90th percentile noise is
+   * recommended. With auto_apply the recommendation is written to the
+   * module's channel mask while the device is not joined, so the next join
+   * uses it; a joined session's channels belong to the network.
+   *
+   * @note The new channel mask is not saved in the module. With
+   * CONFIG_LORAWAN_FAST_BOOT the configured sub-band is restored on the next
+   * unit_lorawan_configure_ttn_us915().
+   *
+   * @param[in] config Survey settings, or NULL to stop the survey. The
+   * history is kept.
+   * @return
+   *     - ESP_OK: Survey settings applied
+   *     - ESP_ERR_INVALID_ARG: interval_ms is 0
+   *     - ESP_ERR_NOT_SUPPORTED: CONFIG_LORAWAN_SURVEY is disabled
+   */
+  esp_err_t
+  unit_lorawan_survey_configure( const unit_lorawan_survey_config_t *config );
+
+  /**
+   * @brief Read the survey statistics of one sub-band
+   *
+   * @param[in] sub_band US915 sub-band, 1-8
+   * @param[out] survey Noise floor per channel and the sub-band's score
+   * @return
+   *     - ESP_OK: Statistics copied, samples is 0 if never scanned
+   *     - ESP_ERR_INVALID_ARG: NULL pointer or sub-band out of range
+   *     - ESP_ERR_NOT_SUPPORTED: CONFIG_LORAWAN_SURVEY is disabled
+   */
+  esp_err_t unit_lorawan_get_survey( uint8_t sub_band,
+                                     unit_lorawan_sub_band_survey_t *survey );
+
+  /**
+   * @brief Quietest served sub-band according to the survey
+   *
+   * Keeps the current sub-band unless a surveyed one beats it by margin_db.
+   *
+   * @param[out] sub_band Recommended US915 sub-band, 1-8
+   * @return
+   *     - ESP_OK: Recommendation available
+   *     - ESP_ERR_INVALID_ARG: NULL pointer
+   *     - ESP_ERR_NOT_FOUND: No served sub-band has been scanned yet
+   *     - ESP_ERR_NOT_SUPPORTED: CONFIG_LORAWAN_SURVEY is disabled
+   */
+  esp_err_t unit_lorawan_survey_recommend( uint8_t *sub_band );
+
+  /**
+   * @brief Read the fill level of the flash uplink spool
+   *
+   * Uplinks that failed are kept in the CONFIG_LORAWAN_SPOOL_PARTITION data
+   * partition across resets and resent, oldest first and packed like
+   * unit_lorawan_aggregate() records, whenever the device is joined and the
+   * TX queue is idle. When the partition is full the oldest flash sector is
+   * erased and its undelivered uplinks are counted as dropped.
+   *
+   * @param[out] status Pending and dropped uplink counts
+   * @return
+   *     - ESP_OK: Status copied
+   *     - ESP_ERR_INVALID_ARG: NULL pointer
+   *     - ESP_ERR_INVALID_STATE: Spool not mounted, the partition is missing
+   *       or the handle is not the default unit
+   *     - ESP_ERR_NOT_SUPPORTED: CONFIG_LORAWAN_SPOOL is disabled
+   */
+  esp_err_t
+  unit_lorawan_get_spool_status( unit_lorawan_spool_status_t *status );
+
   /**
    * @brief Set number of transmission retries
    *
@@ -547,6 +1504,65 @@ extern "C"
    */
   esp_err_t unit_lorawan_link_check( uint8_t mode );
 
+  /**
+   * @brief Aggregate the link check answers of a recent window
+   *
+   * Every +CLINKCHECK the module reports is kept, up to
+   * UNIT_LORAWAN_LINK_HISTORY of them. Link check mode 2 samples the link
+   * after every uplink, which also makes the answers visible to
+   * unit_lorawan_downlink_t.
+   *
+   * @param window_ms Only use answers this recent, 0 for all of them
+   * @param[out] quality Aggregates over the window
+   *
+   * @return
+   *     - ESP_OK: quality filled, samples may still be 0
+   *     - ESP_ERR_INVALID_ARG: NULL handle or quality
+   */
+  esp_err_t
+  unit_lorawan_get_link_quality( uint32_t window_ms,
+                                 unit_lorawan_link_quality_t *quality );
+
+  /**
+   * @brief Suggest a data rate and TX power from the link margin
+   *
+   * Follows the network-side ADR rule on the host: every 3 dB the lowest
+   * margin of the window has above a 10 dB installation margin raises the
+   * data rate, up to the fastest 125 kHz one (DR3 in US915, DR5 in EU868),
+   * and then lowers the TX power. A shortfall raises the TX power first,
+   * then lowers the data rate. Missed link checks keep the hint from
+   * stepping up.
+   *
+   * @param window_ms Only use answers this recent, 0 for all of them
+   * @param[out] hint Suggested settings, steps is 0 when they match the
+   *                  current ones
+   *
+   * @return
+   *     - ESP_OK: hint filled
+   *     - ESP_ERR_INVALID_ARG: NULL handle or hint
+   *     - ESP_ERR_NOT_FOUND: Fewer than UNIT_LORAWAN_ADR_HINT_MIN_SAMPLES
+   *       answers in the window
+   *     - ESP_FAIL: Could not read the current data rate or TX power
+   */
+  esp_err_t unit_lorawan_get_adr_hint( uint32_t window_ms,
+                                       unit_lorawan_adr_hint_t *hint );
+
+  /**
+   * @brief Apply a hint from unit_lorawan_get_adr_hint()
+   *
+   * Only sends the settings that differ from the current ones.
+   *
+   * @param[in] hint Hint to apply
+   *
+   * @return
+   *     - ESP_OK: Settings applied
+   *     - ESP_ERR_INVALID_ARG: NULL handle or hint, or values out of range
+   *     - ESP_ERR_INVALID_STATE: ADR is enabled, the network owns both
+   *       settings
+   *     - ESP_FAIL: The module rejected a setting
+   */
+  esp_err_t unit_lorawan_apply_adr_hint( const unit_lorawan_adr_hint_t *hint );
+
   /**
    * @brief Save current configuration to non-volatile memory
    *
@@ -559,6 +1575,152 @@ extern "C"
    */
   esp_err_t unit_lorawan_save_config( void );
 
+  /**
+   * @brief Save the host's session record to NVS
+   *
+   * Stores the provisioned configuration hash, joined state, data rate, TX
+   * power, ADR setting and uplink counters so a later
+   * unit_lorawan_configure_ttn_us915() can skip provisioning and decide on a
+   * join with a single CSTATUS? query. The record is also saved automatically
+   * after provisioning and whenever a join completes. Call this before
+   * entering deep sleep to keep the uplink counters current.
+   *
+   * @note Requires CONFIG_LORAWAN_NVS_SESSION and an initialized NVS
+   * partition (nvs_flash_init()).
+   *
+   * @return
+   *     - ESP_OK: Session record saved
+   *     - ESP_ERR_NOT_SUPPORTED: CONFIG_LORAWAN_NVS_SESSION is disabled
+   *     - Other: NVS error from opening or writing the namespace
+   */
+  esp_err_t unit_lorawan_save_session( void );
+
+  /**
+   * @brief Put the module into low power mode while the link is idle
+   *
+   * When enabled, the module is sent AT+CLPM=1 right away and again whenever
+   * no AT exchange has run for CONFIG_LORAWAN_LOW_POWER_IDLE_MS. The next
+   * command or queued uplink wakes it first with the datasheet wake sequence
+   * (00 00 00 00 0D 0A). Disabling wakes the module and sends AT+CLPM=0.
+   *
+   * Independently of this setting, the driver holds an ESP-IDF PM lock only
+   * while the link is active, so with CONFIG_PM_ENABLE the SoC may
+   * light-sleep between uplinks.
+   *
+   * @note A join in progress keeps the link active until +CJOIN arrives.
+   *
+   * @param[in] enable True to let the module sleep between exchanges
+   * @return
+   *     - ESP_OK: Setting applied
+   *     - ESP_ERR_INVALID_STATE: Driver not initialized
+   *     - ESP_FAIL: Module did not accept AT+CLPM=0
+   */
+  esp_err_t unit_lorawan_set_low_power( bool enable );
+
+  /**
+   * @brief Get whether module low power mode is enabled
+   *
+   * @param[out] enabled True if unit_lorawan_set_low_power() enabled it
+   * @return
+   *     - ESP_OK: Setting retrieved
+   *     - ESP_ERR_INVALID_ARG: enabled is NULL
+   */
+  esp_err_t unit_lorawan_get_low_power( bool *enabled );
+
+  /**
+   * @brief Take a snapshot of the driver's instrumentation counters
+   *
+   * Counts AT command attempts, outcomes, retries and latency per command
+   * class, plus the bytes moved on the UART, so slow modules and degrading
+   * links show up next to application telemetry.
+   *
+   * @note Requires CONFIG_LORAWAN_STATS.
+   *
+   * @param[out] stats Receives a consistent copy of the counters
+   * @return
+   *     - ESP_OK: Snapshot taken
+   *     - ESP_ERR_INVALID_ARG: stats is NULL
+   *     - ESP_ERR_NOT_SUPPORTED: CONFIG_LORAWAN_STATS is disabled
+   */
+  esp_err_t unit_lorawan_get_stats( unit_lorawan_stats_t *stats );
+
+  /**
+   * @brief Clear the instrumentation counters
+   *
+   * @return
+   *     - ESP_OK: Counters cleared
+   *     - ESP_ERR_NOT_SUPPORTED: CONFIG_LORAWAN_STATS is disabled
+   */
+  esp_err_t unit_lorawan_reset_stats( void );
+
+  /**
+   * @brief Drain records from the binary event log
+   *
+   * Every AT command attempt, finished uplink and finished join appends one
+   * unit_lorawan_log_record_t to a RAM ring of CONFIG_LORAWAN_EVENT_LOG_SIZE
+   * records, without any text formatting. Records are returned oldest first
+   * and removed; when the ring is full the oldest unread record is
+   * overwritten.
+   *
+   * @note Requires CONFIG_LORAWAN_EVENT_LOG.
+   *
+   * @param[out] records Buffer for the records
+   * @param max_records Capacity of records
+   * @param[out] count Number of records copied, 0 when the log is empty
+   * @param[out] lost Records overwritten unread since the previous call (can
+   * be NULL)
+   * @return
+   *     - ESP_OK: Records copied
+   *     - ESP_ERR_INVALID_ARG: records or count is NULL, or max_records is 0
+   *     - ESP_ERR_NOT_SUPPORTED: CONFIG_LORAWAN_EVENT_LOG is disabled
+   */
+  esp_err_t unit_lorawan_read_events( unit_lorawan_log_record_t *records,
+                                      size_t max_records, size_t *count,
+                                      uint32_t *lost );
+
+  /**
+   * @brief Replace the UART transport used to reach the module
+   *
+   * Lets the driver run against something other than the port C UART, for
+   * example a scripted module emulator for host-side benchmarks of the AT
+   * command engine together with unit_lorawan_get_stats(). The transport is
+   * copied.
+   *
+   * @note Must be called before unit_lorawan_init().
+   *
+   * @param[in] transport Operations to use, or NULL for the port C UART
+   * @return
+   *     - ESP_OK: Transport installed
+   *     - ESP_ERR_INVALID_ARG: An operation is NULL, or transport is NULL for
+   *       an instance from unit_lorawan_create()
+   *     - ESP_ERR_INVALID_STATE: Driver already initialized
+   */
+  esp_err_t
+  unit_lorawan_set_transport( const unit_lorawan_transport_t *transport );
+
+  /**
+   * @brief Build a transport on the ESP-IDF UART driver
+   *
+   * The transport installs the driver with an RX ring buffer and pattern
+   * detection on '\n', so the receive task wakes once per module line
+   * instead of polling. It can also change its baud rate, which lets the
+   * driver move the module to CONFIG_LORAWAN_BAUD_RATE. With
+   * CONFIG_LORAWAN_UART_TRANSPORT the default handle uses one built from the
+   * Kconfig wiring; pass others to unit_lorawan_create().
+   *
+   * @param[in] config UART controller, pins and ring buffer size
+   * @param[out] transport Filled with the operations, each call allocates
+   *                       its own driver state
+   * @return
+   *     - ESP_OK: transport filled
+   *     - ESP_ERR_INVALID_ARG: NULL argument or rx_buffer_size too small
+   *     - ESP_ERR_NO_MEM: Out of memory for the driver state
+   *     - ESP_ERR_NOT_SUPPORTED: CONFIG_LORAWAN_UART_TRANSPORT is disabled
+   */
+  esp_err_t
+  unit_lorawan_uart_transport( const unit_lorawan_uart_config_t *config,
+                               unit_lorawan_transport_t *transport );
+
   /**
    * @brief Restore factory default configuration
    *
@@ -610,6 +1772,12 @@ extern "C"
    *
    * @note This function uses CONFIG_LORAWAN_* values from Kconfig
    * @note Automatically detects OTAA vs ABP based on Kconfig selection
+   * @note With CONFIG_LORAWAN_NVS_CREDENTIALS, credentials stored in NVS
+   * (see unit_lorawan_load_credentials()) replace the Kconfig ones and
+   * select the activation mode
+   * @note Credentials are written with unit_lorawan_provision(), and only
+   * settings that differ from the module's are written and saved
+   * @note ABP devices are activated without a join
    * @note For US915, uses CONFIG_LORAWAN_US915_SUB_BAND and
    * CONFIG_LORAWAN_US915_DATA_RATE
    */
@@ -643,14 +1811,361 @@ extern "C"
    * @return
    *     - ESP_OK: ABP configuration completed successfully
    *     - ESP_ERR_INVALID_ARG: Invalid or missing Kconfig values
-   *     - ESP_ERR_NOT_SUPPORTED: ABP not fully implemented yet
    *     - ESP_FAIL: Configuration failed
    *
    * @note Requires CONFIG_LORAWAN_ABP to be enabled in Kconfig
-   * @warning ABP support is experimental
    */
   esp_err_t unit_lorawan_config_abp_from_kconfig( void );
 
+  /**
+   * @brief Load per-device credentials from NVS
+   *
+   * Reads hex strings stored under the keys dev_eui, app_eui and app_key
+   * for OTAA, or dev_addr, nwk_skey and app_skey for ABP. A dev_addr key
+   * selects ABP. The namespace is usually written per device from a
+   * manufacturing NVS image, see README.
+   *
+   * @param[in] nvs_namespace NVS namespace, NULL for
+   * CONFIG_LORAWAN_CREDENTIALS_NAMESPACE
+   * @param[out] credentials Loaded and validated credentials
+   * @return
+   *     - ESP_OK: Credentials loaded
+   *     - ESP_ERR_INVALID_ARG: NULL pointer or malformed stored value
+   *     - ESP_ERR_INVALID_SIZE: Stored value longer than expected
+   *     - ESP_ERR_NVS_NOT_FOUND: Namespace or a required key is missing
+   *     - ESP_ERR_NOT_SUPPORTED: CONFIG_LORAWAN_NVS_CREDENTIALS is disabled
+   *
+   * @note The application must call nvs_flash_init() first
+   */
+  esp_err_t
+  unit_lorawan_load_credentials( const char *nvs_namespace,
+                                 unit_lorawan_credentials_t *credentials );
+
+  /**
+   * @brief Write credentials to the module, skipping those it already holds
+   *
+   * Reads the join mode, every key and the operating mode (uplink/downlink
+   * mode, class A, work mode) back and writes only the settings that
+   * differ, as one back to back command sequence. Written settings are
+   * saved with CSAVE and read back again to verify them. A unit that
+   * already holds the credentials costs only the read-back. ABP sessions
+   * are activated afterwards, OTAA devices still need unit_lorawan_join().
+   *
+   * @param[in] credentials Credentials to provision
+   * @param[out] written Settings rewritten, 0 when the module already
+   * matched (may be NULL)
+   * @return
+   *     - ESP_OK: Module holds the credentials
+   *     - ESP_ERR_INVALID_ARG: NULL or malformed credentials
+   *     - ESP_ERR_INVALID_RESPONSE: A written setting did not read back
+   *     - ESP_FAIL: The module rejected a setting or the save
+   */
+  esp_err_t
+  unit_lorawan_provision( const unit_lorawan_credentials_t *credentials,
+                          size_t *written );
+
+  /**
+   * @brief Load credentials from NVS and provision them
+   *
+   * Combines unit_lorawan_load_credentials() and unit_lorawan_provision().
+   *
+   * @param[in] nvs_namespace NVS namespace, NULL for
+   * CONFIG_LORAWAN_CREDENTIALS_NAMESPACE
+   * @param[out] written Settings rewritten (may be NULL)
+   * @return
+   *     - ESP_OK: Module holds the stored credentials
+   *     - ESP_ERR_NOT_SUPPORTED: CONFIG_LORAWAN_NVS_CREDENTIALS is disabled
+   *     - Any error of unit_lorawan_load_credentials() or
+   *       unit_lorawan_provision()
+   */
+  esp_err_t unit_lorawan_provision_from_nvs( const char *nvs_namespace,
+                                             size_t *written );
+
+  /**
+   * @brief Open another LoRaWAN unit
+   *
+   * Creates an independent driver instance with its own tasks, buffers,
+   * session mirror and duty cycle budget, reached through transport. Drive
+   * it with the `_h` functions below, starting with unit_lorawan_init_h().
+   * The unit on expansion port C is the default instance and is not
+   * created here, see unit_lorawan_default_handle(). Instances live until
+   * reboot.
+   *
+   * When CONFIG_LORAWAN_NVS_SESSION is enabled every instance keeps its
+   * session under its own NVS key.
+   *
+   * @param[in] transport Operations reaching the unit, copied
+   * @param[out] handle The new instance
+   * @return
+   *     - ESP_OK: Instance created
+   *     - ESP_ERR_INVALID_ARG: handle is NULL or an operation is missing
+   *     - ESP_ERR_NO_MEM: Out of memory
+   */
+  esp_err_t unit_lorawan_create( const unit_lorawan_transport_t *transport,
+                                 unit_lorawan_handle_t *handle );
+
+  /**
+   * @brief Handle of the unit on expansion port C
+   *
+   * The functions without a handle all act on this instance.
+   *
+   * @return The default instance, never NULL
+   */
+  unit_lorawan_handle_t unit_lorawan_default_handle( void );
+
+  /*
+   * Handle variants. Each behaves like the function of the same name without
+   * the _h suffix, on the given unit, and returns ESP_ERR_INVALID_ARG for a
+   * NULL handle.
+   */
+
+  /** @brief Handle variant of unit_lorawan_log() */
+  esp_err_t unit_lorawan_log_h( unit_lorawan_handle_t handle, uint8_t level );
+
+  /** @brief Handle variant of unit_lorawan_connected() */
+  esp_err_t unit_lorawan_connected_h( unit_lorawan_handle_t handle,
+                                      bool *state );
+
+  /** @brief Handle variant of unit_lorawan_join() */
+  esp_err_t unit_lorawan_join_h( unit_lorawan_handle_t handle );
+
+  /** @brief Handle variant of unit_lorawan_configOTTA() */
+  esp_err_t unit_lorawan_configOTTA_h( unit_lorawan_handle_t handle,
+                                       char *devEUI, char *appEUI, char *appKey,
+                                       unit_lorwan_uldlmode mode );
+
+  /** @brief Handle variant of unit_lorawan_config_abp() */
+  esp_err_t unit_lorawan_config_abp_h( unit_lorawan_handle_t handle,
+                                       const char *dev_addr,
+                                       const char *nwk_skey,
+                                       const char *app_skey,
+                                       unit_lorwan_uldlmode mode );
+
+  /** @brief Handle variant of unit_lorawan_reboot() */
+  esp_err_t unit_lorawan_reboot_h( unit_lorawan_handle_t handle );
+
+  /** @brief Handle variant of unit_lorawan_attached() */
+  esp_err_t unit_lorawan_attached_h( unit_lorawan_handle_t handle,
+                                     bool *state );
+
+  /** @brief Handle variant of unit_lorawan_send() */
+  esp_err_t unit_lorawan_send_h( unit_lorawan_handle_t handle, char *message,
+                                 size_t length );
+
+  /** @brief Handle variant of unit_lorawan_send_ex() */
+  esp_err_t unit_lorawan_send_ex_h( unit_lorawan_handle_t handle,
+                                    const uint8_t *buf, size_t len,
+                                    const unit_lorawan_tx_opts_t *opts );
+
+  /** @brief Handle variant of unit_lorawan_send_async() */
+  esp_err_t unit_lorawan_send_async_h( unit_lorawan_handle_t handle,
+                                       const char *message, size_t length,
+                                       unit_lorawan_tx_callback_t callback,
+                                       void *user_data );
+
+  /** @brief Handle variant of unit_lorawan_send_async_ex() */
+  esp_err_t unit_lorawan_send_async_ex_h( unit_lorawan_handle_t handle,
+                                          const uint8_t *buf, size_t len,
+                                          const unit_lorawan_tx_opts_t *opts,
+                                          unit_lorawan_tx_callback_t callback,
+                                          void *user_data );
+
+  /** @brief Handle variant of unit_lorawan_send_encoded() */
+  esp_err_t unit_lorawan_send_encoded_h( unit_lorawan_handle_t handle,
+                                         const unit_lorawan_schema_t *schema,
+                                         const int32_t *values, size_t records,
+                                         const unit_lorawan_tx_opts_t *opts,
+                                         size_t *sent );
+
+  /** @brief Handle variant of unit_lorawan_aggregator_configure() */
+  esp_err_t unit_lorawan_aggregator_configure_h(
+      unit_lorawan_handle_t handle,
+      const unit_lorawan_aggregator_config_t *config );
+
+  /** @brief Handle variant of unit_lorawan_aggregate() */
+  esp_err_t unit_lorawan_aggregate_h( unit_lorawan_handle_t handle,
+                                      const uint8_t *record, size_t length );
+
+  /** @brief Handle variant of unit_lorawan_aggregate_flush() */
+  esp_err_t unit_lorawan_aggregate_flush_h( unit_lorawan_handle_t handle );
+
+  /** @brief Handle variant of unit_lorawan_get_next_tx_delay() */
+  esp_err_t unit_lorawan_get_next_tx_delay_h( unit_lorawan_handle_t handle,
+                                              size_t length,
+                                              uint32_t *delay_ms );
+
+  /** @brief Handle variant of unit_lorawan_get_airtime_budget() */
+  esp_err_t unit_lorawan_get_airtime_budget_h( unit_lorawan_handle_t handle,
+                                               uint32_t *remaining_ms );
+
+  /** @brief Handle variant of unit_lorawan_set_downlink_callback() */
+  esp_err_t unit_lorawan_set_downlink_callback_h(
+      unit_lorawan_handle_t handle, unit_lorawan_downlink_callback_t callback,
+      void *user_data );
+
+  /** @brief Handle variant of unit_lorawan_set_event_callback() */
+  esp_err_t
+  unit_lorawan_set_event_callback_h( unit_lorawan_handle_t handle,
+                                     unit_lorawan_event_callback_t callback,
+                                     void *user_data );
+
+  /** @brief Handle variant of unit_lorawan_init() */
+  esp_err_t unit_lorawan_init_h( unit_lorawan_handle_t handle );
+
+  /** @brief Handle variant of unit_lorawan_configure_ttn_us915() */
+  esp_err_t unit_lorawan_configure_ttn_us915_h(
+      unit_lorawan_handle_t handle, const unit_lorawan_ttn_config_t *config,
+      unit_lorawan_ttn_join_callback_t join_callback, void *user_data );
+
+  /** @brief Handle variant of unit_lorawan_configure_ttn_eu868() */
+  esp_err_t unit_lorawan_configure_ttn_eu868_h(
+      unit_lorawan_handle_t handle, const unit_lorawan_ttn_config_t *config,
+      unit_lorawan_ttn_join_callback_t join_callback, void *user_data );
+
+  /** @brief Handle variant of unit_lorawan_provision() */
+  esp_err_t
+  unit_lorawan_provision_h( unit_lorawan_handle_t handle,
+                            const unit_lorawan_credentials_t *credentials,
+                            size_t *written );
+
+  /** @brief Handle variant of unit_lorawan_provision_from_nvs() */
+  esp_err_t unit_lorawan_provision_from_nvs_h( unit_lorawan_handle_t handle,
+                                               const char *nvs_namespace,
+                                               size_t *written );
+
+  /** @brief Handle variant of unit_lorawan_get_data_rate_info() */
+  esp_err_t unit_lorawan_get_data_rate_info_h( unit_lorawan_handle_t handle,
+                                               uint8_t *current_data_rate,
+                                               size_t *max_payload_size );
+
+  /** @brief Handle variant of unit_lorawan_set_data_rate() */
+  esp_err_t unit_lorawan_set_data_rate_h( unit_lorawan_handle_t handle,
+                                          uint8_t data_rate );
+
+  /** @brief Handle variant of unit_lorawan_set_rx2_frequency() */
+  esp_err_t unit_lorawan_set_rx2_frequency_h( unit_lorawan_handle_t handle,
+                                              uint32_t frequency );
+
+  /** @brief Handle variant of unit_lorawan_set_rx2_data_rate() */
+  esp_err_t unit_lorawan_set_rx2_data_rate_h( unit_lorawan_handle_t handle,
+                                              uint8_t data_rate );
+
+  /** @brief Handle variant of unit_lorawan_get_rssi() */
+  esp_err_t unit_lorawan_get_rssi_h( unit_lorawan_handle_t handle,
+                                     int16_t *rssi );
+
+  /** @brief Handle variant of unit_lorawan_get_channel_rssi() */
+  esp_err_t unit_lorawan_get_channel_rssi_h( unit_lorawan_handle_t handle,
+                                             uint8_t freq_band_idx,
+                                             int16_t *rssi_values,
+                                             size_t *channel_count );
+
+  /** @brief Handle variant of unit_lorawan_survey_configure() */
+  esp_err_t
+  unit_lorawan_survey_configure_h( unit_lorawan_handle_t handle,
+                                   const unit_lorawan_survey_config_t *config );
+
+  /** @brief Handle variant of unit_lorawan_get_survey() */
+  esp_err_t unit_lorawan_get_survey_h( unit_lorawan_handle_t handle,
+                                       uint8_t sub_band,
+                                       unit_lorawan_sub_band_survey_t *survey );
+
+  /** @brief Handle variant of unit_lorawan_survey_recommend() */
+  esp_err_t unit_lorawan_survey_recommend_h( unit_lorawan_handle_t handle,
+                                             uint8_t *sub_band );
+
+  /** @brief Handle variant of unit_lorawan_get_spool_status() */
+  esp_err_t
+  unit_lorawan_get_spool_status_h( unit_lorawan_handle_t handle,
+                                   unit_lorawan_spool_status_t *status );
+
+  /** @brief Handle variant of unit_lorawan_set_retries() */
+  esp_err_t unit_lorawan_set_retries_h( unit_lorawan_handle_t handle,
+                                        uint8_t message_type, uint8_t retries );
+
+  /** @brief Handle variant of unit_lorawan_set_tx_power() */
+  esp_err_t unit_lorawan_set_tx_power_h( unit_lorawan_handle_t handle,
+                                         uint8_t power_index );
+
+  /** @brief Handle variant of unit_lorawan_get_tx_power() */
+  esp_err_t unit_lorawan_get_tx_power_h( unit_lorawan_handle_t handle,
+                                         uint8_t *power_index );
+
+  /** @brief Handle variant of unit_lorawan_link_check() */
+  esp_err_t unit_lorawan_link_check_h( unit_lorawan_handle_t handle,
+                                       uint8_t mode );
+
+  /** @brief Handle variant of unit_lorawan_get_link_quality() */
+  esp_err_t
+  unit_lorawan_get_link_quality_h( unit_lorawan_handle_t handle,
+                                   uint32_t window_ms,
+                                   unit_lorawan_link_quality_t *quality );
+
+  /** @brief Handle variant of unit_lorawan_get_adr_hint() */
+  esp_err_t unit_lorawan_get_adr_hint_h( unit_lorawan_handle_t handle,
+                                         uint32_t window_ms,
+                                         unit_lorawan_adr_hint_t *hint );
+
+  /** @brief Handle variant of unit_lorawan_apply_adr_hint() */
+  esp_err_t
+  unit_lorawan_apply_adr_hint_h( unit_lorawan_handle_t handle,
+                                 const unit_lorawan_adr_hint_t *hint );
+
+  /** @brief Handle variant of unit_lorawan_save_config() */
+  esp_err_t unit_lorawan_save_config_h( unit_lorawan_handle_t handle );
+
+  /** @brief Handle variant of unit_lorawan_save_session() */
+  esp_err_t unit_lorawan_save_session_h( unit_lorawan_handle_t handle );
+
+  /** @brief Handle variant of unit_lorawan_set_low_power() */
+  esp_err_t unit_lorawan_set_low_power_h( unit_lorawan_handle_t handle,
+                                          bool enable );
+
+  /** @brief Handle variant of unit_lorawan_get_low_power() */
+  esp_err_t unit_lorawan_get_low_power_h( unit_lorawan_handle_t handle,
+                                          bool *enabled );
+
+  /** @brief Handle variant of unit_lorawan_get_stats() */
+  esp_err_t unit_lorawan_get_stats_h( unit_lorawan_handle_t handle,
+                                      unit_lorawan_stats_t *stats );
+
+  /** @brief Handle variant of unit_lorawan_reset_stats() */
+  esp_err_t unit_lorawan_reset_stats_h( unit_lorawan_handle_t handle );
+
+  /** @brief Handle variant of unit_lorawan_read_events() */
+  esp_err_t unit_lorawan_read_events_h( unit_lorawan_handle_t handle,
+                                        unit_lorawan_log_record_t *records,
+                                        size_t max_records, size_t *count,
+                                        uint32_t *lost );
+
+  /** @brief Handle variant of unit_lorawan_set_transport() */
+  esp_err_t
+  unit_lorawan_set_transport_h( unit_lorawan_handle_t handle,
+                                const unit_lorawan_transport_t *transport );
+
+  /** @brief Handle variant of unit_lorawan_restore_defaults() */
+  esp_err_t unit_lorawan_restore_defaults_h( unit_lorawan_handle_t handle );
+
+  /** @brief Handle variant of unit_lorawan_send_raw_command() */
+  esp_err_t unit_lorawan_send_raw_command_h( unit_lorawan_handle_t handle,
+                                             const char *command,
+                                             char *response,
+                                             size_t response_size,
+                                             uint32_t timeout_ms );
+
+  /** @brief Handle variant of unit_lorawan_init_with_config() */
+  esp_err_t unit_lorawan_init_with_config_h(
+      unit_lorawan_handle_t handle,
+      unit_lorawan_ttn_join_callback_t join_callback, void *user_data );
+
+  /** @brief Handle variant of unit_lorawan_config_otaa_from_kconfig() */
+  esp_err_t
+  unit_lorawan_config_otaa_from_kconfig_h( unit_lorawan_handle_t handle );
+
+  /** @brief Handle variant of unit_lorawan_config_abp_from_kconfig() */
+  esp_err_t
+  unit_lorawan_config_abp_from_kconfig_h( unit_lorawan_handle_t handle );
+
 #ifdef __cplusplus
 }
 #endif
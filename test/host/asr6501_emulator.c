@@ -0,0 +1,651 @@
+/**
+ * @file asr6501_emulator.c
+ * @brief Scripted ASR6501 module behind a unit_lorawan_transport_t
+ */
+
+#include "asr6501_emulator.h"
+
+#include "core2foraws.h"
+#include "esp_timer.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ASR6501_SETTINGS        32
+#define ASR6501_NAME_SIZE       16
+#define ASR6501_VALUE_SIZE      48
+#define ASR6501_SEGMENTS        256
+#define ASR6501_SEGMENT_SIZE    64
+#define ASR6501_INPUT_SIZE      640 // An AT+DTRX of the largest payload
+#define ASR6501_UART_FIFO_SIZE  128 // What one BSP read can return
+#define ASR6501_CRSSI_CHANNELS  8
+
+// Recorded on a Unit LoRaWAN915, milliseconds from the end of the command
+// to the start of each line it produced
+#define ASR6501_QUERY_MS        8
+#define ASR6501_CRSSI_HEADER_MS 180
+#define ASR6501_CRSSI_ROW_MS    24
+#define ASR6501_JOIN_OK_MS      12
+#define ASR6501_JOIN_ACCEPT_MS  5600
+#define ASR6501_SEND_MS         22
+#define ASR6501_SENT_MS         1450
+#define ASR6501_RECV_MS         2080
+#define ASR6501_REBOOT_MS       40
+
+typedef struct
+{
+  char name[ ASR6501_NAME_SIZE ];
+  char value[ ASR6501_VALUE_SIZE ];
+} asr6501_setting_t;
+
+typedef struct
+{
+  int64_t due_us; // Released to the reader from this time on
+  uint8_t length;
+  uint8_t offset; // Bytes already read
+  char data[ ASR6501_SEGMENT_SIZE ];
+} asr6501_segment_t;
+
+struct asr6501_emulator_s
+{
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  asr6501_config_t config;
+  asr6501_setting_t live[ ASR6501_SETTINGS ];
+  asr6501_setting_t saved[ ASR6501_SETTINGS ];
+  int64_t joined_us; // Joined from this time on, 0 when not joined
+  char input[ ASR6501_INPUT_SIZE ];
+  size_t input_length;
+  asr6501_segment_t segments[ ASR6501_SEGMENTS ];
+  size_t head;
+  size_t count;
+  uint32_t commands;
+  uint32_t uplinks;
+};
+
+// Settings of a module out of the box
+static const asr6501_setting_t _asr6501_factory[] = {
+    { "CJOINMODE", "0" },
+    { "CDEVEUI", "00956906000068C3" },
+    { "CAPPEUI", "0000000000000000" },
+    { "CAPPKEY", "00000000000000000000000000000000" },
+    { "CDEVADDR", "00000000" },
+    { "CNWKSKEY", "00000000000000000000000000000000" },
+    { "CAPPSKEY", "00000000000000000000000000000000" },
+    { "CFREQBANDMASK", "0001" },
+    { "CULDLMODE", "2" },
+    { "CCLASS", "0" },
+    { "CWORKMODE", "2" },
+    { "CADR", "0" },
+    { "CDATARATE", "0" },
+    { "CTXP", "0" },
+    { "CAPPPORT", "10" },
+    { "CNBTRIALS", "0,3" },
+    { "CGMI", "ASR" },
+};
+
+static asr6501_emulator_t *_asr6501_bsp;
+
+static int64_t _asr6501_scaled_us( asr6501_emulator_t *emu, uint32_t ms )
+{
+  if( emu->config.delivery != ASR6501_DELIVERY_DELAYED )
+  {
+    return 0;
+  }
+  return (int64_t)ms * 1000 * emu->config.time_scale / 100;
+}
+
+static void _asr6501_push( asr6501_emulator_t *emu, int64_t due_us,
+                           const char *data, size_t length )
+{
+  if( emu->count == ASR6501_SEGMENTS )
+  {
+    fprintf( stderr, "asr6501: output overflow, dropping %zu bytes\n",
+             length );
+    return;
+  }
+  asr6501_segment_t *segment =
+      &emu->segments[ ( emu->head + emu->count ) % ASR6501_SEGMENTS ];
+  segment->due_us = due_us;
+  segment->length = (uint8_t)length;
+  segment->offset = 0;
+  memcpy( segment->data, data, length );
+  emu->count++;
+}
+
+// Queues one output line offset_ms (recorded timing) after now_us, never
+// ahead of output already queued
+static void _asr6501_emit( asr6501_emulator_t *emu, int64_t now_us,
+                           uint32_t offset_ms, const char *format, ... )
+  __attribute__( ( format( printf, 4, 5 ) ) );
+
+static void _asr6501_emit( asr6501_emulator_t *emu, int64_t now_us,
+                           uint32_t offset_ms, const char *format, ... )
+{
+  char line[ 256 ];
+  va_list args;
+  va_start( args, format );
+  int length = vsnprintf( line, sizeof( line ) - 2, format, args );
+  va_end( args );
+  if( length < 0 )
+  {
+    return;
+  }
+  if( (size_t)length > sizeof( line ) - 3 )
+  {
+    length = (int)sizeof( line ) - 3;
+  }
+  line[ length++ ] = '\r';
+  line[ length++ ] = '\n';
+
+  int64_t due_us = now_us + _asr6501_scaled_us( emu, offset_ms );
+  if( emu->count > 0 )
+  {
+    const asr6501_segment_t *last =
+        &emu->segments[ ( emu->head + emu->count - 1 ) % ASR6501_SEGMENTS ];
+    if( last->due_us > due_us )
+    {
+      due_us = last->due_us;
+    }
+  }
+
+  size_t piece = ASR6501_SEGMENT_SIZE;
+  if( emu->config.delivery == ASR6501_DELIVERY_CHUNKED &&
+      emu->config.chunk_size > 0 && emu->config.chunk_size < piece )
+  {
+    piece = emu->config.chunk_size;
+  }
+  for( int at = 0; at < length; at += (int)piece )
+  {
+    size_t size = (size_t)( length - at ) < piece ? (size_t)( length - at )
+                                                  : piece;
+    _asr6501_push( emu, due_us, line + at, size );
+    if( emu->config.delivery == ASR6501_DELIVERY_CHUNKED )
+    {
+      due_us += emu->config.chunk_gap_us;
+    }
+  }
+  pthread_cond_broadcast( &emu->changed );
+}
+
+static asr6501_setting_t *_asr6501_setting( asr6501_setting_t *settings,
+                                            const char *name, bool create )
+{
+  for( size_t i = 0; i < ASR6501_SETTINGS; i++ )
+  {
+    if( strcmp( settings[ i ].name, name ) == 0 )
+    {
+      return &settings[ i ];
+    }
+  }
+  if( !create )
+  {
+    return NULL;
+  }
+  for( size_t i = 0; i < ASR6501_SETTINGS; i++ )
+  {
+    if( settings[ i ].name[ 0 ] == '\0' )
+    {
+      snprintf( settings[ i ].name, ASR6501_NAME_SIZE, "%s", name );
+      return &settings[ i ];
+    }
+  }
+  return NULL;
+}
+
+static bool _asr6501_joined( asr6501_emulator_t *emu, int64_t now_us )
+{
+  return emu->joined_us != 0 && now_us >= emu->joined_us;
+}
+
+// AT+DTRX=<confirmed>,<trials>,<length>,<hex>
+static void _asr6501_dtrx( asr6501_emulator_t *emu, int64_t now_us,
+                           const char *args )
+{
+  int confirmed = 0;
+  int trials = 0;
+  size_t length = 0;
+  int consumed = 0;
+  if( sscanf( args, "%d,%d,%zu,%n", &confirmed, &trials, &length,
+              &consumed ) != 3 ||
+      consumed == 0 )
+  {
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "+CME ERROR:1" );
+    return;
+  }
+  const char *hex = args + consumed;
+  size_t digits = strlen( hex );
+  for( size_t i = 0; i < digits; i++ )
+  {
+    if( !isxdigit( (unsigned char)hex[ i ] ) )
+    {
+      digits = 0;
+      break;
+    }
+  }
+  if( digits != length * 2 || trials < 1 )
+  {
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "+CME ERROR:1" );
+    return;
+  }
+  if( !_asr6501_joined( emu, now_us ) )
+  {
+    _asr6501_emit( emu, now_us, ASR6501_SEND_MS, "ERR+SEND:00" );
+    return;
+  }
+
+  emu->uplinks++;
+  _asr6501_emit( emu, now_us, ASR6501_SEND_MS, "OK+SEND:%02zX", length );
+  _asr6501_emit( emu, now_us, ASR6501_SENT_MS, "OK+SENT:01" );
+  if( confirmed )
+  {
+    _asr6501_emit( emu, now_us, ASR6501_RECV_MS, "OK+RECV:02,01,00" );
+  }
+}
+
+// AT+CRSSI <band>?, one row per channel of the band
+static void _asr6501_crssi( asr6501_emulator_t *emu, int64_t now_us,
+                            int band )
+{
+  if( band < 0 || band > 7 )
+  {
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "+CME ERROR:1" );
+    return;
+  }
+  _asr6501_emit( emu, now_us, ASR6501_CRSSI_HEADER_MS, "+CRSSI:" );
+  uint32_t at = ASR6501_CRSSI_HEADER_MS;
+  for( int channel = 0; channel < ASR6501_CRSSI_CHANNELS; channel++ )
+  {
+    at += ASR6501_CRSSI_ROW_MS;
+    _asr6501_emit( emu, now_us, at, "%d:%d", channel,
+                   -120 + band * 2 + channel );
+  }
+  _asr6501_emit( emu, now_us, at, "OK" );
+}
+
+static void _asr6501_query( asr6501_emulator_t *emu, int64_t now_us,
+                            const char *name )
+{
+  int band = 0;
+  if( sscanf( name, "CRSSI %d", &band ) == 1 )
+  {
+    _asr6501_crssi( emu, now_us, band );
+    return;
+  }
+  if( strcmp( name, "CSTATUS" ) == 0 )
+  {
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "+CSTATUS:%02d",
+                   _asr6501_joined( emu, now_us ) ? 4 : 0 );
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "OK" );
+    return;
+  }
+
+  const asr6501_setting_t *setting =
+      _asr6501_setting( emu->live, name, false );
+  if( !setting )
+  {
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "+CME ERROR:1" );
+    return;
+  }
+  _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "+%s:%s", setting->name,
+                 setting->value );
+  _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "OK" );
+}
+
+static void _asr6501_set( asr6501_emulator_t *emu, int64_t now_us,
+                          const char *name, const char *value )
+{
+  if( strcmp( name, "DTRX" ) == 0 )
+  {
+    _asr6501_dtrx( emu, now_us, value );
+    return;
+  }
+  if( strcmp( name, "CJOIN" ) == 0 )
+  {
+    emu->joined_us = now_us + _asr6501_scaled_us( emu, ASR6501_JOIN_ACCEPT_MS );
+    if( emu->joined_us == 0 )
+    {
+      emu->joined_us = 1;
+    }
+    _asr6501_emit( emu, now_us, ASR6501_JOIN_OK_MS, "OK" );
+    _asr6501_emit( emu, now_us, ASR6501_JOIN_ACCEPT_MS, "+CJOIN:OK" );
+    return;
+  }
+  if( strcmp( name, "IREBOOT" ) == 0 )
+  {
+    // Unsaved settings and the session are lost
+    memcpy( emu->live, emu->saved, sizeof( emu->live ) );
+    emu->joined_us = 0;
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "OK" );
+    _asr6501_emit( emu, now_us, ASR6501_REBOOT_MS, "ASR6501:~#" );
+    return;
+  }
+  if( strcmp( name, "ILOGLVL" ) == 0 || strcmp( name, "CLPM" ) == 0 ||
+      strcmp( name, "CLINKCHECK" ) == 0 )
+  {
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "OK" );
+    return;
+  }
+
+  asr6501_setting_t *setting = _asr6501_setting( emu->live, name, true );
+  if( !setting || strlen( value ) >= ASR6501_VALUE_SIZE )
+  {
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "+CME ERROR:1" );
+    return;
+  }
+  snprintf( setting->value, ASR6501_VALUE_SIZE, "%s", value );
+  _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "OK" );
+}
+
+// Runs one received line, called with the lock held
+static void _asr6501_command( asr6501_emulator_t *emu, char *line )
+{
+  if( line[ 0 ] == '\0' )
+  {
+    return; // Wake sequence or a blank line
+  }
+  emu->commands++;
+  int64_t now_us = esp_timer_get_time();
+
+  if( strcmp( line, "AT" ) == 0 )
+  {
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "OK" );
+    return;
+  }
+  if( strncmp( line, "AT+", 3 ) != 0 )
+  {
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "ERROR" );
+    return;
+  }
+
+  char *command = line + 3;
+  size_t length = strlen( command );
+  char *equals = strchr( command, '=' );
+  if( equals )
+  {
+    *equals = '\0';
+    _asr6501_set( emu, now_us, command, equals + 1 );
+  }
+  else if( length > 0 && command[ length - 1 ] == '?' )
+  {
+    command[ length - 1 ] = '\0';
+    _asr6501_query( emu, now_us, command );
+  }
+  else if( strcmp( command, "CSAVE" ) == 0 )
+  {
+    memcpy( emu->saved, emu->live, sizeof( emu->saved ) );
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "OK" );
+  }
+  else if( strcmp( command, "CRESTORE" ) == 0 )
+  {
+    memcpy( emu->live, emu->saved, sizeof( emu->live ) );
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "OK" );
+  }
+  else
+  {
+    _asr6501_emit( emu, now_us, ASR6501_QUERY_MS, "+CME ERROR:1" );
+  }
+}
+
+// Bytes of the output head that may be read now
+static size_t _asr6501_due( asr6501_emulator_t *emu, int64_t now_us )
+{
+  if( emu->count == 0 )
+  {
+    return 0;
+  }
+  const asr6501_segment_t *segment = &emu->segments[ emu->head ];
+  return segment->due_us <= now_us ? segment->length - segment->offset : 0;
+}
+
+static size_t _asr6501_read( asr6501_emulator_t *emu, uint8_t *buffer,
+                             size_t size )
+{
+  if( emu->config.delivery == ASR6501_DELIVERY_CHUNKED &&
+      emu->config.chunk_size > 0 && emu->config.chunk_size < size )
+  {
+    size = emu->config.chunk_size;
+  }
+
+  pthread_mutex_lock( &emu->lock );
+  int64_t now_us = esp_timer_get_time();
+  size_t copied = 0;
+  size_t due;
+  while( copied < size && ( due = _asr6501_due( emu, now_us ) ) > 0 )
+  {
+    asr6501_segment_t *segment = &emu->segments[ emu->head ];
+    size_t take = due < size - copied ? due : size - copied;
+    memcpy( buffer + copied, segment->data + segment->offset, take );
+    copied += take;
+    segment->offset += (uint8_t)take;
+    if( segment->offset == segment->length )
+    {
+      emu->head = ( emu->head + 1 ) % ASR6501_SEGMENTS;
+      emu->count--;
+    }
+  }
+  pthread_mutex_unlock( &emu->lock );
+  return copied;
+}
+
+static void _asr6501_write( asr6501_emulator_t *emu, const char *data,
+                            size_t length )
+{
+  pthread_mutex_lock( &emu->lock );
+  for( size_t i = 0; i < length; i++ )
+  {
+    char c = data[ i ];
+    if( c == '\0' || c == '\r' )
+    {
+      continue;
+    }
+    if( c == '\n' )
+    {
+      emu->input[ emu->input_length ] = '\0';
+      _asr6501_command( emu, emu->input );
+      emu->input_length = 0;
+    }
+    else if( emu->input_length < sizeof( emu->input ) - 1 )
+    {
+      emu->input[ emu->input_length++ ] = c;
+    }
+  }
+  pthread_mutex_unlock( &emu->lock );
+}
+
+static bool _asr6501_flush( asr6501_emulator_t *emu )
+{
+  pthread_mutex_lock( &emu->lock );
+  bool flushed = emu->count > 0;
+  emu->head = 0;
+  emu->count = 0;
+  pthread_mutex_unlock( &emu->lock );
+  return flushed;
+}
+
+// Transport operations
+
+static esp_err_t _asr6501_transport_begin( uint32_t baud, void *ctx )
+{
+  return baud == 115200 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+static esp_err_t _asr6501_transport_write( const char *data, size_t length,
+                                           size_t *written, void *ctx )
+{
+  _asr6501_write( (asr6501_emulator_t *)ctx, data, length );
+  *written = length;
+  return ESP_OK;
+}
+
+static esp_err_t _asr6501_transport_read( uint8_t *buffer, size_t size,
+                                          size_t *read, void *ctx )
+{
+  *read = _asr6501_read( (asr6501_emulator_t *)ctx, buffer, size );
+  return ESP_OK;
+}
+
+static esp_err_t _asr6501_transport_flush( bool *flushed, void *ctx )
+{
+  *flushed = _asr6501_flush( (asr6501_emulator_t *)ctx );
+  return ESP_OK;
+}
+
+// Sleeps until the next piece of output is due, or timeout_ms
+static esp_err_t _asr6501_transport_wait( uint32_t timeout_ms, void *ctx )
+{
+  asr6501_emulator_t *emu = (asr6501_emulator_t *)ctx;
+  int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+
+  pthread_mutex_lock( &emu->lock );
+  esp_err_t err = ESP_ERR_TIMEOUT;
+  for( ;; )
+  {
+    int64_t now_us = esp_timer_get_time();
+    if( _asr6501_due( emu, now_us ) > 0 )
+    {
+      err = ESP_OK;
+      break;
+    }
+    if( now_us >= deadline_us )
+    {
+      break;
+    }
+
+    int64_t wake_us = deadline_us;
+    if( emu->count > 0 && emu->segments[ emu->head ].due_us < wake_us )
+    {
+      wake_us = emu->segments[ emu->head ].due_us;
+    }
+    // esp_timer_get_time() runs on CLOCK_MONOTONIC, like the condition
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    int64_t at_ns = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec +
+                    ( wake_us - now_us ) * 1000;
+    struct timespec wake = {
+        .tv_sec = (time_t)( at_ns / 1000000000LL ),
+        .tv_nsec = (long)( at_ns % 1000000000LL ),
+    };
+    pthread_cond_timedwait( &emu->changed, &emu->lock, &wake );
+  }
+  pthread_mutex_unlock( &emu->lock );
+  return err;
+}
+
+asr6501_emulator_t *asr6501_emulator_create( const asr6501_config_t *config )
+{
+  asr6501_emulator_t *emu = calloc( 1, sizeof( *emu ) );
+  if( !emu )
+  {
+    return NULL;
+  }
+  pthread_condattr_t attr;
+  pthread_condattr_init( &attr );
+  pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+  pthread_cond_init( &emu->changed, &attr );
+  pthread_condattr_destroy( &attr );
+  pthread_mutex_init( &emu->lock, NULL );
+  emu->config = *config;
+  asr6501_emulator_factory_reset( emu );
+  return emu;
+}
+
+unit_lorawan_transport_t asr6501_emulator_transport( asr6501_emulator_t *emu )
+{
+  unit_lorawan_transport_t transport = {
+      .begin = _asr6501_transport_begin,
+      .write = _asr6501_transport_write,
+      .read = _asr6501_transport_read,
+      .flush = _asr6501_transport_flush,
+      .wait = _asr6501_transport_wait,
+      .ctx = emu,
+  };
+  return transport;
+}
+
+void asr6501_emulator_attach_bsp( asr6501_emulator_t *emu )
+{
+  _asr6501_bsp = emu;
+}
+
+void asr6501_emulator_factory_reset( asr6501_emulator_t *emu )
+{
+  pthread_mutex_lock( &emu->lock );
+  memset( emu->live, 0, sizeof( emu->live ) );
+  for( size_t i = 0; i < sizeof( _asr6501_factory ) /
+                              sizeof( _asr6501_factory[ 0 ] );
+       i++ )
+  {
+    emu->live[ i ] = _asr6501_factory[ i ];
+  }
+  memcpy( emu->saved, emu->live, sizeof( emu->saved ) );
+  emu->joined_us = 0;
+  pthread_mutex_unlock( &emu->lock );
+}
+
+void asr6501_emulator_set_joined( asr6501_emulator_t *emu, bool joined )
+{
+  pthread_mutex_lock( &emu->lock );
+  emu->joined_us = joined ? esp_timer_get_time() : 0;
+  pthread_mutex_unlock( &emu->lock );
+}
+
+uint32_t asr6501_emulator_commands( asr6501_emulator_t *emu )
+{
+  pthread_mutex_lock( &emu->lock );
+  uint32_t commands = emu->commands;
+  pthread_mutex_unlock( &emu->lock );
+  return commands;
+}
+
+uint32_t asr6501_emulator_uplinks( asr6501_emulator_t *emu )
+{
+  pthread_mutex_lock( &emu->lock );
+  uint32_t uplinks = emu->uplinks;
+  pthread_mutex_unlock( &emu->lock );
+  return uplinks;
+}
+
+// Core2 for AWS expansion port C, polled without a wait like the BSP
+
+esp_err_t core2foraws_expports_uart_begin( uint32_t baud )
+{
+  return _asr6501_bsp ? _asr6501_transport_begin( baud, _asr6501_bsp )
+                      : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t core2foraws_expports_uart_write( const char *message, size_t length,
+                                           size_t *was_written )
+{
+  if( !_asr6501_bsp )
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  return _asr6501_transport_write( message, length, was_written,
+                                   _asr6501_bsp );
+}
+
+esp_err_t core2foraws_expports_uart_read( uint8_t *message_buffer,
+                                          size_t *was_read )
+{
+  if( !_asr6501_bsp )
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  return _asr6501_transport_read( message_buffer, ASR6501_UART_FIFO_SIZE,
+                                  was_read, _asr6501_bsp );
+}
+
+esp_err_t core2foraws_expports_uart_read_flush( bool *was_flushed )
+{
+  if( !_asr6501_bsp )
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  return _asr6501_transport_flush( was_flushed, _asr6501_bsp );
+}
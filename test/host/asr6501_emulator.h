@@ -0,0 +1,78 @@
+/**
+ * @file asr6501_emulator.h
+ * @brief Scripted ASR6501 module behind a unit_lorawan_transport_t
+ *
+ * Answers the AT commands the driver issues from a settings model and from
+ * transcripts recorded on a Unit LoRaWAN915 at 115200 baud: CSTATUS, CRSSI,
+ * CJOIN and DTRX. Output is released to the reader as a whole line, in small
+ * chunks with gaps between them, or at the recorded module timing.
+ */
+
+#pragma once
+
+#include "unit_lorawan.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief How module output reaches the driver
+ */
+typedef enum
+{
+  ASR6501_DELIVERY_WHOLE = 0, /**< Every line readable as soon as the
+                                 command is written */
+  ASR6501_DELIVERY_CHUNKED,   /**< Lines split into chunk_size reads with
+                                 chunk_gap_us between them */
+  ASR6501_DELIVERY_DELAYED,   /**< Lines released at the recorded module
+                                 timing, scaled by time_scale */
+} asr6501_delivery_t;
+
+typedef struct
+{
+  asr6501_delivery_t delivery;
+  size_t chunk_size;     /**< CHUNKED: largest read, in bytes */
+  uint32_t chunk_gap_us; /**< CHUNKED: pause between chunks of a line */
+  uint32_t time_scale;   /**< DELAYED: percent of the recorded timing */
+} asr6501_config_t;
+
+typedef struct asr6501_emulator_s asr6501_emulator_t;
+
+/**
+ * @brief Create an emulated module in its factory state, not joined
+ * @return The emulator, or NULL when out of memory
+ */
+asr6501_emulator_t *asr6501_emulator_create( const asr6501_config_t *config );
+
+/**
+ * @brief Transport that talks to the emulator, for unit_lorawan_set_transport()
+ */
+unit_lorawan_transport_t asr6501_emulator_transport( asr6501_emulator_t *emu );
+
+/**
+ * @brief Serve the core2foraws_expports_uart_* calls of the default
+ * instance from the emulator
+ */
+void asr6501_emulator_attach_bsp( asr6501_emulator_t *emu );
+
+/**
+ * @brief Restore the factory settings, both live and saved, and leave the
+ * network
+ */
+void asr6501_emulator_factory_reset( asr6501_emulator_t *emu );
+
+/**
+ * @brief Join or leave the network without a CJOIN exchange
+ */
+void asr6501_emulator_set_joined( asr6501_emulator_t *emu, bool joined );
+
+/**
+ * @brief AT command lines received since the emulator was created
+ */
+uint32_t asr6501_emulator_commands( asr6501_emulator_t *emu );
+
+/**
+ * @brief Uplinks the emulator put on the air
+ */
+uint32_t asr6501_emulator_uplinks( asr6501_emulator_t *emu );
@@ -0,0 +1,417 @@
+/**
+ * @file bench.c
+ * @brief Host bench of the driver against the ASR6501 emulator
+ *
+ * Runs init, provisioning, CSTATUS, CRSSI, CJOIN and DTRX over the stubbed
+ * expansion port C, or over the emulator's transport with whole, chunked or
+ * delayed delivery. Every answer is checked, so the bench fails when the
+ * driver mis-frames a reply. For every scenario it reports AT commands per
+ * second, heap allocations per command and call latency percentiles.
+ *
+ * Usage: unit_lorawan_bench <bsp|whole|chunked|delayed> [iterations], with
+ * BENCH_VERBOSE set in the environment for the driver's debug log
+ */
+
+#include "asr6501_emulator.h"
+#include "host_alloc.h"
+#include "unit_lorawan.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_ITERATIONS_DEFAULT 20
+#define BENCH_DELAYED_SCALE      2 // Percent of the recorded module timing
+
+typedef struct
+{
+  const char *name;
+  size_t calls;
+  uint32_t commands;    // AT commands the driver wrote
+  uint32_t allocations; // malloc, calloc and realloc calls
+  int64_t busy_us;      // Time spent inside the calls
+  uint32_t *latency_us; // One per call
+  size_t capacity;
+} bench_result_t;
+
+typedef struct
+{
+  const char *name;
+  asr6501_emulator_t *emu;
+} bench_target_t;
+
+static int _bench_failures;
+
+#define BENCH_CHECK( cond, ... )                                               \
+  do                                                                           \
+  {                                                                            \
+    if( !( cond ) )                                                            \
+    {                                                                          \
+      fprintf( stderr, "FAIL %s:%d: ", __FILE__, __LINE__ );                   \
+      fprintf( stderr, __VA_ARGS__ );                                          \
+      fputc( '\n', stderr );                                                   \
+      _bench_failures++;                                                       \
+    }                                                                          \
+  } while( 0 )
+
+static const unit_lorawan_credentials_t _bench_credentials = {
+    .activation = UNIT_LORAWAN_ACTIVATION_OTAA,
+    .dev_eui = "70B3D57ED006BED3",
+    .app_eui = "0000000000000001",
+    .app_key = "6D23016D08DBC02237CDC1A19957E974",
+};
+
+// The allocation count covers every thread, the driver's tasks included
+static void _bench_counters( uint32_t *commands, uint32_t *allocations )
+{
+  unit_lorawan_stats_t stats;
+  *commands = 0;
+  *allocations = host_alloc_count();
+  if( unit_lorawan_get_stats( &stats ) != ESP_OK )
+  {
+    return;
+  }
+  for( size_t i = 0; i < UNIT_LORAWAN_STATS_COMMAND_COUNT; i++ )
+  {
+    *commands += stats.commands[ i ].sent;
+  }
+}
+
+static void _bench_begin( bench_result_t *result, const char *name,
+                          size_t capacity )
+{
+  memset( result, 0, sizeof( *result ) );
+  result->name = name;
+  result->capacity = capacity;
+  result->latency_us = calloc( capacity, sizeof( uint32_t ) );
+  if( !result->latency_us )
+  {
+    fprintf( stderr, "Out of memory\n" );
+    exit( 2 );
+  }
+}
+
+static void _bench_sample( bench_result_t *result, int64_t elapsed_us )
+{
+  if( result->calls < result->capacity )
+  {
+    result->latency_us[ result->calls++ ] = (uint32_t)elapsed_us;
+  }
+  result->busy_us += elapsed_us;
+}
+
+static int _bench_compare( const void *a, const void *b )
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static double _bench_percentile_ms( const bench_result_t *result,
+                                    unsigned percent )
+{
+  if( result->calls == 0 )
+  {
+    return 0;
+  }
+  size_t index = ( result->calls * percent + 99 ) / 100;
+  index = index > 0 ? index - 1 : 0;
+  return result->latency_us[ index ] / 1000.0;
+}
+
+static void _bench_report( const bench_target_t *target,
+                           bench_result_t *result, bool allocates )
+{
+#ifdef CONFIG_LORAWAN_STATIC_BUFFERS
+  BENCH_CHECK( allocates || result->allocations == 0,
+               "%s: %s: %u heap allocations", target->name, result->name,
+               result->allocations );
+#else
+  (void)allocates;
+#endif
+  qsort( result->latency_us, result->calls, sizeof( uint32_t ),
+         _bench_compare );
+  double seconds = result->busy_us / 1e6;
+  printf( "%-10s %-16s %6zu %7u %9.1f %9.2f %8.2f %8.2f %8.2f\n",
+          target->name, result->name, result->calls, result->commands,
+          seconds > 0 ? result->commands / seconds : 0,
+          result->commands ? (double)result->allocations / result->commands
+                           : 0,
+          _bench_percentile_ms( result, 50 ),
+          _bench_percentile_ms( result, 99 ),
+          _bench_percentile_ms( result, 100 ) );
+  free( result->latency_us );
+}
+
+// Times one call and charges the commands and allocations it caused
+#define BENCH_MEASURE( result, call )                                          \
+  ( {                                                                          \
+    uint32_t _commands, _allocations;                                          \
+    _bench_counters( &_commands, &_allocations );                              \
+    int64_t _started = esp_timer_get_time();                                   \
+    esp_err_t _err = ( call );                                                 \
+    _bench_sample( result, esp_timer_get_time() - _started );                 \
+    uint32_t _commands_after, _allocations_after;                              \
+    _bench_counters( &_commands_after, &_allocations_after );                  \
+    ( result )->commands += _commands_after - _commands;                       \
+    ( result )->allocations += _allocations_after - _allocations;              \
+    _err;                                                                      \
+  } )
+
+static void _bench_init( const bench_target_t *target, size_t iterations )
+{
+  bench_result_t result;
+  _bench_begin( &result, "init", iterations );
+  for( size_t i = 0; i < iterations; i++ )
+  {
+    // Init starts the command counters over, so what they hold after it is
+    // its own
+    uint32_t allocations = host_alloc_count();
+    int64_t started = esp_timer_get_time();
+    esp_err_t err = unit_lorawan_init();
+    _bench_sample( &result, esp_timer_get_time() - started );
+    BENCH_CHECK( err == ESP_OK, "%s: init: %s", target->name,
+                 esp_err_to_name( err ) );
+    uint32_t commands, allocations_after;
+    _bench_counters( &commands, &allocations_after );
+    result.commands += commands;
+    result.allocations += allocations_after - allocations;
+  }
+  // The first init creates the driver's tasks and queues
+  _bench_report( target, &result, true );
+}
+
+static void _bench_provision( const bench_target_t *target, size_t iterations )
+{
+  bench_result_t written;
+  bench_result_t verified;
+  _bench_begin( &written, "provision/write", iterations );
+  _bench_begin( &verified, "provision/verify", iterations );
+  for( size_t i = 0; i < iterations; i++ )
+  {
+    // A factory fresh unit takes every credential, then only reads them back
+    asr6501_emulator_factory_reset( target->emu );
+    size_t count = 0;
+    esp_err_t err = BENCH_MEASURE(
+        &written, unit_lorawan_provision( &_bench_credentials, &count ) );
+    BENCH_CHECK( err == ESP_OK && count > 0,
+                 "%s: provision: %s, %zu written", target->name,
+                 esp_err_to_name( err ), count );
+
+    err = BENCH_MEASURE(
+        &verified, unit_lorawan_provision( &_bench_credentials, &count ) );
+    BENCH_CHECK( err == ESP_OK && count == 0,
+                 "%s: provision again: %s, %zu written", target->name,
+                 esp_err_to_name( err ), count );
+  }
+  _bench_report( target, &written, false );
+  _bench_report( target, &verified, false );
+}
+
+static void _bench_join( const bench_target_t *target, size_t iterations )
+{
+  bench_result_t result;
+  _bench_begin( &result, "cjoin", iterations );
+  for( size_t i = 0; i < iterations; i++ )
+  {
+    asr6501_emulator_set_joined( target->emu, false );
+    esp_err_t err = BENCH_MEASURE( &result, unit_lorawan_join() );
+    BENCH_CHECK( err == ESP_OK, "%s: join: %s", target->name,
+                 esp_err_to_name( err ) );
+
+    // The accept follows as +CJOIN:OK, which CSTATUS then reports
+    bool joined = false;
+    int64_t deadline = esp_timer_get_time() + 5000000;
+    while( !joined && esp_timer_get_time() < deadline )
+    {
+      unit_lorawan_connected( &joined );
+    }
+    BENCH_CHECK( joined, "%s: not joined after CJOIN", target->name );
+  }
+  _bench_report( target, &result, false );
+}
+
+static void _bench_cstatus( const bench_target_t *target, size_t iterations )
+{
+  bench_result_t result;
+  _bench_begin( &result, "cstatus", iterations );
+  asr6501_emulator_set_joined( target->emu, true );
+  for( size_t i = 0; i < iterations; i++ )
+  {
+    bool joined = false;
+    esp_err_t err =
+        BENCH_MEASURE( &result, unit_lorawan_connected( &joined ) );
+    BENCH_CHECK( err == ESP_OK && joined, "%s: CSTATUS: %s, joined %d",
+                 target->name, esp_err_to_name( err ), joined );
+  }
+  _bench_report( target, &result, false );
+}
+
+static void _bench_crssi( const bench_target_t *target, size_t iterations )
+{
+  bench_result_t result;
+  _bench_begin( &result, "crssi", iterations );
+  for( size_t i = 0; i < iterations; i++ )
+  {
+    uint8_t band = (uint8_t)( i % 8 );
+    int16_t rssi[ 8 ] = { 0 };
+    size_t channels = 0;
+    esp_err_t err = BENCH_MEASURE(
+        &result, unit_lorawan_get_channel_rssi( band, rssi, &channels ) );
+    BENCH_CHECK( err == ESP_OK && channels == 8, "%s: CRSSI: %s, %zu rows",
+                 target->name, esp_err_to_name( err ), channels );
+    for( size_t channel = 0; channel < channels; channel++ )
+    {
+      BENCH_CHECK( rssi[ channel ] == -120 + band * 2 + (int)channel,
+                   "%s: CRSSI band %u channel %zu read %d", target->name,
+                   band, channel, rssi[ channel ] );
+    }
+  }
+  _bench_report( target, &result, false );
+}
+
+static void _bench_send( const bench_target_t *target, size_t iterations,
+                         bool confirmed )
+{
+  bench_result_t result;
+  _bench_begin( &result, confirmed ? "dtrx/confirmed" : "dtrx/unconfirmed",
+                iterations );
+  asr6501_emulator_set_joined( target->emu, true );
+  const unit_lorawan_tx_opts_t opts = {
+      .confirmed = confirmed,
+      .port = 0,
+      .retries = 1,
+  };
+  uint32_t uplinks = asr6501_emulator_uplinks( target->emu );
+  for( size_t i = 0; i < iterations; i++ )
+  {
+    uint8_t payload[ 11 ];
+    for( size_t j = 0; j < sizeof( payload ); j++ )
+    {
+      payload[ j ] = (uint8_t)( i + j );
+    }
+    esp_err_t err = BENCH_MEASURE(
+        &result, unit_lorawan_send_ex( payload, 1 + i % 11, &opts ) );
+    BENCH_CHECK( err == ESP_OK, "%s: DTRX: %s", target->name,
+                 esp_err_to_name( err ) );
+
+    // The uplink's OK+SENT may still be on its way and must not be taken
+    // for the answer to the next command
+    bool joined = false;
+    err = unit_lorawan_connected( &joined );
+    BENCH_CHECK( err == ESP_OK && joined,
+                 "%s: CSTATUS after DTRX: %s, joined %d", target->name,
+                 esp_err_to_name( err ), joined );
+  }
+  BENCH_CHECK( asr6501_emulator_uplinks( target->emu ) - uplinks ==
+                   iterations,
+               "%s: %u of %zu uplinks reached the air", target->name,
+               asr6501_emulator_uplinks( target->emu ) - uplinks,
+               iterations );
+  _bench_report( target, &result, false );
+}
+
+static void _bench_run( const bench_target_t *target, size_t iterations )
+{
+  uint32_t before = asr6501_emulator_commands( target->emu );
+  _bench_init( target, iterations / 4 + 1 );
+  _bench_provision( target, iterations / 2 + 1 );
+  _bench_join( target, iterations / 4 + 1 );
+  _bench_cstatus( target, iterations * 4 );
+  _bench_crssi( target, iterations );
+  _bench_send( target, iterations * 2, false );
+  _bench_send( target, iterations, true );
+  printf( "%-10s %u AT commands served\n", target->name,
+          asr6501_emulator_commands( target->emu ) - before );
+}
+
+static bool _bench_config( const char *mode, asr6501_config_t *config )
+{
+  if( strcmp( mode, "bsp" ) == 0 || strcmp( mode, "whole" ) == 0 )
+  {
+    *config = ( asr6501_config_t ){ .delivery = ASR6501_DELIVERY_WHOLE };
+  }
+  else if( strcmp( mode, "chunked" ) == 0 )
+  {
+    *config = ( asr6501_config_t ){
+        .delivery = ASR6501_DELIVERY_CHUNKED,
+        .chunk_size = 3,
+        .chunk_gap_us = 150,
+    };
+  }
+  else if( strcmp( mode, "delayed" ) == 0 )
+  {
+    *config = ( asr6501_config_t ){
+        .delivery = ASR6501_DELIVERY_DELAYED,
+        .time_scale = BENCH_DELAYED_SCALE,
+    };
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+int main( int argc, char **argv )
+{
+  asr6501_config_t config;
+  size_t iterations = BENCH_ITERATIONS_DEFAULT;
+  if( argc > 2 )
+  {
+    iterations = strtoul( argv[ 2 ], NULL, 10 );
+  }
+  if( argc < 2 || !_bench_config( argv[ 1 ], &config ) || iterations == 0 )
+  {
+    fprintf( stderr, "Usage: %s <bsp|whole|chunked|delayed> [iterations]\n",
+             argv[ 0 ] );
+    return 2;
+  }
+  esp_log_level_set( "*", getenv( "BENCH_VERBOSE" ) ? ESP_LOG_DEBUG
+                                                    : ESP_LOG_ERROR );
+
+  bench_target_t target = { .name = argv[ 1 ] };
+  target.emu = asr6501_emulator_create( &config );
+  if( !target.emu )
+  {
+    fprintf( stderr, "Out of memory\n" );
+    return 2;
+  }
+  if( strcmp( target.name, "bsp" ) == 0 )
+  {
+    // Served through the stubbed core2foraws_expports_uart_* calls
+    asr6501_emulator_attach_bsp( target.emu );
+  }
+  else
+  {
+    unit_lorawan_transport_t transport =
+        asr6501_emulator_transport( target.emu );
+    esp_err_t err = unit_lorawan_set_transport( &transport );
+    if( err != ESP_OK )
+    {
+      fprintf( stderr, "set_transport: %s\n", esp_err_to_name( err ) );
+      return 2;
+    }
+  }
+
+#ifdef CONFIG_LORAWAN_STATIC_BUFFERS
+  printf( "Static buffers, %zu iterations\n", iterations );
+#else
+  printf( "Heap buffers, %zu iterations\n", iterations );
+#endif
+  printf( "%-10s %-16s %6s %7s %9s %9s %8s %8s %8s\n", "transport",
+          "scenario", "calls", "cmds", "cmd/s", "alloc/cmd", "p50 ms",
+          "p99 ms", "max ms" );
+  _bench_run( &target, iterations );
+
+  if( _bench_failures )
+  {
+    printf( "%d checks failed\n", _bench_failures );
+    return 1;
+  }
+  printf( "All checks passed\n" );
+  return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file esp_host.c
+ * @brief ESP-IDF timer, error and logging calls for the host build
+ */
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+static esp_log_level_t _host_log_level = ESP_LOG_WARN;
+
+int64_t esp_timer_get_time( void )
+{
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+const char *esp_err_to_name( esp_err_t code )
+{
+  switch( code )
+  {
+  case ESP_OK:
+    return "ESP_OK";
+  case ESP_FAIL:
+    return "ESP_FAIL";
+  case ESP_ERR_NO_MEM:
+    return "ESP_ERR_NO_MEM";
+  case ESP_ERR_INVALID_ARG:
+    return "ESP_ERR_INVALID_ARG";
+  case ESP_ERR_INVALID_STATE:
+    return "ESP_ERR_INVALID_STATE";
+  case ESP_ERR_INVALID_SIZE:
+    return "ESP_ERR_INVALID_SIZE";
+  case ESP_ERR_NOT_FOUND:
+    return "ESP_ERR_NOT_FOUND";
+  case ESP_ERR_NOT_SUPPORTED:
+    return "ESP_ERR_NOT_SUPPORTED";
+  case ESP_ERR_TIMEOUT:
+    return "ESP_ERR_TIMEOUT";
+  case ESP_ERR_INVALID_RESPONSE:
+    return "ESP_ERR_INVALID_RESPONSE";
+  case ESP_ERR_INVALID_CRC:
+    return "ESP_ERR_INVALID_CRC";
+  case ESP_ERR_INVALID_VERSION:
+    return "ESP_ERR_INVALID_VERSION";
+  default:
+    return "UNKNOWN ERROR";
+  }
+}
+
+// One level for every tag, which is all the bench needs
+void esp_log_level_set( const char *tag, esp_log_level_t level )
+{
+  (void)tag;
+  _host_log_level = level;
+}
+
+void esp_log_write( esp_log_level_t level, const char *tag, const char *format,
+                    ... )
+{
+  if( level > _host_log_level )
+  {
+    return;
+  }
+  static const char letters[] = "NEWIDV";
+  fprintf( stderr, "%c (%lld) %s: ", letters[ level ],
+           (long long)( esp_timer_get_time() / 1000 ), tag );
+  va_list args;
+  va_start( args, format );
+  vfprintf( stderr, format, args );
+  va_end( args );
+  fputc( '\n', stderr );
+}
@@ -0,0 +1,499 @@
+/**
+ * @file freertos_host.c
+ * @brief The FreeRTOS subset the driver uses, on POSIX threads
+ *
+ * Every primitive is a mutex and condition variable pair timed against
+ * CLOCK_MONOTONIC, so one tick is one millisecond of real time and the
+ * driver's timeouts behave as they do on the device.
+ */
+
+#define _GNU_SOURCE // PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct host_task_s
+{
+  pthread_t thread;
+  TaskFunction_t function;
+  void *parameters;
+};
+
+typedef enum
+{
+  HOST_SEMAPHORE_BINARY,
+  HOST_SEMAPHORE_MUTEX,
+  HOST_SEMAPHORE_RECURSIVE,
+} host_semaphore_kind_t;
+
+struct host_semaphore_s
+{
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  host_semaphore_kind_t kind;
+  bool available;
+  TaskHandle_t owner; // Mutexes only
+  uint32_t depth;     // Recursive takes held by owner
+  bool dynamic;       // Allocated rather than built in a StaticSemaphore_t
+};
+
+_Static_assert( sizeof( StaticSemaphore_t ) >=
+                    sizeof( struct host_semaphore_s ),
+                "StaticSemaphore_t cannot hold a semaphore" );
+
+struct host_queue_s
+{
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  UBaseType_t length;
+  UBaseType_t item_size;
+  UBaseType_t head;
+  UBaseType_t count;
+  uint8_t *storage;
+};
+
+struct host_event_group_s
+{
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  EventBits_t bits;
+};
+
+static pthread_mutex_t _host_critical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static __thread TaskHandle_t _host_current;
+static struct host_task_s _host_main_task;
+
+static uint64_t _host_now_ns( void )
+{
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static void _host_cond_init( pthread_mutex_t *lock, pthread_cond_t *cond )
+{
+  pthread_condattr_t attr;
+  pthread_condattr_init( &attr );
+  pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+  pthread_cond_init( cond, &attr );
+  pthread_condattr_destroy( &attr );
+  pthread_mutex_init( lock, NULL );
+}
+
+static struct timespec _host_deadline( TickType_t ticks )
+{
+  uint64_t at = _host_now_ns() + (uint64_t)pdTICKS_TO_MS( ticks ) * 1000000ULL;
+  struct timespec deadline = {
+      .tv_sec = (time_t)( at / 1000000000ULL ),
+      .tv_nsec = (long)( at % 1000000000ULL ),
+  };
+  return deadline;
+}
+
+// Waits on cond with lock held; false once ticks have passed
+static bool _host_cond_wait( pthread_cond_t *cond, pthread_mutex_t *lock,
+                             TickType_t ticks, const struct timespec *deadline )
+{
+  if( ticks == portMAX_DELAY )
+  {
+    pthread_cond_wait( cond, lock );
+    return true;
+  }
+  if( ticks == 0 )
+  {
+    return false;
+  }
+  return pthread_cond_timedwait( cond, lock, deadline ) != ETIMEDOUT;
+}
+
+// Ports
+
+void vPortEnterCritical( portMUX_TYPE *mux )
+{
+  (void)mux;
+  pthread_mutex_lock( &_host_critical );
+}
+
+void vPortExitCritical( portMUX_TYPE *mux )
+{
+  (void)mux;
+  pthread_mutex_unlock( &_host_critical );
+}
+
+// Tasks
+
+static void *_host_task_entry( void *arg )
+{
+  TaskHandle_t task = (TaskHandle_t)arg;
+  _host_current = task;
+  task->function( task->parameters );
+  return NULL;
+}
+
+BaseType_t xTaskCreate( TaskFunction_t function, const char *name,
+                        uint32_t stack_depth, void *parameters,
+                        UBaseType_t priority, TaskHandle_t *created )
+{
+  (void)name;
+  (void)stack_depth;
+  (void)priority;
+  TaskHandle_t task = calloc( 1, sizeof( *task ) );
+  if( !task )
+  {
+    return pdFAIL;
+  }
+  task->function = function;
+  task->parameters = parameters;
+
+  // The creator may compare against the handle before the task first runs
+  if( created )
+  {
+    *created = task;
+  }
+  if( pthread_create( &task->thread, NULL, _host_task_entry, task ) != 0 )
+  {
+    if( created )
+    {
+      *created = NULL;
+    }
+    free( task );
+    return pdFAIL;
+  }
+  pthread_detach( task->thread );
+  return pdPASS;
+}
+
+void vTaskDelete( TaskHandle_t task )
+{
+  if( !task || task == _host_current )
+  {
+    pthread_exit( NULL );
+  }
+  pthread_cancel( task->thread );
+}
+
+void vTaskDelay( TickType_t ticks )
+{
+  uint64_t ns = (uint64_t)pdTICKS_TO_MS( ticks ) * 1000000ULL;
+  struct timespec delay = {
+      .tv_sec = (time_t)( ns / 1000000000ULL ),
+      .tv_nsec = (long)( ns % 1000000000ULL ),
+  };
+  while( nanosleep( &delay, &delay ) != 0 && errno == EINTR )
+  {
+  }
+}
+
+TickType_t xTaskGetTickCount( void )
+{
+  return (TickType_t)pdMS_TO_TICKS( _host_now_ns() / 1000000ULL );
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle( void )
+{
+  return _host_current ? _host_current : &_host_main_task;
+}
+
+// Queues
+
+QueueHandle_t xQueueCreate( UBaseType_t length, UBaseType_t item_size )
+{
+  QueueHandle_t queue = calloc( 1, sizeof( *queue ) );
+  if( !queue )
+  {
+    return NULL;
+  }
+  queue->storage = calloc( length, item_size ? item_size : 1 );
+  if( !queue->storage )
+  {
+    free( queue );
+    return NULL;
+  }
+  _host_cond_init( &queue->lock, &queue->changed );
+  queue->length = length;
+  queue->item_size = item_size;
+  return queue;
+}
+
+BaseType_t xQueueSend( QueueHandle_t queue, const void *item,
+                       TickType_t ticks )
+{
+  struct timespec deadline = _host_deadline( ticks );
+  pthread_mutex_lock( &queue->lock );
+  while( queue->count == queue->length )
+  {
+    if( !_host_cond_wait( &queue->changed, &queue->lock, ticks, &deadline ) )
+    {
+      pthread_mutex_unlock( &queue->lock );
+      return pdFAIL;
+    }
+  }
+  UBaseType_t tail = ( queue->head + queue->count ) % queue->length;
+  memcpy( queue->storage + tail * queue->item_size, item, queue->item_size );
+  queue->count++;
+  pthread_cond_broadcast( &queue->changed );
+  pthread_mutex_unlock( &queue->lock );
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive( QueueHandle_t queue, void *item, TickType_t ticks )
+{
+  struct timespec deadline = _host_deadline( ticks );
+  pthread_mutex_lock( &queue->lock );
+  while( queue->count == 0 )
+  {
+    if( !_host_cond_wait( &queue->changed, &queue->lock, ticks, &deadline ) )
+    {
+      pthread_mutex_unlock( &queue->lock );
+      return pdFAIL;
+    }
+  }
+  memcpy( item, queue->storage + queue->head * queue->item_size,
+          queue->item_size );
+  queue->head = ( queue->head + 1 ) % queue->length;
+  queue->count--;
+  pthread_cond_broadcast( &queue->changed );
+  pthread_mutex_unlock( &queue->lock );
+  return pdPASS;
+}
+
+BaseType_t xQueueReset( QueueHandle_t queue )
+{
+  pthread_mutex_lock( &queue->lock );
+  queue->head = 0;
+  queue->count = 0;
+  pthread_cond_broadcast( &queue->changed );
+  pthread_mutex_unlock( &queue->lock );
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting( QueueHandle_t queue )
+{
+  pthread_mutex_lock( &queue->lock );
+  UBaseType_t count = queue->count;
+  pthread_mutex_unlock( &queue->lock );
+  return count;
+}
+
+void vQueueDelete( QueueHandle_t queue )
+{
+  pthread_cond_destroy( &queue->changed );
+  pthread_mutex_destroy( &queue->lock );
+  free( queue->storage );
+  free( queue );
+}
+
+// Semaphores
+
+static SemaphoreHandle_t _host_semaphore_init( SemaphoreHandle_t semaphore,
+                                               host_semaphore_kind_t kind )
+{
+  memset( semaphore, 0, sizeof( *semaphore ) );
+  _host_cond_init( &semaphore->lock, &semaphore->changed );
+  semaphore->kind = kind;
+  semaphore->available = kind != HOST_SEMAPHORE_BINARY;
+  return semaphore;
+}
+
+static SemaphoreHandle_t _host_semaphore_create( host_semaphore_kind_t kind )
+{
+  SemaphoreHandle_t semaphore = malloc( sizeof( *semaphore ) );
+  if( !semaphore )
+  {
+    return NULL;
+  }
+  _host_semaphore_init( semaphore, kind );
+  semaphore->dynamic = true;
+  return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex( void )
+{
+  return _host_semaphore_create( HOST_SEMAPHORE_MUTEX );
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex( void )
+{
+  return _host_semaphore_create( HOST_SEMAPHORE_RECURSIVE );
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary( void )
+{
+  return _host_semaphore_create( HOST_SEMAPHORE_BINARY );
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic( StaticSemaphore_t *buffer )
+{
+  return _host_semaphore_init( (SemaphoreHandle_t)buffer,
+                               HOST_SEMAPHORE_MUTEX );
+}
+
+SemaphoreHandle_t
+xSemaphoreCreateRecursiveMutexStatic( StaticSemaphore_t *buffer )
+{
+  return _host_semaphore_init( (SemaphoreHandle_t)buffer,
+                               HOST_SEMAPHORE_RECURSIVE );
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic( StaticSemaphore_t *buffer )
+{
+  return _host_semaphore_init( (SemaphoreHandle_t)buffer,
+                               HOST_SEMAPHORE_BINARY );
+}
+
+BaseType_t xSemaphoreTake( SemaphoreHandle_t semaphore, TickType_t ticks )
+{
+  struct timespec deadline = _host_deadline( ticks );
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  pthread_mutex_lock( &semaphore->lock );
+  if( semaphore->kind == HOST_SEMAPHORE_RECURSIVE && !semaphore->available &&
+      semaphore->owner == self )
+  {
+    semaphore->depth++;
+    pthread_mutex_unlock( &semaphore->lock );
+    return pdPASS;
+  }
+  while( !semaphore->available )
+  {
+    if( !_host_cond_wait( &semaphore->changed, &semaphore->lock, ticks,
+                          &deadline ) )
+    {
+      pthread_mutex_unlock( &semaphore->lock );
+      return pdFAIL;
+    }
+  }
+  semaphore->available = false;
+  semaphore->owner = self;
+  semaphore->depth = 1;
+  pthread_mutex_unlock( &semaphore->lock );
+  return pdPASS;
+}
+
+BaseType_t xSemaphoreGive( SemaphoreHandle_t semaphore )
+{
+  pthread_mutex_lock( &semaphore->lock );
+  BaseType_t given = pdFAIL;
+  if( semaphore->kind == HOST_SEMAPHORE_BINARY )
+  {
+    given = semaphore->available ? pdFAIL : pdPASS;
+    semaphore->available = true;
+  }
+  else if( !semaphore->available &&
+           semaphore->owner == xTaskGetCurrentTaskHandle() )
+  {
+    // Like FreeRTOS, only the holder can release a mutex
+    if( --semaphore->depth == 0 )
+    {
+      semaphore->available = true;
+      semaphore->owner = NULL;
+    }
+    given = pdPASS;
+  }
+  pthread_cond_broadcast( &semaphore->changed );
+  pthread_mutex_unlock( &semaphore->lock );
+  return given;
+}
+
+BaseType_t xSemaphoreTakeRecursive( SemaphoreHandle_t mutex, TickType_t ticks )
+{
+  return xSemaphoreTake( mutex, ticks );
+}
+
+BaseType_t xSemaphoreGiveRecursive( SemaphoreHandle_t mutex )
+{
+  return xSemaphoreGive( mutex );
+}
+
+void vSemaphoreDelete( SemaphoreHandle_t semaphore )
+{
+  pthread_cond_destroy( &semaphore->changed );
+  pthread_mutex_destroy( &semaphore->lock );
+  if( semaphore->dynamic )
+  {
+    free( semaphore );
+  }
+}
+
+// Event groups
+
+EventGroupHandle_t xEventGroupCreate( void )
+{
+  EventGroupHandle_t group = calloc( 1, sizeof( *group ) );
+  if( group )
+  {
+    _host_cond_init( &group->lock, &group->changed );
+  }
+  return group;
+}
+
+EventBits_t xEventGroupSetBits( EventGroupHandle_t group, EventBits_t bits )
+{
+  pthread_mutex_lock( &group->lock );
+  group->bits |= bits;
+  EventBits_t now = group->bits;
+  pthread_cond_broadcast( &group->changed );
+  pthread_mutex_unlock( &group->lock );
+  return now;
+}
+
+EventBits_t xEventGroupClearBits( EventGroupHandle_t group, EventBits_t bits )
+{
+  pthread_mutex_lock( &group->lock );
+  EventBits_t before = group->bits;
+  group->bits &= ~bits;
+  pthread_mutex_unlock( &group->lock );
+  return before;
+}
+
+EventBits_t xEventGroupGetBits( EventGroupHandle_t group )
+{
+  pthread_mutex_lock( &group->lock );
+  EventBits_t now = group->bits;
+  pthread_mutex_unlock( &group->lock );
+  return now;
+}
+
+EventBits_t xEventGroupWaitBits( EventGroupHandle_t group, EventBits_t bits,
+                                 BaseType_t clear_on_exit,
+                                 BaseType_t wait_for_all, TickType_t ticks )
+{
+  struct timespec deadline = _host_deadline( ticks );
+  pthread_mutex_lock( &group->lock );
+  for( ;; )
+  {
+    EventBits_t set = group->bits & bits;
+    if( wait_for_all ? set == bits : set != 0 )
+    {
+      break;
+    }
+    if( !_host_cond_wait( &group->changed, &group->lock, ticks, &deadline ) )
+    {
+      break;
+    }
+  }
+  EventBits_t now = group->bits;
+  if( clear_on_exit && ( wait_for_all ? ( now & bits ) == bits
+                                      : ( now & bits ) != 0 ) )
+  {
+    group->bits &= ~bits;
+  }
+  pthread_mutex_unlock( &group->lock );
+  return now;
+}
+
+void vEventGroupDelete( EventGroupHandle_t group )
+{
+  pthread_cond_destroy( &group->changed );
+  pthread_mutex_destroy( &group->lock );
+  free( group );
+}
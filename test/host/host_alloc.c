@@ -0,0 +1,38 @@
+/**
+ * @file host_alloc.c
+ * @brief Counts the heap allocations of the host build
+ */
+
+#include "host_alloc.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+void *__real_malloc( size_t size );
+void *__real_calloc( size_t count, size_t size );
+void *__real_realloc( void *pointer, size_t size );
+
+static atomic_uint _host_allocations;
+
+void *__wrap_malloc( size_t size )
+{
+  atomic_fetch_add( &_host_allocations, 1 );
+  return __real_malloc( size );
+}
+
+void *__wrap_calloc( size_t count, size_t size )
+{
+  atomic_fetch_add( &_host_allocations, 1 );
+  return __real_calloc( count, size );
+}
+
+void *__wrap_realloc( void *pointer, size_t size )
+{
+  atomic_fetch_add( &_host_allocations, 1 );
+  return __real_realloc( pointer, size );
+}
+
+uint32_t host_alloc_count( void )
+{
+  return atomic_load( &_host_allocations );
+}
@@ -0,0 +1,18 @@
+/**
+ * @file host_alloc.h
+ * @brief Heap allocation counter for the host build
+ *
+ * The bench links with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc, so
+ * every allocation made from the driver, the shims and the bench passes
+ * through host_alloc.c.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief malloc, calloc and realloc calls since the program started, from
+ * every thread
+ */
+uint32_t host_alloc_count( void );
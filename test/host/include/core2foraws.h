@@ -0,0 +1,27 @@
+/**
+ * @file core2foraws.h
+ * @brief Core2 for AWS expansion port C UART, backed by the ASR6501 emulator
+ *
+ * The driver's default transport calls these. On the host they forward to
+ * the emulator the bench installed, see asr6501_emulator_attach_bsp().
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+esp_err_t core2foraws_expports_uart_begin( uint32_t baud );
+esp_err_t core2foraws_expports_uart_write( const char *message, size_t length,
+                                           size_t *was_written );
+esp_err_t core2foraws_expports_uart_read( uint8_t *message_buffer,
+                                          size_t *was_read );
+esp_err_t core2foraws_expports_uart_read_flush( bool *was_flushed );
@@ -0,0 +1,34 @@
+/**
+ * @file esp_log.h
+ * @brief ESP-IDF logging macros for the host build
+ *
+ * Lines at or below the level set with esp_log_level_set() go to stderr, so
+ * the bench report on stdout stays readable.
+ */
+
+#pragma once
+
+typedef enum
+{
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+void esp_log_level_set( const char *tag, esp_log_level_t level );
+void esp_log_write( esp_log_level_t level, const char *tag, const char *format,
+                    ... ) __attribute__( ( format( printf, 3, 4 ) ) );
+
+#define ESP_LOGE( tag, format, ... )                                           \
+  esp_log_write( ESP_LOG_ERROR, tag, format, ##__VA_ARGS__ )
+#define ESP_LOGW( tag, format, ... )                                           \
+  esp_log_write( ESP_LOG_WARN, tag, format, ##__VA_ARGS__ )
+#define ESP_LOGI( tag, format, ... )                                           \
+  esp_log_write( ESP_LOG_INFO, tag, format, ##__VA_ARGS__ )
+#define ESP_LOGD( tag, format, ... )                                           \
+  esp_log_write( ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__ )
+#define ESP_LOGV( tag, format, ... )                                           \
+  esp_log_write( ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__ )
@@ -0,0 +1,10 @@
+/**
+ * @file esp_timer.h
+ * @brief Monotonic microsecond clock for the host build
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time( void );
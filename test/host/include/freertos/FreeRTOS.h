@@ -0,0 +1,46 @@
+/**
+ * @file FreeRTOS.h
+ * @brief FreeRTOS types and port macros for the host build
+ *
+ * Tasks run as POSIX threads and the tick is one millisecond. Critical
+ * sections take one process-wide lock, so they exclude every other task as
+ * they would on a single core.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  pdTRUE
+#define pdFAIL  pdFALSE
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS ( 1000 / configTICK_RATE_HZ )
+#define portMAX_DELAY      ( (TickType_t)0xffffffffUL )
+#define pdMS_TO_TICKS( ms )                                                    \
+  ( (TickType_t)( ( (uint64_t)( ms ) * configTICK_RATE_HZ ) / 1000 ) )
+#define pdTICKS_TO_MS( ticks )                                                 \
+  ( (uint32_t)( ( (uint64_t)( ticks ) * 1000 ) / configTICK_RATE_HZ ) )
+
+typedef struct
+{
+  int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED                                           \
+  {                                                                            \
+    0                                                                          \
+  }
+
+void vPortEnterCritical( portMUX_TYPE *mux );
+void vPortExitCritical( portMUX_TYPE *mux );
+
+#define portENTER_CRITICAL( mux ) vPortEnterCritical( mux )
+#define portEXIT_CRITICAL( mux )  vPortExitCritical( mux )
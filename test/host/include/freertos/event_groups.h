@@ -0,0 +1,20 @@
+/**
+ * @file event_groups.h
+ * @brief FreeRTOS event group API for the host build
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_event_group_s *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+EventGroupHandle_t xEventGroupCreate( void );
+EventBits_t xEventGroupSetBits( EventGroupHandle_t group, EventBits_t bits );
+EventBits_t xEventGroupClearBits( EventGroupHandle_t group, EventBits_t bits );
+EventBits_t xEventGroupGetBits( EventGroupHandle_t group );
+EventBits_t xEventGroupWaitBits( EventGroupHandle_t group, EventBits_t bits,
+                                 BaseType_t clear_on_exit,
+                                 BaseType_t wait_for_all, TickType_t ticks );
+void vEventGroupDelete( EventGroupHandle_t group );
@@ -0,0 +1,18 @@
+/**
+ * @file queue.h
+ * @brief FreeRTOS queue API for the host build
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue_s *QueueHandle_t;
+
+QueueHandle_t xQueueCreate( UBaseType_t length, UBaseType_t item_size );
+BaseType_t xQueueSend( QueueHandle_t queue, const void *item,
+                       TickType_t ticks );
+BaseType_t xQueueReceive( QueueHandle_t queue, void *item, TickType_t ticks );
+BaseType_t xQueueReset( QueueHandle_t queue );
+UBaseType_t uxQueueMessagesWaiting( QueueHandle_t queue );
+void vQueueDelete( QueueHandle_t queue );
@@ -0,0 +1,32 @@
+/**
+ * @file semphr.h
+ * @brief FreeRTOS semaphore and mutex API for the host build
+ *
+ * The static variants build the semaphore inside the caller's buffer, so the
+ * bench sees every heap allocation the driver makes.
+ */
+
+#pragma once
+
+#include "freertos/queue.h"
+
+typedef struct host_semaphore_s *SemaphoreHandle_t;
+
+typedef struct
+{
+  void *storage[ 24 ]; // Holds a struct host_semaphore_s
+} StaticSemaphore_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex( void );
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex( void );
+SemaphoreHandle_t xSemaphoreCreateBinary( void );
+SemaphoreHandle_t xSemaphoreCreateMutexStatic( StaticSemaphore_t *buffer );
+SemaphoreHandle_t
+xSemaphoreCreateRecursiveMutexStatic( StaticSemaphore_t *buffer );
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic( StaticSemaphore_t *buffer );
+BaseType_t xSemaphoreTake( SemaphoreHandle_t semaphore, TickType_t ticks );
+BaseType_t xSemaphoreGive( SemaphoreHandle_t semaphore );
+BaseType_t xSemaphoreTakeRecursive( SemaphoreHandle_t mutex,
+                                    TickType_t ticks );
+BaseType_t xSemaphoreGiveRecursive( SemaphoreHandle_t mutex );
+void vSemaphoreDelete( SemaphoreHandle_t semaphore );
@@ -0,0 +1,19 @@
+/**
+ * @file task.h
+ * @brief FreeRTOS task API for the host build
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task_s *TaskHandle_t;
+typedef void ( *TaskFunction_t )( void *parameters );
+
+BaseType_t xTaskCreate( TaskFunction_t function, const char *name,
+                        uint32_t stack_depth, void *parameters,
+                        UBaseType_t priority, TaskHandle_t *created );
+void vTaskDelete( TaskHandle_t task );
+void vTaskDelay( TickType_t ticks );
+TickType_t xTaskGetTickCount( void );
+TaskHandle_t xTaskGetCurrentTaskHandle( void );
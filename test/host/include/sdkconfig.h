@@ -0,0 +1,26 @@
+/**
+ * @file sdkconfig.h
+ * @brief Kconfig values for the host build of the driver
+ *
+ * Mirrors a menuconfig run with the defaults, plus CONFIG_LORAWAN_STATS for
+ * the allocation and latency counters the bench reports. Airtime accounting
+ * is off so back to back uplinks are measured rather than refused.
+ */
+
+#pragma once
+
+#define CONFIG_LORAWAN_OTAA 1
+#define CONFIG_LORAWAN_DEVICE_EUI "70B3D57ED006BED3"
+#define CONFIG_LORAWAN_APP_EUI "0000000000000000"
+#define CONFIG_LORAWAN_APP_KEY "6D23016D08DBC02237CDC1A19957E974"
+#define CONFIG_LORAWAN_REGION_US915 1
+#define CONFIG_LORAWAN_US915_SUB_BAND 2
+#define CONFIG_LORAWAN_US915_DATA_RATE 2
+#define CONFIG_LORAWAN_ADR_ENABLED 1
+#define CONFIG_LORAWAN_JOIN_TIMEOUT_SEC 60
+#define CONFIG_LORAWAN_TX_POWER_INDEX 2
+#define CONFIG_LORAWAN_CONFIRMED_RETRIES 3
+#define CONFIG_LORAWAN_INTERACTIVE_WAIT_MS 5000
+#define CONFIG_LORAWAN_AIRTIME_BUDGET_MS 0
+#define CONFIG_LORAWAN_LOW_POWER_IDLE_MS 7000
+#define CONFIG_LORAWAN_STATS 1
@@ -25,43 +25,532 @@
 
 #include "unit_lorawan.h"
 #include "core2foraws.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "sdkconfig.h" // For CONFIG_* values
+#include <ctype.h>
+#include <strings.h>
+
+#if defined( CONFIG_LORAWAN_NVS_SESSION ) ||                                   \
+    defined( CONFIG_LORAWAN_NVS_CREDENTIALS )
+#include "nvs.h"
+#endif
+
+#ifdef CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+#ifdef CONFIG_LORAWAN_UART_TRANSPORT
+#include "driver/uart.h"
+#include "esp_idf_version.h"
+#endif
+
+#ifdef CONFIG_LORAWAN_SPOOL
+#include "esp_idf_version.h"
+#include "esp_partition.h"
+#include <stddef.h>
+#endif
+
+#include "esp_timer.h"
 
 #define UNIT_LORAWAN_DATA_RATE            115200
+#ifdef CONFIG_LORAWAN_BAUD_RATE
+#define UNIT_LORAWAN_BAUD_RATE CONFIG_LORAWAN_BAUD_RATE
+#else
+#define UNIT_LORAWAN_BAUD_RATE UNIT_LORAWAN_DATA_RATE
+#endif
 #define UNIT_LORAWAN_MFG                  "ASR"
 #define UNIT_LORAWAN_MODEL                "6501"
 #define UNIT_LORAWAN_RESPONSE_TIMEOUT_MS  5000
-#define UNIT_LORAWAN_COMMAND_DELAY_MS     100
 #define UNIT_LORAWAN_MAX_RETRIES          3
 #define UNIT_LORAWAN_RESPONSE_BUFFER_SIZE 512
 #define UNIT_LORAWAN_HEX_MESSAGE_MAX_SIZE                                      \
-  512 // Allows up to 256 bytes payload, doubled for hex encoding
+  ( 2 * UNIT_LORAWAN_REGION_MAX_PAYLOAD )
+#define UNIT_LORAWAN_COMMAND_BUFFER_SIZE                                       \
+  ( sizeof( "AT+DTRX=1,15,255," ) + UNIT_LORAWAN_HEX_MESSAGE_MAX_SIZE +       \
+    sizeof( "\r\n" ) ) // Longest framed uplink
+#define UNIT_LORAWAN_LINE_BUFFER_SIZE   256 // Longest single response line
+#define UNIT_LORAWAN_CRSSI_CHANNELS     8   // Rows in a CRSSI scan
+#define UNIT_LORAWAN_RX_TASK_STACK_SIZE 3072
+#define UNIT_LORAWAN_RX_TASK_PRIORITY   5
+#define UNIT_LORAWAN_RX_POLL_MS         10 // Idle interval between UART reads
+#define UNIT_LORAWAN_RX_IDLE_POLL_MS    100 // Read interval while the link idles
+#define UNIT_LORAWAN_RX_WAIT_MS         1000 // Longest block in transport.wait
+#define UNIT_LORAWAN_SEND_TIMEOUT_MS    30000
+// Per trial of an uplink: TTN RX1 delay of 5 s, RX2 one second later, and
+// the up to 3 s ACK_TIMEOUT before a confirmed retransmission
+#define UNIT_LORAWAN_TX_TRIAL_MS 9000
+#define UNIT_LORAWAN_TX_QUEUE_LENGTH    8
+#define UNIT_LORAWAN_TX_TASK_STACK_SIZE 4096
+#define UNIT_LORAWAN_TX_TASK_PRIORITY   4
+#define UNIT_LORAWAN_AGGREGATE_RETRY_MS 1000 // Deadline flush retry, queue full
+
+// Uplink airtime accounting against the TTN fair use policy
+#ifdef CONFIG_LORAWAN_AIRTIME_BUDGET_MS
+#define UNIT_LORAWAN_AIRTIME_BUDGET_MS CONFIG_LORAWAN_AIRTIME_BUDGET_MS
+#else
+#define UNIT_LORAWAN_AIRTIME_BUDGET_MS 30000
+#endif
+#define UNIT_LORAWAN_AIRTIME_BUDGET_US                                         \
+  ( (uint64_t)UNIT_LORAWAN_AIRTIME_BUDGET_MS * 1000 )
+#define UNIT_LORAWAN_AIRTIME_WINDOW_MS ( 24ULL * 60 * 60 * 1000 )
+#define UNIT_LORAWAN_FRAME_OVERHEAD    13 // MHDR, FHDR, FPort and MIC bytes
+
+// Link power management between exchanges
+#ifdef CONFIG_LORAWAN_LOW_POWER_IDLE_MS
+#define UNIT_LORAWAN_LOW_POWER_IDLE_MS CONFIG_LORAWAN_LOW_POWER_IDLE_MS
+#else
+#define UNIT_LORAWAN_LOW_POWER_IDLE_MS 7000
+#endif
+#define UNIT_LORAWAN_WAKE_SETTLE_MS 20 // Module UART restart after wake bytes
+
+// Background channel survey
+#ifdef CONFIG_LORAWAN_SURVEY
+#define UNIT_LORAWAN_SURVEY_HISTORY CONFIG_LORAWAN_SURVEY_HISTORY
+#endif
+#define UNIT_LORAWAN_SURVEY_BUSY_RETRY_MS 1000 // Link busy, look again later
+#define UNIT_LORAWAN_SURVEY_PERCENTILE    90   // Noise level a channel scores
+
+// Store-and-forward spool of undelivered uplinks on a flash partition
+#define UNIT_LORAWAN_SPOOL_SECTOR_SIZE    4096 // Flash erase unit
+#define UNIT_LORAWAN_SPOOL_MAGIC          0xA5
+#define UNIT_LORAWAN_SPOOL_PENDING        0xFF // State byte as written
+#define UNIT_LORAWAN_SPOOL_DELIVERED      0x00 // Cleared in place once ACKed
+#define UNIT_LORAWAN_SPOOL_RETRY_MS       30000 // Not joined or drain failed
+#define UNIT_LORAWAN_SPOOL_BUSY_RETRY_MS  1000  // Uplinks queued, look again
+// Each record also needs its length byte in a drain frame
+#define UNIT_LORAWAN_SPOOL_RECORD_MAX ( UNIT_LORAWAN_REGION_MAX_PAYLOAD - 1 )
+
+// Session record kept in NVS across host resets
+#define UNIT_LORAWAN_NVS_NAMESPACE       "unit_lorawan"
+#define UNIT_LORAWAN_NVS_SESSION_KEY     "session"
+#define UNIT_LORAWAN_NVS_SESSION_VERSION 1
+
+// Per-device credential strings, see unit_lorawan_load_credentials()
+#define UNIT_LORAWAN_NVS_DEV_EUI_KEY  "dev_eui"
+#define UNIT_LORAWAN_NVS_APP_EUI_KEY  "app_eui"
+#define UNIT_LORAWAN_NVS_APP_KEY_KEY  "app_key"
+#define UNIT_LORAWAN_NVS_DEV_ADDR_KEY "dev_addr"
+#define UNIT_LORAWAN_NVS_NWK_SKEY_KEY "nwk_skey"
+#define UNIT_LORAWAN_NVS_APP_SKEY_KEY "app_skey"
+
+#define UNIT_LORAWAN_COMMAND_QUEUE_LENGTH   8
+// Longest an interactive command waits for the driver to pick it up
+#ifdef CONFIG_LORAWAN_INTERACTIVE_WAIT_MS
+#define UNIT_LORAWAN_INTERACTIVE_WAIT_MS CONFIG_LORAWAN_INTERACTIVE_WAIT_MS
+#else
+#define UNIT_LORAWAN_INTERACTIVE_WAIT_MS UNIT_LORAWAN_RESPONSE_TIMEOUT_MS
+#endif
+// Command retry policy
+#define UNIT_LORAWAN_RETRY_BACKOFF_MIN_MS      100
+#define UNIT_LORAWAN_RETRY_BACKOFF_MAX_MS      1000
+#define UNIT_LORAWAN_LATENCY_MIN_SAMPLES       4 // Before timeouts adapt
+#define UNIT_LORAWAN_QUICK_TIMEOUT_FLOOR_MS    250
+#define UNIT_LORAWAN_QUICK_TIMEOUT_INITIAL_MS  1000
+#define UNIT_LORAWAN_NORMAL_TIMEOUT_FLOOR_MS   1000
+#define UNIT_LORAWAN_DRIVER_TASK_STACK_SIZE 4096
+#define UNIT_LORAWAN_DRIVER_TASK_PRIORITY   5
+#define UNIT_LORAWAN_JOIN_TIMEOUT_MS        30000
+#define UNIT_LORAWAN_PROBE_TIMEOUT_MS       100 // Bare "AT" answers in ~10 ms
+#define UNIT_LORAWAN_PROBE_INTERVAL_MS      20
+#define UNIT_LORAWAN_BOOT_TIMEOUT_MS        3000
+// IREBOOT answers OK before resetting; don't let the old firmware answer the
+// first probe
+#define UNIT_LORAWAN_REBOOT_SETTLE_MS 50
+// CGBR also answers OK at the old rate, then the module reopens its UART
+#define UNIT_LORAWAN_BAUD_SETTLE_MS 20
+#define UNIT_LORAWAN_BAUD_READY_MS  500
+// Pause before re-issuing CJOIN after +CJOIN:FAIL, doubled after every
+// failure so repeated attempts stay within the join duty cycle limits
+#define UNIT_LORAWAN_JOIN_BACKOFF_MIN_MS 15000
+#define UNIT_LORAWAN_JOIN_BACKOFF_MAX_MS 300000
 
 // TTN US915 internal constants (not exposed to users)
 #define TTN_US915_CLASS_DEFAULT     0 // Class A (most common)
 #define TTN_US915_WORK_MODE_DEFAULT 2 // LoRaWAN mode
 
-// ASR6501 frequency band masks for US915 sub-bands (internal use only)
-#define ASR6501_US915_SUB_BAND_1_MASK "0001" // Channels 0-7
-#define ASR6501_US915_SUB_BAND_2_MASK "0002" // Channels 8-15 (TTN)
-#define ASR6501_US915_SUB_BAND_3_MASK "0004" // Channels 16-23
-#define ASR6501_US915_SUB_BAND_4_MASK "0008" // Channels 24-31
-#define ASR6501_US915_SUB_BAND_5_MASK "0010" // Channels 32-39
-#define ASR6501_US915_SUB_BAND_6_MASK "0020" // Channels 40-47
-#define ASR6501_US915_SUB_BAND_7_MASK "0040" // Channels 48-55
-#define ASR6501_US915_SUB_BAND_8_MASK "0080" // Channels 56-63
-
-// US915 data rate to maximum payload mapping for ASR6501
-static const size_t us915_max_payload_sizes[] = {
-    UNIT_LORAWAN_US915_MAX_PAYLOAD_DR0, // DR0: SF10, 125kHz
-    UNIT_LORAWAN_US915_MAX_PAYLOAD_DR1, // DR1: SF9, 125kHz
-    UNIT_LORAWAN_US915_MAX_PAYLOAD_DR2, // DR2: SF8, 125kHz
-    UNIT_LORAWAN_US915_MAX_PAYLOAD_DR3, // DR3: SF7, 125kHz
-    UNIT_LORAWAN_US915_MAX_PAYLOAD_DR4  // DR4: SF8, 500kHz
+// Channels in one ASR6501 CFREQBANDMASK group
+#define UNIT_LORAWAN_SUB_BAND_CHANNELS 8
+
+// Uplink data rate: LoRa modulation and the largest application payload
+typedef struct
+{
+  uint8_t spreading_factor;
+  uint16_t bandwidth_khz;
+  uint8_t max_payload;
+} lorawan_data_rate_t;
+
+#define LORAWAN_REGION_DATA_RATES 7 // Most LoRa data rates of any region
+
+// Regional parameters of the ASR6501 firmware variant
+typedef struct
+{
+  const char *name;
+  uint8_t data_rate_max;     // Highest LoRa uplink data rate
+  uint8_t data_rate_default; // Initial data rate recommended by TTN
+  uint8_t adr_data_rate_max; // Fastest data rate on 125 kHz channels
+  uint8_t sub_band_count;    // CFREQBANDMASK groups, 0 if not selectable
+  uint8_t channel_count;     // 125 kHz uplink channels
+  uint32_t rx2_frequency;    // TTN RX2 settings the stack applies itself
+  uint8_t rx2_data_rate;
+  uint8_t tx_power_max_dbm; // TX power index 0, each index is 2 dB less
+  lorawan_data_rate_t data_rates[ LORAWAN_REGION_DATA_RATES ];
+} lorawan_region_t;
+
+// Only the region selected in Kconfig is built, so validation and airtime
+// math are lookups in one constant table
+#ifdef CONFIG_LORAWAN_REGION_EU868
+#define LORAWAN_REGION_SUB_BANDS 1 // One airtime budget for the whole band
+static const lorawan_region_t _unit_lorawan_region = {
+    .name = "EU868",
+    .data_rate_max = UNIT_LORAWAN_EU868_DATA_RATE_MAX,
+    .data_rate_default = UNIT_LORAWAN_TTN_EU868_DATA_RATE_DEFAULT,
+    .adr_data_rate_max = 5,
+    .sub_band_count = 0,
+    .channel_count = 16,
+    .rx2_frequency = UNIT_LORAWAN_TTN_EU868_RX2_FREQUENCY,
+    .rx2_data_rate = UNIT_LORAWAN_TTN_EU868_RX2_DATA_RATE,
+    .tx_power_max_dbm = 16,
+    .data_rates =
+        {
+            { 12, 125, UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR0 },
+            { 11, 125, UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR1 },
+            { 10, 125, UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR2 },
+            { 9, 125, UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR3 },
+            { 8, 125, UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR4 },
+            { 7, 125, UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR5 },
+            { 7, 250, UNIT_LORAWAN_EU868_MAX_PAYLOAD_DR6 },
+        },
+};
+#else
+#define LORAWAN_REGION_SUB_BANDS UNIT_LORAWAN_US915_SUB_BAND_MAX
+static const lorawan_region_t _unit_lorawan_region = {
+    .name = "US915",
+    .data_rate_max = UNIT_LORAWAN_US915_DATA_RATE_MAX,
+    .data_rate_default = UNIT_LORAWAN_TTN_US915_DATA_RATE_DEFAULT,
+    .adr_data_rate_max = 3,
+    .sub_band_count = LORAWAN_REGION_SUB_BANDS,
+    .channel_count = 64,
+    .rx2_frequency = UNIT_LORAWAN_TTN_US915_RX2_FREQUENCY,
+    .rx2_data_rate = UNIT_LORAWAN_TTN_US915_RX2_DATA_RATE,
+    .tx_power_max_dbm = 30,
+    .data_rates =
+        {
+            { 10, 125, UNIT_LORAWAN_US915_MAX_PAYLOAD_DR0 },
+            { 9, 125, UNIT_LORAWAN_US915_MAX_PAYLOAD_DR1 },
+            { 8, 125, UNIT_LORAWAN_US915_MAX_PAYLOAD_DR2 },
+            { 7, 125, UNIT_LORAWAN_US915_MAX_PAYLOAD_DR3 },
+            { 8, 500, UNIT_LORAWAN_US915_MAX_PAYLOAD_DR4 },
+        },
 };
+#endif
+
+// Largest payload at data_rate, or the DR0 one for a rate the region lacks
+static size_t _unit_lorawan_region_max_payload( uint8_t data_rate )
+{
+  if( data_rate > _unit_lorawan_region.data_rate_max )
+  {
+    data_rate = 0;
+  }
+  return _unit_lorawan_region.data_rates[ data_rate ].max_payload;
+}
 
 static const char *_TAG = "UNIT_LORAWAN";
 
+// Working buffers used on the AT command path
+typedef enum
+{
+  LORAWAN_BUFFER_COMMAND,  // Framed "AT+<cmd>\r\n" line
+  LORAWAN_BUFFER_RESPONSE, // Lines captured for the command in flight
+  LORAWAN_BUFFER_COUNT
+} lorawan_buffer_t;
+
+#ifdef CONFIG_LORAWAN_STATIC_BUFFERS
+// Static buffer sets. Callers lease theirs across the submit, so the driver
+// task has a set of its own and never waits on a caller whose command it
+// has yet to run. Interactive commands have a set of their own too, so a
+// long uplink holding the bulk set never stalls a status query.
+typedef enum
+{
+  LORAWAN_ARENA_BULK,
+  LORAWAN_ARENA_INTERACTIVE,
+  LORAWAN_ARENA_DRIVER,
+  LORAWAN_ARENA_COUNT
+} lorawan_arena_id_t;
+
+typedef struct
+{
+  char command[ UNIT_LORAWAN_COMMAND_BUFFER_SIZE ];
+  char response[ UNIT_LORAWAN_RESPONSE_BUFFER_SIZE ];
+  // Held while either buffer is leased so one command uses them at a time
+  SemaphoreHandle_t lock;
+  StaticSemaphore_t lock_buffer;
+} lorawan_arena_t;
+#endif
+
+// Response tags recognised at the start of a module output line
+typedef enum
+{
+  LORAWAN_TAG_NONE = 0, // Untagged line (e.g. CRSSI channel rows)
+  LORAWAN_TAG_OK,
+  LORAWAN_TAG_ERROR,
+  LORAWAN_TAG_SEND_OK,  // OK+SEND:<len>, uplink accepted
+  LORAWAN_TAG_SENT_OK,  // OK+SENT:<count>, uplink transmitted
+  LORAWAN_TAG_RECV,     // OK+RECV:<type>,<port>,<len>[,<data>]
+  LORAWAN_TAG_SEND_ERR, // ERR+SEND:<reason>
+  LORAWAN_TAG_SENT_ERR, // ERR+SENT:<count>
+  LORAWAN_TAG_CGMI,
+  LORAWAN_TAG_CSTATUS,
+  LORAWAN_TAG_CDATARATE,
+  LORAWAN_TAG_CTXP,
+  LORAWAN_TAG_CRSSI,
+  LORAWAN_TAG_CLINKCHECK,
+  LORAWAN_TAG_DTRX,
+  LORAWAN_TAG_CJOIN,
+  LORAWAN_TAG_CDEVEUI,
+  LORAWAN_TAG_CAPPEUI,
+  LORAWAN_TAG_CAPPKEY,
+  LORAWAN_TAG_CFREQBANDMASK,
+  LORAWAN_TAG_CULDLMODE,
+  LORAWAN_TAG_CCLASS,
+  LORAWAN_TAG_CWORKMODE,
+  LORAWAN_TAG_CADR,
+  LORAWAN_TAG_CJOINMODE,
+  LORAWAN_TAG_CDEVADDR,
+  LORAWAN_TAG_CAPPSKEY,
+  LORAWAN_TAG_CNWKSKEY,
+  LORAWAN_TAG_COUNT
+} lorawan_tag_t;
+
+#define LORAWAN_TAG_BIT( tag ) ( 1UL << ( tag ) )
+
+#define LORAWAN_TAGS_SUCCESS                                                   \
+  ( LORAWAN_TAG_BIT( LORAWAN_TAG_OK ) | LORAWAN_TAG_BIT( LORAWAN_TAG_SEND_OK ) | \
+    LORAWAN_TAG_BIT( LORAWAN_TAG_SENT_OK ) | LORAWAN_TAG_BIT( LORAWAN_TAG_RECV ) )
+#define LORAWAN_TAGS_FAILURE                                                   \
+  ( LORAWAN_TAG_BIT( LORAWAN_TAG_ERROR ) |                                     \
+    LORAWAN_TAG_BIT( LORAWAN_TAG_SEND_ERR ) |                                  \
+    LORAWAN_TAG_BIT( LORAWAN_TAG_SENT_ERR ) )
+// Tags that carry a value worth handing to the caller
+#define LORAWAN_TAGS_DATA                                                      \
+  ( ~( LORAWAN_TAG_BIT( LORAWAN_TAG_NONE ) | LORAWAN_TAG_BIT( LORAWAN_TAG_OK ) | \
+       LORAWAN_TAG_BIT( LORAWAN_TAG_ERROR ) ) &                                \
+    ( LORAWAN_TAG_BIT( LORAWAN_TAG_COUNT ) - 1 ) )
+// A command is finished at its result code unless the caller says otherwise
+#define LORAWAN_TAGS_FINAL_DEFAULT ( LORAWAN_TAGS_SUCCESS | LORAWAN_TAGS_FAILURE )
+
+#define UNIT_LORAWAN_MAX_FIELDS 6
+
+typedef struct
+{
+  const char *prefix;
+  uint8_t prefix_len;
+  lorawan_tag_t tag;
+  uint8_t base; // Radix of the numeric fields that follow the prefix
+} lorawan_tag_entry_t;
+
+#define LORAWAN_TAG_ENTRY( prefix, tag, base )                                 \
+  {                                                                            \
+    prefix, sizeof( prefix ) - 1, tag, base                                    \
+  }
+
+// A prefix only matches when followed by a separator, so "OK" never matches
+// "OK+SEND" and "+CJOIN" never matches "+CJOINMODE"
+static const lorawan_tag_entry_t _unit_lorawan_tag_table[] = {
+    LORAWAN_TAG_ENTRY( "OK", LORAWAN_TAG_OK, 10 ),
+    LORAWAN_TAG_ENTRY( "OK+SEND", LORAWAN_TAG_SEND_OK, 10 ),
+    LORAWAN_TAG_ENTRY( "OK+SENT", LORAWAN_TAG_SENT_OK, 10 ),
+    LORAWAN_TAG_ENTRY( "OK+RECV", LORAWAN_TAG_RECV, 16 ),
+    LORAWAN_TAG_ENTRY( "ERROR", LORAWAN_TAG_ERROR, 10 ),
+    LORAWAN_TAG_ENTRY( "ERR+SEND", LORAWAN_TAG_SEND_ERR, 10 ),
+    LORAWAN_TAG_ENTRY( "ERR+SENT", LORAWAN_TAG_SENT_ERR, 10 ),
+    LORAWAN_TAG_ENTRY( "+CME ERROR", LORAWAN_TAG_ERROR, 10 ),
+    LORAWAN_TAG_ENTRY( "+CGMI", LORAWAN_TAG_CGMI, 10 ),
+    LORAWAN_TAG_ENTRY( "+CSTATUS", LORAWAN_TAG_CSTATUS, 10 ),
+    LORAWAN_TAG_ENTRY( "+CDATARATE", LORAWAN_TAG_CDATARATE, 10 ),
+    LORAWAN_TAG_ENTRY( "+CTXP", LORAWAN_TAG_CTXP, 10 ),
+    LORAWAN_TAG_ENTRY( "+CRSSI", LORAWAN_TAG_CRSSI, 10 ),
+    LORAWAN_TAG_ENTRY( "+CLINKCHECK", LORAWAN_TAG_CLINKCHECK, 10 ),
+    LORAWAN_TAG_ENTRY( "+DTRX", LORAWAN_TAG_DTRX, 10 ),
+    LORAWAN_TAG_ENTRY( "+CJOIN", LORAWAN_TAG_CJOIN, 10 ),
+    LORAWAN_TAG_ENTRY( "+CDEVEUI", LORAWAN_TAG_CDEVEUI, 16 ),
+    LORAWAN_TAG_ENTRY( "+CAPPEUI", LORAWAN_TAG_CAPPEUI, 16 ),
+    LORAWAN_TAG_ENTRY( "+CAPPKEY", LORAWAN_TAG_CAPPKEY, 16 ),
+    LORAWAN_TAG_ENTRY( "+CFREQBANDMASK", LORAWAN_TAG_CFREQBANDMASK, 16 ),
+    LORAWAN_TAG_ENTRY( "+CULDLMODE", LORAWAN_TAG_CULDLMODE, 10 ),
+    LORAWAN_TAG_ENTRY( "+CCLASS", LORAWAN_TAG_CCLASS, 10 ),
+    LORAWAN_TAG_ENTRY( "+CWORKMODE", LORAWAN_TAG_CWORKMODE, 10 ),
+    LORAWAN_TAG_ENTRY( "+CADR", LORAWAN_TAG_CADR, 10 ),
+    LORAWAN_TAG_ENTRY( "+CJOINMODE", LORAWAN_TAG_CJOINMODE, 10 ),
+    LORAWAN_TAG_ENTRY( "+CDEVADDR", LORAWAN_TAG_CDEVADDR, 16 ),
+    LORAWAN_TAG_ENTRY( "+CAPPSKEY", LORAWAN_TAG_CAPPSKEY, 16 ),
+    LORAWAN_TAG_ENTRY( "+CNWKSKEY", LORAWAN_TAG_CNWKSKEY, 16 ),
+};
+
+// One classified output line
+typedef struct
+{
+  lorawan_tag_t tag;
+  const char *value; // Text after the tag, NULL if the line was not kept
+  int32_t fields[ UNIT_LORAWAN_MAX_FIELDS ];
+  uint8_t field_count;
+} lorawan_line_t;
+
+// Consumes the lines of a response as they arrive, so a long multi-line
+// answer never has to fit the capture buffer. Runs in the RX task with the
+// receive lock held and must not block. Returns false to keep the line in
+// the capture buffer instead.
+typedef struct
+{
+  bool ( *consume )( const lorawan_line_t *line, void *ctx );
+  void *ctx;
+} lorawan_line_sink_t;
+
+// Receive path state shared between the RX task and the command issuer
+typedef struct
+{
+  TaskHandle_t task;
+  SemaphoreHandle_t lock;
+  SemaphoreHandle_t line_ready; // Given for every line added to the capture
+  char *capture;                // Response buffer of the command in flight
+  size_t capture_size;
+  size_t capture_len;
+  bool complete;                // Final result code (OK/ERROR) received
+  uint32_t final_tags;          // Tags that end the command, 0 for default
+  const lorawan_line_sink_t *sink; // Takes captured lines first, may be NULL
+  uint32_t tags;                // LORAWAN_TAG_BIT() of every captured line
+  lorawan_line_t result;        // First captured line carrying data
+  lorawan_line_t error;         // First captured failure line
+  char line[ UNIT_LORAWAN_LINE_BUFFER_SIZE ];
+  size_t line_len;
+  uint8_t chunk[ UNIT_LORAWAN_RESPONSE_BUFFER_SIZE ]; // RX task read buffer
+} lorawan_rx_t;
+
+// Queued uplink waiting for the TX worker
+typedef struct
+{
+  size_t length;
+  unit_lorawan_tx_opts_t opts;
+  bool packed; // Length-prefixed records that may be split on a DR drop
+  bool drain;  // Records read from the spool, which still holds them
+  TickType_t queued; // Tick the request entered the TX queue
+  unit_lorawan_tx_callback_t callback;
+  void *user_data;
+  uint8_t payload[ UNIT_LORAWAN_REGION_MAX_PAYLOAD ];
+} lorawan_tx_request_t;
+
+// Options used by unit_lorawan_send() and unit_lorawan_send_async()
+static const unit_lorawan_tx_opts_t _unit_lorawan_default_tx_opts = {
+    .confirmed = true,
+    .port = 0,
+    .retries = UNIT_LORAWAN_TX_RETRIES_DEFAULT,
+};
+
+typedef struct
+{
+  TaskHandle_t task;
+  QueueHandle_t queue;
+  lorawan_tx_request_t request; // Being sent, too large for the task stack
+} lorawan_tx_t;
+
+// Records collected into one length-prefixed frame ahead of the TX queue
+typedef struct
+{
+  SemaphoreHandle_t lock;
+  StaticSemaphore_t lock_buffer;
+  uint32_t max_delay_ms;
+  unit_lorawan_tx_opts_t opts;
+  unit_lorawan_tx_callback_t callback;
+  void *user_data;
+  TickType_t flush_at;
+  size_t length;
+  uint8_t frame[ UNIT_LORAWAN_REGION_MAX_PAYLOAD ];
+} lorawan_aggregator_t;
+
+// Module state mirrored on the host so the send path needs no queries
+typedef struct
+{
+  portMUX_TYPE lock;
+  bool data_rate_valid;
+  uint8_t data_rate;
+  size_t max_payload;
+  bool tx_power_valid;
+  uint8_t tx_power;
+  bool joined;
+  bool adr_enabled;
+  bool port_valid;
+  uint8_t port;
+  uint32_t uplinks;       // Uplinks the module accepted (OK+SEND)
+  uint32_t transmissions; // Transmissions reported by OK+SENT and ERR+SENT
+} lorawan_session_t;
+
+// Uplink airtime credit per sub-band, refilled linearly over the fair use
+// window so it never exceeds the budget
+typedef struct
+{
+  portMUX_TYPE lock;
+  uint8_t sub_band;
+  uint32_t pending_us; // One transmission of the uplink awaiting OK+SENT
+  int64_t credit_us[ LORAWAN_REGION_SUB_BANDS ];
+  TickType_t refilled[ LORAWAN_REGION_SUB_BANDS ];
+} lorawan_airtime_t;
+
+// Largest downlink the module can report (LEN is one byte)
+#define UNIT_LORAWAN_DOWNLINK_MAX_SIZE 255
+
+// OK+RECV TYPE bit set when the downlink carried a link check answer
+#define UNIT_LORAWAN_RECV_TYPE_CONFIRMED  0x01
+#define UNIT_LORAWAN_RECV_TYPE_LINK_CHECK 0x04
+
+// Handlers registered for unsolicited result codes
+typedef struct
+{
+  portMUX_TYPE lock;
+  unit_lorawan_downlink_callback_t downlink_callback;
+  void *downlink_user_data;
+  unit_lorawan_event_callback_t event_callback;
+  void *event_user_data;
+  uint8_t downlink[ UNIT_LORAWAN_DOWNLINK_MAX_SIZE ]; // RX task only
+} lorawan_urc_t;
+
+// Installation margin and step of the ADR hint, both from the Semtech ADR
+// algorithm networks run
+#define UNIT_LORAWAN_ADR_HINT_MARGIN_DB 10
+#define UNIT_LORAWAN_ADR_HINT_STEP_DB   3
+#define UNIT_LORAWAN_TX_POWER_INDEX_MAX 7
+
+// One +CLINKCHECK report
+typedef struct
+{
+  TickType_t at;
+  bool answered;
+  uint8_t margin;
+  uint8_t gateways;
+  int16_t rssi;
+  int8_t snr;
+} lorawan_link_sample_t;
+
+// Recent link check reports, written by the RX task
+typedef struct
+{
+  portMUX_TYPE lock;
+  lorawan_link_sample_t samples[ UNIT_LORAWAN_LINK_HISTORY ];
+  uint8_t head; // Next slot to write
+  uint8_t count;
+} lorawan_link_t;
+
+// A confirmed DTRX is finished once the ACK arrives or the module gives up
+#define LORAWAN_TAGS_FINAL_DTRX                                                \
+  ( LORAWAN_TAG_BIT( LORAWAN_TAG_RECV ) | LORAWAN_TAGS_FAILURE )
+// Unconfirmed uplinks expect no OK+RECV, so they finish once transmitted
+#define LORAWAN_TAGS_FINAL_DTRX_UNCONFIRMED                                    \
+  ( LORAWAN_TAG_BIT( LORAWAN_TAG_SENT_OK ) | LORAWAN_TAGS_FAILURE )
+// Once the module took an uplink it may be on the air, whatever follows
+#define LORAWAN_TAGS_ON_AIR                                                    \
+  ( LORAWAN_TAG_BIT( LORAWAN_TAG_SEND_OK ) |                                   \
+    LORAWAN_TAG_BIT( LORAWAN_TAG_SENT_OK ) )
+
 // Enhanced response parsing structure
 typedef struct
 {
@@ -69,1423 +558,7302 @@ typedef struct
   char *response_data;
   size_t data_length;
   char error_code[ 16 ];
+  uint32_t tags;         // LORAWAN_TAG_BIT() of every line in the response
+  lorawan_line_t result; // First data line, value points into response_data
 } lorawan_response_t;
 
-static esp_err_t _unit_lorawan_send_at_command( const char *cmd,
-                                                lorawan_response_t *response,
-                                                uint32_t timeout_ms );
-static esp_err_t
-_unit_lorawan_parse_response( const char *raw_response, size_t response_len,
-                              lorawan_response_t *parsed_response );
-static esp_err_t _unit_lorawan_wait_for_response( char *buffer,
-                                                  size_t buffer_size,
-                                                  size_t *received_len,
-                                                  uint32_t timeout_ms );
-static esp_err_t _unit_lorawan_validate_payload_size( size_t payload_size,
-                                                      uint8_t data_rate );
-static void _unit_lorawan_cleanup_response( lorawan_response_t *response );
-static const char *
-_unit_lorawan_get_connection_status_description( const char *status_code );
+// Age limit of an uplink, counted from when it was handed to the driver
+typedef struct
+{
+  TickType_t start;
+  uint32_t max_age_ms; // 0 never expires
+  bool expired;        // Set when the driver dropped the uplink unsent
+} lorawan_deadline_t;
+
+// One AT exchange handed to the driver task. Lives on the caller's stack
+// until the driver gives done.
+typedef struct
+{
+  const char *cmd;              // Command as given, for logging
+  const char *at_cmd;           // Framed "AT+<cmd>\r\n" line
+  char *response_buffer;        // Capture buffer owned by the caller
+  size_t response_size;
+  lorawan_response_t *response; // Parsed result, may be NULL
+  uint32_t timeout_ms;
+  uint32_t final_tags;
+  const lorawan_line_sink_t *sink; // Streams lines to the caller, may be NULL
+  uint8_t attempts;
+  lorawan_deadline_t *deadline; // Bulk lane only, may be NULL
+  uint8_t port; // FPort selected in the same driver turn, 0 keeps it
+  SemaphoreHandle_t done;
+  esp_err_t result;
+} lorawan_command_t;
+
+// Driver task that owns the UART and runs one exchange at a time. Commands
+// answered within UNIT_LORAWAN_RESPONSE_TIMEOUT_MS take the interactive lane,
+// a single slot checked before the queue. Radio-bound ones such as DTRX and
+// CJOIN take the bulk lane, the queue.
+typedef struct
+{
+  TaskHandle_t task;
+  QueueHandle_t queue; // Bulk lane: lorawan_command_t pointers, NULL wakes
+  portMUX_TYPE lock;
+  lorawan_command_t *urgent; // Interactive lane, withdrawn on timeout
+  SemaphoreHandle_t urgent_lock; // One interactive caller at a time
+  StaticSemaphore_t urgent_lock_buffer;
+} lorawan_driver_t;
+
+// Join outcome bits set from the +CJOIN URC
+#define LORAWAN_JOIN_ACCEPTED_BIT ( 1 << 0 )
+#define LORAWAN_JOIN_FAILED_BIT   ( 1 << 1 )
+
+// Join watch run by the driver task on behalf of configure_ttn_us915()
+typedef struct
+{
+  portMUX_TYPE lock;
+  EventGroupHandle_t events;
+  bool active;
+  unit_lorawan_ttn_join_callback_t callback;
+  void *user_data;
+  TickType_t started;
+  TickType_t deadline;
+  bool retry_pending;
+  TickType_t retry_at;
+  uint32_t backoff_ms;
+} lorawan_join_t;
+
+// Link power state run by the driver task. The link goes idle once no
+// exchange has run for UNIT_LORAWAN_LOW_POWER_IDLE_MS: the PM lock is
+// released and, with low power enabled, the module is sent AT+CLPM=1.
+typedef struct
+{
+  portMUX_TYPE lock;
+  bool low_power;    // unit_lorawan_set_low_power() asked for AT+CLPM=1
+  bool enter;        // Send AT+CLPM=1 now instead of at the idle timeout
+  bool asleep;       // Module needs the wake sequence before a command
+  bool idle;         // PM lock released, nothing expected from the module
+  TickType_t active; // Last exchange finished
+#ifdef CONFIG_PM_ENABLE
+  esp_pm_lock_handle_t pm_lock;
+#endif
+} lorawan_power_t;
+
+#ifdef CONFIG_LORAWAN_SURVEY
+// Noise floor history per US915 channel, written by the driver task. Only
+// complete scans are kept, so a sub-band's channels share one ring position.
+// Readings are stored as -dBm to fit a byte.
+typedef struct
+{
+  portMUX_TYPE lock;
+  bool enabled;
+  unit_lorawan_survey_config_t config;
+  TickType_t next_at;
+  uint8_t next_sub_band; // Scanned next, 1-8
+  uint8_t recommended;   // Last recommendation logged, 0 for none
+  uint8_t noise[ UNIT_LORAWAN_US915_SUB_BAND_MAX ]
+               [ UNIT_LORAWAN_CRSSI_CHANNELS ][ UNIT_LORAWAN_SURVEY_HISTORY ];
+  uint8_t head[ UNIT_LORAWAN_US915_SUB_BAND_MAX ];  // Ring slot written next
+  uint8_t count[ UNIT_LORAWAN_US915_SUB_BAND_MAX ]; // Scans in the ring
+  TickType_t scanned_at[ UNIT_LORAWAN_US915_SUB_BAND_MAX ];
+} lorawan_survey_t;
+#endif
+
+#ifdef CONFIG_LORAWAN_SPOOL
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL( 5, 0, 0 )
+typedef esp_partition_mmap_handle_t lorawan_spool_map_t;
+#define LORAWAN_SPOOL_MMAP_DATA ESP_PARTITION_MMAP_DATA
+#else
+typedef spi_flash_mmap_handle_t lorawan_spool_map_t;
+#define LORAWAN_SPOOL_MMAP_DATA SPI_FLASH_MMAP_DATA
+#endif
+
+// Header of one spooled uplink, followed by its payload and padded to a
+// word. Erased flash reads 0xFF, so an unwritten slot never has the magic.
+typedef struct
+{
+  uint8_t magic;
+  uint8_t state; // UNIT_LORAWAN_SPOOL_PENDING or _DELIVERED
+  uint8_t length;
+  uint8_t port;      // FPort of the uplink, 0 for the module's current one
+  uint32_t sequence; // Increases by one per record, orders them on mount
+} lorawan_spool_record_t;
+
+// Positions in the spool ring. The lock covers flash writes, so it is a
+// mutex rather than a spinlock.
+typedef struct
+{
+  SemaphoreHandle_t lock;
+  StaticSemaphore_t lock_buffer;
+  const esp_partition_t *partition;
+  const uint8_t *map; // Partition mapped for reads, NULL until mounted
+  lorawan_spool_map_t map_handle;
+  uint32_t head;     // Offset the next record is written at
+  uint32_t tail;     // Offset of the oldest pending record
+  uint32_t sequence; // Of the next record
+  uint32_t pending;
+  uint32_t dropped; // Overwritten undelivered since init
+  bool draining;    // A drain frame is in the TX queue
+  uint32_t drain_last; // Sequence of the last record in that frame
+  TickType_t retry_at;
+} lorawan_spool_t;
+#endif
+
+// Datasheet wake-up sequence; a plain AT+CLPM=0 can be misread while the
+// module's UART is still starting
+static const uint8_t _unit_lorawan_wake_sequence[] = { 0x00, 0x00, 0x00,
+                                                       0x00, '\r', '\n' };
+
+#ifdef CONFIG_LORAWAN_STATS
+// Instrumentation counters, updated from the driver and RX tasks
+typedef struct
+{
+  portMUX_TYPE lock;
+  int64_t since_us;
+  unit_lorawan_stats_t stats;
+} lorawan_stats_t;
+#endif
+
+#ifdef CONFIG_LORAWAN_EVENT_LOG
+// Ring of binary event records, overwritten oldest first until read
+typedef struct
+{
+  portMUX_TYPE lock;
+  uint16_t head;  // Slot written next
+  uint16_t count; // Records not yet read
+  uint32_t lost;  // Overwritten unread since the last read
+  unit_lorawan_log_record_t records[ CONFIG_LORAWAN_EVENT_LOG_SIZE ];
+} lorawan_event_log_t;
+#endif
+
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+// Layout of the NVS blob; bump the version when it changes
+typedef struct
+{
+  uint8_t version;
+  uint8_t provisioned; // config_hash went into the module and was saved
+  uint8_t joined;
+  uint8_t data_rate_valid;
+  uint8_t data_rate;
+  uint8_t tx_power_valid;
+  uint8_t tx_power;
+  uint8_t adr_enabled;
+  uint32_t config_hash;
+  uint32_t uplinks;
+  uint32_t transmissions;
+} lorawan_stored_session_t;
+
+// What the store knows beyond the module mirror
+typedef struct
+{
+  portMUX_TYPE lock;
+  bool pending; // A save was requested from a task that must not write flash
+  bool provisioned;
+  uint32_t config_hash;
+  char key[ 16 ]; // NVS key of the blob, one per instance
+} lorawan_store_t;
+#endif
+
+// How long a command is expected to take to answer
+typedef enum
+{
+  LORAWAN_LATENCY_QUICK,  // Register reads, answered from RAM
+  LORAWAN_LATENCY_NORMAL, // Writes, may touch flash
+  LORAWAN_LATENCY_RADIO,  // Waits on the air, bounded by the caller only
+} lorawan_latency_class_t;
+
+// Retry and timeout policy for the commands that need one. Commands not
+// listed are idempotent and QUICK for reads or NORMAL for writes.
+typedef struct
+{
+  const char *name; // Command name without "AT+" or parameters
+  bool idempotent;  // Safe to send again if the answer was lost
+  lorawan_latency_class_t latency;
+} lorawan_command_policy_t;
+
+static const lorawan_command_policy_t _unit_lorawan_command_policies[] = {
+    { "AT", true, LORAWAN_LATENCY_QUICK },
+    { "DTRX", false, LORAWAN_LATENCY_RADIO },     // A resend is a new uplink
+    { "CJOIN", false, LORAWAN_LATENCY_NORMAL },   // Restarts the join
+    { "IREBOOT", false, LORAWAN_LATENCY_NORMAL }, // Would reset again
+    { "CRESTORE", false, LORAWAN_LATENCY_NORMAL },
+    { "CLINKCHECK", true, LORAWAN_LATENCY_RADIO }, // Answer follows an uplink
+    { "CRSSI", true, LORAWAN_LATENCY_RADIO },      // Channel scan
+    { NULL, true, LORAWAN_LATENCY_QUICK },         // Any other read
+    { NULL, true, LORAWAN_LATENCY_NORMAL },        // Any other write
+};
+
+#define LORAWAN_COMMAND_POLICY_COUNT                                           \
+  ( sizeof( _unit_lorawan_command_policies ) /                                 \
+    sizeof( _unit_lorawan_command_policies[ 0 ] ) )
+
+// Smoothed answer latency per policy, updated by the driver task only
+typedef struct
+{
+  uint32_t srtt_us;   // Smoothed latency
+  uint32_t rttvar_us; // Smoothed mean deviation
+  uint8_t samples;
+} lorawan_latency_t;
+
+// Everything one module needs: its transport, the tasks that drive it and
+// the host-side mirror of its state. unit_lorawan_handle_t points to one.
+struct unit_lorawan_s
+{
+  const char *tag; // Log tag
+  uint8_t index;   // 0 for the default instance
+  char name[ 16 ]; // Backs tag for created instances
+  unit_lorawan_transport_t transport;
+  uint32_t baud; // Rate the transport was opened or last switched at
+  uint8_t log_level; // Last unit_lorawan_log() level, gates path text
+  lorawan_rx_t rx;
+  lorawan_tx_t tx;
+  lorawan_aggregator_t aggregator;
+  lorawan_session_t session;
+  lorawan_airtime_t airtime;
+  lorawan_urc_t urc;
+  lorawan_link_t link;
+  lorawan_driver_t driver;
+  lorawan_join_t join;
+  lorawan_power_t power;
+  lorawan_latency_t latency[ LORAWAN_COMMAND_POLICY_COUNT ];
+#ifdef CONFIG_LORAWAN_STATS
+  lorawan_stats_t stats;
+#endif
+#ifdef CONFIG_LORAWAN_EVENT_LOG
+  lorawan_event_log_t events;
+#endif
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+  lorawan_store_t store;
+#endif
+#ifdef CONFIG_LORAWAN_SURVEY
+  lorawan_survey_t survey;
+#endif
+#ifdef CONFIG_LORAWAN_SPOOL
+  lorawan_spool_t spool;
+#endif
+#ifdef CONFIG_LORAWAN_STATIC_BUFFERS
+  lorawan_arena_t arenas[ LORAWAN_ARENA_COUNT ];
+#endif
+};
+
+typedef struct unit_lorawan_s lorawan_instance_t;
+
+#define LORAWAN_CHECK_HANDLE( handle )                                         \
+  do                                                                           \
+  {                                                                            \
+    if( !( handle ) )                                                          \
+    {                                                                          \
+      ESP_LOGE( _TAG, "✗ NULL unit_lorawan_handle_t" );                        \
+      return ESP_ERR_INVALID_ARG;                                              \
+    }                                                                          \
+  } while( 0 )
+
+#ifdef CONFIG_LORAWAN_STATS
+#define LORAWAN_INSTANCE_STATS_INITIALIZER                                     \
+  .stats = { .lock = portMUX_INITIALIZER_UNLOCKED },
+#else
+#define LORAWAN_INSTANCE_STATS_INITIALIZER
+#endif
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+#define LORAWAN_INSTANCE_STORE_INITIALIZER                                     \
+  .store = { .lock = portMUX_INITIALIZER_UNLOCKED,                             \
+             .key = UNIT_LORAWAN_NVS_SESSION_KEY },
+#else
+#define LORAWAN_INSTANCE_STORE_INITIALIZER
+#endif
+#ifdef CONFIG_LORAWAN_SURVEY
+#define LORAWAN_INSTANCE_SURVEY_INITIALIZER                                    \
+  .survey = { .lock = portMUX_INITIALIZER_UNLOCKED, .next_sub_band = 1 },
+#else
+#define LORAWAN_INSTANCE_SURVEY_INITIALIZER
+#endif
+#ifdef CONFIG_LORAWAN_EVENT_LOG
+#define LORAWAN_INSTANCE_EVENT_LOG_INITIALIZER                                 \
+  .events = { .lock = portMUX_INITIALIZER_UNLOCKED },
+#else
+#define LORAWAN_INSTANCE_EVENT_LOG_INITIALIZER
+#endif
+
+// Power-on state of an instance, before unit_lorawan_init_h()
+#define LORAWAN_INSTANCE_INITIALIZER( instance_tag, instance_transport )       \
+  {                                                                            \
+    .tag = ( instance_tag ), .transport = instance_transport,                  \
+    .log_level = UNIT_LORAWAN_LOG_LEVEL_MAX,                                   \
+    .aggregator =                                                              \
+        {                                                                      \
+            .max_delay_ms = UNIT_LORAWAN_AGGREGATE_MAX_DELAY_DEFAULT_MS,       \
+            .opts = { .confirmed = true,                                       \
+                      .port = 0,                                               \
+                      .retries = UNIT_LORAWAN_TX_RETRIES_DEFAULT },            \
+        },                                                                     \
+    .session =                                                                 \
+        {                                                                      \
+            .lock = portMUX_INITIALIZER_UNLOCKED,                              \
+            .adr_enabled = true, /* Module factory default */                  \
+        },                                                                     \
+    .airtime =                                                                 \
+        {                                                                      \
+            .lock = portMUX_INITIALIZER_UNLOCKED,                              \
+            .sub_band = UNIT_LORAWAN_TTN_US915_SUB_BAND_DEFAULT,               \
+        },                                                                     \
+    .urc = { .lock = portMUX_INITIALIZER_UNLOCKED },                           \
+    .link = { .lock = portMUX_INITIALIZER_UNLOCKED },                          \
+    .driver = { .lock = portMUX_INITIALIZER_UNLOCKED },                        \
+    .join = { .lock = portMUX_INITIALIZER_UNLOCKED },                          \
+    .power = { .lock = portMUX_INITIALIZER_UNLOCKED },                         \
+    LORAWAN_INSTANCE_STATS_INITIALIZER LORAWAN_INSTANCE_STORE_INITIALIZER      \
+        LORAWAN_INSTANCE_SURVEY_INITIALIZER                                    \
+            LORAWAN_INSTANCE_EVENT_LOG_INITIALIZER                             \
+  }
+
+// Text on the per-command and per-uplink path. Compiled in with
+// CONFIG_LORAWAN_VERBOSE_LOG and printed while the unit_lorawan_log() level
+// allows it: info from level 1, debug from level 3. Errors and warnings
+// always use ESP_LOGE/ESP_LOGW.
+#ifdef CONFIG_LORAWAN_VERBOSE_LOG
+#define LORAWAN_PATH_LOGI( lw, format, ... )                                   \
+  do                                                                           \
+  {                                                                            \
+    if( ( lw )->log_level >= 1 )                                               \
+    {                                                                          \
+      ESP_LOGI( ( lw )->tag, format, ##__VA_ARGS__ );                          \
+    }                                                                          \
+  } while( 0 )
+#define LORAWAN_PATH_LOGD( lw, format, ... )                                   \
+  do                                                                           \
+  {                                                                            \
+    if( ( lw )->log_level >= 3 )                                               \
+    {                                                                          \
+      ESP_LOGD( ( lw )->tag, format, ##__VA_ARGS__ );                          \
+    }                                                                          \
+  } while( 0 )
+#else
+#define LORAWAN_PATH_LOGI( lw, format, ... )                                   \
+  do                                                                           \
+  {                                                                            \
+  } while( 0 )
+#define LORAWAN_PATH_LOGD( lw, format, ... )                                   \
+  do                                                                           \
+  {                                                                            \
+  } while( 0 )
+#endif
+
+#if defined( CONFIG_LORAWAN_STATS ) || defined( CONFIG_LORAWAN_EVENT_LOG )
+static unit_lorawan_stats_command_t _unit_lorawan_stats_class( const char *cmd )
+{
+  if( strcmp( cmd, "AT" ) == 0 )
+  {
+    return UNIT_LORAWAN_STATS_COMMAND_PROBE;
+  }
+  if( strncmp( cmd, "DTRX", 4 ) == 0 )
+  {
+    return UNIT_LORAWAN_STATS_COMMAND_UPLINK;
+  }
+  if( strncmp( cmd, "CJOIN", 5 ) == 0 )
+  {
+    return UNIT_LORAWAN_STATS_COMMAND_JOIN;
+  }
+  if( strchr( cmd, '?' ) )
+  {
+    return UNIT_LORAWAN_STATS_COMMAND_QUERY;
+  }
+  return UNIT_LORAWAN_STATS_COMMAND_SET;
+}
+#endif
+
+#ifdef CONFIG_LORAWAN_STATS
+// Log2 of the latency in milliseconds, with the last bucket open-ended
+static uint8_t _unit_lorawan_stats_bucket( int64_t latency_us )
+{
+  int64_t ms = latency_us / 1000;
+  uint8_t bucket = 0;
+  while( ms > 1 && bucket < UNIT_LORAWAN_STATS_LATENCY_BUCKETS - 1 )
+  {
+    ms >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+static void _unit_lorawan_stats_reset( lorawan_instance_t *lw )
+{
+  portENTER_CRITICAL( &lw->stats.lock );
+  memset( &lw->stats.stats, 0, sizeof( lw->stats.stats ) );
+  lw->stats.since_us = esp_timer_get_time();
+  portEXIT_CRITICAL( &lw->stats.lock );
+}
+
+static void _unit_lorawan_stats_uart( lorawan_instance_t *lw, size_t tx_bytes,
+                                      size_t rx_bytes )
+{
+  portENTER_CRITICAL( &lw->stats.lock );
+  lw->stats.stats.uart_tx_bytes += tx_bytes;
+  lw->stats.stats.uart_rx_bytes += rx_bytes;
+  portEXIT_CRITICAL( &lw->stats.lock );
+}
+
+#ifndef CONFIG_LORAWAN_STATIC_BUFFERS
+static void _unit_lorawan_stats_allocation( lorawan_instance_t *lw )
+{
+  portENTER_CRITICAL( &lw->stats.lock );
+  lw->stats.stats.allocations++;
+  portEXIT_CRITICAL( &lw->stats.lock );
+}
+#endif
+
+static void _unit_lorawan_stats_urc( lorawan_instance_t *lw )
+{
+  portENTER_CRITICAL( &lw->stats.lock );
+  lw->stats.stats.urcs++;
+  portEXIT_CRITICAL( &lw->stats.lock );
+}
+
+// Records one attempt of a command. Latency counts only when the module
+// answered, accepted is set when that answer was not an error.
+static void _unit_lorawan_stats_attempt( lorawan_instance_t *lw,
+                                         const char *cmd, int retry,
+                                         esp_err_t err, bool answered,
+                                         bool accepted, int64_t started_us )
+{
+  int64_t latency_us = esp_timer_get_time() - started_us;
+  unit_lorawan_command_stats_t *stats =
+      &lw->stats.stats.commands[ _unit_lorawan_stats_class( cmd ) ];
+
+  portENTER_CRITICAL( &lw->stats.lock );
+  stats->sent++;
+  if( retry > 0 )
+  {
+    stats->retries++;
+  }
+  if( err == ESP_ERR_TIMEOUT )
+  {
+    stats->timeout++;
+  }
+  else if( err == ESP_OK && accepted )
+  {
+    stats->ok++;
+  }
+  else
+  {
+    stats->error++;
+  }
+  if( answered )
+  {
+    stats->latency_total_us += latency_us;
+    if( latency_us > stats->latency_max_us )
+    {
+      stats->latency_max_us = latency_us;
+    }
+    stats->latency_histogram[ _unit_lorawan_stats_bucket( latency_us ) ]++;
+  }
+  portEXIT_CRITICAL( &lw->stats.lock );
+}
+#endif
+
+#ifdef CONFIG_LORAWAN_EVENT_LOG
+// Appends one record, overwriting the oldest unread one when full. Cheap
+// enough for every command attempt: no formatting and no console output.
+static void _unit_lorawan_event_log( lorawan_instance_t *lw,
+                                     unit_lorawan_log_event_t event,
+                                     uint8_t command, uint8_t detail,
+                                     esp_err_t err, uint32_t duration_ms )
+{
+  unit_lorawan_log_record_t record = {
+      .timestamp_ms = (uint32_t)( esp_timer_get_time() / 1000 ),
+      .duration_ms = duration_ms > UINT16_MAX ? UINT16_MAX : duration_ms,
+      .error = (int16_t)err,
+      .event = event,
+      .command = command,
+      .detail = detail,
+  };
+
+  lorawan_event_log_t *log = &lw->events;
+  portENTER_CRITICAL( &log->lock );
+  log->records[ log->head ] = record;
+  log->head = ( log->head + 1 ) % CONFIG_LORAWAN_EVENT_LOG_SIZE;
+  if( log->count < CONFIG_LORAWAN_EVENT_LOG_SIZE )
+  {
+    log->count++;
+  }
+  else
+  {
+    log->lost++;
+  }
+  portEXIT_CRITICAL( &log->lock );
+}
+
+static void _unit_lorawan_event_log_command( lorawan_instance_t *lw,
+                                             const char *cmd, int retry,
+                                             esp_err_t err, int64_t started_us )
+{
+  _unit_lorawan_event_log(
+      lw, UNIT_LORAWAN_LOG_EVENT_COMMAND, _unit_lorawan_stats_class( cmd ),
+      retry > UINT8_MAX ? UINT8_MAX : retry, err,
+      ( esp_timer_get_time() - started_us ) / 1000 );
+}
+
+static void _unit_lorawan_event_log_uplink( lorawan_instance_t *lw,
+                                            unit_lorawan_tx_status_t status,
+                                            esp_err_t err, TickType_t started )
+{
+  _unit_lorawan_event_log( lw, UNIT_LORAWAN_LOG_EVENT_UPLINK,
+                           UNIT_LORAWAN_STATS_COMMAND_UPLINK, status, err,
+                           pdTICKS_TO_MS( xTaskGetTickCount() - started ) );
+}
+#endif
+
+// Port C UART of the Core2 for AWS, the default transport
+static esp_err_t _unit_lorawan_bsp_begin( uint32_t baud, void *ctx )
+{
+  return core2foraws_expports_uart_begin( baud );
+}
+
+static esp_err_t _unit_lorawan_bsp_write( const char *data, size_t length,
+                                          size_t *written, void *ctx )
+{
+  return core2foraws_expports_uart_write( data, length, written );
+}
+
+// The BSP copies whatever its driver buffered, which the RX chunk is sized
+// for, so size only bounds other transports
+static esp_err_t _unit_lorawan_bsp_read( uint8_t *buffer, size_t size,
+                                         size_t *read, void *ctx )
+{
+  return core2foraws_expports_uart_read( buffer, read );
+}
+
+static esp_err_t _unit_lorawan_bsp_flush( bool *flushed, void *ctx )
+{
+  return core2foraws_expports_uart_read_flush( flushed );
+}
+
+#define LORAWAN_BSP_TRANSPORT                                                  \
+  {                                                                            \
+    .begin = _unit_lorawan_bsp_begin, .write = _unit_lorawan_bsp_write,        \
+    .read = _unit_lorawan_bsp_read, .flush = _unit_lorawan_bsp_flush,          \
+  }
+
+#ifdef CONFIG_LORAWAN_UART_TRANSPORT
+// ESP-IDF UART driver, which frames lines in its ISR so the receive task
+// sleeps until the module finishes one
+#define UNIT_LORAWAN_UART_EVENT_QUEUE_LENGTH   16
+#define UNIT_LORAWAN_UART_PATTERN_QUEUE_LENGTH 16
+#define UNIT_LORAWAN_UART_PATTERN_CHR_TOUT     9 // Baud cycles between chars
+#define UNIT_LORAWAN_UART_MIN_RX_BUFFER_SIZE   128 // Hardware FIFO
+
+typedef struct
+{
+  unit_lorawan_uart_config_t config;
+  QueueHandle_t events; // NULL until begin installs the driver
+} lorawan_uart_t;
+
+static esp_err_t _unit_lorawan_uart_begin( uint32_t baud, void *ctx )
+{
+  lorawan_uart_t *uart = (lorawan_uart_t *)ctx;
+  uart_port_t port = uart->config.uart_num;
+  if( uart->events )
+  {
+    return uart_set_baudrate( port, baud );
+  }
+
+  esp_err_t err = uart_driver_install(
+      port, uart->config.rx_buffer_size, 0,
+      UNIT_LORAWAN_UART_EVENT_QUEUE_LENGTH, &uart->events, 0 );
+  if( err != ESP_OK )
+  {
+    uart->events = NULL;
+    return err;
+  }
+
+  uart_config_t uart_config = {
+      .baud_rate = baud,
+      .data_bits = UART_DATA_8_BITS,
+      .parity = UART_PARITY_DISABLE,
+      .stop_bits = UART_STOP_BITS_1,
+      .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL( 5, 0, 0 )
+      .source_clk = UART_SCLK_DEFAULT,
+#endif
+  };
+  err = uart_param_config( port, &uart_config );
+  if( err == ESP_OK )
+  {
+    err = uart_set_pin( port, uart->config.tx_pin, uart->config.rx_pin,
+                        UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE );
+  }
+  if( err == ESP_OK )
+  {
+    err = uart_enable_pattern_det_baud_intr(
+        port, '\n', 1, UNIT_LORAWAN_UART_PATTERN_CHR_TOUT, 0, 0 );
+  }
+  if( err == ESP_OK )
+  {
+    err = uart_pattern_queue_reset( port,
+                                    UNIT_LORAWAN_UART_PATTERN_QUEUE_LENGTH );
+  }
+  if( err != ESP_OK )
+  {
+    uart_driver_delete( port );
+    uart->events = NULL;
+  }
+  return err;
+}
+
+static esp_err_t _unit_lorawan_uart_write( const char *data, size_t length,
+                                           size_t *written, void *ctx )
+{
+  lorawan_uart_t *uart = (lorawan_uart_t *)ctx;
+  int sent = uart_write_bytes( uart->config.uart_num, data, length );
+  if( sent < 0 )
+  {
+    return ESP_FAIL;
+  }
+  *written = (size_t)sent;
+  return ESP_OK;
+}
+
+static esp_err_t _unit_lorawan_uart_read( uint8_t *buffer, size_t size,
+                                          size_t *read, void *ctx )
+{
+  lorawan_uart_t *uart = (lorawan_uart_t *)ctx;
+  size_t buffered = 0;
+  *read = 0;
+  esp_err_t err =
+      uart_get_buffered_data_len( uart->config.uart_num, &buffered );
+  if( err != ESP_OK || buffered == 0 )
+  {
+    return err;
+  }
+
+  int copied = uart_read_bytes( uart->config.uart_num, buffer,
+                                buffered < size ? buffered : size, 0 );
+  if( copied < 0 )
+  {
+    return ESP_FAIL;
+  }
+  *read = (size_t)copied;
+  return ESP_OK;
+}
+
+static esp_err_t _unit_lorawan_uart_flush( bool *flushed, void *ctx )
+{
+  lorawan_uart_t *uart = (lorawan_uart_t *)ctx;
+  esp_err_t err = uart_flush_input( uart->config.uart_num );
+  xQueueReset( uart->events );
+  uart_pattern_queue_reset( uart->config.uart_num,
+                            UNIT_LORAWAN_UART_PATTERN_QUEUE_LENGTH );
+  *flushed = err == ESP_OK;
+  return err;
+}
+
+// Returns once the ISR saw a '\n'. Partial lines stay buffered until their
+// terminator arrives, which is the only time the line framer can use them.
+static esp_err_t _unit_lorawan_uart_wait( uint32_t timeout_ms, void *ctx )
+{
+  lorawan_uart_t *uart = (lorawan_uart_t *)ctx;
+  TickType_t start = xTaskGetTickCount();
+  TickType_t timeout = pdMS_TO_TICKS( timeout_ms );
+  for( ;; )
+  {
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    uart_event_t event;
+    if( elapsed >= timeout ||
+        xQueueReceive( uart->events, &event, timeout - elapsed ) != pdTRUE )
+    {
+      return ESP_ERR_TIMEOUT;
+    }
+
+    switch( event.type )
+    {
+    case UART_PATTERN_DET:
+      // The read that follows consumes the line, drop its position
+      uart_pattern_pop_pos( uart->config.uart_num );
+      return ESP_OK;
+    case UART_FIFO_OVF:
+    case UART_BUFFER_FULL:
+      // Drain what arrived so the driver can take more
+      ESP_LOGW( _TAG, "⚠ UART %d RX overflow",
+                uart->config.uart_num );
+      return ESP_OK;
+    default:
+      break;
+    }
+  }
+}
+
+static esp_err_t _unit_lorawan_uart_set_baud( uint32_t baud, void *ctx )
+{
+  lorawan_uart_t *uart = (lorawan_uart_t *)ctx;
+  return uart_set_baudrate( uart->config.uart_num, baud );
+}
+
+#define LORAWAN_UART_TRANSPORT( uart_ctx )                                     \
+  {                                                                            \
+    .begin = _unit_lorawan_uart_begin, .write = _unit_lorawan_uart_write,      \
+    .read = _unit_lorawan_uart_read, .flush = _unit_lorawan_uart_flush,        \
+    .wait = _unit_lorawan_uart_wait, .set_baud = _unit_lorawan_uart_set_baud,  \
+    .ctx = ( uart_ctx ),                                                       \
+  }
+
+// Expansion port wiring from Kconfig for the default instance
+static lorawan_uart_t _unit_lorawan_uart_default = {
+    .config =
+        {
+            .uart_num = CONFIG_LORAWAN_UART_NUM,
+            .tx_pin = CONFIG_LORAWAN_UART_TX_GPIO,
+            .rx_pin = CONFIG_LORAWAN_UART_RX_GPIO,
+            .rx_buffer_size = CONFIG_LORAWAN_UART_RX_BUFFER_SIZE,
+        },
+};
+
+#define LORAWAN_DEFAULT_TRANSPORT                                              \
+  LORAWAN_UART_TRANSPORT( &_unit_lorawan_uart_default )
+#else
+#define LORAWAN_DEFAULT_TRANSPORT LORAWAN_BSP_TRANSPORT
+#endif
+
+static const unit_lorawan_transport_t _unit_lorawan_default_transport =
+    LORAWAN_DEFAULT_TRANSPORT;
+
+// Module on expansion port C, used by the handle-less API
+static lorawan_instance_t _unit_lorawan_default =
+    LORAWAN_INSTANCE_INITIALIZER( "UNIT_LORAWAN", LORAWAN_DEFAULT_TRANSPORT );
+
+// Copied into every instance made by unit_lorawan_create()
+static const lorawan_instance_t _unit_lorawan_instance_template =
+    LORAWAN_INSTANCE_INITIALIZER( NULL, LORAWAN_BSP_TRANSPORT );
+
+static portMUX_TYPE _unit_lorawan_instances_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t _unit_lorawan_instances = 1; // The default instance is 0
+
+static esp_err_t _unit_lorawan_send_at_command( lorawan_instance_t *lw,
+                                                const char *cmd,
+                                                lorawan_response_t *response,
+                                                uint32_t timeout_ms );
+static esp_err_t _unit_lorawan_send_at_command_until(
+    lorawan_instance_t *lw, const char *cmd, lorawan_response_t *response,
+    uint32_t timeout_ms, uint32_t final_tags, const lorawan_line_sink_t *sink );
+static esp_err_t _unit_lorawan_parse_response(
+    lorawan_instance_t *lw, char *raw_response, size_t response_len,
+    lorawan_response_t *parsed_response );
+static esp_err_t _unit_lorawan_rx_start( lorawan_instance_t *lw );
+static TickType_t _unit_lorawan_aggregator_wait( lorawan_instance_t *lw );
+static void _unit_lorawan_driver_wake( lorawan_instance_t *lw );
+static void _unit_lorawan_aggregator_service( lorawan_instance_t *lw );
+#ifdef CONFIG_LORAWAN_SURVEY
+static TickType_t _unit_lorawan_survey_wait( lorawan_instance_t *lw );
+static void _unit_lorawan_survey_service( lorawan_instance_t *lw );
+static esp_err_t _configure_frequency_plan( lorawan_instance_t *lw,
+                                            uint8_t sub_band );
+#endif
+#ifdef CONFIG_LORAWAN_SPOOL
+static TickType_t _unit_lorawan_spool_wait( lorawan_instance_t *lw );
+static void _unit_lorawan_spool_service( lorawan_instance_t *lw );
+static esp_err_t _unit_lorawan_spool_append( lorawan_instance_t *lw,
+                                             const uint8_t *payload,
+                                             size_t length, uint8_t port );
+#endif
+static void _unit_lorawan_rx_begin( lorawan_instance_t *lw, char *buffer,
+                                    size_t buffer_size, uint32_t final_tags,
+                                    const lorawan_line_sink_t *sink );
+static size_t _unit_lorawan_rx_end( lorawan_instance_t *lw,
+                                    lorawan_response_t *response );
+static esp_err_t _unit_lorawan_wait_for_response( lorawan_instance_t *lw,
+                                                  lorawan_response_t *response,
+                                                  size_t *received_len,
+                                                  uint32_t timeout_ms );
+static uint8_t _unit_lorawan_parse_fields( const char *text, uint8_t base,
+                                           int32_t *fields,
+                                           uint8_t max_fields );
+static esp_err_t _unit_lorawan_validate_payload_size( size_t payload_size,
+                                                      uint8_t data_rate );
+static void _unit_lorawan_cleanup_response( lorawan_instance_t *lw,
+                                            lorawan_response_t *response );
+static esp_err_t _unit_lorawan_buffer_alloc( lorawan_instance_t *lw,
+                                             lorawan_buffer_t id, size_t size,
+                                             uint32_t timeout_ms,
+                                             char **buffer );
+static void _unit_lorawan_buffer_free( lorawan_instance_t *lw,
+                                       lorawan_buffer_t id, char *buffer );
+static const char *
+_unit_lorawan_get_connection_status_description( int32_t status_code );
+
+static const char *_unit_lorawan_uldlmode_str[ 2 ] = { "2", "1" };
+
+static esp_err_t _unit_lorawan_buffers_init( lorawan_instance_t *lw )
+{
+#ifdef CONFIG_LORAWAN_STATIC_BUFFERS
+  for( size_t i = 0; i < LORAWAN_ARENA_COUNT; i++ )
+  {
+    lorawan_arena_t *arena = &lw->arenas[ i ];
+    if( !arena->lock )
+    {
+      arena->lock = xSemaphoreCreateRecursiveMutexStatic( &arena->lock_buffer );
+    }
+  }
+#endif
+  return ESP_OK;
+}
+
+#ifdef CONFIG_LORAWAN_STATIC_BUFFERS
+// The set a buffer was leased from
+static lorawan_arena_t *_unit_lorawan_buffer_arena( lorawan_instance_t *lw,
+                                                    const char *buffer )
+{
+  for( size_t i = 0; i < LORAWAN_ARENA_COUNT; i++ )
+  {
+    lorawan_arena_t *arena = &lw->arenas[ i ];
+    if( buffer == arena->command || buffer == arena->response )
+    {
+      return arena;
+    }
+  }
+  return NULL;
+}
+#endif
+
+// Returns a working buffer from the heap, or from its static arena when
+// CONFIG_LORAWAN_STATIC_BUFFERS is enabled. timeout_ms is that of the
+// exchange the buffer serves and picks the arena by the driver's lane rule;
+// the interactive arena is waited for at most UNIT_LORAWAN_INTERACTIVE_WAIT_MS.
+static esp_err_t _unit_lorawan_buffer_alloc( lorawan_instance_t *lw,
+                                             lorawan_buffer_t id, size_t size,
+                                             uint32_t timeout_ms,
+                                             char **buffer )
+{
+  const char *name = id == LORAWAN_BUFFER_COMMAND ? "command" : "response";
+#ifdef CONFIG_LORAWAN_STATIC_BUFFERS
+  lorawan_arena_id_t arena_id = LORAWAN_ARENA_BULK;
+  TickType_t wait = portMAX_DELAY;
+  if( xTaskGetCurrentTaskHandle() == lw->driver.task )
+  {
+    arena_id = LORAWAN_ARENA_DRIVER;
+  }
+  else if( timeout_ms <= UNIT_LORAWAN_RESPONSE_TIMEOUT_MS )
+  {
+    arena_id = LORAWAN_ARENA_INTERACTIVE;
+    wait = pdMS_TO_TICKS( UNIT_LORAWAN_INTERACTIVE_WAIT_MS );
+  }
+  lorawan_arena_t *arena = &lw->arenas[ arena_id ];
+  size_t buffer_size = id == LORAWAN_BUFFER_COMMAND
+                           ? sizeof( arena->command )
+                           : sizeof( arena->response );
+  if( !arena->lock || size > buffer_size )
+  {
+    ESP_LOGE( lw->tag, "No static %s buffer for %zu bytes", name, size );
+    return ESP_ERR_NO_MEM;
+  }
+  if( xSemaphoreTakeRecursive( arena->lock, wait ) != pdTRUE )
+  {
+    ESP_LOGW( lw->tag, "⚠ Interactive %s buffer busy", name );
+    return ESP_ERR_TIMEOUT;
+  }
+  *buffer = id == LORAWAN_BUFFER_COMMAND ? arena->command : arena->response;
+  return ESP_OK;
+#else
+#ifdef CONFIG_LORAWAN_STATS
+  _unit_lorawan_stats_allocation( lw );
+#endif
+  *buffer = malloc( size );
+  if( !*buffer )
+  {
+    ESP_LOGE( lw->tag, "Failed to allocate %s buffer", name );
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+#endif
+}
+
+static void _unit_lorawan_buffer_free( lorawan_instance_t *lw,
+                                       lorawan_buffer_t id, char *buffer )
+{
+  if( !buffer )
+  {
+    return;
+  }
+#ifdef CONFIG_LORAWAN_STATIC_BUFFERS
+  lorawan_arena_t *arena = _unit_lorawan_buffer_arena( lw, buffer );
+  if( arena )
+  {
+    xSemaphoreGiveRecursive( arena->lock );
+  }
+#else
+  free( buffer );
+#endif
+}
+
+static const char *
+_unit_lorawan_get_connection_status_description( int32_t status_code )
+{
+  switch( status_code )
+  {
+  case 4:
+    return "Network joined successfully (OTAA)";
+  case 8:
+    return "Network joined successfully (ABP)";
+  case 2:
+    return "Network joining in progress";
+  case 1:
+    return "Device not joined to network";
+  case 3:
+    return "Network join failed";
+  default:
+    return "Unknown connection status";
+  }
+}
+
+static esp_err_t _unit_lorawan_validate_payload_size( size_t payload_size,
+                                                      uint8_t data_rate )
+{
+  if( data_rate > _unit_lorawan_region.data_rate_max )
+  {
+    ESP_LOGW( _TAG, "Unknown data rate %d, using maximum safe payload size",
+              data_rate );
+  }
+  size_t max_payload = _unit_lorawan_region_max_payload( data_rate );
+  if( payload_size > max_payload )
+  {
+    ESP_LOGE( _TAG,
+              "Payload size %zu exceeds maximum %zu bytes for data rate DR%d",
+              payload_size, max_payload, data_rate );
+    return ESP_ERR_INVALID_SIZE;
+  }
+  ESP_LOGD( _TAG, "Payload size %zu is valid for data rate DR%d (max: %zu)",
+            payload_size, data_rate, max_payload );
+  return ESP_OK;
+}
+
+static void _unit_lorawan_session_set_data_rate( lorawan_instance_t *lw,
+                                                 uint8_t data_rate )
+{
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  session->data_rate = data_rate;
+  session->max_payload = _unit_lorawan_region_max_payload( data_rate );
+  session->data_rate_valid = true;
+  portEXIT_CRITICAL( &session->lock );
+}
+
+static bool _unit_lorawan_session_get_data_rate( lorawan_instance_t *lw,
+                                                 uint8_t *data_rate,
+                                                 size_t *max_payload )
+{
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  bool valid = session->data_rate_valid;
+  *data_rate = session->data_rate;
+  *max_payload = session->max_payload;
+  portEXIT_CRITICAL( &session->lock );
+  return valid;
+}
+
+static void _unit_lorawan_session_set_tx_power( lorawan_instance_t *lw,
+                                                uint8_t power_index )
+{
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  session->tx_power = power_index;
+  session->tx_power_valid = true;
+  portEXIT_CRITICAL( &session->lock );
+}
+
+static void _unit_lorawan_session_set_joined( lorawan_instance_t *lw,
+                                              bool joined )
+{
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  session->joined = joined;
+  portEXIT_CRITICAL( &session->lock );
+}
+
+static void _unit_lorawan_session_set_adr( lorawan_instance_t *lw,
+                                           bool enabled )
+{
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  session->adr_enabled = enabled;
+  portEXIT_CRITICAL( &session->lock );
+}
+
+static bool _unit_lorawan_session_adr_enabled( lorawan_instance_t *lw )
+{
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  bool enabled = session->adr_enabled;
+  portEXIT_CRITICAL( &session->lock );
+  return enabled;
+}
+
+static bool _unit_lorawan_session_get_tx_power( lorawan_instance_t *lw,
+                                                uint8_t *power_index )
+{
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  bool valid = session->tx_power_valid;
+  *power_index = session->tx_power;
+  portEXIT_CRITICAL( &session->lock );
+  return valid;
+}
+
+static bool _unit_lorawan_session_joined( lorawan_instance_t *lw )
+{
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  bool joined = session->joined;
+  portEXIT_CRITICAL( &session->lock );
+  return joined;
+}
+
+static void _unit_lorawan_session_set_port( lorawan_instance_t *lw,
+                                            uint8_t port )
+{
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  session->port = port;
+  session->port_valid = true;
+  portEXIT_CRITICAL( &session->lock );
+}
+
+static bool _unit_lorawan_session_port_is( lorawan_instance_t *lw,
+                                           uint8_t port )
+{
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  bool matches = session->port_valid && session->port == port;
+  portEXIT_CRITICAL( &session->lock );
+  return matches;
+}
+
+static void _unit_lorawan_session_invalidate_data_rate( lorawan_instance_t *lw )
+{
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  session->data_rate_valid = false;
+  portEXIT_CRITICAL( &session->lock );
+}
+
+// Forgets everything mirrored from the module after a reboot or restore
+static void _unit_lorawan_session_invalidate( lorawan_instance_t *lw )
+{
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  session->data_rate_valid = false;
+  session->tx_power_valid = false;
+  session->joined = false;
+  session->adr_enabled = true;
+  session->port_valid = false;
+  portEXIT_CRITICAL( &session->lock );
+}
+
+// LoRa time-on-air of one uplink carrying length application bytes, using
+// the Semtech formula with an 8 symbol preamble, explicit header, CRC and
+// coding rate 4/5
+static uint32_t _unit_lorawan_time_on_air_us( uint8_t data_rate,
+                                              size_t length )
+{
+  const lorawan_data_rate_t *modulation =
+      &_unit_lorawan_region.data_rates[ data_rate ];
+  int32_t sf = modulation->spreading_factor;
+  uint32_t symbol_us = ( 1000UL << sf ) / modulation->bandwidth_khz;
+  int32_t low_rate_optimize = symbol_us >= 16000 ? 1 : 0;
+
+  int32_t phy_length = (int32_t)length + UNIT_LORAWAN_FRAME_OVERHEAD;
+  int32_t numerator = 8 * phy_length - 4 * sf + 28 + 16;
+  int32_t denominator = 4 * ( sf - 2 * low_rate_optimize );
+  int32_t blocks =
+      numerator > 0 ? ( numerator + denominator - 1 ) / denominator : 0;
+  uint32_t payload_symbols = 8 + (uint32_t)blocks * 5;
+
+  // The preamble lasts 12.25 symbols, so count in quarter symbols
+  return ( ( 4 * payload_symbols + 49 ) * symbol_us ) / 4;
+}
+
+// Called with the airtime lock held
+static void _unit_lorawan_airtime_refill( lorawan_airtime_t *airtime,
+                                          uint8_t index, TickType_t now )
+{
+  if( airtime->credit_us[ index ] >= (int64_t)UNIT_LORAWAN_AIRTIME_BUDGET_US )
+  {
+    airtime->refilled[ index ] = now;
+    return;
+  }
+
+  uint64_t elapsed_ms =
+      (uint64_t)( now - airtime->refilled[ index ] ) * portTICK_PERIOD_MS;
+  uint64_t gained_us = elapsed_ms * UNIT_LORAWAN_AIRTIME_BUDGET_US /
+                       UNIT_LORAWAN_AIRTIME_WINDOW_MS;
+  if( gained_us == 0 )
+  {
+    return; // Keep the timestamp so short intervals still add up
+  }
+  airtime->refilled[ index ] = now;
+  airtime->credit_us[ index ] += (int64_t)gained_us;
+  if( airtime->credit_us[ index ] > (int64_t)UNIT_LORAWAN_AIRTIME_BUDGET_US )
+  {
+    airtime->credit_us[ index ] = (int64_t)UNIT_LORAWAN_AIRTIME_BUDGET_US;
+  }
+}
+
+// Starts every sub-band with a full budget; history before init is unknown
+static void _unit_lorawan_airtime_reset( lorawan_instance_t *lw )
+{
+  lorawan_airtime_t *airtime = &lw->airtime;
+  TickType_t now = xTaskGetTickCount();
+  portENTER_CRITICAL( &airtime->lock );
+  for( uint8_t i = 0; i < LORAWAN_REGION_SUB_BANDS; i++ )
+  {
+    airtime->credit_us[ i ] = (int64_t)UNIT_LORAWAN_AIRTIME_BUDGET_US;
+    airtime->refilled[ i ] = now;
+  }
+  airtime->pending_us = 0;
+  portEXIT_CRITICAL( &airtime->lock );
+}
+
+static void _unit_lorawan_airtime_set_sub_band( lorawan_instance_t *lw,
+                                                uint8_t sub_band )
+{
+  lorawan_airtime_t *airtime = &lw->airtime;
+  portENTER_CRITICAL( &airtime->lock );
+  airtime->sub_band = sub_band;
+  portEXIT_CRITICAL( &airtime->lock );
+}
+
+#ifdef CONFIG_LORAWAN_SURVEY
+static uint8_t _unit_lorawan_airtime_sub_band( lorawan_instance_t *lw )
+{
+  lorawan_airtime_t *airtime = &lw->airtime;
+  portENTER_CRITICAL( &airtime->lock );
+  uint8_t sub_band = airtime->sub_band;
+  portEXIT_CRITICAL( &airtime->lock );
+  return sub_band;
+}
+#endif
+
+// Remaining airtime credit on the active sub-band, negative when in debt
+static int64_t _unit_lorawan_airtime_credit( lorawan_instance_t *lw )
+{
+  lorawan_airtime_t *airtime = &lw->airtime;
+  TickType_t now = xTaskGetTickCount();
+  portENTER_CRITICAL( &airtime->lock );
+  uint8_t index = airtime->sub_band - 1;
+  _unit_lorawan_airtime_refill( airtime, index, now );
+  int64_t credit = airtime->credit_us[ index ];
+  portEXIT_CRITICAL( &airtime->lock );
+  return credit;
+}
+
+// Milliseconds until an uplink of airtime_us fits the budget
+static uint32_t _unit_lorawan_airtime_delay_ms( lorawan_instance_t *lw,
+                                                uint32_t airtime_us )
+{
+#if UNIT_LORAWAN_AIRTIME_BUDGET_MS == 0
+  (void)lw;
+  (void)airtime_us;
+  return 0;
+#else
+  // A frame longer than the whole budget goes out once it is full
+  int64_t needed = airtime_us < UNIT_LORAWAN_AIRTIME_BUDGET_US
+                       ? (int64_t)airtime_us
+                       : (int64_t)UNIT_LORAWAN_AIRTIME_BUDGET_US;
+  int64_t credit = _unit_lorawan_airtime_credit( lw );
+  if( credit >= needed )
+  {
+    return 0;
+  }
+
+  uint64_t deficit_us = (uint64_t)( needed - credit );
+  uint64_t delay_ms =
+      ( deficit_us * UNIT_LORAWAN_AIRTIME_WINDOW_MS +
+        UNIT_LORAWAN_AIRTIME_BUDGET_US - 1 ) /
+      UNIT_LORAWAN_AIRTIME_BUDGET_US;
+  return delay_ms > UINT32_MAX ? UINT32_MAX : (uint32_t)delay_ms;
+#endif
+}
+
+// Remembers the airtime of the uplink being issued until OK+SENT reports how
+// many times it went out
+static void _unit_lorawan_airtime_begin( lorawan_instance_t *lw,
+                                         uint32_t airtime_us )
+{
+  lorawan_airtime_t *airtime = &lw->airtime;
+  portENTER_CRITICAL( &airtime->lock );
+  airtime->pending_us = airtime_us;
+  portEXIT_CRITICAL( &airtime->lock );
+}
+
+static void _unit_lorawan_airtime_charge( lorawan_instance_t *lw,
+                                          uint8_t tx_count )
+{
+  lorawan_airtime_t *airtime = &lw->airtime;
+  portENTER_CRITICAL( &airtime->lock );
+  uint8_t index = airtime->sub_band - 1;
+  airtime->credit_us[ index ] -=
+      (int64_t)airtime->pending_us * ( tx_count > 0 ? tx_count : 1 );
+  airtime->pending_us = 0;
+  portEXIT_CRITICAL( &airtime->lock );
+}
+
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+// FNV-1a, enough to notice any change to the provisioned settings
+static uint32_t _unit_lorawan_fnv1a( uint32_t hash, const void *data,
+                                     size_t length )
+{
+  const uint8_t *bytes = (const uint8_t *)data;
+  for( size_t i = 0; i < length; i++ )
+  {
+    hash = ( hash ^ bytes[ i ] ) * 16777619u;
+  }
+  return hash;
+}
+
+static uint32_t
+_unit_lorawan_ttn_config_hash( const unit_lorawan_ttn_config_t *config )
+{
+  uint32_t hash = 2166136261u;
+  hash = _unit_lorawan_fnv1a( hash, config->dev_eui, strlen( config->dev_eui ) );
+  hash = _unit_lorawan_fnv1a( hash, config->app_eui, strlen( config->app_eui ) );
+  hash = _unit_lorawan_fnv1a( hash, config->app_key, strlen( config->app_key ) );
+  uint8_t params[] = { config->sub_band, config->adr_enabled ? 1 : 0,
+                       config->adr_enabled ? 0 : config->data_rate };
+  return _unit_lorawan_fnv1a( hash, params, sizeof( params ) );
+}
+
+// Writes the current mirror to NVS. Blocks on flash, so it runs only in
+// application tasks or the driver task.
+static esp_err_t _unit_lorawan_store_save( lorawan_instance_t *lw )
+{
+  lorawan_stored_session_t stored = {
+      .version = UNIT_LORAWAN_NVS_SESSION_VERSION,
+  };
+
+  lorawan_store_t *store = &lw->store;
+  portENTER_CRITICAL( &store->lock );
+  store->pending = false;
+  stored.provisioned = store->provisioned;
+  stored.config_hash = store->config_hash;
+  portEXIT_CRITICAL( &store->lock );
+
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  stored.joined = session->joined;
+  stored.data_rate_valid = session->data_rate_valid;
+  stored.data_rate = session->data_rate;
+  stored.tx_power_valid = session->tx_power_valid;
+  stored.tx_power = session->tx_power;
+  stored.adr_enabled = session->adr_enabled;
+  stored.uplinks = session->uplinks;
+  stored.transmissions = session->transmissions;
+  portEXIT_CRITICAL( &session->lock );
+
+  nvs_handle_t handle;
+  esp_err_t err =
+      nvs_open( UNIT_LORAWAN_NVS_NAMESPACE, NVS_READWRITE, &handle );
+  if( err == ESP_OK )
+  {
+    err = nvs_set_blob( handle, store->key, &stored, sizeof( stored ) );
+    if( err == ESP_OK )
+    {
+      err = nvs_commit( handle );
+    }
+    nvs_close( handle );
+  }
+
+  if( err != ESP_OK )
+  {
+    ESP_LOGW( lw->tag, "⚠ Failed to store LoRaWAN session: %s",
+              esp_err_to_name( err ) );
+  }
+  else
+  {
+    ESP_LOGD( lw->tag, "Session stored (joined: %d, uplinks: %u)",
+              stored.joined, stored.uplinks );
+  }
+  return err;
+}
+
+// Defers a save to the driver task, for callers in the RX task
+static void _unit_lorawan_store_request( lorawan_instance_t *lw )
+{
+  lorawan_store_t *store = &lw->store;
+  portENTER_CRITICAL( &store->lock );
+  store->pending = true;
+  portEXIT_CRITICAL( &store->lock );
+  _unit_lorawan_driver_wake( lw );
+}
+
+// Runs in the driver task after every command or wake
+static void _unit_lorawan_store_service( lorawan_instance_t *lw )
+{
+  lorawan_store_t *store = &lw->store;
+  portENTER_CRITICAL( &store->lock );
+  bool pending = store->pending;
+  portEXIT_CRITICAL( &store->lock );
+  if( pending )
+  {
+    _unit_lorawan_store_save( lw );
+  }
+}
+
+static void _unit_lorawan_store_set_provisioned( lorawan_instance_t *lw,
+                                                 bool provisioned,
+                                                 uint32_t config_hash )
+{
+  lorawan_store_t *store = &lw->store;
+  portENTER_CRITICAL( &store->lock );
+  store->provisioned = provisioned;
+  store->config_hash = config_hash;
+  portEXIT_CRITICAL( &store->lock );
+  _unit_lorawan_store_save( lw );
+}
+
+// True when the stored record says this exact configuration was provisioned
+static bool _unit_lorawan_store_provisioned( lorawan_instance_t *lw,
+                                             uint32_t config_hash )
+{
+  lorawan_store_t *store = &lw->store;
+  portENTER_CRITICAL( &store->lock );
+  bool provisioned = store->provisioned && store->config_hash == config_hash;
+  portEXIT_CRITICAL( &store->lock );
+  return provisioned;
+}
+
+// Seeds the mirror from NVS. The joined state is left for CSTATUS? to
+// confirm, since the module may have lost its session while the host slept.
+static void _unit_lorawan_store_restore( lorawan_instance_t *lw )
+{
+  lorawan_stored_session_t stored;
+  size_t length = sizeof( stored );
+  nvs_handle_t handle;
+  esp_err_t err =
+      nvs_open( UNIT_LORAWAN_NVS_NAMESPACE, NVS_READONLY, &handle );
+  if( err == ESP_OK )
+  {
+    err = nvs_get_blob( handle, lw->store.key, &stored, &length );
+    nvs_close( handle );
+  }
+  if( err != ESP_OK || length != sizeof( stored ) ||
+      stored.version != UNIT_LORAWAN_NVS_SESSION_VERSION )
+  {
+    ESP_LOGD( lw->tag, "No stored LoRaWAN session to restore" );
+    return;
+  }
+
+  lorawan_store_t *store = &lw->store;
+  portENTER_CRITICAL( &store->lock );
+  store->provisioned = stored.provisioned;
+  store->config_hash = stored.config_hash;
+  portEXIT_CRITICAL( &store->lock );
+
+  lorawan_session_t *session = &lw->session;
+  portENTER_CRITICAL( &session->lock );
+  session->adr_enabled = stored.adr_enabled;
+  session->tx_power_valid = stored.tx_power_valid;
+  session->tx_power = stored.tx_power;
+  session->uplinks = stored.uplinks;
+  session->transmissions = stored.transmissions;
+  portEXIT_CRITICAL( &session->lock );
+  if( stored.data_rate_valid )
+  {
+    _unit_lorawan_session_set_data_rate( lw, stored.data_rate );
+  }
+
+  ESP_LOGI( lw->tag, "✓ Restored LoRaWAN session (%s, %u uplinks)",
+            stored.joined ? "joined" : "not joined", stored.uplinks );
+}
+#endif
+
+// Parses the separated numeric fields of a tag value, stopping at the first
+// token that is not a number. Returns the number of fields stored.
+static uint8_t _unit_lorawan_parse_fields( const char *text, uint8_t base,
+                                           int32_t *fields, uint8_t max_fields )
+{
+  uint8_t count = 0;
+  while( text && count < max_fields )
+  {
+    char *end = NULL;
+    long value = strtol( text, &end, base );
+    if( end == text )
+    {
+      break;
+    }
+    fields[ count++ ] = (int32_t)value;
+    while( *end == ' ' )
+    {
+      end++;
+    }
+    if( *end != ',' && *end != ':' )
+    {
+      break;
+    }
+    text = end + 1;
+  }
+  return count;
+}
+
+// Matches the line against the tag table once and extracts its fields
+static void _unit_lorawan_classify_line( const char *line,
+                                         lorawan_line_t *parsed )
+{
+  const lorawan_tag_entry_t *match = NULL;
+  const char *value = line;
+
+  for( size_t i = 0; i < sizeof( _unit_lorawan_tag_table ) /
+                             sizeof( _unit_lorawan_tag_table[ 0 ] );
+       i++ )
+  {
+    const lorawan_tag_entry_t *entry = &_unit_lorawan_tag_table[ i ];
+    if( line[ 0 ] != entry->prefix[ 0 ] ||
+        strncmp( line, entry->prefix, entry->prefix_len ) != 0 )
+    {
+      continue;
+    }
+    char next = line[ entry->prefix_len ];
+    if( next == '\0' || next == ':' || next == '=' || next == ' ' )
+    {
+      match = entry;
+      break;
+    }
+  }
+
+  parsed->tag = match ? match->tag : LORAWAN_TAG_NONE;
+  if( match )
+  {
+    value = line + match->prefix_len;
+    if( *value == ':' || *value == '=' )
+    {
+      value++;
+    }
+    while( *value == ' ' )
+    {
+      value++;
+    }
+  }
+  parsed->value = value;
+  parsed->field_count = _unit_lorawan_parse_fields(
+      value, match ? match->base : 10, parsed->fields,
+      UNIT_LORAWAN_MAX_FIELDS );
+}
+
+// Tracks data rate changes visible in any module output line
+static void _unit_lorawan_session_observe( lorawan_instance_t *lw,
+                                           const lorawan_line_t *line )
+{
+  if( line->field_count < 1 )
+  {
+    return;
+  }
+  if( line->tag == LORAWAN_TAG_CDATARATE && line->fields[ 0 ] >= 0 )
+  {
+    _unit_lorawan_session_set_data_rate( lw, (uint8_t)line->fields[ 0 ] );
+  }
+  else if( line->tag == LORAWAN_TAG_SEND_OK ||
+           line->tag == LORAWAN_TAG_SENT_OK ||
+           line->tag == LORAWAN_TAG_SENT_ERR )
+  {
+    lorawan_session_t *session = &lw->session;
+    portENTER_CRITICAL( &session->lock );
+    if( line->tag == LORAWAN_TAG_SEND_OK )
+    {
+      session->uplinks++;
+    }
+    else if( line->fields[ 0 ] > 0 )
+    {
+      session->transmissions += (uint32_t)line->fields[ 0 ];
+    }
+    portEXIT_CRITICAL( &session->lock );
+  }
+  else if( line->tag == LORAWAN_TAG_SEND_ERR && line->fields[ 0 ] == 2 )
+  {
+    // Payload too long for the current data rate, so ADR must have lowered it
+    ESP_LOGD( lw->tag,
+              "Uplink exceeded data rate limit, refreshing data rate" );
+    _unit_lorawan_session_invalidate_data_rate( lw );
+  }
+  else if( line->tag == LORAWAN_TAG_RECV && line->field_count >= 2 &&
+           line->fields[ 1 ] == 0 && _unit_lorawan_session_adr_enabled( lw ) )
+  {
+    // A port 0 downlink only carries MAC commands such as LinkADRReq
+    ESP_LOGD( lw->tag, "MAC command downlink received, refreshing data rate" );
+    _unit_lorawan_session_invalidate_data_rate( lw );
+  }
+}
+
+static int _unit_lorawan_hex_nibble( char c )
+{
+  if( c >= '0' && c <= '9' )
+  {
+    return c - '0';
+  }
+  if( c >= 'A' && c <= 'F' )
+  {
+    return c - 'A' + 10;
+  }
+  if( c >= 'a' && c <= 'f' )
+  {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// Decodes hex text up to the first non-hex character. Returns bytes written.
+static size_t _unit_lorawan_hex_decode( const char *hex, uint8_t *out,
+                                        size_t out_size )
+{
+  size_t count = 0;
+  while( count < out_size )
+  {
+    int high = _unit_lorawan_hex_nibble( hex[ 0 ] );
+    int low = high < 0 ? -1 : _unit_lorawan_hex_nibble( hex[ 1 ] );
+    if( low < 0 )
+    {
+      break;
+    }
+    out[ count++ ] = (uint8_t)( ( high << 4 ) | low );
+    hex += 2;
+  }
+  return count;
+}
+
+static const char _unit_lorawan_hex_digits[ 16 ] = "0123456789ABCDEF";
+
+// Writes two uppercase hex digits per byte, without a terminator
+static void _unit_lorawan_hex_encode( const uint8_t *data, size_t length,
+                                      char *out )
+{
+  for( size_t i = 0; i < length; i++ )
+  {
+    *out++ = _unit_lorawan_hex_digits[ data[ i ] >> 4 ];
+    *out++ = _unit_lorawan_hex_digits[ data[ i ] & 0x0F ];
+  }
+}
+
+static void _unit_lorawan_urc_emit( lorawan_instance_t *lw,
+                                    const unit_lorawan_event_t *event )
+{
+  lorawan_urc_t *urc = &lw->urc;
+  portENTER_CRITICAL( &urc->lock );
+  unit_lorawan_event_callback_t callback = urc->event_callback;
+  void *user_data = urc->event_user_data;
+  portEXIT_CRITICAL( &urc->lock );
+
+  if( callback )
+  {
+    callback( event, user_data );
+  }
+}
+
+// Lets the driver task look at its timed work without a command to run
+static void _unit_lorawan_driver_wake( lorawan_instance_t *lw )
+{
+  lorawan_command_t *wake = NULL;
+  if( lw->driver.queue )
+  {
+    xQueueSend( lw->driver.queue, &wake, 0 );
+  }
+}
+
+// +CJOIN:OK or +CJOIN:FAIL once the module's join attempts finish
+static void _unit_lorawan_urc_join( lorawan_instance_t *lw,
+                                    const lorawan_line_t *line )
+{
+  bool joined = strncmp( line->value, "OK", 2 ) == 0;
+  _unit_lorawan_session_set_joined( lw, joined );
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+  _unit_lorawan_store_request( lw );
+#endif
+  if( lw->join.events )
+  {
+    xEventGroupSetBits( lw->join.events,
+                        joined ? LORAWAN_JOIN_ACCEPTED_BIT
+                               : LORAWAN_JOIN_FAILED_BIT );
+    _unit_lorawan_driver_wake( lw );
+  }
+  ESP_LOGI( lw->tag, "%s LoRaWAN join %s", joined ? "✓" : "✗",
+            joined ? "accepted" : "failed" );
+
+  unit_lorawan_event_t event = {
+      .id = joined ? UNIT_LORAWAN_EVENT_JOINED : UNIT_LORAWAN_EVENT_JOIN_FAILED,
+  };
+  _unit_lorawan_urc_emit( lw, &event );
+}
+
+static void _unit_lorawan_link_record( lorawan_instance_t *lw,
+                                       const lorawan_link_sample_t *sample )
+{
+  lorawan_link_t *link = &lw->link;
+  portENTER_CRITICAL( &link->lock );
+  link->samples[ link->head ] = *sample;
+  link->head = ( link->head + 1 ) % UNIT_LORAWAN_LINK_HISTORY;
+  if( link->count < UNIT_LORAWAN_LINK_HISTORY )
+  {
+    link->count++;
+  }
+  portEXIT_CRITICAL( &link->lock );
+}
+
+// Report age-th newest, 0 for the newest; the caller holds link->lock
+static const lorawan_link_sample_t *
+_unit_lorawan_link_at( const lorawan_link_t *link, uint8_t age )
+{
+  return &link->samples[ ( link->head + UNIT_LORAWAN_LINK_HISTORY - 1 - age ) %
+                         UNIT_LORAWAN_LINK_HISTORY ];
+}
+
+// Newest link check report, or the newest answered one, false when none
+static bool _unit_lorawan_link_latest( lorawan_instance_t *lw, bool answered,
+                                       lorawan_link_sample_t *sample )
+{
+  lorawan_link_t *link = &lw->link;
+  bool found = false;
+  portENTER_CRITICAL( &link->lock );
+  for( uint8_t i = 0; i < link->count && !found; i++ )
+  {
+    const lorawan_link_sample_t *candidate = _unit_lorawan_link_at( link, i );
+    if( !answered || candidate->answered )
+    {
+      *sample = *candidate;
+      found = true;
+    }
+  }
+  portEXIT_CRITICAL( &link->lock );
+  return found;
+}
+
+// Aggregates of the reports no older than window_ms, 0 for all of them
+static void
+_unit_lorawan_link_summarize( lorawan_instance_t *lw, uint32_t window_ms,
+                              unit_lorawan_link_quality_t *quality )
+{
+  lorawan_link_t *link = &lw->link;
+  TickType_t now = xTaskGetTickCount();
+  TickType_t window = pdMS_TO_TICKS( window_ms );
+  int32_t rssi_sum = 0;
+  int32_t snr_sum = 0;
+  uint32_t margin_sum = 0;
+
+  memset( quality, 0, sizeof( *quality ) );
+  portENTER_CRITICAL( &link->lock );
+  for( uint8_t i = 0; i < link->count; i++ )
+  {
+    const lorawan_link_sample_t *sample = _unit_lorawan_link_at( link, i );
+    TickType_t age = now - sample->at;
+    if( window_ms && age > window )
+    {
+      break; // Newest first, everything after is older still
+    }
+    if( !sample->answered )
+    {
+      quality->missed++;
+      continue;
+    }
+
+    if( quality->samples == 0 )
+    {
+      quality->age_ms = pdTICKS_TO_MS( age );
+      quality->rssi_min = quality->rssi_max = sample->rssi;
+      quality->snr_min = quality->snr_max = sample->snr;
+      quality->margin_min = sample->margin;
+    }
+    quality->samples++;
+    rssi_sum += sample->rssi;
+    snr_sum += sample->snr;
+    margin_sum += sample->margin;
+    if( sample->rssi < quality->rssi_min )
+    {
+      quality->rssi_min = sample->rssi;
+    }
+    if( sample->rssi > quality->rssi_max )
+    {
+      quality->rssi_max = sample->rssi;
+    }
+    if( sample->snr < quality->snr_min )
+    {
+      quality->snr_min = sample->snr;
+    }
+    if( sample->snr > quality->snr_max )
+    {
+      quality->snr_max = sample->snr;
+    }
+    if( sample->margin < quality->margin_min )
+    {
+      quality->margin_min = sample->margin;
+    }
+    if( sample->gateways > quality->gateways_max )
+    {
+      quality->gateways_max = sample->gateways;
+    }
+  }
+  portEXIT_CRITICAL( &link->lock );
+
+  if( quality->samples )
+  {
+    quality->rssi_mean = (int16_t)( rssi_sum / quality->samples );
+    quality->snr_mean = (int8_t)( snr_sum / quality->samples );
+    quality->margin_mean = (uint8_t)( margin_sum / quality->samples );
+  }
+}
+
+// OK+RECV:<type>,<port>,<len>,<data> with every field in hex
+static void _unit_lorawan_urc_downlink( lorawan_instance_t *lw,
+                                        const lorawan_line_t *line )
+{
+  lorawan_urc_t *urc = &lw->urc;
+  if( line->field_count < 3 || line->fields[ 2 ] == 0 )
+  {
+    return; // Bare ACK of a confirmed uplink
+  }
+
+  const char *hex = line->value;
+  for( int commas = 0; hex && commas < 3; commas++ )
+  {
+    hex = strchr( hex, ',' );
+    hex = hex ? hex + 1 : NULL;
+  }
+  if( !hex )
+  {
+    ESP_LOGW( lw->tag, "Downlink without payload: %s", line->value );
+    return;
+  }
+
+  size_t length =
+      _unit_lorawan_hex_decode( hex, urc->downlink, sizeof( urc->downlink ) );
+  if( length != (size_t)line->fields[ 2 ] )
+  {
+    ESP_LOGW( lw->tag, "Downlink length %d does not match %zu decoded bytes",
+              (int)line->fields[ 2 ], length );
+  }
+
+  uint8_t type = (uint8_t)line->fields[ 0 ];
+  unit_lorawan_downlink_t downlink = {
+      .port = (uint8_t)line->fields[ 1 ],
+      .confirmed = ( type & UNIT_LORAWAN_RECV_TYPE_CONFIRMED ) != 0,
+      .data = urc->downlink,
+      .length = length,
+  };
+
+  lorawan_link_sample_t sample;
+  if( ( type & UNIT_LORAWAN_RECV_TYPE_LINK_CHECK ) &&
+      _unit_lorawan_link_latest( lw, false, &sample ) && sample.answered )
+  {
+    downlink.link_quality_valid = true;
+    downlink.rssi = sample.rssi;
+    downlink.snr = sample.snr;
+  }
+
+  portENTER_CRITICAL( &urc->lock );
+  unit_lorawan_downlink_callback_t callback = urc->downlink_callback;
+  void *user_data = urc->downlink_user_data;
+  portEXIT_CRITICAL( &urc->lock );
+
+  ESP_LOGI( lw->tag, "Downlink received on port %d (%zu bytes)", downlink.port,
+            downlink.length );
+  if( callback )
+  {
+    callback( &downlink, user_data );
+  }
+}
+
+// +CLINKCHECK:<result>,<margin>,<gateways>,<rssi>,<snr>
+static void _unit_lorawan_urc_link_check( lorawan_instance_t *lw,
+                                          const lorawan_line_t *line )
+{
+  if( line->field_count < 5 )
+  {
+    return; // The CLINKCHECK=<mode> echo carries no answer
+  }
+
+  unit_lorawan_event_t event = {
+      .id = UNIT_LORAWAN_EVENT_LINK_CHECK,
+      .link_check =
+          {
+              .result = (uint8_t)line->fields[ 0 ],
+              .margin = (uint8_t)line->fields[ 1 ],
+              .gateways = (uint8_t)line->fields[ 2 ],
+              .rssi = (int16_t)line->fields[ 3 ],
+              .snr = (int8_t)line->fields[ 4 ],
+          },
+  };
+
+  lorawan_link_sample_t sample = {
+      .at = xTaskGetTickCount(),
+      .answered = event.link_check.result == 0,
+      .margin = event.link_check.margin,
+      .gateways = event.link_check.gateways,
+      .rssi = event.link_check.rssi,
+      .snr = event.link_check.snr,
+  };
+  _unit_lorawan_link_record( lw, &sample );
+
+  _unit_lorawan_urc_emit( lw, &event );
+}
+
+// OK+SENT:<count> or ERR+SENT:<count> once an uplink leaves the radio
+static void _unit_lorawan_urc_tx_done( lorawan_instance_t *lw,
+                                       const lorawan_line_t *line )
+{
+  unit_lorawan_event_t event = {
+      .id = line->tag == LORAWAN_TAG_SENT_OK ? UNIT_LORAWAN_EVENT_TX_DONE
+                                             : UNIT_LORAWAN_EVENT_TX_FAILED,
+      .tx_count = line->field_count > 0 ? (uint8_t)line->fields[ 0 ] : 0,
+  };
+  _unit_lorawan_airtime_charge( lw, event.tx_count );
+  _unit_lorawan_urc_emit( lw, &event );
+}
+
+typedef void ( *lorawan_urc_handler_t )( lorawan_instance_t *lw,
+                                         const lorawan_line_t *line );
+
+// Lines routed to a handler whether or not a command is waiting for them
+static const lorawan_urc_handler_t
+    _unit_lorawan_urc_handlers[ LORAWAN_TAG_COUNT ] = {
+        [LORAWAN_TAG_CJOIN] = _unit_lorawan_urc_join,
+        [LORAWAN_TAG_RECV] = _unit_lorawan_urc_downlink,
+        [LORAWAN_TAG_CLINKCHECK] = _unit_lorawan_urc_link_check,
+        [LORAWAN_TAG_SENT_OK] = _unit_lorawan_urc_tx_done,
+        [LORAWAN_TAG_SENT_ERR] = _unit_lorawan_urc_tx_done,
+};
+
+// Whether the command being captured owns an unsolicited line: the outcome
+// of an uplink once the module took it, anything else only when the command
+// waits for it. A late OK+SENT then never ends the next command early.
+static bool _unit_lorawan_rx_owns_urc( const lorawan_rx_t *rx,
+                                       lorawan_tag_t tag )
+{
+  switch( tag )
+  {
+  case LORAWAN_TAG_SENT_OK:
+  case LORAWAN_TAG_SENT_ERR:
+  case LORAWAN_TAG_RECV:
+    return rx->tags & LORAWAN_TAG_BIT( LORAWAN_TAG_SEND_OK );
+  default:
+    return rx->final_tags & LORAWAN_TAG_BIT( tag );
+  }
+}
+
+// Called with the RX lock held for every complete line received. Returns
+// true with the classified line in urc when a URC handler wants it.
+static bool _unit_lorawan_rx_line( lorawan_instance_t *lw, const char *line,
+                                   size_t line_len, lorawan_line_t *urc )
+{
+  lorawan_rx_t *rx = &lw->rx;
+  lorawan_line_t parsed;
+  _unit_lorawan_classify_line( line, &parsed );
+  _unit_lorawan_session_observe( lw, &parsed );
+
+  bool is_urc = _unit_lorawan_urc_handlers[ parsed.tag ] != NULL;
+  if( is_urc )
+  {
+    *urc = parsed; // Value still points into the RX line buffer
+  }
+
+  if( !rx->capture || rx->complete )
+  {
+    if( !is_urc )
+    {
+      ESP_LOGD( lw->tag, "Discarding unsolicited line: %s", line );
+    }
+    return is_urc;
+  }
+  if( is_urc && !_unit_lorawan_rx_owns_urc( rx, parsed.tag ) )
+  {
+    return true;
+  }
+
+  // Keep the legacy "\r\n" separated layout so parsers can walk the lines
+  size_t space = rx->capture_size - rx->capture_len;
+  if( rx->sink && rx->sink->consume( &parsed, rx->sink->ctx ) )
+  {
+    parsed.value = NULL; // Handed over, only its tag is recorded
+  }
+  else if( line_len + 2 < space )
+  {
+    char *kept = rx->capture + rx->capture_len;
+    memcpy( kept, line, line_len );
+    rx->capture_len += line_len;
+    rx->capture[ rx->capture_len++ ] = '\r';
+    rx->capture[ rx->capture_len++ ] = '\n';
+    rx->capture[ rx->capture_len ] = '\0';
+    parsed.value = kept + ( parsed.value - line );
+  }
+  else
+  {
+    ESP_LOGW( lw->tag, "Response buffer full, dropping line: %s", line );
+    parsed.value = NULL;
+  }
+
+  uint32_t bit = LORAWAN_TAG_BIT( parsed.tag );
+  if( ( bit & LORAWAN_TAGS_DATA ) && rx->result.tag == LORAWAN_TAG_NONE )
+  {
+    rx->result = parsed;
+  }
+  if( ( bit & LORAWAN_TAGS_FAILURE ) && rx->error.tag == LORAWAN_TAG_NONE )
+  {
+    rx->error = parsed;
+  }
+  rx->tags |= bit;
+
+  uint32_t final_tags =
+      rx->final_tags ? rx->final_tags : LORAWAN_TAGS_FINAL_DEFAULT;
+  // A bare ERROR always ends the command, whatever the caller waits for
+  if( bit & ( final_tags | LORAWAN_TAG_BIT( LORAWAN_TAG_ERROR ) ) )
+  {
+    rx->complete = true;
+  }
+  xSemaphoreGive( rx->line_ready );
+  return is_urc;
+}
+
+// Splits the raw UART byte stream into lines terminated by "\r\n"
+static void _unit_lorawan_rx_feed( lorawan_instance_t *lw, const uint8_t *data,
+                                   size_t length )
+{
+  lorawan_rx_t *rx = &lw->rx;
+  xSemaphoreTake( rx->lock, portMAX_DELAY );
+  for( size_t i = 0; i < length; i++ )
+  {
+    char c = (char)data[ i ];
+    if( c == '\n' || rx->line_len == sizeof( rx->line ) - 1 )
+    {
+      if( rx->line_len > 0 && rx->line[ rx->line_len - 1 ] == '\r' )
+      {
+        rx->line_len--;
+      }
+      rx->line[ rx->line_len ] = '\0';
+      lorawan_line_t urc;
+      if( rx->line_len > 0 &&
+          _unit_lorawan_rx_line( lw, rx->line, rx->line_len, &urc ) )
+      {
+        // Handlers run unlocked so a waiting command is not held up. Only
+        // this task writes the line buffer the URC value points into.
+        xSemaphoreGive( rx->lock );
+#ifdef CONFIG_LORAWAN_STATS
+        _unit_lorawan_stats_urc( lw );
+#endif
+        _unit_lorawan_urc_handlers[ urc.tag ]( lw, &urc );
+        xSemaphoreTake( rx->lock, portMAX_DELAY );
+      }
+      rx->line_len = 0;
+      if( c == '\n' )
+      {
+        continue;
+      }
+    }
+    rx->line[ rx->line_len++ ] = c;
+  }
+  xSemaphoreGive( rx->lock );
+}
+
+static void _unit_lorawan_rx_task( void *pvParameters )
+{
+  lorawan_instance_t *lw = (lorawan_instance_t *)pvParameters;
+  lorawan_rx_t *rx = &lw->rx;
+
+  for( ;; )
+  {
+    size_t available_bytes = 0;
+    esp_err_t err = lw->transport.read(
+        rx->chunk, sizeof( rx->chunk ), &available_bytes, lw->transport.ctx );
+    if( err == ESP_OK && available_bytes > 0 )
+    {
+      ESP_LOGV( lw->tag, "Received %zu bytes", available_bytes );
+#ifdef CONFIG_LORAWAN_STATS
+      _unit_lorawan_stats_uart( lw, 0, available_bytes );
+#endif
+      _unit_lorawan_rx_feed( lw, rx->chunk, available_bytes );
+      continue; // More data may already be waiting
+    }
+
+    // Transports that frame lines themselves wake the task once per line
+    if( lw->transport.wait )
+    {
+      err = lw->transport.wait( UNIT_LORAWAN_RX_WAIT_MS, lw->transport.ctx );
+      if( err == ESP_OK || err == ESP_ERR_TIMEOUT )
+      {
+        continue;
+      }
+    }
+
+    // Poll slowly while the link idles so tickless idle can light-sleep
+    portENTER_CRITICAL( &lw->power.lock );
+    bool idle = lw->power.idle;
+    portEXIT_CRITICAL( &lw->power.lock );
+    TickType_t poll = pdMS_TO_TICKS( idle ? UNIT_LORAWAN_RX_IDLE_POLL_MS
+                                          : UNIT_LORAWAN_RX_POLL_MS );
+    vTaskDelay( poll > 0 ? poll : 1 );
+  }
+}
+
+static esp_err_t _unit_lorawan_rx_start( lorawan_instance_t *lw )
+{
+  lorawan_rx_t *rx = &lw->rx;
+  if( rx->task )
+  {
+    return ESP_OK;
+  }
+
+  rx->lock = xSemaphoreCreateMutex();
+  rx->line_ready = xSemaphoreCreateBinary();
+  if( !rx->lock || !rx->line_ready )
+  {
+    ESP_LOGE( lw->tag, "Failed to allocate RX synchronization primitives" );
+    return ESP_ERR_NO_MEM;
+  }
+
+  if( xTaskCreate( _unit_lorawan_rx_task, "lorawan_rx",
+                   UNIT_LORAWAN_RX_TASK_STACK_SIZE, lw,
+                   UNIT_LORAWAN_RX_TASK_PRIORITY, &rx->task ) != pdPASS )
+  {
+    ESP_LOGE( lw->tag, "Failed to create LoRaWAN RX task" );
+    rx->task = NULL;
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+// Arms the line capture before the command is written so no reply is missed
+static void _unit_lorawan_rx_begin( lorawan_instance_t *lw, char *buffer,
+                                    size_t buffer_size, uint32_t final_tags,
+                                    const lorawan_line_sink_t *sink )
+{
+  lorawan_rx_t *rx = &lw->rx;
+  xSemaphoreTake( rx->lock, portMAX_DELAY );
+  buffer[ 0 ] = '\0';
+  rx->capture = buffer;
+  rx->capture_size = buffer_size;
+  rx->capture_len = 0;
+  rx->complete = false;
+  rx->final_tags = final_tags;
+  rx->sink = sink;
+  rx->tags = 0;
+  rx->result.tag = LORAWAN_TAG_NONE;
+  rx->error.tag = LORAWAN_TAG_NONE;
+  rx->line_len = 0; // Drop any partial line left over from earlier output
+  xSemaphoreTake( rx->line_ready, 0 );
+  xSemaphoreGive( rx->lock );
+}
+
+// Detaches the capture buffer and returns the number of bytes it holds. The
+// line classification gathered while capturing is copied to the response.
+static size_t _unit_lorawan_rx_end( lorawan_instance_t *lw,
+                                    lorawan_response_t *response )
+{
+  lorawan_rx_t *rx = &lw->rx;
+  xSemaphoreTake( rx->lock, portMAX_DELAY );
+  size_t captured = rx->capture_len;
+  if( response )
+  {
+    response->tags = rx->tags;
+    response->result = rx->result;
+    // Failure lines only contribute their reason code
+    response->error_code[ 0 ] = '\0';
+    if( rx->error.tag != LORAWAN_TAG_NONE && rx->error.value )
+    {
+      sscanf( rx->error.value, "%15s", response->error_code );
+    }
+  }
+  rx->capture = NULL;
+  rx->capture_size = 0;
+  rx->final_tags = 0;
+  rx->sink = NULL; // A late line must not reach a caller that has returned
+  xSemaphoreGive( rx->lock );
+  return captured;
+}
+
+static esp_err_t _unit_lorawan_wait_for_response( lorawan_instance_t *lw,
+                                                  lorawan_response_t *response,
+                                                  size_t *received_len,
+                                                  uint32_t timeout_ms )
+{
+  lorawan_rx_t *rx = &lw->rx;
+  TickType_t start = xTaskGetTickCount();
+  TickType_t timeout_ticks = pdMS_TO_TICKS( timeout_ms );
+  bool complete = false;
+
+  for( ;; )
+  {
+    xSemaphoreTake( rx->lock, portMAX_DELAY );
+    complete = rx->complete;
+    xSemaphoreGive( rx->lock );
+
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    if( complete || elapsed >= timeout_ticks )
+    {
+      break;
+    }
+    xSemaphoreTake( rx->line_ready, timeout_ticks - elapsed );
+  }
+
+  *received_len = _unit_lorawan_rx_end( lw, response );
+  if( complete )
+  {
+    return ESP_OK;
+  }
+  if( *received_len > 0 )
+  {
+    // Some responses carry no final result code; hand over what arrived
+    ESP_LOGD( lw->tag, "No final result code after %u ms, using %zu bytes",
+              timeout_ms, *received_len );
+    return ESP_OK;
+  }
+  ESP_LOGW( lw->tag, "Timeout waiting for response after %u ms", timeout_ms );
+  return ESP_ERR_TIMEOUT;
+}
+
+// Classifies the captured response from the tags the RX task recorded for
+// each line. Response data is not copied: it points into raw_response, which
+// the caller hands over to the parsed response.
+static esp_err_t _unit_lorawan_parse_response(
+    lorawan_instance_t *lw, char *raw_response, size_t response_len,
+    lorawan_response_t *parsed_response )
+{
+  if( !raw_response || !parsed_response || response_len == 0 )
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  uint32_t tags = parsed_response->tags;
+  parsed_response->success = false;
+  parsed_response->response_data = NULL;
+  parsed_response->data_length = 0;
+
+  if( tags & LORAWAN_TAGS_SUCCESS )
+  {
+    parsed_response->success = true;
+    LORAWAN_PATH_LOGD( lw, "Command executed successfully" );
+  }
+  else if( tags & LORAWAN_TAGS_FAILURE )
+  {
+    ESP_LOGW( lw->tag, "Command failed with error: %s",
+              parsed_response->error_code );
+  }
+  // Some queries answer with their +COMMAND: line and no final OK
+  else if( tags & LORAWAN_TAGS_DATA )
+  {
+    parsed_response->success = true;
+  }
+
+  if( tags & LORAWAN_TAGS_DATA )
+  {
+    parsed_response->data_length = response_len;
+    parsed_response->response_data = raw_response;
+    LORAWAN_PATH_LOGD( lw, "Response data captured: %s",
+                       parsed_response->response_data );
+  }
+
+  return ESP_OK;
+}
+
+static esp_err_t _unit_lorawan_send_at_command( lorawan_instance_t *lw,
+                                                const char *cmd,
+                                                lorawan_response_t *response,
+                                                uint32_t timeout_ms )
+{
+  return _unit_lorawan_send_at_command_until( lw, cmd, response, timeout_ms, 0,
+                                              NULL );
+}
+
+static size_t _unit_lorawan_command_policy( const char *cmd )
+{
+  size_t name_len = strcspn( cmd, "=? " );
+  for( size_t i = 0; i < LORAWAN_COMMAND_POLICY_COUNT - 2; i++ )
+  {
+    const char *name = _unit_lorawan_command_policies[ i ].name;
+    if( strlen( name ) == name_len && strncmp( cmd, name, name_len ) == 0 )
+    {
+      return i;
+    }
+  }
+  return LORAWAN_COMMAND_POLICY_COUNT - ( strchr( cmd, '?' ) ? 2 : 1 );
+}
+
+// Mean and deviation as in TCP's retransmission timer (RFC 6298). Only
+// first attempts are sampled, as a late answer to a retried command can't
+// be told apart from the answer to the retry.
+static void _unit_lorawan_latency_observe( lorawan_instance_t *lw,
+                                           size_t policy, int64_t latency_us )
+{
+  lorawan_latency_t *latency = &lw->latency[ policy ];
+  uint32_t sample = latency_us > UINT32_MAX ? UINT32_MAX : latency_us;
+  if( latency->samples == 0 )
+  {
+    latency->srtt_us = sample;
+    latency->rttvar_us = sample / 2;
+  }
+  else
+  {
+    uint32_t delta = sample > latency->srtt_us ? sample - latency->srtt_us
+                                               : latency->srtt_us - sample;
+    latency->rttvar_us = ( 3 * (uint64_t)latency->rttvar_us + delta ) / 4;
+    latency->srtt_us = ( 7 * (uint64_t)latency->srtt_us + sample ) / 8;
+  }
+  if( latency->samples < UINT8_MAX )
+  {
+    latency->samples++;
+  }
+}
+
+// First attempt timeout: the smoothed latency plus four deviations once
+// enough answers were seen, never below the class floor or above limit_ms
+static uint32_t _unit_lorawan_command_timeout( lorawan_instance_t *lw,
+                                               size_t policy,
+                                               uint32_t limit_ms )
+{
+  const lorawan_latency_t *latency = &lw->latency[ policy ];
+  uint32_t floor_ms = UNIT_LORAWAN_NORMAL_TIMEOUT_FLOOR_MS;
+  uint32_t timeout_ms = limit_ms;
+  switch( _unit_lorawan_command_policies[ policy ].latency )
+  {
+  case LORAWAN_LATENCY_RADIO:
+    return limit_ms;
+  case LORAWAN_LATENCY_QUICK:
+    floor_ms = UNIT_LORAWAN_QUICK_TIMEOUT_FLOOR_MS;
+    timeout_ms = UNIT_LORAWAN_QUICK_TIMEOUT_INITIAL_MS;
+    break;
+  case LORAWAN_LATENCY_NORMAL:
+    break;
+  }
+
+  if( latency->samples >= UNIT_LORAWAN_LATENCY_MIN_SAMPLES )
+  {
+    uint64_t rto_us =
+        latency->srtt_us + 4 * (uint64_t)latency->rttvar_us + 999;
+    timeout_ms = rto_us / 1000;
+  }
+  if( timeout_ms < floor_ms )
+  {
+    timeout_ms = floor_ms;
+  }
+  return timeout_ms < limit_ms ? timeout_ms : limit_ms;
+}
+
+// Brings the link out of idle before an exchange: takes the PM lock back and
+// wakes the module if it was left in low power mode
+static void _unit_lorawan_power_wake( lorawan_instance_t *lw )
+{
+  lorawan_power_t *power = &lw->power;
+  portENTER_CRITICAL( &power->lock );
+  bool idle = power->idle;
+  bool asleep = power->asleep;
+  power->idle = false;
+  power->asleep = false;
+  portEXIT_CRITICAL( &power->lock );
+
+#ifdef CONFIG_PM_ENABLE
+  if( idle && power->pm_lock )
+  {
+    esp_pm_lock_acquire( power->pm_lock );
+  }
+#else
+  (void)idle;
+#endif
+
+  if( asleep )
+  {
+    size_t written = 0;
+    lw->transport.write( (const char *)_unit_lorawan_wake_sequence,
+                         sizeof( _unit_lorawan_wake_sequence ), &written,
+                         lw->transport.ctx );
+#ifdef CONFIG_LORAWAN_STATS
+    _unit_lorawan_stats_uart( lw, written, 0 );
+#endif
+    vTaskDelay( pdMS_TO_TICKS( UNIT_LORAWAN_WAKE_SETTLE_MS ) + 1 );
+    ESP_LOGD( lw->tag, "Module woken from low power mode" );
+  }
+}
+
+static void _unit_lorawan_power_touch( lorawan_instance_t *lw )
+{
+  portENTER_CRITICAL( &lw->power.lock );
+  lw->power.active = xTaskGetTickCount();
+  portEXIT_CRITICAL( &lw->power.lock );
+}
+
+static esp_err_t _unit_lorawan_driver_select_port( lorawan_instance_t *lw,
+                                                   uint8_t port );
+
+// Runs one command on the UART, retrying until it parses. Timeouts start
+// from the command's observed latency and double on every retry, up to the
+// caller's timeout. A command that is not idempotent is only sent again if
+// it never reached the module. Only ever called from the driver task, so
+// exchanges never interleave on the port.
+static esp_err_t _unit_lorawan_driver_execute( lorawan_instance_t *lw,
+                                               lorawan_command_t *command )
+{
+  esp_err_t err = ESP_FAIL;
+  size_t policy = _unit_lorawan_command_policy( command->cmd );
+  uint32_t timeout_ms =
+      _unit_lorawan_command_timeout( lw, policy, command->timeout_ms );
+  uint32_t backoff_ms = UNIT_LORAWAN_RETRY_BACKOFF_MIN_MS;
+
+  // The FPort goes out in the same driver turn as its uplink, so no other
+  // uplink can move the port between CAPPPORT and DTRX
+  if( command->port != 0 )
+  {
+    err = _unit_lorawan_driver_select_port( lw, command->port );
+    if( err != ESP_OK )
+    {
+      return err;
+    }
+  }
+
+  _unit_lorawan_power_wake( lw );
+  for( int retry = 0; retry < command->attempts; retry++ )
+  {
+    if( retry > 0 )
+    {
+      ESP_LOGW( lw->tag, "Retrying command (attempt %d/%d, %u ms): %s",
+                retry + 1, command->attempts, timeout_ms, command->cmd );
+      vTaskDelay( pdMS_TO_TICKS( backoff_ms ) );
+      if( backoff_ms < UNIT_LORAWAN_RETRY_BACKOFF_MAX_MS )
+      {
+        backoff_ms *= 2;
+      }
+    }
+
+    // Capture response lines from the RX task
+    _unit_lorawan_rx_begin( lw, command->response_buffer,
+                            command->response_size, command->final_tags,
+                            command->sink );
+
+    // Send command
+    int64_t started_us = esp_timer_get_time();
+    size_t written = 0;
+    err = lw->transport.write( command->at_cmd, strlen( command->at_cmd ),
+                               &written, lw->transport.ctx );
+#ifdef CONFIG_LORAWAN_STATS
+    _unit_lorawan_stats_uart( lw, written, 0 );
+#endif
+    if( err != ESP_OK )
+    {
+      ESP_LOGE( lw->tag, "Failed to send AT command: %s", command->cmd );
+      _unit_lorawan_rx_end( lw, NULL );
+#ifdef CONFIG_LORAWAN_STATS
+      _unit_lorawan_stats_attempt( lw, command->cmd, retry, err, false, false,
+                                   started_us );
+#endif
+#ifdef CONFIG_LORAWAN_EVENT_LOG
+      _unit_lorawan_event_log_command( lw, command->cmd, retry, err,
+                                       started_us );
+#endif
+      continue;
+    }
+
+    LORAWAN_PATH_LOGD( lw, "Sent AT command (%zu bytes): %s", written,
+                       command->at_cmd );
+
+    // The capture was armed before the write, so wait right away
+    size_t received_len = 0;
+    err = _unit_lorawan_wait_for_response( lw, command->response, &received_len,
+                                           timeout_ms );
+    bool answered = err == ESP_OK;
+    if( answered && retry == 0 )
+    {
+      _unit_lorawan_latency_observe( lw, policy,
+                                     esp_timer_get_time() - started_us );
+    }
+
+    if( err == ESP_OK && command->response )
+    {
+      err = _unit_lorawan_parse_response( lw, command->response_buffer,
+                                          received_len, command->response );
+    }
+#ifdef CONFIG_LORAWAN_STATS
+    _unit_lorawan_stats_attempt(
+        lw, command->cmd, retry, err, answered,
+        !command->response || command->response->success, started_us );
+#endif
+#ifdef CONFIG_LORAWAN_EVENT_LOG
+    _unit_lorawan_event_log_command(
+        lw, command->cmd, retry,
+        err == ESP_OK && command->response && !command->response->success
+            ? ESP_FAIL
+            : err,
+        started_us );
+#endif
+
+    if( err == ESP_OK )
+    {
+      break; // Success, exit retry loop
+    }
+    if( !_unit_lorawan_command_policies[ policy ].idempotent )
+    {
+      ESP_LOGW( lw->tag, "Not retrying %s, the module may have acted on it",
+                command->cmd );
+      break;
+    }
+
+    // Back off before the next attempt, which also gets longer to answer
+    timeout_ms = timeout_ms > command->timeout_ms / 2 ? command->timeout_ms
+                                                      : timeout_ms * 2;
+  }
+  _unit_lorawan_power_touch( lw );
+  return err;
+}
+
+// DTRX has no port field, so the port is selected ahead of the uplink. Runs
+// on the driver task with a capture of its own, so it leases no buffers.
+static esp_err_t _unit_lorawan_driver_select_port( lorawan_instance_t *lw,
+                                                   uint8_t port )
+{
+  if( _unit_lorawan_session_port_is( lw, port ) )
+  {
+    return ESP_OK;
+  }
+
+  char port_cmd[ sizeof( "CAPPPORT=255" ) ];
+  char at_cmd[ sizeof( "AT+CAPPPORT=255\r\n" ) ];
+  char capture[ 64 ];
+  snprintf( port_cmd, sizeof( port_cmd ), "CAPPPORT=%u", port );
+  snprintf( at_cmd, sizeof( at_cmd ), "AT+%s\r\n", port_cmd );
+  lorawan_response_t response = { 0 };
+  lorawan_command_t command = {
+      .cmd = port_cmd,
+      .at_cmd = at_cmd,
+      .response_buffer = capture,
+      .response_size = sizeof( capture ),
+      .response = &response,
+      .timeout_ms = UNIT_LORAWAN_RESPONSE_TIMEOUT_MS,
+      .attempts = UNIT_LORAWAN_MAX_RETRIES,
+  };
+  esp_err_t err = _unit_lorawan_driver_execute( lw, &command );
+  if( err == ESP_OK && !response.success )
+  {
+    err = ESP_FAIL;
+  }
+  if( err != ESP_OK )
+  {
+    ESP_LOGE( lw->tag, "✗ Failed to select FPort %u", port );
+    return err;
+  }
+  _unit_lorawan_session_set_port( lw, port );
+  return ESP_OK;
+}
+
+static bool _unit_lorawan_tick_reached( TickType_t now, TickType_t when )
+{
+  return (int32_t)( now - when ) >= 0;
+}
+
+// Ticks the driver may sleep before the join watch needs attention
+static TickType_t _unit_lorawan_join_watch_wait( lorawan_instance_t *lw )
+{
+  lorawan_join_t *join = &lw->join;
+  portENTER_CRITICAL( &join->lock );
+  bool active = join->active;
+  portEXIT_CRITICAL( &join->lock );
+  if( !active )
+  {
+    return portMAX_DELAY;
+  }
+  if( xEventGroupGetBits( join->events ) &
+      ( LORAWAN_JOIN_ACCEPTED_BIT | LORAWAN_JOIN_FAILED_BIT ) )
+  {
+    return 0;
+  }
+
+  TickType_t now = xTaskGetTickCount();
+  TickType_t due = join->deadline;
+  if( join->retry_pending && (int32_t)( join->retry_at - due ) < 0 )
+  {
+    due = join->retry_at;
+  }
+  return _unit_lorawan_tick_reached( now, due ) ? 0 : due - now;
+}
+
+static void _unit_lorawan_join_watch_finish( lorawan_instance_t *lw,
+                                             bool joined, uint8_t error_code )
+{
+  lorawan_join_t *join = &lw->join;
+  uint32_t elapsed_ms =
+      pdTICKS_TO_MS( xTaskGetTickCount() - join->started );
+  if( joined )
+  {
+    ESP_LOGI( lw->tag, "✓ TTN network join successful after %u ms",
+              elapsed_ms );
+  }
+  else
+  {
+    ESP_LOGE( lw->tag, "✗ TTN network join %s after %u ms",
+              error_code == 1 ? "timeout" : "failed", elapsed_ms );
+    ESP_LOGE( lw->tag, "Check TTN console, gateway coverage, and credentials" );
+  }
+#ifdef CONFIG_LORAWAN_EVENT_LOG
+  _unit_lorawan_event_log( lw, UNIT_LORAWAN_LOG_EVENT_JOIN,
+                           UNIT_LORAWAN_STATS_COMMAND_JOIN, error_code,
+                           joined            ? ESP_OK
+                           : error_code == 1 ? ESP_ERR_TIMEOUT
+                                             : ESP_FAIL,
+                           elapsed_ms );
+#endif
+
+  portENTER_CRITICAL( &join->lock );
+  join->active = false;
+  unit_lorawan_ttn_join_callback_t callback = join->callback;
+  void *user_data = join->user_data;
+  portEXIT_CRITICAL( &join->lock );
+
+  if( callback )
+  {
+    callback( joined, error_code, user_data );
+  }
+}
+
+// Reacts to +CJOIN results, retries with back-off and falls back to a single
+// CSTATUS? query once the deadline passes without a result
+static void _unit_lorawan_join_watch_service( lorawan_instance_t *lw )
+{
+  lorawan_join_t *join = &lw->join;
+  portENTER_CRITICAL( &join->lock );
+  bool active = join->active;
+  portEXIT_CRITICAL( &join->lock );
+  if( !active )
+  {
+    return;
+  }
+
+  TickType_t now = xTaskGetTickCount();
+  EventBits_t bits = xEventGroupGetBits( join->events );
+  if( bits & LORAWAN_JOIN_ACCEPTED_BIT )
+  {
+    _unit_lorawan_join_watch_finish( lw, true, 0 );
+    return;
+  }
+
+  if( bits & LORAWAN_JOIN_FAILED_BIT )
+  {
+    xEventGroupClearBits( join->events, LORAWAN_JOIN_FAILED_BIT );
+    TickType_t retry_at = now + pdMS_TO_TICKS( join->backoff_ms );
+    if( (int32_t)( join->deadline - retry_at ) <= 0 )
+    {
+      _unit_lorawan_join_watch_finish( lw, false, 2 );
+      return;
+    }
+    ESP_LOGW( lw->tag, "Join attempt failed, retrying in %u ms",
+              join->backoff_ms );
+    join->retry_pending = true;
+    join->retry_at = retry_at;
+    join->backoff_ms = join->backoff_ms * 2 > UNIT_LORAWAN_JOIN_BACKOFF_MAX_MS
+                           ? UNIT_LORAWAN_JOIN_BACKOFF_MAX_MS
+                           : join->backoff_ms * 2;
+    return;
+  }
+
+  if( join->retry_pending && _unit_lorawan_tick_reached( now, join->retry_at ) )
+  {
+    join->retry_pending = false;
+    if( unit_lorawan_join_h( lw ) != ESP_OK )
+    {
+      ESP_LOGW( lw->tag, "Join retry could not be issued" );
+    }
+    return;
+  }
+
+  if( _unit_lorawan_tick_reached( now, join->deadline ) )
+  {
+    // The +CJOIN URC may have been missed; ask the module once
+    bool connected = false;
+    unit_lorawan_connected_h( lw, &connected );
+    _unit_lorawan_join_watch_finish( lw, connected, connected ? 0 : 1 );
+  }
+}
+
+// Arms the join watch. The join itself must already have been issued.
+static void _unit_lorawan_join_watch_start(
+    lorawan_instance_t *lw, unit_lorawan_ttn_join_callback_t callback,
+    void *user_data, uint16_t timeout_sec )
+{
+  lorawan_join_t *join = &lw->join;
+  TickType_t now = xTaskGetTickCount();
+  portENTER_CRITICAL( &join->lock );
+  join->callback = callback;
+  join->user_data = user_data;
+  join->started = now;
+  join->deadline = now + pdMS_TO_TICKS( (uint32_t)timeout_sec * 1000 );
+  join->retry_pending = false;
+  join->backoff_ms = UNIT_LORAWAN_JOIN_BACKOFF_MIN_MS;
+  join->active = true;
+  portEXIT_CRITICAL( &join->lock );
+
+  ESP_LOGI( lw->tag, "TTN join monitoring started (timeout: %d seconds)",
+            timeout_sec );
+  _unit_lorawan_driver_wake( lw );
+}
+
+// Ticks the driver may sleep before the link should go idle
+static TickType_t _unit_lorawan_power_wait( lorawan_instance_t *lw )
+{
+  lorawan_power_t *power = &lw->power;
+  portENTER_CRITICAL( &lw->join.lock );
+  bool joining = lw->join.active;
+  portEXIT_CRITICAL( &lw->join.lock );
+  portENTER_CRITICAL( &power->lock );
+  bool idle = power->idle;
+  bool enter = power->enter;
+  TickType_t idle_at =
+      power->active + pdMS_TO_TICKS( UNIT_LORAWAN_LOW_POWER_IDLE_MS );
+  portEXIT_CRITICAL( &power->lock );
+
+  // A pending join still expects +CJOIN, so the link stays up until it ends
+  if( joining )
+  {
+    return portMAX_DELAY;
+  }
+  if( enter )
+  {
+    return 0;
+  }
+  if( idle )
+  {
+    return portMAX_DELAY;
+  }
+  TickType_t now = xTaskGetTickCount();
+  return _unit_lorawan_tick_reached( now, idle_at ) ? 0 : idle_at - now;
+}
+
+// Takes the link idle once the idle time has passed without an exchange
+static void _unit_lorawan_power_service( lorawan_instance_t *lw )
+{
+  if( _unit_lorawan_power_wait( lw ) != 0 )
+  {
+    return;
+  }
+
+  lorawan_power_t *power = &lw->power;
+  portENTER_CRITICAL( &power->lock );
+  bool low_power = power->low_power;
+  bool asleep = power->asleep;
+  power->enter = false;
+  portEXIT_CRITICAL( &power->lock );
+
+  if( low_power && !asleep )
+  {
+    lorawan_response_t response = { 0 };
+    esp_err_t err = _unit_lorawan_send_at_command(
+        lw, "CLPM=1", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+    asleep = err == ESP_OK && response.success;
+    _unit_lorawan_cleanup_response( lw, &response );
+    if( asleep )
+    {
+      ESP_LOGD( lw->tag, "Module entered low power mode" );
+    }
+    else
+    {
+      ESP_LOGW( lw->tag, "⚠ Module did not enter low power mode" );
+    }
+  }
+
+  portENTER_CRITICAL( &power->lock );
+  bool idle = power->idle;
+  power->idle = true;
+  power->asleep = asleep;
+  portEXIT_CRITICAL( &power->lock );
+
+#ifdef CONFIG_PM_ENABLE
+  if( !idle && power->pm_lock )
+  {
+    esp_pm_lock_release( power->pm_lock );
+  }
+#else
+  (void)idle;
+#endif
+}
+
+// The link starts up with the PM lock held. The module's power state is
+// unknown after a host reset, so the first exchange always wakes it.
+static esp_err_t _unit_lorawan_power_start( lorawan_instance_t *lw )
+{
+  lorawan_power_t *power = &lw->power;
+#ifdef CONFIG_PM_ENABLE
+  if( !power->pm_lock )
+  {
+    // APB_FREQ_MAX also rules out light sleep and keeps the UART baud rate
+    // stable under dynamic frequency scaling
+    esp_err_t err = esp_pm_lock_create( ESP_PM_APB_FREQ_MAX, 0, "lorawan",
+                                        &power->pm_lock );
+    if( err != ESP_OK )
+    {
+      ESP_LOGE( lw->tag, "Failed to create LoRaWAN PM lock: %s",
+                esp_err_to_name( err ) );
+      power->pm_lock = NULL;
+      return err;
+    }
+  }
+#endif
+
+  portENTER_CRITICAL( &power->lock );
+  power->idle = true;
+  power->asleep = true;
+  power->active = xTaskGetTickCount();
+  portEXIT_CRITICAL( &power->lock );
+  return ESP_OK;
+}
+
+// Milliseconds left before the deadline passes, UINT32_MAX without one
+static uint32_t
+_unit_lorawan_deadline_remaining_ms( const lorawan_deadline_t *deadline )
+{
+  if( !deadline || deadline->max_age_ms == 0 )
+  {
+    return UINT32_MAX;
+  }
+  uint32_t age_ms = pdTICKS_TO_MS( xTaskGetTickCount() - deadline->start );
+  return age_ms < deadline->max_age_ms ? deadline->max_age_ms - age_ms : 0;
+}
+
+static lorawan_command_t *
+_unit_lorawan_driver_take_urgent( lorawan_driver_t *driver )
+{
+  portENTER_CRITICAL( &driver->lock );
+  lorawan_command_t *command = driver->urgent;
+  driver->urgent = NULL;
+  portEXIT_CRITICAL( &driver->lock );
+  return command;
+}
+
+static void _unit_lorawan_driver_task( void *pvParameters )
+{
+  lorawan_instance_t *lw = (lorawan_instance_t *)pvParameters;
+  lorawan_driver_t *driver = &lw->driver;
+
+  for( ;; )
+  {
+    // A NULL entry only wakes the task to service the join watch, the
+    // aggregation deadline, the link idle timer, the channel survey and the
+    // spool drain
+    TickType_t wait = _unit_lorawan_join_watch_wait( lw );
+    TickType_t aggregator_wait = _unit_lorawan_aggregator_wait( lw );
+    if( aggregator_wait < wait )
+    {
+      wait = aggregator_wait;
+    }
+    TickType_t power_wait = _unit_lorawan_power_wait( lw );
+    if( power_wait < wait )
+    {
+      wait = power_wait;
+    }
+#ifdef CONFIG_LORAWAN_SURVEY
+    TickType_t survey_wait = _unit_lorawan_survey_wait( lw );
+    if( survey_wait < wait )
+    {
+      wait = survey_wait;
+    }
+#endif
+#ifdef CONFIG_LORAWAN_SPOOL
+    TickType_t spool_wait = _unit_lorawan_spool_wait( lw );
+    if( spool_wait < wait )
+    {
+      wait = spool_wait;
+    }
+#endif
+
+    // The interactive lane goes first, ahead of any queued bulk command
+    lorawan_command_t *command = _unit_lorawan_driver_take_urgent( driver );
+    if( !command && xQueueReceive( driver->queue, &command, wait ) != pdTRUE )
+    {
+      command = NULL;
+    }
+    if( command )
+    {
+      if( _unit_lorawan_deadline_remaining_ms( command->deadline ) == 0 )
+      {
+        ESP_LOGW( lw->tag, "⚠ Dropping stale %s, queued %u ms",
+                  command->cmd,
+                  pdTICKS_TO_MS( xTaskGetTickCount() -
+                                 command->deadline->start ) );
+        command->deadline->expired = true;
+        command->result = ESP_ERR_TIMEOUT;
+      }
+      else
+      {
+        command->result = _unit_lorawan_driver_execute( lw, command );
+      }
+      xSemaphoreGive( command->done );
+    }
+    _unit_lorawan_join_watch_service( lw );
+    _unit_lorawan_aggregator_service( lw );
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+    _unit_lorawan_store_service( lw );
+#endif
+#ifdef CONFIG_LORAWAN_SURVEY
+    _unit_lorawan_survey_service( lw );
+#endif
+#ifdef CONFIG_LORAWAN_SPOOL
+    _unit_lorawan_spool_service( lw );
+#endif
+    _unit_lorawan_power_service( lw );
+  }
+}
+
+static esp_err_t _unit_lorawan_driver_start( lorawan_instance_t *lw )
+{
+  lorawan_driver_t *driver = &lw->driver;
+  if( driver->task )
+  {
+    return ESP_OK;
+  }
+
+  if( !driver->queue )
+  {
+    driver->queue = xQueueCreate( UNIT_LORAWAN_COMMAND_QUEUE_LENGTH,
+                                  sizeof( lorawan_command_t * ) );
+    if( !driver->queue )
+    {
+      ESP_LOGE( lw->tag, "Failed to allocate LoRaWAN command queue" );
+      return ESP_ERR_NO_MEM;
+    }
+  }
+
+  if( !driver->urgent_lock )
+  {
+    driver->urgent_lock =
+        xSemaphoreCreateMutexStatic( &driver->urgent_lock_buffer );
+  }
+
+  if( !lw->join.events )
+  {
+    lw->join.events = xEventGroupCreate();
+    if( !lw->join.events )
+    {
+      ESP_LOGE( lw->tag, "Failed to allocate LoRaWAN join event group" );
+      return ESP_ERR_NO_MEM;
+    }
+  }
+
+  if( xTaskCreate( _unit_lorawan_driver_task, "lorawan_drv",
+                   UNIT_LORAWAN_DRIVER_TASK_STACK_SIZE, lw,
+                   UNIT_LORAWAN_DRIVER_TASK_PRIORITY,
+                   &driver->task ) != pdPASS )
+  {
+    ESP_LOGE( lw->tag, "Failed to create LoRaWAN driver task" );
+    driver->task = NULL;
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+// Hands an interactive command to the driver through the lane slot. Taking
+// the slot and waiting for the driver to pick the command up share one
+// UNIT_LORAWAN_INTERACTIVE_WAIT_MS budget. A command the driver has not
+// started by then is withdrawn, so a long uplink never freezes a query.
+static esp_err_t
+_unit_lorawan_driver_submit_interactive( lorawan_instance_t *lw,
+                                         lorawan_command_t *command )
+{
+  lorawan_driver_t *driver = &lw->driver;
+  TickType_t start = xTaskGetTickCount();
+  TickType_t budget = pdMS_TO_TICKS( UNIT_LORAWAN_INTERACTIVE_WAIT_MS );
+  if( xSemaphoreTake( driver->urgent_lock, budget ) != pdTRUE )
+  {
+    ESP_LOGW( lw->tag, "⚠ Driver busy, %s not sent", command->cmd );
+    return ESP_ERR_TIMEOUT;
+  }
+
+  StaticSemaphore_t done_buffer;
+  command->done = xSemaphoreCreateBinaryStatic( &done_buffer );
+  command->result = ESP_FAIL;
+  portENTER_CRITICAL( &driver->lock );
+  driver->urgent = command;
+  portEXIT_CRITICAL( &driver->lock );
+  _unit_lorawan_driver_wake( lw );
+
+  TickType_t elapsed = xTaskGetTickCount() - start;
+  if( xSemaphoreTake( command->done,
+                      elapsed < budget ? budget - elapsed : 0 ) != pdTRUE )
+  {
+    portENTER_CRITICAL( &driver->lock );
+    bool withdrawn = driver->urgent == command;
+    if( withdrawn )
+    {
+      driver->urgent = NULL;
+    }
+    portEXIT_CRITICAL( &driver->lock );
+
+    if( withdrawn )
+    {
+      ESP_LOGW( lw->tag, "⚠ Driver busy, %s not sent", command->cmd );
+      command->result = ESP_ERR_TIMEOUT;
+    }
+    else
+    {
+      // Already running, its own timeout bounds the rest
+      xSemaphoreTake( command->done, portMAX_DELAY );
+    }
+  }
+  vSemaphoreDelete( command->done );
+  xSemaphoreGive( driver->urgent_lock );
+  return command->result;
+}
+
+// Queues the command for the driver task and blocks until it has run
+static esp_err_t _unit_lorawan_driver_submit( lorawan_instance_t *lw,
+                                              lorawan_command_t *command )
+{
+  lorawan_driver_t *driver = &lw->driver;
+  if( !driver->task )
+  {
+    ESP_LOGE( lw->tag, "LoRaWAN driver not initialized" );
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  // The RX task delivers the replies, so it can never wait for one
+  if( xTaskGetCurrentTaskHandle() == lw->rx.task )
+  {
+    ESP_LOGE( lw->tag, "Blocking LoRaWAN call from a URC handler: %s",
+              command->cmd );
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  // Work the driver task issues for itself must not wait on its own queue
+  if( xTaskGetCurrentTaskHandle() == driver->task )
+  {
+    return _unit_lorawan_driver_execute( lw, command );
+  }
+
+  if( command->timeout_ms <= UNIT_LORAWAN_RESPONSE_TIMEOUT_MS )
+  {
+    return _unit_lorawan_driver_submit_interactive( lw, command );
+  }
+
+  StaticSemaphore_t done_buffer;
+  command->done = xSemaphoreCreateBinaryStatic( &done_buffer );
+  command->result = ESP_FAIL;
+  xQueueSend( driver->queue, &command, portMAX_DELAY );
+  xSemaphoreTake( command->done, portMAX_DELAY );
+  vSemaphoreDelete( command->done );
+  return command->result;
+}
+
+// Runs an already framed line in the COMMAND buffer through the driver. The
+// caller keeps ownership of at_cmd; cmd only names the exchange in logs.
+static esp_err_t _unit_lorawan_exchange( lorawan_instance_t *lw,
+                                         const char *cmd, const char *at_cmd,
+                                         lorawan_response_t *response,
+                                         uint32_t timeout_ms,
+                                         uint32_t final_tags, uint8_t attempts,
+                                         const lorawan_line_sink_t *sink,
+                                         lorawan_deadline_t *deadline,
+                                         uint8_t port )
+{
+  // One capture buffer serves every attempt; a parsed response keeps it
+  char *response_buffer = NULL;
+  esp_err_t err = _unit_lorawan_buffer_alloc(
+      lw, LORAWAN_BUFFER_RESPONSE, UNIT_LORAWAN_RESPONSE_BUFFER_SIZE,
+      timeout_ms, &response_buffer );
+  if( err != ESP_OK )
+  {
+    return err;
+  }
+
+  // Buffers stay with the caller so the static arena lease never changes task
+  lorawan_command_t command = {
+      .cmd = cmd,
+      .at_cmd = at_cmd,
+      .response_buffer = response_buffer,
+      .response_size = UNIT_LORAWAN_RESPONSE_BUFFER_SIZE,
+      .response = response,
+      .timeout_ms = timeout_ms,
+      .final_tags = final_tags,
+      .sink = sink,
+      .attempts = attempts,
+      .deadline = deadline,
+      .port = port,
+  };
+  err = _unit_lorawan_driver_submit( lw, &command );
+
+  if( !response || response->response_data != response_buffer )
+  {
+    _unit_lorawan_buffer_free( lw, LORAWAN_BUFFER_RESPONSE, response_buffer );
+  }
+
+  if( err != ESP_OK )
+  {
+    ESP_LOGE( lw->tag, "Command failed after %d retries: %s", attempts, cmd );
+  }
+
+  return err;
+}
+
+static esp_err_t _unit_lorawan_send_at_command_until(
+    lorawan_instance_t *lw, const char *cmd, lorawan_response_t *response,
+    uint32_t timeout_ms, uint32_t final_tags, const lorawan_line_sink_t *sink )
+{
+  if( !cmd )
+  {
+    ESP_LOGE( lw->tag, "Command cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // Format AT command
+  size_t at_cmd_len =
+      strlen( cmd ) + 6; // "AT+" + cmd + "\r\n" + null terminator
+  char *at_cmd = NULL;
+  esp_err_t err = _unit_lorawan_buffer_alloc( lw, LORAWAN_BUFFER_COMMAND,
+                                              at_cmd_len, timeout_ms, &at_cmd );
+  if( err != ESP_OK )
+  {
+    return err;
+  }
+
+  snprintf( at_cmd, at_cmd_len, "AT+%s\r\n", cmd );
+
+  err = _unit_lorawan_exchange( lw, cmd, at_cmd, response, timeout_ms,
+                                final_tags, UNIT_LORAWAN_MAX_RETRIES, sink,
+                                NULL, 0 );
+
+  _unit_lorawan_buffer_free( lw, LORAWAN_BUFFER_COMMAND, at_cmd );
+  return err;
+}
+
+static void _unit_lorawan_cleanup_response( lorawan_instance_t *lw,
+                                            lorawan_response_t *response )
+{
+  if( response && response->response_data )
+  {
+    _unit_lorawan_buffer_free( lw, LORAWAN_BUFFER_RESPONSE,
+                               response->response_data );
+    response->response_data = NULL;
+    response->data_length = 0;
+  }
+}
+
+// Sends one bare "AT" and reports whether the module answered OK
+static bool _unit_lorawan_probe( lorawan_instance_t *lw )
+{
+  char capture[ 32 ];
+  lorawan_response_t response = { 0 };
+  lorawan_command_t command = {
+      .cmd = "AT",
+      .at_cmd = "AT\r\n",
+      .response_buffer = capture,
+      .response_size = sizeof( capture ),
+      .response = &response,
+      .timeout_ms = UNIT_LORAWAN_PROBE_TIMEOUT_MS,
+      .attempts = 1,
+  };
+  esp_err_t err = _unit_lorawan_driver_submit( lw, &command );
+  return err == ESP_OK && response.success &&
+         ( response.tags & LORAWAN_TAG_BIT( LORAWAN_TAG_OK ) );
+}
+
+// Probes until the module answers, with timeout_ms as the only bound
+static esp_err_t _unit_lorawan_wait_ready( lorawan_instance_t *lw,
+                                           uint32_t timeout_ms )
+{
+  TickType_t start = xTaskGetTickCount();
+  do
+  {
+    if( _unit_lorawan_probe( lw ) )
+    {
+      ESP_LOGD( lw->tag, "Module ready after %u ms",
+                pdTICKS_TO_MS( xTaskGetTickCount() - start ) );
+      return ESP_OK;
+    }
+    vTaskDelay( pdMS_TO_TICKS( UNIT_LORAWAN_PROBE_INTERVAL_MS ) );
+  } while( pdTICKS_TO_MS( xTaskGetTickCount() - start ) < timeout_ms );
+  return ESP_ERR_TIMEOUT;
+}
+
+// Moves the host end of the link and drops anything framed at the old rate
+static esp_err_t _unit_lorawan_baud_switch( lorawan_instance_t *lw,
+                                            uint32_t baud )
+{
+  esp_err_t err = lw->transport.set_baud( baud, lw->transport.ctx );
+  if( err == ESP_OK )
+  {
+    bool flushed = false;
+    lw->transport.flush( &flushed, lw->transport.ctx );
+    lw->baud = baud;
+  }
+  return err;
+}
+
+// The module keeps its rate across host resets, so it may answer at either
+// the default or the configured one. Leaves the host on whichever works.
+static bool _unit_lorawan_baud_find( lorawan_instance_t *lw )
+{
+  if( !lw->transport.set_baud ||
+      UNIT_LORAWAN_BAUD_RATE == UNIT_LORAWAN_DATA_RATE )
+  {
+    return false;
+  }
+  if( _unit_lorawan_probe( lw ) )
+  {
+    return true;
+  }
+
+  uint32_t previous = lw->baud;
+  uint32_t other = previous == UNIT_LORAWAN_BAUD_RATE
+                       ? UNIT_LORAWAN_DATA_RATE
+                       : UNIT_LORAWAN_BAUD_RATE;
+  if( _unit_lorawan_baud_switch( lw, other ) == ESP_OK &&
+      _unit_lorawan_probe( lw ) )
+  {
+    ESP_LOGI( lw->tag, "✓ Module found at %u baud", (unsigned)other );
+    return true;
+  }
+  _unit_lorawan_baud_switch( lw, previous );
+  return false;
+}
+
+// Moves both ends to CONFIG_LORAWAN_BAUD_RATE with AT+CGBR, returning to
+// the default rate when the module or the wiring cannot hold it
+static esp_err_t _unit_lorawan_baud_sync( lorawan_instance_t *lw )
+{
+  uint32_t target = UNIT_LORAWAN_BAUD_RATE;
+  if( target == UNIT_LORAWAN_DATA_RATE )
+  {
+    return ESP_OK;
+  }
+  if( !lw->transport.set_baud )
+  {
+    ESP_LOGW( lw->tag, "⚠ Transport cannot change rate, staying at %u baud",
+              (unsigned)lw->baud );
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  if( !_unit_lorawan_baud_find( lw ) )
+  {
+    return ESP_ERR_TIMEOUT;
+  }
+  if( lw->baud == target )
+  {
+    return ESP_OK;
+  }
+
+  char cmd[ sizeof( "CGBR=4294967295" ) ];
+  snprintf( cmd, sizeof( cmd ), "CGBR=%u", (unsigned)target );
+  lorawan_response_t response = { 0 };
+  esp_err_t err = _unit_lorawan_send_at_command(
+      lw, cmd, &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+  bool accepted = err == ESP_OK && response.success;
+  _unit_lorawan_cleanup_response( lw, &response );
+  if( !accepted )
+  {
+    ESP_LOGW( lw->tag, "⚠ Module refused %u baud, staying at %u",
+              (unsigned)target, (unsigned)lw->baud );
+    return err != ESP_OK ? err : ESP_ERR_NOT_SUPPORTED;
+  }
+
+  vTaskDelay( pdMS_TO_TICKS( UNIT_LORAWAN_BAUD_SETTLE_MS ) + 1 );
+  err = _unit_lorawan_baud_switch( lw, target );
+  if( err == ESP_OK &&
+      _unit_lorawan_wait_ready( lw, UNIT_LORAWAN_BAUD_READY_MS ) == ESP_OK )
+  {
+    ESP_LOGI( lw->tag, "✓ UART switched to %u baud", (unsigned)target );
+    return ESP_OK;
+  }
+
+  // The host could not follow; the module may still be at the old rate
+  ESP_LOGW( lw->tag, "⚠ No answer at %u baud, returning to %u",
+            (unsigned)target, UNIT_LORAWAN_DATA_RATE );
+  _unit_lorawan_baud_switch( lw, UNIT_LORAWAN_DATA_RATE );
+  return _unit_lorawan_probe( lw ) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+// ILOGLVL only, so init can quiet the module without quieting the host
+static esp_err_t _unit_lorawan_module_log_level( lorawan_instance_t *lw,
+                                                 uint8_t level )
+{
+  ESP_LOGI( lw->tag, "Setting LoRaWAN log level to %d", level );
+
+  if( level > UNIT_LORAWAN_LOG_LEVEL_MAX )
+  {
+    ESP_LOGW( lw->tag, "Log level %d is out of range (0-%d), clamping to %d",
+              level, UNIT_LORAWAN_LOG_LEVEL_MAX, UNIT_LORAWAN_LOG_LEVEL_MAX );
+    level = UNIT_LORAWAN_LOG_LEVEL_MAX;
+  }
+
+  char log_cmd[ 32 ];
+  snprintf( log_cmd, sizeof( log_cmd ), "ILOGLVL=%d", level );
+
+  lorawan_response_t response = { 0 };
+  esp_err_t err = _unit_lorawan_send_at_command(
+      lw, log_cmd, &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+
+  if( err == ESP_OK && response.success )
+  {
+    ESP_LOGI( lw->tag, "✓ LoRaWAN log level set to %d successfully", level );
+  }
+  else
+  {
+    ESP_LOGE( lw->tag, "✗ Failed to set LoRaWAN log level" );
+  }
+
+  _unit_lorawan_cleanup_response( lw, &response );
+  return err;
+}
+
+esp_err_t unit_lorawan_log_h( unit_lorawan_handle_t lw, uint8_t level )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  esp_err_t err = _unit_lorawan_module_log_level( lw, level );
+  lw->log_level =
+      level > UNIT_LORAWAN_LOG_LEVEL_MAX ? UNIT_LORAWAN_LOG_LEVEL_MAX : level;
+  return err;
+}
+
+esp_err_t unit_lorawan_read_events_h( unit_lorawan_handle_t lw,
+                                      unit_lorawan_log_record_t *records,
+                                      size_t max_records, size_t *count,
+                                      uint32_t *lost )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+#ifdef CONFIG_LORAWAN_EVENT_LOG
+  if( !records || max_records == 0 || !count )
+  {
+    ESP_LOGE( lw->tag, "Invalid event log read parameters" );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // Oldest first; the records read are removed from the ring
+  lorawan_event_log_t *log = &lw->events;
+  portENTER_CRITICAL( &log->lock );
+  size_t n = log->count < max_records ? log->count : max_records;
+  size_t first = ( log->head + CONFIG_LORAWAN_EVENT_LOG_SIZE - log->count ) %
+                 CONFIG_LORAWAN_EVENT_LOG_SIZE;
+  for( size_t i = 0; i < n; i++ )
+  {
+    records[ i ] =
+        log->records[ ( first + i ) % CONFIG_LORAWAN_EVENT_LOG_SIZE ];
+  }
+  log->count -= n;
+  if( lost )
+  {
+    *lost = log->lost;
+  }
+  log->lost = 0;
+  portEXIT_CRITICAL( &log->lock );
+
+  *count = n;
+  return ESP_OK;
+#else
+  ESP_LOGW( lw->tag, "Event log disabled (CONFIG_LORAWAN_EVENT_LOG)" );
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t unit_lorawan_connected_h( unit_lorawan_handle_t lw, bool *state )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !state )
+  {
+    ESP_LOGE( lw->tag, "State parameter cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  ESP_LOGD( lw->tag, "Checking LoRaWAN network connection status" );
+  *state = false;
+
+  lorawan_response_t response = { 0 };
+  esp_err_t err = _unit_lorawan_send_at_command(
+      lw, "CSTATUS?", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+
+  if( err == ESP_OK && response.success && response.response_data )
+  {
+    if( response.result.tag != LORAWAN_TAG_CSTATUS )
+    {
+      ESP_LOGW( lw->tag, "✗ Could not find +CSTATUS: in response: %s",
+                response.response_data );
+    }
+    else if( response.result.field_count < 1 )
+    {
+      ESP_LOGW( lw->tag, "✗ Could not parse connection status from response" );
+    }
+    else
+    {
+      int32_t status_code = response.result.fields[ 0 ];
+      if( status_code == 4 || status_code == 8 )
+      {
+        *state = true;
+        ESP_LOGI( lw->tag, "✓ Device is connected to LoRaWAN network" );
+      }
+      else
+      {
+        const char *description =
+            _unit_lorawan_get_connection_status_description( status_code );
+        ESP_LOGI( lw->tag,
+                  "✗ Device not connected to network - Status: %02d (%s)",
+                  (int)status_code, description );
+      }
+    }
+  }
+  else
+  {
+    ESP_LOGE( lw->tag, "✗ Failed to check LoRaWAN connection status" );
+  }
+
+  if( err == ESP_OK )
+  {
+    _unit_lorawan_session_set_joined( lw, *state );
+  }
+
+  _unit_lorawan_cleanup_response( lw, &response );
+  return err;
+}
+
+esp_err_t unit_lorawan_join_h( unit_lorawan_handle_t lw )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  ESP_LOGI( lw->tag, "Attempting to join LoRaWAN network..." );
+
+  // Forget the outcome of any earlier attempt before the new one reports
+  if( lw->join.events )
+  {
+    xEventGroupClearBits( lw->join.events,
+                          LORAWAN_JOIN_ACCEPTED_BIT | LORAWAN_JOIN_FAILED_BIT );
+  }
+
+  lorawan_response_t response = { 0 };
+  // Use longer timeout for join operation
+  esp_err_t err = _unit_lorawan_send_at_command( lw, "CJOIN=1,1,10,8",
+                                                 &response,
+                                                 UNIT_LORAWAN_JOIN_TIMEOUT_MS );
+
+  if( err == ESP_OK && response.success )
+  {
+    _unit_lorawan_session_set_joined( lw, false );
+    ESP_LOGI( lw->tag, "✓ LoRaWAN join command sent successfully" );
+    ESP_LOGI( lw->tag,
+              "  Join process initiated - this may take up to 30 seconds" );
+    ESP_LOGI( lw->tag, "  Use unit_lorawan_connected() to check join status" );
+  }
+  else
+  {
+    ESP_LOGE( lw->tag, "✗ Failed to send LoRaWAN join command" );
+  }
+
+  _unit_lorawan_cleanup_response( lw, &response );
+  return err;
+}
+
+// Runtime values a script step can splice into its command
+typedef enum
+{
+  LORAWAN_SCRIPT_ARG_NONE,
+  LORAWAN_SCRIPT_ARG_DEV_EUI,
+  LORAWAN_SCRIPT_ARG_APP_EUI,
+  LORAWAN_SCRIPT_ARG_APP_KEY,
+  LORAWAN_SCRIPT_ARG_ULDL_MODE,
+  LORAWAN_SCRIPT_ARG_CHANNEL_MASK,
+  LORAWAN_SCRIPT_ARG_ADR,
+  LORAWAN_SCRIPT_ARG_DATA_RATE,
+  LORAWAN_SCRIPT_ARG_DEV_ADDR,
+  LORAWAN_SCRIPT_ARG_NWK_SKEY,
+  LORAWAN_SCRIPT_ARG_APP_SKEY,
+  LORAWAN_SCRIPT_ARG_COUNT
+} lorawan_script_arg_t;
+
+// One provisioning command. cmd may hold a single %s that takes args[arg].
+typedef struct
+{
+  const char *cmd;
+  lorawan_script_arg_t arg;
+  lorawan_tag_t expected_tag;
+  uint32_t timeout_ms;
+  const char *description;
+  bool optional; // A rejection is logged and the script carries on
+} lorawan_script_step_t;
+
+#define LORAWAN_SCRIPT_STEP( cmd, arg, description )                           \
+  { cmd, arg, LORAWAN_TAG_OK, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS, description,  \
+    false }
+#define LORAWAN_SCRIPT_STEP_OPTIONAL( cmd, arg, description )                  \
+  { cmd, arg, LORAWAN_TAG_OK, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS, description,  \
+    true }
+
+// Runs the steps back to back, each one issued as soon as the previous
+// result code arrives, through one command buffer leased for the whole
+// script. Stops at the first required step the module rejects; nothing
+// written so far is persisted until CSAVE, so a reboot undoes it. Bit i of
+// completed is set for every step i the module accepted.
+static esp_err_t
+_unit_lorawan_run_script( lorawan_instance_t *lw, const char *name,
+                          const lorawan_script_step_t *steps, size_t count,
+                          const char *const args[ LORAWAN_SCRIPT_ARG_COUNT ],
+                          uint32_t *completed )
+{
+  // The lease follows the lane of the slowest step
+  uint32_t timeout_ms = 0;
+  for( size_t i = 0; i < count; i++ )
+  {
+    if( steps[ i ].timeout_ms > timeout_ms )
+    {
+      timeout_ms = steps[ i ].timeout_ms;
+    }
+  }
+  char *at_cmd = NULL;
+  esp_err_t err = _unit_lorawan_buffer_alloc(
+      lw, LORAWAN_BUFFER_COMMAND, UNIT_LORAWAN_COMMAND_BUFFER_SIZE, timeout_ms,
+      &at_cmd );
+  if( err != ESP_OK )
+  {
+    return err;
+  }
+
+  uint32_t accepted = 0;
+  TickType_t script_start = xTaskGetTickCount();
+  for( size_t i = 0; i < count; i++ )
+  {
+    const lorawan_script_step_t *step = &steps[ i ];
+    int length = snprintf( at_cmd, UNIT_LORAWAN_COMMAND_BUFFER_SIZE, "AT+" );
+    length += snprintf( at_cmd + length,
+                        UNIT_LORAWAN_COMMAND_BUFFER_SIZE - length, step->cmd,
+                        args ? args[ step->arg ] : NULL );
+    snprintf( at_cmd + length, UNIT_LORAWAN_COMMAND_BUFFER_SIZE - length,
+              "\r\n" );
+
+    TickType_t step_start = xTaskGetTickCount();
+    lorawan_response_t response = { 0 };
+    esp_err_t step_err = _unit_lorawan_exchange( lw, step->description, at_cmd,
+                                                 &response, step->timeout_ms, 0,
+                                                 UNIT_LORAWAN_MAX_RETRIES,
+                                                 NULL, NULL, 0 );
+    bool ok = step_err == ESP_OK && response.success &&
+              ( response.tags & LORAWAN_TAG_BIT( step->expected_tag ) );
+    _unit_lorawan_cleanup_response( lw, &response );
+    uint32_t step_ms = pdTICKS_TO_MS( xTaskGetTickCount() - step_start );
+
+    if( ok )
+    {
+      accepted |= 1UL << i;
+      ESP_LOGI( lw->tag, "✓ %s configured (%u ms)", step->description,
+                step_ms );
+      continue;
+    }
+    if( step->optional )
+    {
+      ESP_LOGW( lw->tag, "⚠ %s not accepted, continuing (%u ms)",
+                step->description, step_ms );
+      continue;
+    }
+
+    ESP_LOGE( lw->tag, "✗ Failed to configure %s (step %zu of %s)",
+              step->description, i + 1, name );
+    err = step_err != ESP_OK ? step_err : ESP_FAIL;
+    break;
+  }
+
+  _unit_lorawan_buffer_free( lw, LORAWAN_BUFFER_COMMAND, at_cmd );
+  if( err == ESP_OK )
+  {
+    ESP_LOGD( lw->tag, "%s script finished: %zu steps in %u ms", name, count,
+              pdTICKS_TO_MS( xTaskGetTickCount() - script_start ) );
+  }
+  if( completed )
+  {
+    *completed = accepted;
+  }
+  return err;
+}
+
+static const lorawan_script_step_t _unit_lorawan_otaa_script[] = {
+    LORAWAN_SCRIPT_STEP( "CJOINMODE=0", LORAWAN_SCRIPT_ARG_NONE,
+                         "OTAA join mode" ),
+    LORAWAN_SCRIPT_STEP( "CDEVEUI=%s", LORAWAN_SCRIPT_ARG_DEV_EUI,
+                         "Device EUI" ),
+    LORAWAN_SCRIPT_STEP( "CAPPEUI=%s", LORAWAN_SCRIPT_ARG_APP_EUI,
+                         "Application EUI" ),
+    LORAWAN_SCRIPT_STEP( "CAPPKEY=%s", LORAWAN_SCRIPT_ARG_APP_KEY,
+                         "Application Key" ),
+    LORAWAN_SCRIPT_STEP( "CULDLMODE=%s", LORAWAN_SCRIPT_ARG_ULDL_MODE,
+                         "Uplink/downlink mode" ),
+    LORAWAN_SCRIPT_STEP( "CCLASS=0", LORAWAN_SCRIPT_ARG_NONE,
+                         "LoRaWAN Class A" ),
+    LORAWAN_SCRIPT_STEP( "CWORKMODE=2", LORAWAN_SCRIPT_ARG_NONE,
+                         "Work mode" ),
+};
+
+esp_err_t unit_lorawan_configOTTA_h( unit_lorawan_handle_t lw, char *devEUI,
+                                     char *appEUI, char *appKey,
+                                     unit_lorwan_uldlmode mode )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !devEUI || !appEUI || !appKey )
+  {
+    ESP_LOGE( lw->tag, "EUI and key parameters cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  ESP_LOGI( lw->tag,
+            "Configuring LoRaWAN device for OTAA (Over-The-Air Activation)" );
+  ESP_LOGI( lw->tag, "  DevEUI: %s", devEUI );
+  ESP_LOGI( lw->tag, "  AppEUI: %s", appEUI );
+  ESP_LOGI( lw->tag, "  Mode: %s",
+            ( mode == DIFFERENT_FREQ_MODE ) ? "Different frequency"
+                                            : "Same frequency" );
+
+  const char *args[ LORAWAN_SCRIPT_ARG_COUNT ] = {
+      [LORAWAN_SCRIPT_ARG_DEV_EUI] = devEUI,
+      [LORAWAN_SCRIPT_ARG_APP_EUI] = appEUI,
+      [LORAWAN_SCRIPT_ARG_APP_KEY] = appKey,
+      [LORAWAN_SCRIPT_ARG_ULDL_MODE] = _unit_lorawan_uldlmode_str[ mode ],
+  };
+  esp_err_t err = _unit_lorawan_run_script(
+      lw, "OTAA", _unit_lorawan_otaa_script,
+      sizeof( _unit_lorawan_otaa_script ) /
+          sizeof( _unit_lorawan_otaa_script[ 0 ] ),
+      args, NULL );
+  if( err != ESP_OK )
+  {
+    return err;
+  }
+
+  ESP_LOGI( lw->tag, "✓ LoRaWAN device successfully configured for OTAA" );
+  ESP_LOGI( lw->tag, "  Note: Network-specific settings (frequency band, RX2, "
+                     "etc.) may need to be configured separately" );
+  return ESP_OK;
+}
+
+static const lorawan_script_step_t _unit_lorawan_abp_script[] = {
+    LORAWAN_SCRIPT_STEP( "CJOINMODE=1", LORAWAN_SCRIPT_ARG_NONE,
+                         "ABP join mode" ),
+    LORAWAN_SCRIPT_STEP( "CDEVADDR=%s", LORAWAN_SCRIPT_ARG_DEV_ADDR,
+                         "Device Address" ),
+    LORAWAN_SCRIPT_STEP( "CNWKSKEY=%s", LORAWAN_SCRIPT_ARG_NWK_SKEY,
+                         "Network Session Key" ),
+    LORAWAN_SCRIPT_STEP( "CAPPSKEY=%s", LORAWAN_SCRIPT_ARG_APP_SKEY,
+                         "Application Session Key" ),
+    LORAWAN_SCRIPT_STEP( "CULDLMODE=%s", LORAWAN_SCRIPT_ARG_ULDL_MODE,
+                         "Uplink/downlink mode" ),
+    LORAWAN_SCRIPT_STEP( "CCLASS=0", LORAWAN_SCRIPT_ARG_NONE,
+                         "LoRaWAN Class A" ),
+    LORAWAN_SCRIPT_STEP( "CWORKMODE=2", LORAWAN_SCRIPT_ARG_NONE,
+                         "Work mode" ),
+};
+
+esp_err_t unit_lorawan_config_abp_h( unit_lorawan_handle_t lw,
+                                     const char *dev_addr,
+                                     const char *nwk_skey,
+                                     const char *app_skey,
+                                     unit_lorwan_uldlmode mode )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !dev_addr || !nwk_skey || !app_skey )
+  {
+    ESP_LOGE( lw->tag, "Address and key parameters cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  ESP_LOGI( lw->tag,
+            "Configuring LoRaWAN device for ABP (Activation By "
+            "Personalization)" );
+  ESP_LOGI( lw->tag, "  DevAddr: %s", dev_addr );
+  ESP_LOGI( lw->tag, "  Mode: %s",
+            ( mode == DIFFERENT_FREQ_MODE ) ? "Different frequency"
+                                            : "Same frequency" );
+
+  const char *args[ LORAWAN_SCRIPT_ARG_COUNT ] = {
+      [LORAWAN_SCRIPT_ARG_DEV_ADDR] = dev_addr,
+      [LORAWAN_SCRIPT_ARG_NWK_SKEY] = nwk_skey,
+      [LORAWAN_SCRIPT_ARG_APP_SKEY] = app_skey,
+      [LORAWAN_SCRIPT_ARG_ULDL_MODE] = _unit_lorawan_uldlmode_str[ mode ],
+  };
+  esp_err_t err = _unit_lorawan_run_script(
+      lw, "ABP", _unit_lorawan_abp_script,
+      sizeof( _unit_lorawan_abp_script ) /
+          sizeof( _unit_lorawan_abp_script[ 0 ] ),
+      args, NULL );
+  if( err != ESP_OK )
+  {
+    return err;
+  }
+
+  // New keys describe a different session from whatever the module had
+  _unit_lorawan_session_set_joined( lw, false );
+  ESP_LOGI( lw->tag, "✓ LoRaWAN device successfully configured for ABP" );
+  return ESP_OK;
+}
+
+esp_err_t unit_lorawan_reboot_h( unit_lorawan_handle_t lw )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  ESP_LOGI( lw->tag, "Rebooting LoRaWAN module..." );
+
+  lorawan_response_t response = { 0 };
+  esp_err_t err = _unit_lorawan_send_at_command(
+      lw, "IREBOOT=0", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+
+  if( err == ESP_OK )
+  {
+    _unit_lorawan_session_invalidate( lw );
+    ESP_LOGI( lw->tag, "✓ LoRaWAN module reboot command sent" );
+    ESP_LOGI( lw->tag, "  Waiting for module to restart..." );
+    vTaskDelay( pdMS_TO_TICKS( UNIT_LORAWAN_REBOOT_SETTLE_MS ) );
+    err = _unit_lorawan_wait_ready( lw, UNIT_LORAWAN_BOOT_TIMEOUT_MS );
+    if( err != ESP_OK && _unit_lorawan_baud_find( lw ) )
+    {
+      err = ESP_OK; // Restarted at the rate it saved
+    }
+    if( err == ESP_OK )
+    {
+      ESP_LOGI( lw->tag, "✓ LoRaWAN module restarted" );
+    }
+    else
+    {
+      ESP_LOGW( lw->tag, "⚠ LoRaWAN module not responding after reboot" );
+    }
+  }
+  else
+  {
+    ESP_LOGE( lw->tag, "✗ Failed to reboot LoRaWAN module" );
+  }
+
+  _unit_lorawan_cleanup_response( lw, &response );
+  return err;
+}
+
+esp_err_t unit_lorawan_attached_h( unit_lorawan_handle_t lw, bool *state )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !state )
+  {
+    ESP_LOGE( lw->tag, "State parameter cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  ESP_LOGD( lw->tag, "Checking if LoRaWAN module is attached and responding" );
+  *state = false;
+
+  lorawan_response_t response = { 0 };
+  esp_err_t err = _unit_lorawan_send_at_command(
+      lw, "CGMI?", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+
+  if( err == ESP_OK && response.success && response.response_data )
+  {
+    // Parse manufacturer from +CGMI=XXX format
+    if( response.result.tag == LORAWAN_TAG_CGMI )
+    {
+      char manufacturer[ 16 ] = { 0 };
+      if( response.result.value &&
+          sscanf( response.result.value, "%15s", manufacturer ) == 1 )
+      {
+        if( strstr( manufacturer, UNIT_LORAWAN_MFG ) != NULL )
+        {
+          *state = true;
+          ESP_LOGI( lw->tag, "✓ LoRaWAN module detected and responding" );
+          ESP_LOGD( lw->tag, "  Module manufacturer: %s", manufacturer );
+        }
+        else
+        {
+          ESP_LOGW( lw->tag,
+                    "✗ Unknown module detected - Expected: %s, Got: %s",
+                    UNIT_LORAWAN_MFG, manufacturer );
+        }
+      }
+      else
+      {
+        ESP_LOGW( lw->tag, "✗ Could not parse manufacturer from response" );
+      }
+    }
+    else
+    {
+      ESP_LOGW( lw->tag, "✗ Could not find +CGMI= in response: %s",
+                response.response_data );
+    }
+  }
+  else
+  {
+    ESP_LOGE( lw->tag, "✗ No LoRaWAN module detected or not responding" );
+    ESP_LOGE( lw->tag, "  Check physical connections and power" );
+  }
+
+  _unit_lorawan_cleanup_response( lw, &response );
+  return err;
+}
+
+static bool _unit_lorawan_tx_opts_valid( const unit_lorawan_tx_opts_t *opts )
+{
+  if( opts->port > UNIT_LORAWAN_FPORT_MAX ||
+      opts->retries < UNIT_LORAWAN_TX_RETRIES_MIN ||
+      opts->retries > UNIT_LORAWAN_TX_RETRIES_MAX )
+  {
+    ESP_LOGE( _TAG, "Invalid uplink options: port %u, retries %u",
+              opts->port, opts->retries );
+    return false;
+  }
+  return true;
+}
+
+// Validates the options and payload, then issues one DTRX uplink with the
+// payload hex encoded straight into the framed command line
+static esp_err_t _unit_lorawan_transmit( lorawan_instance_t *lw,
+                                         const uint8_t *payload, size_t length,
+                                         const unit_lorawan_tx_opts_t *opts,
+                                         uint32_t final_tags,
+                                         lorawan_deadline_t *deadline,
+                                         lorawan_response_t *response )
+{
+  if( !opts )
+  {
+    opts = &_unit_lorawan_default_tx_opts;
+  }
+  if( !_unit_lorawan_tx_opts_valid( opts ) )
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // Validate against the cached data rate, querying the module only when
+  // the cache is empty or ADR may have raised the rate since it was filled
+  uint8_t current_dr;
+  size_t max_payload;
+  if( !_unit_lorawan_session_get_data_rate( lw, &current_dr, &max_payload ) )
+  {
+    esp_err_t dr_err =
+        unit_lorawan_get_data_rate_info_h( lw, &current_dr, &max_payload );
+    if( dr_err != ESP_OK )
+    {
+      ESP_LOGW(
+          lw->tag,
+          "Failed to get current data rate, using conservative validation" );
+      current_dr = 0;
+      max_payload = _unit_lorawan_region_max_payload( 0 );
+    }
+  }
+  else if( length > max_payload && _unit_lorawan_session_adr_enabled( lw ) )
+  {
+    uint8_t fresh_dr;
+    size_t fresh_max;
+    if( unit_lorawan_get_data_rate_info_h( lw, &fresh_dr, &fresh_max ) ==
+        ESP_OK )
+    {
+      current_dr = fresh_dr;
+      max_payload = fresh_max;
+    }
+  }
+
+  // Validate payload size against current data rate
+  esp_err_t size_check =
+      _unit_lorawan_validate_payload_size( length, current_dr );
+  if( size_check != ESP_OK )
+  {
+    return size_check;
+  }
+
+  // Refuse rather than block when the airtime budget is spent
+  uint32_t airtime_us = _unit_lorawan_time_on_air_us( current_dr, length );
+  uint32_t delay_ms = _unit_lorawan_airtime_delay_ms( lw, airtime_us );
+  if( delay_ms > 0 )
+  {
+    ESP_LOGW( lw->tag, "⚠ Airtime budget spent, next uplink allowed in %u ms",
+              delay_ms );
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  LORAWAN_PATH_LOGI( lw, "Sending LoRaWAN message (%zu bytes) on DR%d", length,
+                     current_dr );
+
+  // Check hex message size limit
+  size_t hex_len = length * 2;
+  if( hex_len > UNIT_LORAWAN_HEX_MESSAGE_MAX_SIZE )
+  {
+    ESP_LOGE( lw->tag, "Hex message too long: %zu bytes (max: %d)", hex_len,
+              UNIT_LORAWAN_HEX_MESSAGE_MAX_SIZE );
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  // Every trial may use the whole receive window sequence
+  uint32_t timeout_ms =
+      opts->retries * ( airtime_us / 1000 + UNIT_LORAWAN_TX_TRIAL_MS ) +
+      UNIT_LORAWAN_RESPONSE_TIMEOUT_MS;
+  if( timeout_ms < UNIT_LORAWAN_SEND_TIMEOUT_MS )
+  {
+    timeout_ms = UNIT_LORAWAN_SEND_TIMEOUT_MS;
+  }
+
+  size_t at_cmd_len =
+      sizeof( "AT+DTRX=1,15,255," ) + hex_len + sizeof( "\r\n" );
+  char *at_cmd = NULL;
+  esp_err_t err = _unit_lorawan_buffer_alloc( lw, LORAWAN_BUFFER_COMMAND,
+                                              at_cmd_len, timeout_ms, &at_cmd );
+  if( err != ESP_OK )
+  {
+    return err;
+  }
+
+  int prefix_len = snprintf( at_cmd, at_cmd_len, "AT+DTRX=%d,%u,%zu,",
+                             opts->confirmed ? 1 : 0, opts->retries, length );
+  _unit_lorawan_hex_encode( payload, length, at_cmd + prefix_len );
+  memcpy( at_cmd + prefix_len + hex_len, "\r\n", sizeof( "\r\n" ) );
+
+  LORAWAN_PATH_LOGD( lw, "  Command: %.*s", (int)( prefix_len + hex_len ),
+                     at_cmd );
+
+  _unit_lorawan_airtime_begin( lw, airtime_us );
+
+  err = _unit_lorawan_exchange( lw, "DTRX", at_cmd, response, timeout_ms,
+                                final_tags, UNIT_LORAWAN_MAX_RETRIES, NULL,
+                                deadline, opts->port );
+
+  _unit_lorawan_buffer_free( lw, LORAWAN_BUFFER_COMMAND, at_cmd );
+  return err;
+}
+
+// Whether a failed uplink can be kept for later without risking a duplicate.
+// A timeout leaves its fate open and an accepted uplink may be on the air.
+static bool _unit_lorawan_tx_spoolable( esp_err_t err,
+                                        const lorawan_response_t *response )
+{
+  return err != ESP_ERR_TIMEOUT && !( response->tags & LORAWAN_TAGS_ON_AIR );
+}
+
+// Maps the DTRX result lines to the furthest stage the uplink reached
+static unit_lorawan_tx_status_t
+_unit_lorawan_get_tx_status( const lorawan_response_t *response )
+{
+  uint32_t tags = response->tags;
+  if( tags & LORAWAN_TAGS_FAILURE )
+  {
+    return UNIT_LORAWAN_TX_FAILED;
+  }
+  if( tags & LORAWAN_TAG_BIT( LORAWAN_TAG_RECV ) )
+  {
+    return UNIT_LORAWAN_TX_ACKED;
+  }
+  if( tags & LORAWAN_TAG_BIT( LORAWAN_TAG_SENT_OK ) )
+  {
+    return UNIT_LORAWAN_TX_SENT;
+  }
+  if( tags & LORAWAN_TAG_BIT( LORAWAN_TAG_SEND_OK ) )
+  {
+    return UNIT_LORAWAN_TX_QUEUED;
+  }
+  return UNIT_LORAWAN_TX_FAILED;
+}
+
+esp_err_t unit_lorawan_send_ex_h( unit_lorawan_handle_t lw, const uint8_t *buf,
+                                  size_t len,
+                                  const unit_lorawan_tx_opts_t *opts )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !buf || len == 0 )
+  {
+    ESP_LOGE( lw->tag, "Message cannot be NULL or empty" );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  lorawan_deadline_t deadline = {
+      .start = xTaskGetTickCount(),
+      .max_age_ms = opts ? opts->max_age_ms : 0,
+  };
+  lorawan_response_t response = { 0 };
+  esp_err_t err =
+      _unit_lorawan_transmit( lw, buf, len, opts, 0, &deadline, &response );
+#ifdef CONFIG_LORAWAN_EVENT_LOG
+  unit_lorawan_tx_status_t status = UNIT_LORAWAN_TX_FAILED;
+  if( deadline.expired )
+  {
+    status = UNIT_LORAWAN_TX_EXPIRED;
+  }
+  else if( err == ESP_OK && response.success )
+  {
+    status = _unit_lorawan_get_tx_status( &response );
+  }
+  _unit_lorawan_event_log_uplink( lw, status, err, deadline.start );
+#endif
+  if( err == ESP_ERR_INVALID_SIZE || err == ESP_ERR_NO_MEM ||
+      err == ESP_ERR_INVALID_ARG || err == ESP_ERR_INVALID_STATE ||
+      deadline.expired )
+  {
+    return err;
+  }
+
+  if( err == ESP_OK && response.success )
+  {
+    LORAWAN_PATH_LOGI( lw, "✓ LoRaWAN message sent successfully" );
+    LORAWAN_PATH_LOGI(
+        lw, "  Message will be transmitted when network conditions allow" );
+
+    if( response.tags & LORAWAN_TAG_BIT( LORAWAN_TAG_SEND_OK ) )
+    {
+      LORAWAN_PATH_LOGI( lw, "  Message queued for transmission" );
+    }
+    if( response.tags & LORAWAN_TAG_BIT( LORAWAN_TAG_SENT_OK ) )
+    {
+      LORAWAN_PATH_LOGI( lw, "  Message transmitted to network" );
+    }
+    if( response.tags & LORAWAN_TAG_BIT( LORAWAN_TAG_RECV ) )
+    {
+      LORAWAN_PATH_LOGI( lw, "  Network acknowledgment received" );
+    }
+    if( response.tags & LORAWAN_TAG_BIT( LORAWAN_TAG_SEND_ERR ) )
+    {
+      ESP_LOGW( lw->tag, "  Message send error detected" );
+    }
+  }
+  else
+  {
+    ESP_LOGE( lw->tag, "✗ Failed to send LoRaWAN message" );
+    if( response.response_data )
+    {
+      ESP_LOGE( lw->tag, "  Error details: %s", response.response_data );
+    }
+    if( err == ESP_OK )
+    {
+      err = ESP_FAIL;
+    }
+#ifdef CONFIG_LORAWAN_SPOOL
+    if( _unit_lorawan_tx_spoolable( err, &response ) &&
+        _unit_lorawan_spool_append( lw, buf, len, opts ? opts->port : 0 ) ==
+            ESP_OK )
+    {
+      err = UNIT_LORAWAN_ERR_SPOOLED;
+    }
+#endif
+  }
+
+  _unit_lorawan_cleanup_response( lw, &response );
+  return err;
+}
+
+esp_err_t unit_lorawan_send_h( unit_lorawan_handle_t lw, char *message,
+                               size_t length )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !message || length == 0 )
+  {
+    ESP_LOGE( lw->tag, "Message cannot be NULL or empty" );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  LORAWAN_PATH_LOGD( lw, "  Message content: %.*s", (int)length, message );
+  return unit_lorawan_send_ex_h( lw, (const uint8_t *)message, length, NULL );
+}
+
+// Current data rate and its payload limit, querying the module when the
+// session cache is empty and assuming DR0 when that fails
+static void _unit_lorawan_current_data_rate( lorawan_instance_t *lw,
+                                             uint8_t *data_rate,
+                                             size_t *max_payload )
+{
+  if( _unit_lorawan_session_get_data_rate( lw, data_rate, max_payload ) ||
+      unit_lorawan_get_data_rate_info_h( lw, data_rate,
+                                         max_payload ) == ESP_OK )
+  {
+    return;
+  }
+  *data_rate = 0;
+  *max_payload = _unit_lorawan_region_max_payload( 0 );
+}
+
+static size_t _unit_lorawan_current_max_payload( lorawan_instance_t *lw )
+{
+  uint8_t data_rate;
+  size_t max_payload;
+  _unit_lorawan_current_data_rate( lw, &data_rate, &max_payload );
+  return max_payload;
+}
+
+// Milliseconds until an uplink of length bytes fits the airtime budget
+static uint32_t _unit_lorawan_next_tx_delay_ms( lorawan_instance_t *lw,
+                                                size_t length )
+{
+  uint8_t data_rate;
+  size_t max_payload;
+  _unit_lorawan_current_data_rate( lw, &data_rate, &max_payload );
+  return _unit_lorawan_airtime_delay_ms(
+      lw, _unit_lorawan_time_on_air_us( data_rate, length ) );
+}
+
+#ifdef CONFIG_LORAWAN_SPOOL
+// The spool is a ring of flash sectors holding one record per undelivered
+// uplink, oldest first. Records are only ever appended, then marked
+// delivered by clearing their state byte, and a sector is erased only when
+// the ring wraps onto it, so erases spread evenly over the partition. Reads
+// go through the memory-mapped partition.
+static uint32_t _unit_lorawan_spool_record_size( uint8_t length )
+{
+  return ( sizeof( lorawan_spool_record_t ) + length + 3 ) & ~3u;
+}
+
+static uint32_t _unit_lorawan_spool_sector_next( const lorawan_spool_t *spool,
+                                                 uint32_t offset )
+{
+  uint32_t next = ( offset / UNIT_LORAWAN_SPOOL_SECTOR_SIZE + 1 ) *
+                  UNIT_LORAWAN_SPOOL_SECTOR_SIZE;
+  return next < spool->partition->size ? next : 0;
+}
+
+// Record starting at offset, or NULL where its sector holds no more records
+static const lorawan_spool_record_t *
+_unit_lorawan_spool_at( const lorawan_spool_t *spool, uint32_t offset )
+{
+  uint32_t room = UNIT_LORAWAN_SPOOL_SECTOR_SIZE -
+                  offset % UNIT_LORAWAN_SPOOL_SECTOR_SIZE;
+  if( room < sizeof( lorawan_spool_record_t ) )
+  {
+    return NULL;
+  }
+  const lorawan_spool_record_t *record =
+      (const lorawan_spool_record_t *)( spool->map + offset );
+  if( record->magic != UNIT_LORAWAN_SPOOL_MAGIC ||
+      record->length > UNIT_LORAWAN_SPOOL_RECORD_MAX ||
+      _unit_lorawan_spool_record_size( record->length ) > room )
+  {
+    return NULL;
+  }
+  return record;
+}
+
+static bool _unit_lorawan_spool_erased( const lorawan_spool_t *spool,
+                                        uint32_t offset, uint32_t length )
+{
+  for( uint32_t i = 0; i < length; i++ )
+  {
+    if( spool->map[ offset + i ] != 0xFF )
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// First pending record at or after offset. Ring order is age order from the
+// tail, so with records pending this is the oldest one left.
+static uint32_t _unit_lorawan_spool_seek( const lorawan_spool_t *spool,
+                                          uint32_t offset )
+{
+  uint32_t steps = spool->partition->size / sizeof( lorawan_spool_record_t );
+  while( spool->pending > 0 && steps-- > 0 )
+  {
+    const lorawan_spool_record_t *record =
+        _unit_lorawan_spool_at( spool, offset );
+    if( !record )
+    {
+      offset = _unit_lorawan_spool_sector_next( spool, offset );
+      continue;
+    }
+    if( record->state == UNIT_LORAWAN_SPOOL_PENDING )
+    {
+      return offset;
+    }
+    offset += _unit_lorawan_spool_record_size( record->length );
+  }
+  return spool->head;
+}
+
+// Erases the sector at offset for new records. Pending records still in it
+// are the oldest ones and are lost.
+static esp_err_t _unit_lorawan_spool_reclaim( lorawan_instance_t *lw,
+                                              uint32_t offset )
+{
+  lorawan_spool_t *spool = &lw->spool;
+  if( _unit_lorawan_spool_erased( spool, offset,
+                                  UNIT_LORAWAN_SPOOL_SECTOR_SIZE ) )
+  {
+    return ESP_OK;
+  }
+
+  uint32_t lost = 0;
+  uint32_t cursor = offset;
+  const lorawan_spool_record_t *record;
+  while( ( record = _unit_lorawan_spool_at( spool, cursor ) ) )
+  {
+    lost += record->state == UNIT_LORAWAN_SPOOL_PENDING;
+    cursor += _unit_lorawan_spool_record_size( record->length );
+  }
+  if( lost > 0 )
+  {
+    ESP_LOGW( lw->tag, "⚠ Spool full, dropping %u oldest uplinks",
+              (unsigned)lost );
+    spool->pending -= lost;
+    spool->dropped += lost;
+    spool->tail = _unit_lorawan_spool_seek(
+        spool, _unit_lorawan_spool_sector_next( spool, offset ) );
+  }
+  return esp_partition_erase_range( spool->partition, offset,
+                                    UNIT_LORAWAN_SPOOL_SECTOR_SIZE );
+}
+
+// Finds the newest and the oldest pending record left by earlier runs
+static esp_err_t _unit_lorawan_spool_mount( lorawan_instance_t *lw )
+{
+  lorawan_spool_t *spool = &lw->spool;
+  if( spool->map )
+  {
+    return ESP_OK;
+  }
+
+  spool->partition = esp_partition_find_first( ESP_PARTITION_TYPE_DATA,
+                                               ESP_PARTITION_SUBTYPE_ANY,
+                                               CONFIG_LORAWAN_SPOOL_PARTITION );
+  if( !spool->partition )
+  {
+    ESP_LOGE( lw->tag, "✗ Spool partition \"%s\" not found",
+              CONFIG_LORAWAN_SPOOL_PARTITION );
+    return ESP_ERR_NOT_FOUND;
+  }
+  if( spool->partition->size < 2 * UNIT_LORAWAN_SPOOL_SECTOR_SIZE )
+  {
+    ESP_LOGE( lw->tag, "✗ Spool partition needs at least two sectors" );
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  const void *map = NULL;
+  esp_err_t err = esp_partition_mmap( spool->partition, 0,
+                                      spool->partition->size,
+                                      LORAWAN_SPOOL_MMAP_DATA, &map,
+                                      &spool->map_handle );
+  if( err != ESP_OK )
+  {
+    ESP_LOGE( lw->tag, "✗ Failed to map spool partition: %s",
+              esp_err_to_name( err ) );
+    return err;
+  }
+
+  spool->lock = xSemaphoreCreateMutexStatic( &spool->lock_buffer );
+  spool->map = (const uint8_t *)map;
+  spool->head = 0;
+  spool->tail = 0;
+  spool->pending = 0;
+  bool found = false;
+  bool oldest_found = false;
+  uint32_t newest = 0;
+  uint32_t oldest = 0;
+  for( uint32_t sector = 0; sector < spool->partition->size;
+       sector += UNIT_LORAWAN_SPOOL_SECTOR_SIZE )
+  {
+    uint32_t offset = sector;
+    const lorawan_spool_record_t *record;
+    while( ( record = _unit_lorawan_spool_at( spool, offset ) ) )
+    {
+      uint32_t size = _unit_lorawan_spool_record_size( record->length );
+      if( !found || (int32_t)( record->sequence - newest ) > 0 )
+      {
+        found = true;
+        newest = record->sequence;
+        spool->head = offset + size;
+      }
+      if( record->state == UNIT_LORAWAN_SPOOL_PENDING )
+      {
+        spool->pending++;
+        if( !oldest_found || (int32_t)( record->sequence - oldest ) < 0 )
+        {
+          oldest_found = true;
+          oldest = record->sequence;
+          spool->tail = offset;
+        }
+      }
+      offset += size;
+    }
+  }
+  spool->sequence = found ? newest + 1 : 0;
+
+  // An append cut short by a reset may have left bytes after the last
+  // header; start over in the next sector rather than program over them
+  uint32_t room = UNIT_LORAWAN_SPOOL_SECTOR_SIZE -
+                  spool->head % UNIT_LORAWAN_SPOOL_SECTOR_SIZE;
+  if( spool->head % UNIT_LORAWAN_SPOOL_SECTOR_SIZE != 0 &&
+      !_unit_lorawan_spool_erased( spool, spool->head, room ) )
+  {
+    spool->head = _unit_lorawan_spool_sector_next( spool, spool->head );
+  }
+  spool->head %= spool->partition->size;
+
+  ESP_LOGI( lw->tag, "✓ Spool mounted on \"%s\" (%u KB), %u uplinks pending",
+            spool->partition->label,
+            (unsigned)( spool->partition->size / 1024 ),
+            (unsigned)spool->pending );
+  return ESP_OK;
+}
+
+// Keeps an undelivered uplink in flash. Only the default instance owns the
+// spool partition.
+static esp_err_t _unit_lorawan_spool_append( lorawan_instance_t *lw,
+                                             const uint8_t *payload,
+                                             size_t length, uint8_t port )
+{
+  lorawan_spool_t *spool = &lw->spool;
+  if( !spool->map )
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if( length > UNIT_LORAWAN_SPOOL_RECORD_MAX )
+  {
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  xSemaphoreTake( spool->lock, portMAX_DELAY );
+  uint32_t size = _unit_lorawan_spool_record_size( length );
+  uint32_t offset = spool->head;
+  if( offset % UNIT_LORAWAN_SPOOL_SECTOR_SIZE + size >
+      UNIT_LORAWAN_SPOOL_SECTOR_SIZE )
+  {
+    offset = _unit_lorawan_spool_sector_next( spool, offset );
+  }
+  esp_err_t err = ESP_OK;
+  if( offset % UNIT_LORAWAN_SPOOL_SECTOR_SIZE == 0 )
+  {
+    err = _unit_lorawan_spool_reclaim( lw, offset );
+  }
+
+  // Payload first, so a record only exists once its header is complete
+  lorawan_spool_record_t record = {
+      .magic = UNIT_LORAWAN_SPOOL_MAGIC,
+      .state = UNIT_LORAWAN_SPOOL_PENDING,
+      .length = length,
+      .port = port,
+      .sequence = spool->sequence,
+  };
+  if( err == ESP_OK && length > 0 )
+  {
+    err = esp_partition_write( spool->partition, offset + sizeof( record ),
+                               payload, length );
+  }
+  if( err == ESP_OK )
+  {
+    err = esp_partition_write( spool->partition, offset, &record,
+                               sizeof( record ) );
+  }
+  if( err == ESP_OK )
+  {
+    if( spool->pending == 0 )
+    {
+      spool->tail = offset;
+    }
+    spool->pending++;
+    spool->sequence++;
+    spool->head = ( offset + size ) % spool->partition->size;
+  }
+  else
+  {
+    // The slot is no longer known to be erased
+    spool->head = _unit_lorawan_spool_sector_next( spool, offset );
+    ESP_LOGE( lw->tag, "✗ Failed to spool uplink: %s",
+              esp_err_to_name( err ) );
+  }
+  uint32_t pending = spool->pending;
+  xSemaphoreGive( spool->lock );
+
+  if( err == ESP_OK )
+  {
+    ESP_LOGW( lw->tag, "⚠ Uplink spooled to flash, %u pending",
+              (unsigned)pending );
+  }
+  return err;
+}
+
+// TX callback of a drain frame. Only an acknowledged frame retires its
+// records; anything else leaves them for the next attempt.
+static void _unit_lorawan_spool_sent( unit_lorawan_tx_status_t status,
+                                      void *user_data )
+{
+  lorawan_instance_t *lw = (lorawan_instance_t *)user_data;
+  lorawan_spool_t *spool = &lw->spool;
+  static const uint8_t delivered = UNIT_LORAWAN_SPOOL_DELIVERED;
+
+  xSemaphoreTake( spool->lock, portMAX_DELAY );
+  uint32_t retired = 0;
+  if( status == UNIT_LORAWAN_TX_ACKED )
+  {
+    const lorawan_spool_record_t *record;
+    while( spool->pending > 0 &&
+           ( record = _unit_lorawan_spool_at( spool, spool->tail ) ) &&
+           (int32_t)( record->sequence - spool->drain_last ) <= 0 )
+    {
+      esp_partition_write( spool->partition,
+                           spool->tail +
+                               offsetof( lorawan_spool_record_t, state ),
+                           &delivered, sizeof( delivered ) );
+      spool->pending--;
+      retired++;
+      spool->tail = _unit_lorawan_spool_seek(
+          spool,
+          spool->tail + _unit_lorawan_spool_record_size( record->length ) );
+    }
+  }
+  else
+  {
+    spool->retry_at =
+        xTaskGetTickCount() + pdMS_TO_TICKS( UNIT_LORAWAN_SPOOL_RETRY_MS );
+  }
+  spool->draining = false;
+  uint32_t pending = spool->pending;
+  xSemaphoreGive( spool->lock );
+
+  if( retired > 0 )
+  {
+    ESP_LOGI( lw->tag, "✓ Delivered %u spooled uplinks, %u pending",
+              (unsigned)retired, (unsigned)pending );
+  }
+  else
+  {
+    ESP_LOGW( lw->tag, "⚠ Spool drain not acknowledged, retrying later" );
+  }
+  _unit_lorawan_driver_wake( lw ); // Next batch
+}
+
+static TickType_t _unit_lorawan_spool_wait( lorawan_instance_t *lw )
+{
+  lorawan_spool_t *spool = &lw->spool;
+  if( !spool->map )
+  {
+    return portMAX_DELAY;
+  }
+
+  xSemaphoreTake( spool->lock, portMAX_DELAY );
+  TickType_t wait = portMAX_DELAY;
+  if( spool->pending > 0 && !spool->draining )
+  {
+    TickType_t now = xTaskGetTickCount();
+    wait = _unit_lorawan_tick_reached( now, spool->retry_at )
+               ? 0
+               : spool->retry_at - now;
+  }
+  xSemaphoreGive( spool->lock );
+  return wait;
+}
+
+// Runs in the driver task. Once the session is joined and the TX queue is
+// idle, packs the oldest spooled uplinks into one aggregated frame, in the
+// length-prefixed format of unit_lorawan_aggregate(), and queues it.
+static void _unit_lorawan_spool_service( lorawan_instance_t *lw )
+{
+  if( _unit_lorawan_spool_wait( lw ) != 0 )
+  {
+    return;
+  }
+
+  // Only the cached data rate: a CDATARATE? round-trip on every spool check
+  // would hold up the single driver task and every command behind it
+  lorawan_spool_t *spool = &lw->spool;
+  bool joined = _unit_lorawan_session_joined( lw );
+  bool idle = uxQueueMessagesWaiting( lw->tx.queue ) == 0;
+  uint8_t data_rate;
+  size_t limit = 0;
+  if( joined && idle &&
+      !_unit_lorawan_session_get_data_rate( lw, &data_rate, &limit ) )
+  {
+    limit = _unit_lorawan_region_max_payload( 0 );
+  }
+  TickType_t now = xTaskGetTickCount();
+  lorawan_tx_request_t request = {
+      .opts = _unit_lorawan_default_tx_opts,
+      .packed = true,
+      .drain = true,
+      .queued = now,
+      .callback = _unit_lorawan_spool_sent,
+      .user_data = lw,
+  };
+  if( limit > sizeof( request.payload ) )
+  {
+    limit = sizeof( request.payload );
+  }
+
+  xSemaphoreTake( spool->lock, portMAX_DELAY );
+  uint32_t offset = spool->tail;
+  uint32_t count = 0;
+  uint32_t last = 0;
+  const lorawan_spool_record_t *record;
+  while( count < CONFIG_LORAWAN_SPOOL_DRAIN_MAX && count < spool->pending &&
+         ( record = _unit_lorawan_spool_at( spool, offset ) ) )
+  {
+    if( ( count > 0 && record->port != request.opts.port ) ||
+        request.length + 1 + record->length > limit )
+    {
+      break;
+    }
+    request.opts.port = record->port;
+    request.payload[ request.length++ ] = record->length;
+    memcpy( request.payload + request.length, record + 1, record->length );
+    request.length += record->length;
+    last = record->sequence;
+    count++;
+    if( count < spool->pending )
+    {
+      offset = _unit_lorawan_spool_seek(
+          spool, offset + _unit_lorawan_spool_record_size( record->length ) );
+    }
+  }
+
+  // Not joined, or the oldest uplink needs a faster data rate
+  uint32_t retry_ms = UNIT_LORAWAN_SPOOL_RETRY_MS;
+  bool queued = false;
+  if( !idle )
+  {
+    retry_ms = UNIT_LORAWAN_SPOOL_BUSY_RETRY_MS;
+  }
+  else if( count > 0 )
+  {
+    queued = xQueueSend( lw->tx.queue, &request, 0 ) == pdTRUE;
+    retry_ms = UNIT_LORAWAN_SPOOL_BUSY_RETRY_MS;
+  }
+  if( queued )
+  {
+    spool->draining = true;
+    spool->drain_last = last;
+  }
+  else
+  {
+    spool->retry_at = now + pdMS_TO_TICKS( retry_ms );
+  }
+  xSemaphoreGive( spool->lock );
+
+  if( queued )
+  {
+    ESP_LOGI( lw->tag, "Draining %u spooled uplinks (%zu bytes)",
+              (unsigned)count, request.length );
+  }
+}
+#endif
+
+// Sends one frame from the TX task. spoolable, when given, tells whether a
+// failed frame could be kept for later, see _unit_lorawan_tx_spoolable().
+static unit_lorawan_tx_status_t
+_unit_lorawan_tx_frame( lorawan_instance_t *lw, const uint8_t *payload,
+                        size_t length, const unit_lorawan_tx_opts_t *opts,
+                        lorawan_deadline_t *deadline, bool *spoolable )
+{
+  uint32_t final_tags = opts->confirmed ? LORAWAN_TAGS_FINAL_DTRX
+                                        : LORAWAN_TAGS_FINAL_DTRX_UNCONFIRMED;
+
+  // Hold the uplink here so it is released only when it can go out at once
+  uint32_t delay_ms;
+  while( ( delay_ms = _unit_lorawan_next_tx_delay_ms( lw, length ) ) > 0 )
+  {
+    if( _unit_lorawan_deadline_remaining_ms( deadline ) <= delay_ms )
+    {
+      ESP_LOGW( lw->tag, "⚠ Queued uplink expires before the airtime budget "
+                         "allows it" );
+      return UNIT_LORAWAN_TX_EXPIRED;
+    }
+    ESP_LOGI( lw->tag, "Holding queued uplink %u ms for airtime budget",
+              delay_ms );
+    vTaskDelay( pdMS_TO_TICKS( delay_ms ) + 1 );
+  }
+
+  lorawan_response_t response = { 0 };
+  esp_err_t err = _unit_lorawan_transmit( lw, payload, length, opts,
+                                          final_tags, deadline, &response );
+  unit_lorawan_tx_status_t status = UNIT_LORAWAN_TX_FAILED;
+  if( err == ESP_OK )
+  {
+    status = _unit_lorawan_get_tx_status( &response );
+  }
+  else if( deadline->expired )
+  {
+    status = UNIT_LORAWAN_TX_EXPIRED;
+  }
+  else
+  {
+    ESP_LOGE( lw->tag, "✗ Queued LoRaWAN message failed: %s",
+              esp_err_to_name( err ) );
+  }
+  if( spoolable )
+  {
+    *spoolable = status == UNIT_LORAWAN_TX_FAILED &&
+                 _unit_lorawan_tx_spoolable( err, &response );
+  }
+  _unit_lorawan_cleanup_response( lw, &response );
+  return status;
+}
+
+#ifdef CONFIG_LORAWAN_SPOOL
+// Keeps the records of a packed frame that failed before reaching the air,
+// so a later drain resends them. False when any of them could not be kept.
+static bool _unit_lorawan_tx_spool_records( lorawan_instance_t *lw,
+                                            const lorawan_tx_request_t *request,
+                                            size_t offset, size_t end )
+{
+  if( request->drain )
+  {
+    return false; // Left in the spool for the next drain
+  }
+  for( size_t at = offset; at < end; at += 1 + request->payload[ at ] )
+  {
+    if( _unit_lorawan_spool_append( lw, request->payload + at + 1,
+                                    request->payload[ at ],
+                                    request->opts.port ) != ESP_OK )
+    {
+      return false;
+    }
+  }
+  return true;
+}
+#endif
+
+// Sends packed records, splitting them at record boundaries into as many
+// frames as the data rate now requires. A frame that fails before reaching
+// the air is spooled record by record. Reports the least advanced outcome.
+static unit_lorawan_tx_status_t
+_unit_lorawan_tx_packed( lorawan_instance_t *lw,
+                         const lorawan_tx_request_t *request,
+                         lorawan_deadline_t *deadline )
+{
+  unit_lorawan_tx_status_t result = UNIT_LORAWAN_TX_ACKED;
+  size_t offset = 0;
+  while( offset < request->length )
+  {
+    size_t limit = _unit_lorawan_current_max_payload( lw );
+    size_t end = offset;
+    while( end < request->length )
+    {
+      size_t next = end + 1 + request->payload[ end ];
+      if( next > request->length || next - offset > limit )
+      {
+        break;
+      }
+      end = next;
+    }
+
+    unit_lorawan_tx_status_t status;
+    bool spoolable = false;
+    if( end == offset )
+    {
+      // A single record no longer fits any frame at this data rate
+      ESP_LOGE( lw->tag, "✗ Aggregated record of %u bytes exceeds %zu bytes",
+                request->payload[ offset ], limit );
+      status = UNIT_LORAWAN_TX_FAILED;
+      spoolable = true;
+      end = offset + 1 + request->payload[ offset ];
+    }
+    else
+    {
+      status = _unit_lorawan_tx_frame( lw, request->payload + offset,
+                                       end - offset, &request->opts, deadline,
+                                       &spoolable );
+    }
+#ifdef CONFIG_LORAWAN_SPOOL
+    if( spoolable &&
+        _unit_lorawan_tx_spool_records( lw, request, offset, end ) )
+    {
+      status = UNIT_LORAWAN_TX_SPOOLED;
+    }
+#endif
+
+    if( status == UNIT_LORAWAN_TX_FAILED || result == UNIT_LORAWAN_TX_FAILED )
+    {
+      result = UNIT_LORAWAN_TX_FAILED;
+    }
+    else if( status == UNIT_LORAWAN_TX_EXPIRED ||
+             result == UNIT_LORAWAN_TX_EXPIRED )
+    {
+      result = UNIT_LORAWAN_TX_EXPIRED;
+    }
+    else if( status == UNIT_LORAWAN_TX_SPOOLED ||
+             result == UNIT_LORAWAN_TX_SPOOLED )
+    {
+      result = UNIT_LORAWAN_TX_SPOOLED;
+    }
+    else if( status < result )
+    {
+      result = status;
+    }
+    offset = end;
+  }
+  return result;
+}
+
+static void _unit_lorawan_tx_task( void *pvParameters )
+{
+  lorawan_instance_t *lw = (lorawan_instance_t *)pvParameters;
+  lorawan_tx_t *tx = &lw->tx;
+  lorawan_tx_request_t *request = &tx->request;
+
+  for( ;; )
+  {
+    if( xQueueReceive( tx->queue, request, portMAX_DELAY ) != pdTRUE )
+    {
+      continue;
+    }
+
+    lorawan_deadline_t deadline = {
+        .start = request->queued,
+        .max_age_ms = request->opts.max_age_ms,
+    };
+    bool spoolable = false;
+    unit_lorawan_tx_status_t status =
+        request->packed
+            ? _unit_lorawan_tx_packed( lw, request, &deadline )
+            : _unit_lorawan_tx_frame( lw, request->payload, request->length,
+                                      &request->opts, &deadline, &spoolable );
+#ifdef CONFIG_LORAWAN_SPOOL
+    if( spoolable &&
+        _unit_lorawan_spool_append( lw, request->payload, request->length,
+                                    request->opts.port ) == ESP_OK )
+    {
+      status = UNIT_LORAWAN_TX_SPOOLED;
+    }
+#endif
+#ifdef CONFIG_LORAWAN_EVENT_LOG
+    _unit_lorawan_event_log_uplink(
+        lw, status,
+        status == UNIT_LORAWAN_TX_FAILED    ? ESP_FAIL
+        : status == UNIT_LORAWAN_TX_EXPIRED ? ESP_ERR_TIMEOUT
+                                            : ESP_OK,
+        request->queued );
+#endif
+    LORAWAN_PATH_LOGD( lw, "Queued uplink (%zu bytes) finished with status %d",
+                       request->length, status );
+
+    if( request->callback )
+    {
+      request->callback( status, request->user_data );
+    }
+  }
+}
+
+static esp_err_t _unit_lorawan_tx_start( lorawan_instance_t *lw )
+{
+  lorawan_tx_t *tx = &lw->tx;
+  if( tx->task )
+  {
+    return ESP_OK;
+  }
+
+  tx->queue = xQueueCreate( UNIT_LORAWAN_TX_QUEUE_LENGTH,
+                            sizeof( lorawan_tx_request_t ) );
+  if( !tx->queue )
+  {
+    ESP_LOGE( lw->tag, "Failed to allocate LoRaWAN TX queue" );
+    return ESP_ERR_NO_MEM;
+  }
+
+  lorawan_aggregator_t *aggregator = &lw->aggregator;
+  if( !aggregator->lock )
+  {
+    aggregator->lock =
+        xSemaphoreCreateMutexStatic( &aggregator->lock_buffer );
+  }
+
+  if( xTaskCreate( _unit_lorawan_tx_task, "lorawan_tx",
+                   UNIT_LORAWAN_TX_TASK_STACK_SIZE, lw,
+                   UNIT_LORAWAN_TX_TASK_PRIORITY, &tx->task ) != pdPASS )
+  {
+    ESP_LOGE( lw->tag, "Failed to create LoRaWAN TX task" );
+    tx->task = NULL;
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+esp_err_t unit_lorawan_send_async_ex_h( unit_lorawan_handle_t lw,
+                                        const uint8_t *buf, size_t length,
+                                        const unit_lorawan_tx_opts_t *opts,
+                                        unit_lorawan_tx_callback_t callback,
+                                        void *user_data )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !buf || length == 0 )
+  {
+    ESP_LOGE( lw->tag, "Message cannot be NULL or empty" );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  if( !opts )
+  {
+    opts = &_unit_lorawan_default_tx_opts;
+  }
+  if( !_unit_lorawan_tx_opts_valid( opts ) )
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  if( length > sizeof( ( (lorawan_tx_request_t *)0 )->payload ) )
+  {
+    ESP_LOGE( lw->tag, "Message length %zu exceeds maximum %d bytes", length,
+              UNIT_LORAWAN_REGION_MAX_PAYLOAD );
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  if( !lw->tx.queue )
+  {
+    ESP_LOGE( lw->tag, "LoRaWAN driver not initialized" );
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  lorawan_tx_request_t request = {
+      .length = length,
+      .opts = *opts,
+      .queued = xTaskGetTickCount(),
+      .callback = callback,
+      .user_data = user_data,
+  };
+  memcpy( request.payload, buf, length );
+
+  if( xQueueSend( lw->tx.queue, &request, 0 ) != pdTRUE )
+  {
+    ESP_LOGW( lw->tag, "LoRaWAN TX queue full, message dropped" );
+    return ESP_ERR_NO_MEM;
+  }
+
+  ESP_LOGD( lw->tag, "Queued LoRaWAN message (%zu bytes)", length );
+  return ESP_OK;
+}
+
+esp_err_t unit_lorawan_send_async_h( unit_lorawan_handle_t lw,
+                                     const char *message, size_t length,
+                                     unit_lorawan_tx_callback_t callback,
+                                     void *user_data )
+{
+  return unit_lorawan_send_async_ex_h( lw, (const uint8_t *)message, length,
+                                       NULL, callback, user_data );
+}
+
+// Hands the collected records to the TX queue. Called with the aggregator
+// lock held; the records stay buffered when the queue is full.
+static esp_err_t _unit_lorawan_aggregator_flush_locked( lorawan_instance_t *lw )
+{
+  lorawan_aggregator_t *aggregator = &lw->aggregator;
+  if( aggregator->length == 0 )
+  {
+    return ESP_OK;
+  }
+
+  lorawan_tx_request_t request = {
+      .length = aggregator->length,
+      .opts = aggregator->opts,
+      .packed = true,
+      .queued = xTaskGetTickCount(),
+      .callback = aggregator->callback,
+      .user_data = aggregator->user_data,
+  };
+  memcpy( request.payload, aggregator->frame, aggregator->length );
+
+  if( xQueueSend( lw->tx.queue, &request, 0 ) != pdTRUE )
+  {
+    ESP_LOGW( lw->tag, "LoRaWAN TX queue full, keeping %zu aggregated bytes",
+              aggregator->length );
+    return ESP_ERR_NO_MEM;
+  }
+
+  ESP_LOGD( lw->tag, "Queued aggregated frame (%zu bytes)",
+            aggregator->length );
+  aggregator->length = 0;
+  return ESP_OK;
+}
+
+// Ticks until the driver task should flush on the deadline
+static TickType_t _unit_lorawan_aggregator_wait( lorawan_instance_t *lw )
+{
+  lorawan_aggregator_t *aggregator = &lw->aggregator;
+  if( !aggregator->lock )
+  {
+    return portMAX_DELAY;
+  }
+
+  TickType_t wait = portMAX_DELAY;
+  xSemaphoreTake( aggregator->lock, portMAX_DELAY );
+  if( aggregator->length > 0 && aggregator->max_delay_ms > 0 )
+  {
+    TickType_t now = xTaskGetTickCount();
+    wait = _unit_lorawan_tick_reached( now, aggregator->flush_at )
+               ? 0
+               : aggregator->flush_at - now;
+  }
+  xSemaphoreGive( aggregator->lock );
+  return wait;
+}
+
+// Runs in the driver task after every command or wake
+static void _unit_lorawan_aggregator_service( lorawan_instance_t *lw )
+{
+  lorawan_aggregator_t *aggregator = &lw->aggregator;
+  if( !aggregator->lock )
+  {
+    return;
+  }
+
+  xSemaphoreTake( aggregator->lock, portMAX_DELAY );
+  TickType_t now = xTaskGetTickCount();
+  if( aggregator->length > 0 && aggregator->max_delay_ms > 0 &&
+      _unit_lorawan_tick_reached( now, aggregator->flush_at ) &&
+      _unit_lorawan_aggregator_flush_locked( lw ) != ESP_OK )
+  {
+    aggregator->flush_at =
+        now + pdMS_TO_TICKS( UNIT_LORAWAN_AGGREGATE_RETRY_MS );
+  }
+  xSemaphoreGive( aggregator->lock );
+}
+
+esp_err_t unit_lorawan_aggregator_configure_h(
+    unit_lorawan_handle_t lw, const unit_lorawan_aggregator_config_t *config )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  lorawan_aggregator_t *aggregator = &lw->aggregator;
+  if( !aggregator->lock )
+  {
+    ESP_LOGE( lw->tag, "LoRaWAN driver not initialized" );
+    return ESP_ERR_INVALID_STATE;
+  }
+  if( config && !_unit_lorawan_tx_opts_valid( &config->opts ) )
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  xSemaphoreTake( aggregator->lock, portMAX_DELAY );
+  if( config )
+  {
+    aggregator->max_delay_ms = config->max_delay_ms;
+    aggregator->opts = config->opts;
+    aggregator->callback = config->callback;
+    aggregator->user_data = config->user_data;
+  }
+  else
+  {
+    aggregator->max_delay_ms = UNIT_LORAWAN_AGGREGATE_MAX_DELAY_DEFAULT_MS;
+    aggregator->opts = _unit_lorawan_default_tx_opts;
+    aggregator->callback = NULL;
+    aggregator->user_data = NULL;
+  }
+  aggregator->flush_at =
+      xTaskGetTickCount() + pdMS_TO_TICKS( aggregator->max_delay_ms );
+  xSemaphoreGive( aggregator->lock );
+
+  _unit_lorawan_driver_wake( lw );
+  return ESP_OK;
+}
+
+esp_err_t unit_lorawan_aggregate_h( unit_lorawan_handle_t lw,
+                                    const uint8_t *record, size_t length )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !record || length == 0 )
+  {
+    ESP_LOGE( lw->tag, "Record cannot be NULL or empty" );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  lorawan_aggregator_t *aggregator = &lw->aggregator;
+  if( !aggregator->lock )
+  {
+    ESP_LOGE( lw->tag, "LoRaWAN driver not initialized" );
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  // Frames are packed against the live data rate so none outgrows it
+  size_t limit = _unit_lorawan_current_max_payload( lw );
+  if( length + 1 > limit )
+  {
+    ESP_LOGE( lw->tag, "Record length %zu exceeds maximum %zu bytes", length,
+              limit - 1 );
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  xSemaphoreTake( aggregator->lock, portMAX_DELAY );
+
+  // Close the current frame when this record would push it past the limit
+  if( aggregator->length + 1 + length > limit &&
+      _unit_lorawan_aggregator_flush_locked( lw ) != ESP_OK )
+  {
+    xSemaphoreGive( aggregator->lock );
+    return ESP_ERR_NO_MEM;
+  }
+
+  bool first = aggregator->length == 0;
+  if( first )
+  {
+    aggregator->flush_at =
+        xTaskGetTickCount() + pdMS_TO_TICKS( aggregator->max_delay_ms );
+  }
+  aggregator->frame[ aggregator->length++ ] = (uint8_t)length;
+  memcpy( aggregator->frame + aggregator->length, record, length );
+  aggregator->length += length;
+
+  // Send right away once not even a one byte record would fit
+  if( aggregator->length + 2 > limit )
+  {
+    _unit_lorawan_aggregator_flush_locked( lw );
+  }
+  xSemaphoreGive( aggregator->lock );
+
+  if( first && aggregator->max_delay_ms > 0 )
+  {
+    _unit_lorawan_driver_wake( lw ); // Arm the deadline in the driver task
+  }
+  return ESP_OK;
+}
+
+esp_err_t unit_lorawan_aggregate_flush_h( unit_lorawan_handle_t lw )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  lorawan_aggregator_t *aggregator = &lw->aggregator;
+  if( !aggregator->lock )
+  {
+    ESP_LOGE( lw->tag, "LoRaWAN driver not initialized" );
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  xSemaphoreTake( aggregator->lock, portMAX_DELAY );
+  esp_err_t err = _unit_lorawan_aggregator_flush_locked( lw );
+  xSemaphoreGive( aggregator->lock );
+  return err;
+}
+
+esp_err_t unit_lorawan_get_time_on_air( uint8_t data_rate, size_t length,
+                                        uint32_t *airtime_ms )
+{
+  if( !airtime_ms || data_rate > _unit_lorawan_region.data_rate_max ||
+      length > _unit_lorawan_region.data_rates[ data_rate ].max_payload )
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  *airtime_ms =
+      ( _unit_lorawan_time_on_air_us( data_rate, length ) + 999 ) / 1000;
+  return ESP_OK;
+}
+
+// Zigzag maps small magnitudes of either sign to small unsigned numbers,
+// which the varint then stores seven bits per byte, low group first
+static uint32_t _unit_lorawan_zigzag( int32_t value )
+{
+  return ( (uint32_t)value << 1 ) ^ (uint32_t)( value >> 31 );
+}
+
+static size_t _unit_lorawan_varint_length( uint32_t value )
+{
+  size_t length = 1;
+  while( value >= 0x80 )
+  {
+    value >>= 7;
+    length++;
+  }
+  return length;
+}
+
+static size_t _unit_lorawan_varint_put( uint32_t value, uint8_t *out )
+{
+  size_t length = 0;
+  while( value >= 0x80 )
+  {
+    out[ length++ ] = (uint8_t)( value | 0x80 );
+    value >>= 7;
+  }
+  out[ length++ ] = (uint8_t)value;
+  return length;
+}
+
+// Field of a record as sent, before zigzag. Differences wrap modulo 2^32 so
+// every int32_t pair encodes exactly.
+static uint32_t _unit_lorawan_encode_field( const unit_lorawan_schema_t *schema,
+                                            const int32_t *values,
+                                            size_t record, size_t field )
+{
+  const unit_lorawan_field_t *spec = &schema->fields[ field ];
+  const int32_t *row = values + record * schema->field_count;
+  uint32_t reference = (uint32_t)spec->base;
+  if( spec->coding == UNIT_LORAWAN_FIELD_DELTA && record > 0 )
+  {
+    const int32_t *previous = row - schema->field_count;
+    reference = (uint32_t)previous[ field ];
+  }
+  return _unit_lorawan_zigzag(
+      (int32_t)( (uint32_t)row[ field ] - reference ) );
+}
+
+esp_err_t unit_lorawan_encode( const unit_lorawan_schema_t *schema,
+                               const int32_t *values, size_t records,
+                               uint8_t *buf, size_t size, size_t *length,
+                               size_t *encoded )
+{
+  if( !schema || !schema->fields || schema->field_count == 0 || !values ||
+      records == 0 || !buf || !length || !encoded )
+  {
+    ESP_LOGE( _TAG, "Invalid encoding parameters" );
+    return ESP_ERR_INVALID_ARG;
+  }
+  for( size_t field = 0; field < schema->field_count; field++ )
+  {
+    if( schema->fields[ field ].coding > UNIT_LORAWAN_FIELD_DELTA )
+    {
+      ESP_LOGE( _TAG, "Unknown coding for field %zu", field );
+      return ESP_ERR_INVALID_ARG;
+    }
+  }
+
+  // Whole records only, so the decoder never sees a partial one
+  size_t used = 0;
+  size_t record = 0;
+  for( ; record < records; record++ )
+  {
+    size_t record_length = 0;
+    for( size_t field = 0; field < schema->field_count; field++ )
+    {
+      record_length += _unit_lorawan_varint_length(
+          _unit_lorawan_encode_field( schema, values, record, field ) );
+    }
+    if( used + record_length > size )
+    {
+      break;
+    }
+    for( size_t field = 0; field < schema->field_count; field++ )
+    {
+      used += _unit_lorawan_varint_put(
+          _unit_lorawan_encode_field( schema, values, record, field ),
+          buf + used );
+    }
+  }
+
+  if( record == 0 )
+  {
+    ESP_LOGE( _TAG, "First record does not fit %zu bytes", size );
+    return ESP_ERR_INVALID_SIZE;
+  }
+  *length = used;
+  *encoded = record;
+  return ESP_OK;
+}
+
+esp_err_t unit_lorawan_send_encoded_h( unit_lorawan_handle_t lw,
+                                       const unit_lorawan_schema_t *schema,
+                                       const int32_t *values, size_t records,
+                                       const unit_lorawan_tx_opts_t *opts,
+                                       size_t *sent )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !sent )
+  {
+    ESP_LOGE( lw->tag, "Sent count pointer cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
+  }
+  *sent = 0;
+
+  // Packed against the live data rate, so the frame passes its size check
+  uint8_t frame[ UNIT_LORAWAN_REGION_MAX_PAYLOAD ];
+  size_t limit = _unit_lorawan_current_max_payload( lw );
+  if( limit > sizeof( frame ) )
+  {
+    limit = sizeof( frame );
+  }
+  size_t length;
+  size_t encoded;
+  esp_err_t err = unit_lorawan_encode( schema, values, records, frame, limit,
+                                       &length, &encoded );
+  if( err != ESP_OK )
+  {
+    return err;
+  }
+
+  ESP_LOGD( lw->tag, "Encoded %zu of %zu records in %zu bytes", encoded,
+            records, length );
+  err = unit_lorawan_send_ex_h( lw, frame, length, opts );
+  if( err == ESP_OK || err == UNIT_LORAWAN_ERR_SPOOLED )
+  {
+    *sent = encoded;
+  }
+  return err;
+}
+
+esp_err_t unit_lorawan_get_next_tx_delay_h( unit_lorawan_handle_t lw,
+                                            size_t length, uint32_t *delay_ms )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !delay_ms || length > UNIT_LORAWAN_REGION_MAX_PAYLOAD )
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  *delay_ms = _unit_lorawan_next_tx_delay_ms( lw, length );
+  return ESP_OK;
+}
+
+esp_err_t unit_lorawan_get_airtime_budget_h( unit_lorawan_handle_t lw,
+                                             uint32_t *remaining_ms )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !remaining_ms )
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  int64_t credit_us = _unit_lorawan_airtime_credit( lw );
+  *remaining_ms = credit_us > 0 ? (uint32_t)( credit_us / 1000 ) : 0;
+  return ESP_OK;
+}
+
+// Index of each step in _unit_lorawan_ttn_network_script
+enum
+{
+  LORAWAN_TTN_NETWORK_STEP_ADR,
+  LORAWAN_TTN_NETWORK_STEP_DATA_RATE,
+};
+
+static const lorawan_script_step_t _unit_lorawan_ttn_network_script[] = {
+    [LORAWAN_TTN_NETWORK_STEP_ADR] = LORAWAN_SCRIPT_STEP(
+        "CADR=%s", LORAWAN_SCRIPT_ARG_ADR, "Adaptive Data Rate" ),
+    // ADR can take over the data rate, so a rejected initial rate is fine
+    [LORAWAN_TTN_NETWORK_STEP_DATA_RATE] = LORAWAN_SCRIPT_STEP_OPTIONAL(
+        "CDATARATE=%s", LORAWAN_SCRIPT_ARG_DATA_RATE, "Initial data rate" ),
+};
+
+static esp_err_t
+_configure_ttn_network_parameters( lorawan_instance_t *lw,
+                                   const unit_lorawan_ttn_config_t *config )
+{
+  ESP_LOGI( lw->tag, "Configuring TTN-specific network parameters" );
+
+  // Note: ASR6501 doesn't support manual RX2 configuration via AT commands
+  // RX2 parameters are automatically handled by the LoRaWAN stack per regional
+  // parameters
+  ESP_LOGI( lw->tag,
+            "RX2 parameters automatically configured per %s regional "
+            "parameters",
+            _unit_lorawan_region.name );
+
+  char data_rate[ 4 ];
+  snprintf( data_rate, sizeof( data_rate ), "%d", config->data_rate );
+  const char *args[ LORAWAN_SCRIPT_ARG_COUNT ] = {
+      [LORAWAN_SCRIPT_ARG_ADR] = config->adr_enabled ? "1" : "0",
+      [LORAWAN_SCRIPT_ARG_DATA_RATE] = data_rate,
+  };
+  uint32_t completed = 0;
+  esp_err_t err = _unit_lorawan_run_script(
+      lw, "TTN network", _unit_lorawan_ttn_network_script,
+      sizeof( _unit_lorawan_ttn_network_script ) /
+          sizeof( _unit_lorawan_ttn_network_script[ 0 ] ),
+      args, &completed );
+  if( err != ESP_OK )
+  {
+    return err;
+  }
+
+  _unit_lorawan_session_set_adr( lw, config->adr_enabled );
+  if( completed & ( 1UL << LORAWAN_TTN_NETWORK_STEP_DATA_RATE ) )
+  {
+    _unit_lorawan_session_set_data_rate( lw, config->data_rate );
+    ESP_LOGI( lw->tag, "  DR%d allows %zu bytes of payload", config->data_rate,
+              _unit_lorawan_region_max_payload( config->data_rate ) );
+  }
+  else
+  {
+    ESP_LOGI( lw->tag, "  Network will use default data rate (ADR: %s)",
+              config->adr_enabled ? "enabled" : "disabled" );
+  }
+  return ESP_OK;
+}
+
+static void _unit_lorawan_log_rx2( lorawan_instance_t *lw )
+{
+  ESP_LOGW( lw->tag,
+            "Device uses automatic RX2 settings per LoRaWAN %s regional "
+            "parameters",
+            _unit_lorawan_region.name );
+  ESP_LOGW( lw->tag,
+            "TTN %s RX2: %u Hz, DR%d (configured automatically by stack)",
+            _unit_lorawan_region.name,
+            (unsigned)_unit_lorawan_region.rx2_frequency,
+            _unit_lorawan_region.rx2_data_rate );
+}
+
+esp_err_t unit_lorawan_set_rx2_frequency_h( unit_lorawan_handle_t lw,
+                                            uint32_t frequency )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  ESP_LOGW( lw->tag, "RX2 frequency configuration not supported by ASR6501" );
+  _unit_lorawan_log_rx2( lw );
+  return ESP_ERR_NOT_SUPPORTED;
+}
 
-static const char *_unit_lorawan_uldlmode_str[ 2 ] = { "2", "1" };
+esp_err_t unit_lorawan_set_rx2_data_rate_h( unit_lorawan_handle_t lw,
+                                            uint8_t data_rate )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  ESP_LOGW( lw->tag, "RX2 data rate configuration not supported by ASR6501" );
+  _unit_lorawan_log_rx2( lw );
+  return ESP_ERR_NOT_SUPPORTED;
+}
 
-static const char *
-_unit_lorawan_get_connection_status_description( const char *status_code )
+// CRSSI scan rows streamed straight into the caller's array
+typedef struct
 {
-  if( strstr( status_code, "04" ) )
+  int16_t *rssi_values;
+  size_t count;
+  bool header; // +CRSSI: seen
+} lorawan_crssi_scan_t;
+
+// Response format: +CRSSI:\r\n0:<rssi>\r\n1:<rssi>\r\n...\r\n7:<rssi>\r\nOK
+static bool _unit_lorawan_crssi_consume( const lorawan_line_t *line,
+                                         void *ctx )
+{
+  lorawan_crssi_scan_t *scan = (lorawan_crssi_scan_t *)ctx;
+  if( line->tag == LORAWAN_TAG_CRSSI )
   {
-    return "Network joined successfully (OTAA)";
+    scan->header = true;
+    return true;
   }
-  else if( strstr( status_code, "08" ) )
+  if( line->tag != LORAWAN_TAG_NONE || !scan->header )
   {
-    return "Network joined successfully (ABP)";
+    return false; // Result codes and stray output stay with the capture
   }
-  else if( strstr( status_code, "02" ) )
+
+  if( line->field_count != 2 )
   {
-    return "Network joining in progress";
+    ESP_LOGW( _TAG, "Failed to parse RSSI line: %s", line->value );
+    return true;
   }
-  else if( strstr( status_code, "01" ) )
+  int32_t channel = line->fields[ 0 ];
+  int32_t rssi_val = line->fields[ 1 ];
+  if( scan->count < UNIT_LORAWAN_CRSSI_CHANNELS &&
+      channel == (int32_t)scan->count )
   {
-    return "Device not joined to network";
+    scan->rssi_values[ scan->count++ ] = (int16_t)rssi_val;
+    ESP_LOGD( _TAG, "Channel %d: %d dBm", (int)channel, (int)rssi_val );
   }
-  else if( strstr( status_code, "03" ) )
+  else
   {
-    return "Network join failed";
+    ESP_LOGW( _TAG, "Unexpected channel number %d at position %zu",
+              (int)channel, scan->count );
   }
-  return "Unknown connection status";
+  return true;
 }
 
-static esp_err_t _unit_lorawan_validate_payload_size( size_t payload_size,
-                                                      uint8_t data_rate )
+esp_err_t unit_lorawan_get_channel_rssi_h( unit_lorawan_handle_t lw,
+                                           uint8_t freq_band_idx,
+                                           int16_t *rssi_values,
+                                           size_t *channel_count )
 {
-  size_t max_payload = 0;
-  switch( data_rate )
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !rssi_values || !channel_count )
   {
-  case 0:
-    max_payload = UNIT_LORAWAN_US915_MAX_PAYLOAD_DR0;
-    break;
-  case 1:
-    max_payload = UNIT_LORAWAN_US915_MAX_PAYLOAD_DR1;
-    break;
-  case 2:
-    max_payload = UNIT_LORAWAN_US915_MAX_PAYLOAD_DR2;
-    break;
-  case 3:
-    max_payload = UNIT_LORAWAN_US915_MAX_PAYLOAD_DR3;
-    break;
-  case 4:
-    max_payload = UNIT_LORAWAN_US915_MAX_PAYLOAD_DR4;
-    break;
-  default:
-    ESP_LOGW( _TAG, "Unknown data rate %d, using maximum safe payload size",
-              data_rate );
-    max_payload = UNIT_LORAWAN_US915_MAX_PAYLOAD_DR0;
-    break;
+    ESP_LOGE( lw->tag,
+              "RSSI values and channel count parameters cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
   }
-  if( payload_size > max_payload )
+
+  ESP_LOGI( lw->tag, "Scanning RSSI for frequency band %d", freq_band_idx );
+
+  char cmd[ 32 ];
+  snprintf( cmd, sizeof( cmd ), "CRSSI %d?", freq_band_idx );
+
+  // Rows are parsed as they arrive, so the scan never needs to fit the
+  // response buffer or a single UART read
+  lorawan_crssi_scan_t scan = { .rssi_values = rssi_values };
+  lorawan_line_sink_t sink = {
+      .consume = _unit_lorawan_crssi_consume,
+      .ctx = &scan,
+  };
+  lorawan_response_t response = { 0 };
+  esp_err_t err = _unit_lorawan_send_at_command_until(
+      lw, cmd, &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS, 0, &sink );
+
+  if( err == ESP_OK && response.success )
   {
-    ESP_LOGE( _TAG,
-              "Payload size %zu exceeds maximum %zu bytes for data rate DR%d",
-              payload_size, max_payload, data_rate );
-    return ESP_ERR_INVALID_SIZE;
+    if( scan.header )
+    {
+      *channel_count = scan.count;
+      if( scan.count == UNIT_LORAWAN_CRSSI_CHANNELS )
+      {
+        ESP_LOGI( lw->tag,
+                  "✓ Successfully scanned RSSI for all %zu channels in "
+                  "frequency band %d",
+                  scan.count, freq_band_idx );
+      }
+      else
+      {
+        ESP_LOGW( lw->tag, "Expected %d channels but only parsed %zu",
+                  UNIT_LORAWAN_CRSSI_CHANNELS, scan.count );
+      }
+    }
+    else
+    {
+      ESP_LOGE( lw->tag, "Invalid RSSI response format - missing +CRSSI:" );
+      err = ESP_FAIL;
+    }
   }
-  ESP_LOGD( _TAG, "Payload size %zu is valid for data rate DR%d (max: %zu)",
-            payload_size, data_rate, max_payload );
-  return ESP_OK;
-}
-
-static esp_err_t _unit_lorawan_wait_for_response( char *buffer,
-                                                  size_t buffer_size,
-                                                  size_t *received_len,
-                                                  uint32_t timeout_ms )
-{
-  *received_len = 0;
-  uint32_t start_time = xTaskGetTickCount() * portTICK_PERIOD_MS;
-  while( ( xTaskGetTickCount() * portTICK_PERIOD_MS - start_time ) <
-         timeout_ms )
+  else
   {
-    size_t available_bytes = 0;
-    esp_err_t err =
-        core2foraws_expports_uart_read( (uint8_t *)buffer, &available_bytes );
-    if( err == ESP_OK && available_bytes > 0 )
+    ESP_LOGE( lw->tag,
+              "✗ Failed to scan channel RSSI values for frequency band %d",
+              freq_band_idx );
+    if( err == ESP_OK )
     {
-      *received_len = available_bytes;
-      buffer[ available_bytes ] = '\0';
-      ESP_LOGD( _TAG, "Received %zu bytes: %s", available_bytes, buffer );
-      return ESP_OK;
+      err = ESP_FAIL;
     }
-    vTaskDelay( pdMS_TO_TICKS( 50 ) );
   }
-  ESP_LOGW( _TAG, "Timeout waiting for response after %u ms", timeout_ms );
-  return ESP_ERR_TIMEOUT;
+
+  _unit_lorawan_cleanup_response( lw, &response );
+  return err;
 }
 
-static esp_err_t
-_unit_lorawan_parse_response( const char *raw_response, size_t response_len,
-                              lorawan_response_t *parsed_response )
+#ifdef CONFIG_LORAWAN_SURVEY
+// AT+CRSSI frequency band index of a US915 sub-band, counted from 0
+static uint8_t _unit_lorawan_survey_band_index( uint8_t sub_band )
 {
-  if( !raw_response || !parsed_response || response_len == 0 )
+  return sub_band - 1;
+}
+
+static bool
+_unit_lorawan_survey_served( const unit_lorawan_survey_config_t *config,
+                             uint8_t sub_band )
+{
+  return config->sub_band_mask == 0 ||
+         ( config->sub_band_mask & ( 1u << ( sub_band - 1 ) ) );
+}
+
+// Served sub-band scanned after sub_band. The mask serves at least one of
+// the eight, so the search ends.
+static uint8_t
+_unit_lorawan_survey_next( const unit_lorawan_survey_config_t *config,
+                           uint8_t sub_band )
+{
+  do
   {
-    return ESP_ERR_INVALID_ARG;
+    sub_band = sub_band % UNIT_LORAWAN_US915_SUB_BAND_MAX + 1;
+  } while( !_unit_lorawan_survey_served( config, sub_band ) );
+  return sub_band;
+}
+
+static void _unit_lorawan_survey_record( lorawan_instance_t *lw,
+                                         uint8_t sub_band,
+                                         const int16_t *rssi_values )
+{
+  lorawan_survey_t *survey = &lw->survey;
+  uint8_t index = sub_band - 1;
+  portENTER_CRITICAL( &survey->lock );
+  uint8_t head = survey->head[ index ];
+  for( size_t channel = 0; channel < UNIT_LORAWAN_CRSSI_CHANNELS; channel++ )
+  {
+    int32_t noise = -rssi_values[ channel ];
+    survey->noise[ index ][ channel ][ head ] =
+        noise < 0 ? 0 : noise > UINT8_MAX ? UINT8_MAX : (uint8_t)noise;
+  }
+  survey->head[ index ] = ( head + 1 ) % UNIT_LORAWAN_SURVEY_HISTORY;
+  if( survey->count[ index ] < UNIT_LORAWAN_SURVEY_HISTORY )
+  {
+    survey->count[ index ]++;
   }
+  survey->scanned_at[ index ] = xTaskGetTickCount();
+  portEXIT_CRITICAL( &survey->lock );
+}
 
-  parsed_response->success = false;
-  parsed_response->response_data = NULL;
-  parsed_response->data_length = 0;
-  memset( parsed_response->error_code, 0,
-          sizeof( parsed_response->error_code ) );
+// Statistics are worked out on a copy so the lock is only held to copy
+static void
+_unit_lorawan_survey_summarize( lorawan_instance_t *lw, uint8_t sub_band,
+                                unit_lorawan_sub_band_survey_t *summary )
+{
+  lorawan_survey_t *survey = &lw->survey;
+  uint8_t index = sub_band - 1;
+  uint8_t noise[ UNIT_LORAWAN_CRSSI_CHANNELS ][ UNIT_LORAWAN_SURVEY_HISTORY ];
+  portENTER_CRITICAL( &survey->lock );
+  memcpy( noise, survey->noise[ index ], sizeof( noise ) );
+  uint8_t count = survey->count[ index ];
+  TickType_t scanned_at = survey->scanned_at[ index ];
+  portEXIT_CRITICAL( &survey->lock );
+
+  memset( summary, 0, sizeof( *summary ) );
+  summary->sub_band = sub_band;
+  summary->samples = count;
+  if( count == 0 )
+  {
+    return;
+  }
+  summary->age_ms = pdTICKS_TO_MS( xTaskGetTickCount() - scanned_at );
 
-  if( strstr( raw_response, "OK" ) != NULL )
+  // Nearest rank; noise is -dBm, so sorting it down sorts dBm up
+  size_t rank = ( count * UNIT_LORAWAN_SURVEY_PERCENTILE + 99 ) / 100;
+  int32_t score = 0;
+  for( size_t channel = 0; channel < UNIT_LORAWAN_CRSSI_CHANNELS; channel++ )
   {
-    parsed_response->success = true;
-    ESP_LOGD( _TAG, "Command executed successfully" );
-
-    if( strstr( raw_response, "+CGMI=" ) != NULL ||
-        strstr( raw_response, "+CSTATUS:" ) != NULL ||
-        strstr( raw_response, "+CDATARATE:" ) != NULL ||
-        strstr( raw_response, "+CTXP:" ) != NULL ||
-        strstr( raw_response, "+CRSSI:" ) != NULL ||
-        strstr( raw_response, "+DTRX:" ) != NULL ||
-        strstr( raw_response, "+CJOIN:" ) != NULL )
-    {
-      parsed_response->data_length = response_len;
-      parsed_response->response_data = malloc( response_len + 1 );
-      if( parsed_response->response_data )
+    uint8_t *readings = noise[ channel ];
+    uint32_t total = 0;
+    for( size_t i = 0; i < count; i++ )
+    {
+      uint8_t reading = readings[ i ];
+      size_t j = i;
+      for( ; j > 0 && readings[ j - 1 ] < reading; j-- )
       {
-        memcpy( parsed_response->response_data, raw_response, response_len );
-        parsed_response->response_data[ response_len ] = '\0';
-        ESP_LOGD( _TAG, "Response data captured: %s",
-                  parsed_response->response_data );
+        readings[ j ] = readings[ j - 1 ];
       }
+      readings[ j ] = reading;
+      total += reading;
     }
+
+    unit_lorawan_channel_noise_t *stats = &summary->channels[ channel ];
+    stats->min_dbm = -(int16_t)readings[ 0 ];
+    stats->mean_dbm = -(int16_t)( ( total + count / 2 ) / count );
+    stats->p90_dbm = -(int16_t)readings[ rank - 1 ];
+    score += stats->p90_dbm;
   }
-  // Check for error responses
-  else if( strstr( raw_response, "ERROR" ) != NULL )
+  summary->score_dbm = score / UNIT_LORAWAN_CRSSI_CHANNELS;
+}
+
+// Quietest served sub-band, or 0 before any has been scanned. current is
+// kept unless another sub-band beats it by the configured margin.
+static uint8_t
+_unit_lorawan_survey_best( lorawan_instance_t *lw,
+                           const unit_lorawan_survey_config_t *config,
+                           uint8_t current )
+{
+  uint8_t best = 0;
+  int16_t best_score = 0;
+  bool current_known = false;
+  int16_t current_score = 0;
+  for( uint8_t sub_band = UNIT_LORAWAN_US915_SUB_BAND_MIN;
+       sub_band <= UNIT_LORAWAN_US915_SUB_BAND_MAX; sub_band++ )
   {
-    parsed_response->success = false;
-    // Try to extract error code
-    char *error_pos = strstr( raw_response, "ERROR" );
-    if( error_pos )
+    if( !_unit_lorawan_survey_served( config, sub_band ) )
     {
-      sscanf( error_pos, "ERROR:%15s", parsed_response->error_code );
+      continue;
     }
-    ESP_LOGW( _TAG, "Command failed with error: %s",
-              parsed_response->error_code );
-  }
-  // Check for specific LoRaWAN responses with +COMMAND: format (fallback for
-  // responses without OK)
-  else if( strstr( raw_response, "+CSTATUS:" ) != NULL ||
-           strstr( raw_response, "+CGMI=" ) != NULL ||
-           strstr( raw_response, "+CDATARATE:" ) != NULL ||
-           strstr( raw_response, "+CTXP:" ) != NULL ||
-           strstr( raw_response, "+CRSSI:" ) != NULL ||
-           strstr( raw_response, "+DTRX:" ) != NULL ||
-           strstr( raw_response, "+CJOIN:" ) != NULL )
-  {
-    parsed_response->success = true;
-    parsed_response->data_length = response_len;
-    parsed_response->response_data = malloc( response_len + 1 );
-    if( parsed_response->response_data )
+    unit_lorawan_sub_band_survey_t summary;
+    _unit_lorawan_survey_summarize( lw, sub_band, &summary );
+    if( summary.samples == 0 )
+    {
+      continue;
+    }
+    if( sub_band == current )
+    {
+      current_known = true;
+      current_score = summary.score_dbm;
+    }
+    if( best == 0 || summary.score_dbm < best_score )
     {
-      memcpy( parsed_response->response_data, raw_response, response_len );
-      parsed_response->response_data[ response_len ] = '\0';
+      best = sub_band;
+      best_score = summary.score_dbm;
     }
   }
 
-  return ESP_OK;
+  if( current_known && best_score + config->margin_db > current_score )
+  {
+    return current;
+  }
+  return best;
 }
 
-static esp_err_t _unit_lorawan_send_at_command( const char *cmd,
-                                                lorawan_response_t *response,
-                                                uint32_t timeout_ms )
+static TickType_t _unit_lorawan_survey_wait( lorawan_instance_t *lw )
 {
-  if( !cmd )
+  lorawan_survey_t *survey = &lw->survey;
+  portENTER_CRITICAL( &survey->lock );
+  bool enabled = survey->enabled;
+  TickType_t next_at = survey->next_at;
+  portEXIT_CRITICAL( &survey->lock );
+  if( !enabled )
   {
-    ESP_LOGE( _TAG, "Command cannot be NULL" );
-    return ESP_ERR_INVALID_ARG;
+    return portMAX_DELAY;
   }
+  TickType_t now = xTaskGetTickCount();
+  return _unit_lorawan_tick_reached( now, next_at ) ? 0 : next_at - now;
+}
 
-  // Format AT command
-  size_t at_cmd_len =
-      strlen( cmd ) + 6; // "AT+" + cmd + "\r\n" + null terminator
-  char *at_cmd = malloc( at_cmd_len );
-  if( !at_cmd )
+// Scans one sub-band when the link has nothing else to do, then acts on the
+// recommendation
+static void _unit_lorawan_survey_service( lorawan_instance_t *lw )
+{
+  if( _unit_lorawan_survey_wait( lw ) != 0 )
   {
-    ESP_LOGE( _TAG, "Failed to allocate memory for AT command" );
-    return ESP_ERR_NO_MEM;
+    return;
   }
 
-  snprintf( at_cmd, at_cmd_len, "AT+%s\r\n", cmd );
+  lorawan_survey_t *survey = &lw->survey;
+  portENTER_CRITICAL( &lw->join.lock );
+  bool joining = lw->join.active;
+  portEXIT_CRITICAL( &lw->join.lock );
+  portENTER_CRITICAL( &lw->driver.lock );
+  bool urgent = lw->driver.urgent != NULL;
+  portEXIT_CRITICAL( &lw->driver.lock );
+  bool busy = joining || urgent ||
+              uxQueueMessagesWaiting( lw->driver.queue ) > 0 ||
+              ( lw->tx.queue && uxQueueMessagesWaiting( lw->tx.queue ) > 0 );
+  TickType_t now = xTaskGetTickCount();
+  if( busy )
+  {
+    portENTER_CRITICAL( &survey->lock );
+    survey->next_at = now + pdMS_TO_TICKS( UNIT_LORAWAN_SURVEY_BUSY_RETRY_MS );
+    portEXIT_CRITICAL( &survey->lock );
+    return;
+  }
 
-  // Send command with retries
-  esp_err_t err = ESP_FAIL;
-  for( int retry = 0; retry < UNIT_LORAWAN_MAX_RETRIES; retry++ )
+  portENTER_CRITICAL( &survey->lock );
+  unit_lorawan_survey_config_t config = survey->config;
+  uint8_t sub_band = survey->next_sub_band;
+  survey->next_sub_band = _unit_lorawan_survey_next( &config, sub_band );
+  survey->next_at = now + pdMS_TO_TICKS( config.interval_ms );
+  portEXIT_CRITICAL( &survey->lock );
+
+  int16_t rssi_values[ UNIT_LORAWAN_CRSSI_CHANNELS ];
+  size_t channel_count = 0;
+  esp_err_t err = unit_lorawan_get_channel_rssi_h(
+      lw, _unit_lorawan_survey_band_index( sub_band ), rssi_values,
+      &channel_count );
+  if( err != ESP_OK || channel_count != UNIT_LORAWAN_CRSSI_CHANNELS )
   {
-    if( retry > 0 )
-    {
-      ESP_LOGW( _TAG, "Retrying command (attempt %d/%d): %s", retry + 1,
-                UNIT_LORAWAN_MAX_RETRIES, cmd );
-      vTaskDelay( pdMS_TO_TICKS( 500 ) ); // Wait before retry
-    }
+    ESP_LOGW( lw->tag, "⚠ Survey scan of sub-band %u failed", sub_band );
+    return;
+  }
+  _unit_lorawan_survey_record( lw, sub_band, rssi_values );
 
-    // Clear any pending data
-    bool flushed = false;
-    core2foraws_expports_uart_read_flush( &flushed );
+  uint8_t current = _unit_lorawan_airtime_sub_band( lw );
+  uint8_t best = _unit_lorawan_survey_best( lw, &config, current );
+  if( best == 0 || best == current )
+  {
+    return;
+  }
 
-    // Send command
-    size_t written = 0;
-    err = core2foraws_expports_uart_write( at_cmd, strlen( at_cmd ), &written );
-    if( err != ESP_OK )
+  if( config.auto_apply && !_unit_lorawan_session_joined( lw ) )
+  {
+    if( _configure_frequency_plan( lw, best ) == ESP_OK )
     {
-      ESP_LOGE( _TAG, "Failed to send AT command: %s", cmd );
-      continue;
+      _unit_lorawan_airtime_set_sub_band( lw, best );
+      ESP_LOGI( lw->tag, "✓ Survey moved the channel mask to sub-band %u",
+                best );
     }
+    return;
+  }
 
-    ESP_LOGD( _TAG, "Sent AT command (%zu bytes): %s", written, at_cmd );
+  portENTER_CRITICAL( &survey->lock );
+  bool changed = survey->recommended != best;
+  survey->recommended = best;
+  portEXIT_CRITICAL( &survey->lock );
+  if( changed )
+  {
+    ESP_LOGI( lw->tag, "Survey recommends sub-band %u over sub-band %u", best,
+              current );
+  }
+}
+#endif
 
-    // Wait for command to be sent
-    vTaskDelay( pdMS_TO_TICKS( UNIT_LORAWAN_COMMAND_DELAY_MS ) );
+esp_err_t unit_lorawan_survey_configure_h(
+    unit_lorawan_handle_t lw, const unit_lorawan_survey_config_t *config )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+#ifdef CONFIG_LORAWAN_SURVEY
+  if( config && config->interval_ms == 0 )
+  {
+    ESP_LOGE( lw->tag, "Survey interval cannot be 0" );
+    return ESP_ERR_INVALID_ARG;
+  }
 
-    // Read response
-    char *response_buffer = malloc( UNIT_LORAWAN_RESPONSE_BUFFER_SIZE );
-    if( !response_buffer )
-    {
-      ESP_LOGE( _TAG, "Failed to allocate response buffer" );
-      err = ESP_ERR_NO_MEM;
-      break;
-    }
+  lorawan_survey_t *survey = &lw->survey;
+  portENTER_CRITICAL( &survey->lock );
+  survey->enabled = config != NULL;
+  survey->recommended = 0;
+  if( config )
+  {
+    survey->config = *config;
+    survey->next_sub_band = _unit_lorawan_survey_next(
+        config, UNIT_LORAWAN_US915_SUB_BAND_MAX );
+    survey->next_at = xTaskGetTickCount();
+  }
+  portEXIT_CRITICAL( &survey->lock );
 
-    size_t received_len = 0;
-    err = _unit_lorawan_wait_for_response(
-        response_buffer, UNIT_LORAWAN_RESPONSE_BUFFER_SIZE - 1, &received_len,
-        timeout_ms );
+  if( config )
+  {
+    ESP_LOGI( lw->tag, "✓ Channel survey every %u ms (sub-band mask 0x%02x)",
+              config->interval_ms, config->sub_band_mask );
+    _unit_lorawan_driver_wake( lw );
+  }
+  else
+  {
+    ESP_LOGI( lw->tag, "Channel survey stopped" );
+  }
+  return ESP_OK;
+#else
+  ESP_LOGW( lw->tag, "Channel survey disabled (CONFIG_LORAWAN_SURVEY)" );
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
 
-    if( err == ESP_OK && response )
-    {
-      err = _unit_lorawan_parse_response( response_buffer, received_len,
-                                          response );
-    }
+esp_err_t unit_lorawan_get_survey_h( unit_lorawan_handle_t lw,
+                                     uint8_t sub_band,
+                                     unit_lorawan_sub_band_survey_t *survey )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+#ifdef CONFIG_LORAWAN_SURVEY
+  if( !survey || sub_band < UNIT_LORAWAN_US915_SUB_BAND_MIN ||
+      sub_band > UNIT_LORAWAN_US915_SUB_BAND_MAX )
+  {
+    ESP_LOGE( lw->tag, "Invalid survey query for sub-band %u", sub_band );
+    return ESP_ERR_INVALID_ARG;
+  }
+  _unit_lorawan_survey_summarize( lw, sub_band, survey );
+  return ESP_OK;
+#else
+  ESP_LOGW( lw->tag, "Channel survey disabled (CONFIG_LORAWAN_SURVEY)" );
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t unit_lorawan_survey_recommend_h( unit_lorawan_handle_t lw,
+                                           uint8_t *sub_band )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+#ifdef CONFIG_LORAWAN_SURVEY
+  if( !sub_band )
+  {
+    ESP_LOGE( lw->tag, "Sub-band pointer cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
+  }
 
-    free( response_buffer );
+  lorawan_survey_t *survey = &lw->survey;
+  portENTER_CRITICAL( &survey->lock );
+  unit_lorawan_survey_config_t config = survey->config;
+  portEXIT_CRITICAL( &survey->lock );
 
-    if( err == ESP_OK )
-    {
-      break; // Success, exit retry loop
-    }
+  uint8_t best = _unit_lorawan_survey_best(
+      lw, &config, _unit_lorawan_airtime_sub_band( lw ) );
+  if( best == 0 )
+  {
+    return ESP_ERR_NOT_FOUND;
+  }
+  *sub_band = best;
+  return ESP_OK;
+#else
+  ESP_LOGW( lw->tag, "Channel survey disabled (CONFIG_LORAWAN_SURVEY)" );
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t unit_lorawan_get_spool_status_h( unit_lorawan_handle_t lw,
+                                           unit_lorawan_spool_status_t *status )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+#ifdef CONFIG_LORAWAN_SPOOL
+  if( !status )
+  {
+    ESP_LOGE( lw->tag, "Status pointer cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
   }
 
-  free( at_cmd );
+  lorawan_spool_t *spool = &lw->spool;
+  if( !spool->map )
+  {
+    ESP_LOGE( lw->tag, "Spool not mounted, it belongs to the default unit" );
+    return ESP_ERR_INVALID_STATE;
+  }
 
-  if( err != ESP_OK )
+  xSemaphoreTake( spool->lock, portMAX_DELAY );
+  status->pending = spool->pending;
+  status->dropped = spool->dropped;
+  status->capacity_bytes = spool->partition->size;
+  xSemaphoreGive( spool->lock );
+  return ESP_OK;
+#else
+  ESP_LOGW( lw->tag, "Uplink spool disabled (CONFIG_LORAWAN_SPOOL)" );
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t unit_lorawan_set_data_rate_h( unit_lorawan_handle_t lw,
+                                        uint8_t data_rate )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( data_rate > _unit_lorawan_region.data_rate_max )
+  {
+    ESP_LOGE( lw->tag, "Invalid data rate %d for %s (valid range: 0-%d)",
+              data_rate, _unit_lorawan_region.name,
+              _unit_lorawan_region.data_rate_max );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  ESP_LOGI( lw->tag, "Setting data rate to DR%d (max payload: %zu bytes)",
+            data_rate, _unit_lorawan_region_max_payload( data_rate ) );
+
+  char dr_cmd[ 32 ];
+  snprintf( dr_cmd, sizeof( dr_cmd ), "CDATARATE=%d", data_rate );
+
+  lorawan_response_t response = { 0 };
+  esp_err_t err = _unit_lorawan_send_at_command(
+      lw, dr_cmd, &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+
+  if( err == ESP_OK && response.success )
   {
-    ESP_LOGE( _TAG, "Command failed after %d retries: %s",
-              UNIT_LORAWAN_MAX_RETRIES, cmd );
+    _unit_lorawan_session_set_data_rate( lw, data_rate );
+    ESP_LOGI( lw->tag, "✓ Data rate set to DR%d successfully", data_rate );
+  }
+  else
+  {
+    ESP_LOGE( lw->tag, "✗ Failed to set data rate to DR%d", data_rate );
+    ESP_LOGW( lw->tag,
+              "Note: If ADR is enabled, network may override this setting" );
   }
 
+  _unit_lorawan_cleanup_response( lw, &response );
   return err;
 }
 
-static void _unit_lorawan_cleanup_response( lorawan_response_t *response )
+esp_err_t unit_lorawan_set_retries_h( unit_lorawan_handle_t lw,
+                                      uint8_t message_type, uint8_t retries )
 {
-  if( response && response->response_data )
+  LORAWAN_CHECK_HANDLE( lw );
+  if( message_type > 1 )
   {
-    free( response->response_data );
-    response->response_data = NULL;
-    response->data_length = 0;
+    ESP_LOGE( lw->tag, "Invalid message type %d (0=unconfirmed, 1=confirmed)",
+              message_type );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  if( retries < 1 || retries > 15 )
+  {
+    ESP_LOGE( lw->tag, "Invalid retry count %d (valid range: 1-15)", retries );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  ESP_LOGI( lw->tag, "Setting %s message retries to %d",
+            message_type ? "confirmed" : "unconfirmed", retries );
+
+  char cmd[ 32 ];
+  snprintf( cmd, sizeof( cmd ), "CNBTRIALS=%d,%d", message_type, retries );
+
+  lorawan_response_t response = { 0 };
+  esp_err_t err = _unit_lorawan_send_at_command(
+      lw, cmd, &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+
+  if( err == ESP_OK && response.success )
+  {
+    ESP_LOGI( lw->tag, "✓ Retry count set successfully" );
+  }
+  else
+  {
+    ESP_LOGE( lw->tag, "✗ Failed to set retry count" );
   }
+
+  _unit_lorawan_cleanup_response( lw, &response );
+  return err;
 }
 
-esp_err_t unit_lorawan_log( uint8_t level )
+esp_err_t unit_lorawan_set_tx_power_h( unit_lorawan_handle_t lw,
+                                       uint8_t power_index )
 {
-  ESP_LOGI( _TAG, "Setting LoRaWAN log level to %d", level );
-
-  if( level > UNIT_LORAWAN_LOG_LEVEL_MAX )
+  LORAWAN_CHECK_HANDLE( lw );
+  if( power_index > 7 )
   {
-    ESP_LOGW( _TAG, "Log level %d is out of range (0-%d), clamping to %d",
-              level, UNIT_LORAWAN_LOG_LEVEL_MAX, UNIT_LORAWAN_LOG_LEVEL_MAX );
-    level = UNIT_LORAWAN_LOG_LEVEL_MAX;
+    ESP_LOGE( lw->tag, "Invalid TX power index %d (valid range: 0-7)",
+              power_index );
+    return ESP_ERR_INVALID_ARG;
   }
 
-  char log_cmd[ 32 ];
-  snprintf( log_cmd, sizeof( log_cmd ), "ILOGLVL=%d", level );
+  ESP_LOGI( lw->tag, "Setting TX power to index %d (%d dBm)", power_index,
+            _unit_lorawan_region.tx_power_max_dbm - 2 * power_index );
+
+  char cmd[ 16 ];
+  snprintf( cmd, sizeof( cmd ), "CTXP=%d", power_index );
 
   lorawan_response_t response = { 0 };
   esp_err_t err = _unit_lorawan_send_at_command(
-      log_cmd, &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+      lw, cmd, &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
 
   if( err == ESP_OK && response.success )
   {
-    ESP_LOGI( _TAG, "✓ LoRaWAN log level set to %d successfully", level );
+    _unit_lorawan_session_set_tx_power( lw, power_index );
+    ESP_LOGI( lw->tag, "✓ TX power set successfully" );
   }
   else
   {
-    ESP_LOGE( _TAG, "✗ Failed to set LoRaWAN log level" );
+    ESP_LOGE( lw->tag, "✗ Failed to set TX power" );
   }
 
-  _unit_lorawan_cleanup_response( &response );
+  _unit_lorawan_cleanup_response( lw, &response );
   return err;
 }
 
-esp_err_t unit_lorawan_connected( bool *state )
+esp_err_t unit_lorawan_get_tx_power_h( unit_lorawan_handle_t lw,
+                                       uint8_t *power_index )
 {
-  if( !state )
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !power_index )
   {
-    ESP_LOGE( _TAG, "State parameter cannot be NULL" );
+    ESP_LOGE( lw->tag, "TX power parameter cannot be NULL" );
     return ESP_ERR_INVALID_ARG;
   }
 
-  ESP_LOGD( _TAG, "Checking LoRaWAN network connection status" );
-  *state = false;
+  ESP_LOGD( lw->tag, "Getting current TX power" );
 
   lorawan_response_t response = { 0 };
   esp_err_t err = _unit_lorawan_send_at_command(
-      "CSTATUS?", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+      lw, "CTXP?", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
 
   if( err == ESP_OK && response.success && response.response_data )
   {
-    char *status_pos = strstr( response.response_data, "+CSTATUS:" );
-    if( status_pos )
+    if( response.result.tag == LORAWAN_TAG_CTXP )
     {
-      char status_code[ 8 ] = { 0 };
-      if( sscanf( status_pos, "+CSTATUS:%7s", status_code ) == 1 )
+      if( response.result.field_count >= 1 )
       {
-        if( strstr( status_code, "04" ) != NULL ||
-            strstr( status_code, "08" ) != NULL )
-        {
-          *state = true;
-          ESP_LOGI( _TAG, "✓ Device is connected to LoRaWAN network" );
-        }
-        else
-        {
-          const char *description =
-              _unit_lorawan_get_connection_status_description( status_code );
-          ESP_LOGI( _TAG, "✗ Device not connected to network - Status: %s (%s)",
-                    status_code, description );
-        }
+        *power_index = (uint8_t)response.result.fields[ 0 ];
+        _unit_lorawan_session_set_tx_power( lw, *power_index );
+        ESP_LOGI( lw->tag, "Current TX power index: %d", *power_index );
       }
       else
       {
-        ESP_LOGW( _TAG, "✗ Could not parse connection status from response" );
+        ESP_LOGE( lw->tag, "Failed to parse TX power from response" );
+        err = ESP_FAIL;
       }
     }
     else
     {
-      ESP_LOGW( _TAG, "✗ Could not find +CSTATUS: in response: %s",
-                response.response_data );
+      ESP_LOGE( lw->tag, "TX power data not found in response" );
+      err = ESP_FAIL;
     }
   }
   else
   {
-    ESP_LOGE( _TAG, "✗ Failed to check LoRaWAN connection status" );
+    ESP_LOGE( lw->tag, "Failed to get TX power" );
   }
 
-  _unit_lorawan_cleanup_response( &response );
+  _unit_lorawan_cleanup_response( lw, &response );
   return err;
 }
 
-esp_err_t unit_lorawan_join( void )
+esp_err_t unit_lorawan_link_check_h( unit_lorawan_handle_t lw, uint8_t mode )
 {
-  ESP_LOGI( _TAG, "Attempting to join LoRaWAN network..." );
+  LORAWAN_CHECK_HANDLE( lw );
+  if( mode > 2 )
+  {
+    ESP_LOGE(
+        lw->tag,
+        "Invalid link check mode %d (0=disable, 1=once, 2=after every uplink)",
+        mode );
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  ESP_LOGI( lw->tag, "Setting link check mode to %d", mode );
+
+  char cmd[ 16 ];
+  snprintf( cmd, sizeof( cmd ), "CLINKCHECK=%d", mode );
 
+  // A one-shot check reports through +CLINKCHECK after the next uplink
   lorawan_response_t response = { 0 };
-  // Use longer timeout for join operation
   esp_err_t err =
-      _unit_lorawan_send_at_command( "CJOIN=1,1,10,8", &response, 30000 );
+      mode == 1
+          ? _unit_lorawan_send_at_command_until(
+                lw, cmd, &response, 30000,
+                LORAWAN_TAG_BIT( LORAWAN_TAG_CLINKCHECK ), NULL )
+          : _unit_lorawan_send_at_command( lw, cmd, &response,
+                                           UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
 
   if( err == ESP_OK && response.success )
   {
-    ESP_LOGI( _TAG, "✓ LoRaWAN join command sent successfully" );
-    ESP_LOGI( _TAG,
-              "  Join process initiated - this may take up to 30 seconds" );
-    ESP_LOGI( _TAG, "  Use unit_lorawan_connected() to check join status" );
+    ESP_LOGI( lw->tag, "✓ Link check configured successfully" );
+
+    const lorawan_line_t *link = &response.result;
+    if( mode == 1 && link->tag == LORAWAN_TAG_CLINKCHECK &&
+        link->field_count == 5 )
+    {
+      if( link->fields[ 0 ] == 0 )
+      {
+        ESP_LOGI( lw->tag, "✓ Link check successful:" );
+        ESP_LOGI( lw->tag, "  Demod Margin: %d", (int)link->fields[ 1 ] );
+        ESP_LOGI( lw->tag, "  Gateways: %d", (int)link->fields[ 2 ] );
+        ESP_LOGI( lw->tag, "  RSSI: %d dBm", (int)link->fields[ 3 ] );
+        ESP_LOGI( lw->tag, "  SNR: %d", (int)link->fields[ 4 ] );
+      }
+      else
+      {
+        ESP_LOGW( lw->tag, "✗ Link check failed with result code %d",
+                  (int)link->fields[ 0 ] );
+      }
+    }
   }
   else
   {
-    ESP_LOGE( _TAG, "✗ Failed to send LoRaWAN join command" );
+    ESP_LOGE( lw->tag, "✗ Failed to configure link check" );
   }
 
-  _unit_lorawan_cleanup_response( &response );
+  _unit_lorawan_cleanup_response( lw, &response );
   return err;
 }
 
-esp_err_t unit_lorawan_configOTTA( char *devEUI, char *appEUI, char *appKey,
-                                   unit_lorwan_uldlmode mode )
+esp_err_t unit_lorawan_get_rssi_h( unit_lorawan_handle_t lw, int16_t *rssi )
 {
-  if( !devEUI || !appEUI || !appKey )
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !rssi )
   {
-    ESP_LOGE( _TAG, "EUI and key parameters cannot be NULL" );
+    ESP_LOGE( lw->tag, "RSSI parameter cannot be NULL" );
     return ESP_ERR_INVALID_ARG;
   }
 
-  ESP_LOGI( _TAG,
-            "Configuring LoRaWAN device for OTAA (Over-The-Air Activation)" );
-  ESP_LOGI( _TAG, "  DevEUI: %s", devEUI );
-  ESP_LOGI( _TAG, "  AppEUI: %s", appEUI );
-  ESP_LOGI( _TAG, "  Mode: %s",
-            ( mode == DIFFERENT_FREQ_MODE ) ? "Different frequency"
-                                            : "Same frequency" );
+  lorawan_link_sample_t sample;
+  if( !_unit_lorawan_link_latest( lw, true, &sample ) )
+  {
+    ESP_LOGW( lw->tag, "No link check answer yet, enable link checks first" );
+    return ESP_ERR_NOT_FOUND;
+  }
 
-  lorawan_response_t response = { 0 };
-  esp_err_t err = ESP_OK;
+  *rssi = sample.rssi;
+  return ESP_OK;
+}
 
-  // Step 1: Set join mode to OTAA
-  err = _unit_lorawan_send_at_command( "CJOINMODE=0", &response,
-                                       UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-  if( err != ESP_OK || !response.success )
+esp_err_t
+unit_lorawan_get_link_quality_h( unit_lorawan_handle_t lw, uint32_t window_ms,
+                                 unit_lorawan_link_quality_t *quality )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !quality )
   {
-    ESP_LOGE( _TAG, "✗ Failed to set OTAA join mode" );
-    goto cleanup;
+    ESP_LOGE( lw->tag, "Link quality parameter cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
   }
-  ESP_LOGI( _TAG, "✓ OTAA join mode configured" );
-  _unit_lorawan_cleanup_response( &response );
 
-  // Step 2: Configure device EUI
-  char deveui_cmd[ 64 ];
-  snprintf( deveui_cmd, sizeof( deveui_cmd ), "CDEVEUI=%s", devEUI );
-  err = _unit_lorawan_send_at_command( deveui_cmd, &response,
-                                       UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-  if( err != ESP_OK || !response.success )
+  _unit_lorawan_link_summarize( lw, window_ms, quality );
+  ESP_LOGD( lw->tag, "Link quality: %d answers, %d missed, RSSI %d dBm mean",
+            quality->samples, quality->missed, quality->rssi_mean );
+  return ESP_OK;
+}
+
+esp_err_t unit_lorawan_get_adr_hint_h( unit_lorawan_handle_t lw,
+                                       uint32_t window_ms,
+                                       unit_lorawan_adr_hint_t *hint )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !hint )
   {
-    ESP_LOGE( _TAG, "✗ Failed to configure Device EUI" );
-    goto cleanup;
+    ESP_LOGE( lw->tag, "ADR hint parameter cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
   }
-  ESP_LOGI( _TAG, "✓ Device EUI configured" );
-  _unit_lorawan_cleanup_response( &response );
 
-  // Step 3: Configure application EUI
-  char appeui_cmd[ 64 ];
-  snprintf( appeui_cmd, sizeof( appeui_cmd ), "CAPPEUI=%s", appEUI );
-  err = _unit_lorawan_send_at_command( appeui_cmd, &response,
-                                       UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-  if( err != ESP_OK || !response.success )
+  unit_lorawan_link_quality_t quality;
+  _unit_lorawan_link_summarize( lw, window_ms, &quality );
+  if( quality.samples < UNIT_LORAWAN_ADR_HINT_MIN_SAMPLES )
   {
-    ESP_LOGE( _TAG, "✗ Failed to configure Application EUI" );
-    goto cleanup;
+    ESP_LOGD( lw->tag, "ADR hint needs %d link check answers, have %d",
+              UNIT_LORAWAN_ADR_HINT_MIN_SAMPLES, quality.samples );
+    return ESP_ERR_NOT_FOUND;
   }
-  ESP_LOGI( _TAG, "✓ Application EUI configured" );
-  _unit_lorawan_cleanup_response( &response );
 
-  // Step 4: Configure application key
-  char appkey_cmd[ 80 ];
-  snprintf( appkey_cmd, sizeof( appkey_cmd ), "CAPPKEY=%s", appKey );
-  err = _unit_lorawan_send_at_command( appkey_cmd, &response,
-                                       UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-  if( err != ESP_OK || !response.success )
+  uint8_t data_rate;
+  size_t max_payload;
+  uint8_t power_index;
+  if( !_unit_lorawan_session_get_data_rate( lw, &data_rate, &max_payload ) &&
+      unit_lorawan_get_data_rate_info_h( lw, &data_rate, &max_payload ) !=
+          ESP_OK )
   {
-    ESP_LOGE( _TAG, "✗ Failed to configure Application Key" );
-    goto cleanup;
+    return ESP_FAIL;
   }
-  ESP_LOGI( _TAG, "✓ Application Key configured" );
-  _unit_lorawan_cleanup_response( &response );
-
-  // Step 5: Configure uplink/downlink mode
-  char uldl_cmd[ 32 ];
-  snprintf( uldl_cmd, sizeof( uldl_cmd ), "CULDLMODE=%s",
-            _unit_lorawan_uldlmode_str[ mode ] );
-  err = _unit_lorawan_send_at_command( uldl_cmd, &response,
-                                       UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-  if( err != ESP_OK || !response.success )
+  if( !_unit_lorawan_session_get_tx_power( lw, &power_index ) &&
+      unit_lorawan_get_tx_power_h( lw, &power_index ) != ESP_OK )
   {
-    ESP_LOGE( _TAG, "✗ Failed to configure uplink/downlink mode" );
-    goto cleanup;
+    return ESP_FAIL;
   }
-  ESP_LOGI( _TAG, "✓ Uplink/downlink mode configured" );
-  _unit_lorawan_cleanup_response( &response );
 
-  // Step 6: Set LoRaWAN class (Class A is most common)
-  err = _unit_lorawan_send_at_command( "CCLASS=0", &response,
-                                       UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-  if( err != ESP_OK || !response.success )
+  int spare_db = (int)quality.margin_min - UNIT_LORAWAN_ADR_HINT_MARGIN_DB;
+  int steps = spare_db / UNIT_LORAWAN_ADR_HINT_STEP_DB;
+  if( spare_db < 0 && spare_db % UNIT_LORAWAN_ADR_HINT_STEP_DB )
+  {
+    steps--; // Round down so any shortfall asks for a step
+  }
+  if( quality.missed && steps > 0 )
   {
-    ESP_LOGE( _TAG, "✗ Failed to set LoRaWAN class" );
-    goto cleanup;
+    steps = 0; // Unanswered checks mean the margin is not the whole story
   }
-  ESP_LOGI( _TAG, "✓ LoRaWAN Class A configured" );
-  _unit_lorawan_cleanup_response( &response );
 
-  // Step 7: Set work mode
-  err = _unit_lorawan_send_at_command( "CWORKMODE=2", &response,
-                                       UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-  if( err != ESP_OK || !response.success )
+  hint->current_data_rate = data_rate;
+  hint->current_tx_power = power_index;
+  hint->steps = 0;
+  for( ; steps > 0 && data_rate < _unit_lorawan_region.adr_data_rate_max;
+       steps-- )
+  {
+    data_rate++;
+    hint->steps++;
+  }
+  for( ; steps > 0 && power_index < UNIT_LORAWAN_TX_POWER_INDEX_MAX; steps-- )
+  {
+    power_index++;
+    hint->steps++;
+  }
+  for( ; steps < 0 && power_index > 0; steps++ )
+  {
+    power_index--;
+    hint->steps--;
+  }
+  for( ; steps < 0 && data_rate > 0 &&
+         data_rate <= _unit_lorawan_region.adr_data_rate_max;
+       steps++ )
   {
-    ESP_LOGE( _TAG, "✗ Failed to set work mode" );
-    goto cleanup;
+    data_rate--;
+    hint->steps--;
   }
-  ESP_LOGI( _TAG, "✓ Work mode configured" );
-  _unit_lorawan_cleanup_response( &response );
+  hint->data_rate = data_rate;
+  hint->tx_power = power_index;
+
+  ESP_LOGI( lw->tag,
+            "ADR hint from %d answers, margin %d dB: DR%d -> DR%d, "
+            "TX power %d -> %d",
+            quality.samples, quality.margin_min, hint->current_data_rate,
+            hint->data_rate, hint->current_tx_power, hint->tx_power );
+  return ESP_OK;
+}
 
-  ESP_LOGI( _TAG, "✓ LoRaWAN device successfully configured for OTAA" );
-  ESP_LOGI( _TAG, "  Note: Network-specific settings (frequency band, RX2, "
-                  "etc.) may need to be configured separately" );
+esp_err_t unit_lorawan_apply_adr_hint_h( unit_lorawan_handle_t lw,
+                                         const unit_lorawan_adr_hint_t *hint )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !hint || hint->data_rate > _unit_lorawan_region.data_rate_max ||
+      hint->tx_power > UNIT_LORAWAN_TX_POWER_INDEX_MAX )
+  {
+    ESP_LOGE( lw->tag, "Invalid ADR hint" );
+    return ESP_ERR_INVALID_ARG;
+  }
+  if( _unit_lorawan_session_adr_enabled( lw ) )
+  {
+    ESP_LOGW( lw->tag, "ADR is enabled, the network sets data rate and power" );
+    return ESP_ERR_INVALID_STATE;
+  }
 
-cleanup:
-  _unit_lorawan_cleanup_response( &response );
+  esp_err_t err = ESP_OK;
+  if( hint->data_rate != hint->current_data_rate )
+  {
+    err = unit_lorawan_set_data_rate_h( lw, hint->data_rate );
+  }
+  if( err == ESP_OK && hint->tx_power != hint->current_tx_power )
+  {
+    err = unit_lorawan_set_tx_power_h( lw, hint->tx_power );
+  }
   return err;
 }
 
-esp_err_t unit_lorawan_reboot( void )
+esp_err_t unit_lorawan_save_config_h( unit_lorawan_handle_t lw )
 {
-  ESP_LOGI( _TAG, "Rebooting LoRaWAN module..." );
+  LORAWAN_CHECK_HANDLE( lw );
+  ESP_LOGI( lw->tag, "Saving LoRaWAN configuration to non-volatile memory" );
 
   lorawan_response_t response = { 0 };
   esp_err_t err = _unit_lorawan_send_at_command(
-      "IREBOOT=0", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+      lw, "CSAVE", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
 
-  if( err == ESP_OK )
+  if( err == ESP_OK && response.success )
   {
-    ESP_LOGI( _TAG, "✓ LoRaWAN module reboot command sent" );
-    ESP_LOGI( _TAG, "  Waiting for module to restart..." );
-    vTaskDelay( pdMS_TO_TICKS( 2000 ) ); // Give module time to reboot
+    ESP_LOGI( lw->tag, "✓ Configuration saved successfully" );
   }
   else
   {
-    ESP_LOGE( _TAG, "✗ Failed to reboot LoRaWAN module" );
+    ESP_LOGE( lw->tag, "✗ Failed to save configuration" );
   }
 
-  _unit_lorawan_cleanup_response( &response );
+  _unit_lorawan_cleanup_response( lw, &response );
   return err;
 }
 
-esp_err_t unit_lorawan_attached( bool *state )
+esp_err_t unit_lorawan_save_session_h( unit_lorawan_handle_t lw )
 {
-  if( !state )
+  LORAWAN_CHECK_HANDLE( lw );
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+  return _unit_lorawan_store_save( lw );
+#else
+  ESP_LOGW( lw->tag, "Session storage disabled (CONFIG_LORAWAN_NVS_SESSION)" );
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t unit_lorawan_set_low_power_h( unit_lorawan_handle_t lw, bool enable )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !lw->driver.task )
   {
-    ESP_LOGE( _TAG, "State parameter cannot be NULL" );
-    return ESP_ERR_INVALID_ARG;
+    ESP_LOGE( lw->tag, "LoRaWAN driver not initialized" );
+    return ESP_ERR_INVALID_STATE;
   }
 
-  ESP_LOGD( _TAG, "Checking if LoRaWAN module is attached and responding" );
-  *state = false;
+  lorawan_power_t *power = &lw->power;
+  portENTER_CRITICAL( &power->lock );
+  bool was_enabled = power->low_power;
+  power->low_power = enable;
+  power->enter = enable;
+  portEXIT_CRITICAL( &power->lock );
+
+  if( enable )
+  {
+    // The driver task sends AT+CLPM=1 so it can never race a queued command
+    _unit_lorawan_driver_wake( lw );
+    ESP_LOGI( lw->tag,
+              "✓ Low power mode enabled (module sleeps after %d ms idle)",
+              UNIT_LORAWAN_LOW_POWER_IDLE_MS );
+    return ESP_OK;
+  }
+  if( !was_enabled )
+  {
+    return ESP_OK;
+  }
 
+  // The exchange sends the wake sequence first if the module is asleep
   lorawan_response_t response = { 0 };
   esp_err_t err = _unit_lorawan_send_at_command(
-      "CGMI?", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-
-  if( err == ESP_OK && response.success && response.response_data )
+      lw, "CLPM=0", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+  if( err == ESP_OK && response.success )
   {
-    // Parse manufacturer from +CGMI=XXX format
-    char *cgmi_pos = strstr( response.response_data, "+CGMI=" );
-    if( cgmi_pos )
-    {
-      char manufacturer[ 16 ] = { 0 };
-      if( sscanf( cgmi_pos, "+CGMI=%15s", manufacturer ) == 1 )
-      {
-        if( strstr( manufacturer, UNIT_LORAWAN_MFG ) != NULL )
-        {
-          *state = true;
-          ESP_LOGI( _TAG, "✓ LoRaWAN module detected and responding" );
-          ESP_LOGD( _TAG, "  Module manufacturer: %s", manufacturer );
-        }
-        else
-        {
-          ESP_LOGW( _TAG, "✗ Unknown module detected - Expected: %s, Got: %s",
-                    UNIT_LORAWAN_MFG, manufacturer );
-        }
-      }
-      else
-      {
-        ESP_LOGW( _TAG, "✗ Could not parse manufacturer from response" );
-      }
-    }
-    else
-    {
-      ESP_LOGW( _TAG, "✗ Could not find +CGMI= in response: %s",
-                response.response_data );
-    }
+    ESP_LOGI( lw->tag, "✓ Low power mode disabled" );
   }
   else
   {
-    ESP_LOGE( _TAG, "✗ No LoRaWAN module detected or not responding" );
-    ESP_LOGE( _TAG, "  Check physical connections and power" );
+    ESP_LOGE( lw->tag, "✗ Failed to take module out of low power mode" );
+    err = ESP_FAIL;
   }
-
-  _unit_lorawan_cleanup_response( &response );
+  _unit_lorawan_cleanup_response( lw, &response );
   return err;
 }
 
-esp_err_t unit_lorawan_send( char *message, size_t length )
+esp_err_t unit_lorawan_get_low_power_h( unit_lorawan_handle_t lw,
+                                        bool *enabled )
 {
-  if( !message || length == 0 )
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !enabled )
   {
-    ESP_LOGE( _TAG, "Message cannot be NULL or empty" );
+    ESP_LOGE( lw->tag, "Enabled parameter cannot be NULL" );
     return ESP_ERR_INVALID_ARG;
   }
+  portENTER_CRITICAL( &lw->power.lock );
+  *enabled = lw->power.low_power;
+  portEXIT_CRITICAL( &lw->power.lock );
+  return ESP_OK;
+}
 
-  // Get current data rate for proper payload validation
-  uint8_t current_dr;
-  size_t max_payload;
-  esp_err_t dr_err =
-      unit_lorawan_get_data_rate_info( &current_dr, &max_payload );
-  if( dr_err != ESP_OK )
+esp_err_t unit_lorawan_get_stats_h( unit_lorawan_handle_t lw,
+                                    unit_lorawan_stats_t *stats )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+#ifdef CONFIG_LORAWAN_STATS
+  if( !stats )
   {
-    ESP_LOGW(
-        _TAG,
-        "Failed to get current data rate, using conservative validation" );
-    current_dr = 0;
-    max_payload = UNIT_LORAWAN_US915_MAX_PAYLOAD_DR0;
+    ESP_LOGE( lw->tag, "Stats parameter cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
   }
+  portENTER_CRITICAL( &lw->stats.lock );
+  *stats = lw->stats.stats;
+  int64_t since_us = lw->stats.since_us;
+  portEXIT_CRITICAL( &lw->stats.lock );
+  stats->elapsed_ms = ( esp_timer_get_time() - since_us ) / 1000;
+  return ESP_OK;
+#else
+  ESP_LOGW( lw->tag, "Instrumentation disabled (CONFIG_LORAWAN_STATS)" );
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
 
-  // Validate payload size against current data rate
-  esp_err_t size_check =
-      _unit_lorawan_validate_payload_size( length, current_dr );
-  if( size_check != ESP_OK )
+esp_err_t unit_lorawan_reset_stats_h( unit_lorawan_handle_t lw )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+#ifdef CONFIG_LORAWAN_STATS
+  _unit_lorawan_stats_reset( lw );
+  return ESP_OK;
+#else
+  ESP_LOGW( lw->tag, "Instrumentation disabled (CONFIG_LORAWAN_STATS)" );
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t
+unit_lorawan_set_transport_h( unit_lorawan_handle_t lw,
+                              const unit_lorawan_transport_t *transport )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  if( lw->driver.task || lw->rx.task )
   {
-    return size_check;
+    ESP_LOGE( lw->tag, "Transport must be set before unit_lorawan_init()" );
+    return ESP_ERR_INVALID_STATE;
+  }
+  if( !transport && lw->index == 0 )
+  {
+    lw->transport = _unit_lorawan_default_transport;
+    return ESP_OK;
+  }
+  if( !transport || !transport->begin || !transport->write ||
+      !transport->read || !transport->flush )
+  {
+    ESP_LOGE( lw->tag, "Transport operations cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
   }
+  lw->transport = *transport;
+  ESP_LOGI( lw->tag, "✓ Custom module transport installed" );
+  return ESP_OK;
+}
 
-  ESP_LOGI( _TAG, "Sending LoRaWAN message (%zu bytes) on DR%d", length,
-            current_dr );
-  ESP_LOGD( _TAG, "  Message content: %.*s", (int)length, message );
+esp_err_t
+unit_lorawan_uart_transport( const unit_lorawan_uart_config_t *config,
+                             unit_lorawan_transport_t *transport )
+{
+#ifdef CONFIG_LORAWAN_UART_TRANSPORT
+  if( !config || !transport ||
+      config->rx_buffer_size <= UNIT_LORAWAN_UART_MIN_RX_BUFFER_SIZE )
+  {
+    ESP_LOGE( _TAG, "UART RX buffer must exceed the %d byte FIFO",
+              UNIT_LORAWAN_UART_MIN_RX_BUFFER_SIZE );
+    return ESP_ERR_INVALID_ARG;
+  }
 
-  // Convert message to hexadecimal
-  char *hex_message = malloc( length * 2 + 1 );
-  if( !hex_message )
+  lorawan_uart_t *uart = calloc( 1, sizeof( *uart ) );
+  if( !uart )
   {
-    ESP_LOGE( _TAG, "Failed to allocate memory for hex conversion" );
+    ESP_LOGE( _TAG, "Failed to allocate UART transport" );
     return ESP_ERR_NO_MEM;
   }
+  uart->config = *config;
+  *transport = ( unit_lorawan_transport_t )LORAWAN_UART_TRANSPORT( uart );
+  return ESP_OK;
+#else
+  ESP_LOGW( _TAG, "UART transport disabled (CONFIG_LORAWAN_UART_TRANSPORT)" );
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
 
-  for( size_t i = 0; i < length; i++ )
+esp_err_t unit_lorawan_create( const unit_lorawan_transport_t *transport,
+                               unit_lorawan_handle_t *handle )
+{
+  if( !handle || !transport || !transport->begin || !transport->write ||
+      !transport->read || !transport->flush )
   {
-    snprintf( hex_message + i * 2, 3, "%02X", (uint8_t)message[ i ] );
+    ESP_LOGE( _TAG, "A handle pointer and a complete transport are required" );
+    return ESP_ERR_INVALID_ARG;
   }
-  hex_message[ length * 2 ] = '\0';
-
-  ESP_LOGD( _TAG, "  Hex encoded: %s", hex_message );
 
-  // Check hex message size limit
-  size_t hex_len = strlen( hex_message );
-  if( hex_len > UNIT_LORAWAN_HEX_MESSAGE_MAX_SIZE )
+  portENTER_CRITICAL( &_unit_lorawan_instances_lock );
+  uint8_t index = _unit_lorawan_instances;
+  if( index < UINT8_MAX )
   {
-    ESP_LOGE( _TAG, "Hex message too long: %zu bytes (max: %d)", hex_len,
-              UNIT_LORAWAN_HEX_MESSAGE_MAX_SIZE );
-    free( hex_message );
-    return ESP_ERR_INVALID_SIZE;
+    _unit_lorawan_instances++;
+  }
+  portEXIT_CRITICAL( &_unit_lorawan_instances_lock );
+  if( index == UINT8_MAX )
+  {
+    ESP_LOGE( _TAG, "Too many LoRaWAN instances" );
+    return ESP_ERR_NO_MEM;
   }
 
-  char *send_cmd = malloc( strlen( "DTRX=1,2," ) + 10 + hex_len +
-                           1 ); // Extra space for length
-  if( !send_cmd )
+  lorawan_instance_t *lw = malloc( sizeof( *lw ) );
+  if( !lw )
   {
-    ESP_LOGE( _TAG, "Failed to allocate memory for send command" );
-    free( hex_message );
+    ESP_LOGE( _TAG, "Failed to allocate LoRaWAN instance" );
     return ESP_ERR_NO_MEM;
   }
+  *lw = _unit_lorawan_instance_template;
+  lw->index = index;
+  snprintf( lw->name, sizeof( lw->name ), "%s%u", _TAG, (unsigned)index );
+  lw->tag = lw->name;
+  lw->transport = *transport;
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+  snprintf( lw->store.key, sizeof( lw->store.key ), "%s%u",
+            UNIT_LORAWAN_NVS_SESSION_KEY, (unsigned)index );
+#endif
+
+  ESP_LOGI( lw->tag, "✓ LoRaWAN instance created" );
+  *handle = lw;
+  return ESP_OK;
+}
+
+unit_lorawan_handle_t unit_lorawan_default_handle( void )
+{
+  return &_unit_lorawan_default;
+}
 
-  // Use confirmed message (1), 2 retries, with hex payload
-  snprintf( send_cmd, strlen( "DTRX=1,2," ) + 10 + hex_len + 1,
-            "DTRX=1,2,%zu,%s", length, hex_message );
+esp_err_t unit_lorawan_restore_defaults_h( unit_lorawan_handle_t lw )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+  ESP_LOGI( lw->tag, "Restoring LoRaWAN factory default configuration" );
 
   lorawan_response_t response = { 0 };
   esp_err_t err = _unit_lorawan_send_at_command(
-      send_cmd, &response, 30000 ); // Longer timeout for send
+      lw, "CRESTORE", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
 
   if( err == ESP_OK && response.success )
   {
-    ESP_LOGI( _TAG, "✓ LoRaWAN message sent successfully" );
-    ESP_LOGI( _TAG,
-              "  Message will be transmitted when network conditions allow" );
-
-    if( response.response_data )
-    {
-      if( strstr( response.response_data, "OK+SEND:" ) )
-      {
-        ESP_LOGI( _TAG, "  Message queued for transmission" );
-      }
-      if( strstr( response.response_data, "OK+SENT:" ) )
-      {
-        ESP_LOGI( _TAG, "  Message transmitted to network" );
-      }
-      if( strstr( response.response_data, "OK+RECV:" ) )
-      {
-        ESP_LOGI( _TAG, "  Network acknowledgment received" );
-      }
-      if( strstr( response.response_data, "ERR+SEND:" ) )
-      {
-        ESP_LOGW( _TAG, "  Message send error detected" );
-      }
-    }
+    _unit_lorawan_session_invalidate( lw );
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+    _unit_lorawan_store_set_provisioned( lw, false, 0 );
+#endif
+    ESP_LOGI( lw->tag, "✓ Factory defaults restored successfully" );
+    ESP_LOGI( lw->tag, "  Note: You may need to reboot the module for "
+                       "changes to take effect" );
   }
   else
   {
-    ESP_LOGE( _TAG, "✗ Failed to send LoRaWAN message" );
-    if( response.response_data )
-    {
-      ESP_LOGE( _TAG, "  Error details: %s", response.response_data );
-    }
+    ESP_LOGE( lw->tag, "✗ Failed to restore factory defaults" );
   }
 
-  free( hex_message );
-  free( send_cmd );
-  _unit_lorawan_cleanup_response( &response );
+  _unit_lorawan_cleanup_response( lw, &response );
   return err;
 }
 
-static esp_err_t
-_configure_ttn_network_parameters( const unit_lorawan_ttn_config_t *config )
+esp_err_t unit_lorawan_send_raw_command_h( unit_lorawan_handle_t lw,
+                                           const char *command, char *response,
+                                           size_t response_size,
+                                           uint32_t timeout_ms )
 {
-  ESP_LOGI( _TAG, "Configuring TTN-specific network parameters" );
-
-  lorawan_response_t response = { 0 };
-  esp_err_t err = ESP_OK;
-
-  // Note: ASR6501 doesn't support manual RX2 configuration via AT commands
-  // RX2 parameters are automatically handled by the LoRaWAN stack per regional
-  // parameters
-  ESP_LOGI(
-      _TAG,
-      "RX2 parameters automatically configured per US915 regional parameters" );
-
-  // Enable/disable Adaptive Data Rate
-  char adr_cmd[ 16 ];
-  snprintf( adr_cmd, sizeof( adr_cmd ), "CADR=%d",
-            config->adr_enabled ? 1 : 0 );
-
-  err = _unit_lorawan_send_at_command( adr_cmd, &response,
-                                       UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-  if( err != ESP_OK || !response.success )
+  LORAWAN_CHECK_HANDLE( lw );
+  if( !command )
   {
-    ESP_LOGE( _TAG, "Failed to configure ADR setting" );
-    goto cleanup;
+    ESP_LOGE( lw->tag, "Command cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
   }
-  ESP_LOGI( _TAG, "✓ Adaptive Data Rate %s",
-            config->adr_enabled ? "enabled" : "disabled" );
-  _unit_lorawan_cleanup_response( &response );
 
-  char dr_cmd[ 32 ];
-  snprintf( dr_cmd, sizeof( dr_cmd ), "CDATARATE=%d", config->data_rate );
+  ESP_LOGI( lw->tag, "Sending raw AT command: %s", command );
 
-  err = _unit_lorawan_send_at_command( dr_cmd, &response,
-                                       UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-  if( err != ESP_OK || !response.success )
+  lorawan_response_t lorawan_resp = { 0 };
+  esp_err_t err =
+      _unit_lorawan_send_at_command( lw, command, &lorawan_resp, timeout_ms );
+
+  if( err == ESP_OK && response && response_size > 0 )
   {
-    ESP_LOGW(
-        _TAG,
-        "Initial data rate setting failed - will rely on ADR if enabled" );
-    ESP_LOGI( _TAG, "✓ Network will use default data rate (ADR: %s)",
-              config->adr_enabled ? "enabled" : "disabled" );
-    _unit_lorawan_cleanup_response( &response );
-    err = ESP_OK; // Don't fail configuration for this
-    goto cleanup;
+    // Copy response data if buffer provided
+    if( lorawan_resp.response_data )
+    {
+      strncpy( response, lorawan_resp.response_data, response_size - 1 );
+      response[ response_size - 1 ] = '\0';
+    }
+    else
+    {
+      response[ 0 ] = '\0';
+    }
   }
-  ESP_LOGI( _TAG,
-            "✓ Initial data rate configured (DR%d, max payload: %zu bytes)",
-            config->data_rate, us915_max_payload_sizes[ config->data_rate ] );
-  _unit_lorawan_cleanup_response( &response );
 
-cleanup:
-  _unit_lorawan_cleanup_response( &response );
+  _unit_lorawan_cleanup_response( lw, &lorawan_resp );
   return err;
 }
 
-esp_err_t unit_lorawan_set_rx2_frequency( uint32_t frequency )
+esp_err_t
+unit_lorawan_set_downlink_callback_h( unit_lorawan_handle_t lw,
+                                      unit_lorawan_downlink_callback_t callback,
+                                      void *user_data )
 {
-  ESP_LOGW( _TAG, "RX2 frequency configuration not supported by ASR6501" );
-  ESP_LOGW( _TAG, "Device uses automatic RX2 settings per LoRaWAN US915 "
-                  "regional parameters" );
-  ESP_LOGW(
-      _TAG,
-      "TTN US915 RX2: 923.3 MHz, DR8 (configured automatically by stack)" );
-  return ESP_ERR_NOT_SUPPORTED;
+  LORAWAN_CHECK_HANDLE( lw );
+  lorawan_urc_t *urc = &lw->urc;
+  portENTER_CRITICAL( &urc->lock );
+  urc->downlink_callback = callback;
+  urc->downlink_user_data = user_data;
+  portEXIT_CRITICAL( &urc->lock );
+  return ESP_OK;
 }
 
-esp_err_t unit_lorawan_set_rx2_data_rate( uint8_t data_rate )
+esp_err_t unit_lorawan_set_event_callback_h(
+    unit_lorawan_handle_t lw, unit_lorawan_event_callback_t callback,
+    void *user_data )
 {
-  ESP_LOGW( _TAG, "RX2 data rate configuration not supported by ASR6501" );
-  ESP_LOGW( _TAG, "Device uses automatic RX2 settings per LoRaWAN US915 "
-                  "regional parameters" );
-  ESP_LOGW(
-      _TAG,
-      "TTN US915 RX2: 923.3 MHz, DR8 (configured automatically by stack)" );
-  return ESP_ERR_NOT_SUPPORTED;
+  LORAWAN_CHECK_HANDLE( lw );
+  lorawan_urc_t *urc = &lw->urc;
+  portENTER_CRITICAL( &urc->lock );
+  urc->event_callback = callback;
+  urc->event_user_data = user_data;
+  portEXIT_CRITICAL( &urc->lock );
+  return ESP_OK;
 }
 
-esp_err_t unit_lorawan_get_channel_rssi( uint8_t freq_band_idx,
-                                         int16_t *rssi_values,
-                                         size_t *channel_count )
+esp_err_t unit_lorawan_init_h( unit_lorawan_handle_t lw )
 {
-  if( !rssi_values || !channel_count )
+  LORAWAN_CHECK_HANDLE( lw );
+  ESP_LOGI( lw->tag, "Initializing LoRaWAN module driver" );
+  _unit_lorawan_session_invalidate( lw );
+  _unit_lorawan_airtime_reset( lw );
+  _unit_lorawan_buffers_init( lw );
+#ifdef CONFIG_LORAWAN_STATS
+  _unit_lorawan_stats_reset( lw );
+#endif
+
+  esp_err_t err = _unit_lorawan_power_start( lw );
+  if( err != ESP_OK )
   {
-    ESP_LOGE( _TAG, "RSSI values and channel count parameters cannot be NULL" );
-    return ESP_ERR_INVALID_ARG;
+    ESP_LOGE( lw->tag, "✗ Failed to set up LoRaWAN power management" );
+    return err;
   }
 
-  ESP_LOGI( _TAG, "Scanning RSSI for frequency band %d", freq_band_idx );
-
-  char cmd[ 32 ];
-  snprintf( cmd, sizeof( cmd ), "CRSSI %d?", freq_band_idx );
-
-  lorawan_response_t response = { 0 };
-  esp_err_t err = _unit_lorawan_send_at_command(
-      cmd, &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-
-  if( err == ESP_OK && response.success && response.response_data )
+  // Initialize UART for LoRaWAN communication
+  err = lw->transport.begin( UNIT_LORAWAN_DATA_RATE, lw->transport.ctx );
+  if( err != ESP_OK )
   {
-    // Response format: +CRSSI:\n0:<rssi>\n1:<rssi>\n...\n7:<rssi>\nOK
-    char *line_start = strstr( response.response_data, "+CRSSI:" );
-    if( line_start )
-    {
-      line_start = strchr( line_start, '\n' ); // Skip to first data line
-      if( line_start )
-        line_start++; // Move past newline
+    ESP_LOGE( lw->tag,
+              "✗ Failed to initialize UART for LoRaWAN communication" );
+    return err;
+  }
+  lw->baud = UNIT_LORAWAN_DATA_RATE;
+  ESP_LOGI( lw->tag, "✓ UART initialized at %d baud", UNIT_LORAWAN_DATA_RATE );
 
-      size_t count = 0;
-      char *line = line_start;
+  // Clear any pending data in UART buffer
+  bool flushed = false;
+  lw->transport.flush( &flushed, lw->transport.ctx );
+  if( flushed )
+  {
+    ESP_LOGD( lw->tag, "✓ UART buffer cleared" );
+  }
 
-      // Parse all 8 channels (0-7)
-      while( line && count < 8 )
-      {
-        int channel, rssi_val;
-        if( sscanf( line, "%d:%d", &channel, &rssi_val ) == 2 )
-        {
-          if( channel >= 0 && channel <= 7 && channel == (int)count )
-          {
-            rssi_values[ count ] = (int16_t)rssi_val;
-            count++;
-            ESP_LOGD( _TAG, "Channel %d: %d dBm", channel, rssi_val );
-          }
-          else
-          {
-            ESP_LOGW( _TAG, "Unexpected channel number %d at position %zu",
-                      channel, count );
-          }
-        }
-        else
-        {
-          ESP_LOGW( _TAG, "Failed to parse RSSI line: %s", line );
-        }
+  // Start the receive task that frames module output into lines
+  err = _unit_lorawan_rx_start( lw );
+  if( err != ESP_OK )
+  {
+    ESP_LOGE( lw->tag, "✗ Failed to start LoRaWAN receive task" );
+    return err;
+  }
 
-        line = strchr( line, '\n' );
-        if( line )
-          line++; // Move to next line
-      }
+  // Start the driver task that serializes every AT exchange on the UART
+  err = _unit_lorawan_driver_start( lw );
+  if( err != ESP_OK )
+  {
+    ESP_LOGE( lw->tag, "✗ Failed to start LoRaWAN driver task" );
+    return err;
+  }
 
-      if( count == 8 )
-      {
-        *channel_count = count;
-        ESP_LOGI( _TAG,
-                  "✓ Successfully scanned RSSI for all %zu channels in "
-                  "frequency band %d",
-                  count, freq_band_idx );
-      }
-      else
-      {
-        ESP_LOGW( _TAG, "Expected 8 channels but only parsed %zu", count );
-        *channel_count = count;
-      }
-    }
-    else
-    {
-      ESP_LOGE( _TAG, "Invalid RSSI response format - missing +CRSSI:" );
-      err = ESP_FAIL;
-    }
+  // Start the worker that drains unit_lorawan_send_async()
+  err = _unit_lorawan_tx_start( lw );
+  if( err != ESP_OK )
+  {
+    ESP_LOGE( lw->tag, "✗ Failed to start LoRaWAN transmit task" );
+    return err;
   }
-  else
+
+#ifdef CONFIG_LORAWAN_SPOOL
+  // Uplinks spooled before a reset are drained once the session is joined
+  if( lw->index == 0 && _unit_lorawan_spool_mount( lw ) != ESP_OK )
   {
-    ESP_LOGE( _TAG,
-              "✗ Failed to scan channel RSSI values for frequency band %d",
-              freq_band_idx );
+    ESP_LOGW( lw->tag, "⚠ Continuing without the uplink spool" );
   }
+#endif
 
-  _unit_lorawan_cleanup_response( &response );
-  return err;
-}
+  // A module left at CONFIG_LORAWAN_BAUD_RATE by an earlier run still answers
+  _unit_lorawan_baud_find( lw );
 
-esp_err_t unit_lorawan_set_data_rate( uint8_t data_rate )
-{
-  if( data_rate > UNIT_LORAWAN_US915_DATA_RATE_MAX )
+  // Check if LoRaWAN module is connected
+  bool attached = false;
+  err = unit_lorawan_attached_h( lw, &attached );
+  if( err != ESP_OK || !attached )
   {
-    ESP_LOGE( _TAG, "Invalid data rate %d for US915 (valid range: %d-%d)",
-              data_rate, UNIT_LORAWAN_US915_DATA_RATE_MIN,
-              UNIT_LORAWAN_US915_DATA_RATE_MAX );
-    return ESP_ERR_INVALID_ARG;
+    ESP_LOGE( lw->tag, "✗ LoRaWAN module not detected" );
+    ESP_LOGE( lw->tag, "  Please check:" );
+    ESP_LOGE( lw->tag, "  - Module is properly connected to expansion port C" );
+    ESP_LOGE( lw->tag, "  - Module has power (check LED indicators)" );
+    ESP_LOGE( lw->tag, "  - UART connections are secure" );
+    return ESP_FAIL;
   }
 
-  ESP_LOGI( _TAG, "Setting data rate to DR%d (max payload: %zu bytes)",
-            data_rate, us915_max_payload_sizes[ data_rate ] );
-
-  char dr_cmd[ 32 ];
-  snprintf( dr_cmd, sizeof( dr_cmd ), "CDATARATE=%d", data_rate );
+  // Set log level to minimal for cleaner operation
+  err = _unit_lorawan_module_log_level( lw, 1 ); // Error level only
+  if( err != ESP_OK )
+  {
+    ESP_LOGW( lw->tag, "⚠ Failed to set log level, continuing anyway" );
+  }
 
+#ifdef CONFIG_LORAWAN_FAST_BOOT
+  // The module keeps its saved configuration across host resets, so there is
+  // nothing new to save and no reason to reboot it
+  ESP_LOGI( lw->tag, "✓ Fast boot: keeping module configuration and state" );
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+  _unit_lorawan_store_restore( lw );
+#endif
+#else
+  // Save configuration and reboot module
   lorawan_response_t response = { 0 };
-  esp_err_t err = _unit_lorawan_send_at_command(
-      dr_cmd, &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-
+  err = _unit_lorawan_send_at_command( lw, "CSAVE", &response,
+                                       UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
   if( err == ESP_OK && response.success )
   {
-    ESP_LOGI( _TAG, "✓ Data rate set to DR%d successfully", data_rate );
+    ESP_LOGI( lw->tag, "✓ Configuration saved to module" );
   }
   else
   {
-    ESP_LOGE( _TAG, "✗ Failed to set data rate to DR%d", data_rate );
-    ESP_LOGW( _TAG,
-              "Note: If ADR is enabled, network may override this setting" );
+    ESP_LOGW( lw->tag, "⚠ Failed to save configuration" );
   }
+  _unit_lorawan_cleanup_response( lw, &response );
 
-  _unit_lorawan_cleanup_response( &response );
-  return err;
+  // Reboot module to ensure clean state
+  unit_lorawan_reboot_h( lw );
+#endif
+
+  // Faster UART for long hex uplinks and CRSSI dumps
+  _unit_lorawan_baud_sync( lw );
+
+  ESP_LOGI( lw->tag, "✓ LoRaWAN module driver initialized successfully" );
+  ESP_LOGI( lw->tag, "  Ready for OTAA configuration and network joining" );
+
+  return ESP_OK;
 }
 
-esp_err_t unit_lorawan_set_retries( uint8_t message_type, uint8_t retries )
+// TTN configuration functions
+
+// CFREQBANDMASK value enabling one sub-band, or the first channel group in
+// regions without selectable sub-bands
+static void _unit_lorawan_sub_band_mask( uint8_t sub_band, char mask[ 5 ] )
 {
-  if( message_type > 1 )
+  if( !_unit_lorawan_region.sub_band_count || sub_band < 1 ||
+      sub_band > _unit_lorawan_region.sub_band_count )
   {
-    ESP_LOGE( _TAG, "Invalid message type %d (0=unconfirmed, 1=confirmed)",
-              message_type );
+    sub_band = 1;
+  }
+  snprintf( mask, 5, "%04X", 1U << ( sub_band - 1 ) );
+}
+
+static esp_err_t _validate_ttn_config( const unit_lorawan_ttn_config_t *config )
+{
+  if( !config )
+  {
+    ESP_LOGE( _TAG, "TTN configuration cannot be NULL" );
     return ESP_ERR_INVALID_ARG;
   }
 
-  if( retries < 1 || retries > 15 )
+  // Validate DevEUI (16 hex characters)
+  if( strlen( config->dev_eui ) != UNIT_LORAWAN_EUI_LENGTH )
   {
-    ESP_LOGE( _TAG, "Invalid retry count %d (valid range: 1-15)", retries );
+    ESP_LOGE( _TAG, "Invalid DevEUI length: %zu (expected %d)",
+              strlen( config->dev_eui ), UNIT_LORAWAN_EUI_LENGTH );
     return ESP_ERR_INVALID_ARG;
   }
 
-  ESP_LOGI( _TAG, "Setting %s message retries to %d",
-            message_type ? "confirmed" : "unconfirmed", retries );
+  // Validate AppEUI (16 hex characters)
+  if( strlen( config->app_eui ) != UNIT_LORAWAN_EUI_LENGTH )
+  {
+    ESP_LOGE( _TAG, "Invalid AppEUI length: %zu (expected %d)",
+              strlen( config->app_eui ), UNIT_LORAWAN_EUI_LENGTH );
+    return ESP_ERR_INVALID_ARG;
+  }
 
-  char cmd[ 32 ];
-  snprintf( cmd, sizeof( cmd ), "CNBTRIALS=%d,%d", message_type, retries );
+  // Validate AppKey (32 hex characters)
+  if( strlen( config->app_key ) != UNIT_LORAWAN_APP_KEY_LENGTH )
+  {
+    ESP_LOGE( _TAG, "Invalid AppKey length: %zu (expected %d)",
+              strlen( config->app_key ), UNIT_LORAWAN_APP_KEY_LENGTH );
+    return ESP_ERR_INVALID_ARG;
+  }
 
-  lorawan_response_t response = { 0 };
-  esp_err_t err = _unit_lorawan_send_at_command(
-      cmd, &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+  // Validate sub-band range where the region has them (1-8 for US915)
+  if( _unit_lorawan_region.sub_band_count &&
+      ( config->sub_band < 1 ||
+        config->sub_band > _unit_lorawan_region.sub_band_count ) )
+  {
+    ESP_LOGE( _TAG, "Invalid %s sub-band: %d (valid range: 1-%d)",
+              _unit_lorawan_region.name, config->sub_band,
+              _unit_lorawan_region.sub_band_count );
+    return ESP_ERR_INVALID_ARG;
+  }
 
-  if( err == ESP_OK && response.success )
+  // Validate data rate for the region (0-4 for US915)
+  if( config->data_rate > _unit_lorawan_region.data_rate_max )
   {
-    ESP_LOGI( _TAG, "✓ Retry count set successfully" );
+    ESP_LOGE( _TAG, "Invalid %s data rate: %d (valid range: 0-%d)",
+              _unit_lorawan_region.name, config->data_rate,
+              _unit_lorawan_region.data_rate_max );
+    return ESP_ERR_INVALID_ARG;
   }
-  else
+
+  // Validate RX2 data rate (8 for TTN US915, 3 for TTN EU868)
+  if( config->rx2_data_rate > 15 )
   {
-    ESP_LOGE( _TAG, "✗ Failed to set retry count" );
+    ESP_LOGE( _TAG, "Invalid RX2 data rate: %d (valid range: 0-15)",
+              config->rx2_data_rate );
+    return ESP_ERR_INVALID_ARG;
   }
 
-  _unit_lorawan_cleanup_response( &response );
-  return err;
+  return ESP_OK;
 }
 
-esp_err_t unit_lorawan_set_tx_power( uint8_t power_index )
+#ifdef CONFIG_LORAWAN_REGION_EU868
+// The EU868 default channels live in the first group
+static const lorawan_script_step_t _unit_lorawan_plan_script[] = {
+    LORAWAN_SCRIPT_STEP( "CFREQBANDMASK=%s", LORAWAN_SCRIPT_ARG_CHANNEL_MASK,
+                         "EU868 channel mask" ),
+};
+#else
+static const lorawan_script_step_t _unit_lorawan_plan_script[] = {
+    LORAWAN_SCRIPT_STEP( "CFREQBANDMASK=0001", LORAWAN_SCRIPT_ARG_NONE,
+                         "US915 frequency band" ),
+    LORAWAN_SCRIPT_STEP( "CFREQBANDMASK=%s", LORAWAN_SCRIPT_ARG_CHANNEL_MASK,
+                         "US915 sub-band channel mask" ),
+};
+#endif
+
+static esp_err_t _configure_frequency_plan( lorawan_instance_t *lw,
+                                            uint8_t sub_band )
 {
-  if( power_index > 7 )
+  ESP_LOGI( lw->tag, "Configuring %s frequency plan (sub-band %d)",
+            _unit_lorawan_region.name, sub_band );
+
+  char mask[ 5 ];
+  _unit_lorawan_sub_band_mask( sub_band, mask );
+  const char *args[ LORAWAN_SCRIPT_ARG_COUNT ] = {
+      [LORAWAN_SCRIPT_ARG_CHANNEL_MASK] = mask,
+  };
+  esp_err_t err = _unit_lorawan_run_script(
+      lw, "frequency plan", _unit_lorawan_plan_script,
+      sizeof( _unit_lorawan_plan_script ) /
+          sizeof( _unit_lorawan_plan_script[ 0 ] ),
+      args, NULL );
+  if( err != ESP_OK )
   {
-    ESP_LOGE( _TAG, "Invalid TX power index %d (valid range: 0-7)",
-              power_index );
-    return ESP_ERR_INVALID_ARG;
+    return err;
   }
 
-  ESP_LOGI( _TAG, "Setting TX power to index %d", power_index );
-
-  char cmd[ 16 ];
-  snprintf( cmd, sizeof( cmd ), "CTXP=%d", power_index );
+  if( _unit_lorawan_region.sub_band_count )
+  {
+    ESP_LOGI( lw->tag, "✓ %s sub-band %d configured (channels %d-%d)",
+              _unit_lorawan_region.name, sub_band,
+              ( sub_band - 1 ) * UNIT_LORAWAN_SUB_BAND_CHANNELS,
+              sub_band * UNIT_LORAWAN_SUB_BAND_CHANNELS - 1 );
+  }
+  else
+  {
+    ESP_LOGI( lw->tag, "✓ %s channels configured (%d max)",
+              _unit_lorawan_region.name, _unit_lorawan_region.channel_count );
+  }
+  return ESP_OK;
+}
 
+// Reads one setting back and compares it with the value we would write
+static bool _unit_lorawan_setting_matches( lorawan_instance_t *lw,
+                                           const char *query, lorawan_tag_t tag,
+                                           const char *expected )
+{
   lorawan_response_t response = { 0 };
+  bool matches = false;
   esp_err_t err = _unit_lorawan_send_at_command(
-      cmd, &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-
-  if( err == ESP_OK && response.success )
+      lw, query, &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+  if( err == ESP_OK && response.success && response.result.tag == tag &&
+      response.result.value )
   {
-    ESP_LOGI( _TAG, "✓ TX power set successfully" );
+    // A shorter value differs within its length, so the character after
+    // the match is only read once the prefix is known to be there
+    const char *value = response.result.value;
+    size_t length = strlen( expected );
+    if( strncasecmp( value, expected, length ) == 0 )
+    {
+      char next = value[ length ];
+      matches = next == '\0' || next == '\r' || next == '\n' ||
+                next == ' ' || next == ',';
+    }
   }
-  else
+  if( !matches )
   {
-    ESP_LOGE( _TAG, "✗ Failed to set TX power" );
+    ESP_LOGD( lw->tag, "Setting %s differs from %s", query, expected );
   }
+  _unit_lorawan_cleanup_response( lw, &response );
+  return matches;
+}
 
-  _unit_lorawan_cleanup_response( &response );
-  return err;
+// A credential the module stores, how to read it back and how to write it
+typedef struct
+{
+  const char *query;
+  lorawan_tag_t tag;
+  size_t length; // Hex characters in the value, 0 for a fixed setting
+  lorawan_script_step_t write;
+} lorawan_credential_t;
+
+#define LORAWAN_CREDENTIAL_COUNT 7
+
+// The operating mode the driver relies on, whichever activation is used
+#define LORAWAN_CREDENTIAL_MODE_SETTINGS                                       \
+  { "CULDLMODE?", LORAWAN_TAG_CULDLMODE, 0,                                    \
+    LORAWAN_SCRIPT_STEP( "CULDLMODE=%s", LORAWAN_SCRIPT_ARG_ULDL_MODE,         \
+                         "Uplink/downlink mode" ) },                           \
+  { "CCLASS?", LORAWAN_TAG_CCLASS, 0,                                          \
+    LORAWAN_SCRIPT_STEP( "CCLASS=0", LORAWAN_SCRIPT_ARG_NONE,                  \
+                         "LoRaWAN Class A" ) },                                \
+  { "CWORKMODE?", LORAWAN_TAG_CWORKMODE, 0,                                    \
+    LORAWAN_SCRIPT_STEP( "CWORKMODE=2", LORAWAN_SCRIPT_ARG_NONE, "Work mode" ) }
+
+// The join mode comes first, the module files the keys under it
+static const lorawan_credential_t
+    _unit_lorawan_otaa_credentials[ LORAWAN_CREDENTIAL_COUNT ] = {
+        { "CJOINMODE?", LORAWAN_TAG_CJOINMODE, 0,
+          LORAWAN_SCRIPT_STEP( "CJOINMODE=0", LORAWAN_SCRIPT_ARG_NONE,
+                               "OTAA join mode" ) },
+        { "CDEVEUI?", LORAWAN_TAG_CDEVEUI, UNIT_LORAWAN_EUI_LENGTH,
+          LORAWAN_SCRIPT_STEP( "CDEVEUI=%s", LORAWAN_SCRIPT_ARG_DEV_EUI,
+                               "Device EUI" ) },
+        { "CAPPEUI?", LORAWAN_TAG_CAPPEUI, UNIT_LORAWAN_EUI_LENGTH,
+          LORAWAN_SCRIPT_STEP( "CAPPEUI=%s", LORAWAN_SCRIPT_ARG_APP_EUI,
+                               "Application EUI" ) },
+        { "CAPPKEY?", LORAWAN_TAG_CAPPKEY, UNIT_LORAWAN_APP_KEY_LENGTH,
+          LORAWAN_SCRIPT_STEP( "CAPPKEY=%s", LORAWAN_SCRIPT_ARG_APP_KEY,
+                               "Application Key" ) },
+        LORAWAN_CREDENTIAL_MODE_SETTINGS,
+};
+
+static const lorawan_credential_t
+    _unit_lorawan_abp_credentials[ LORAWAN_CREDENTIAL_COUNT ] = {
+        { "CJOINMODE?", LORAWAN_TAG_CJOINMODE, 0,
+          LORAWAN_SCRIPT_STEP( "CJOINMODE=1", LORAWAN_SCRIPT_ARG_NONE,
+                               "ABP join mode" ) },
+        { "CDEVADDR?", LORAWAN_TAG_CDEVADDR, UNIT_LORAWAN_DEV_ADDR_LENGTH,
+          LORAWAN_SCRIPT_STEP( "CDEVADDR=%s", LORAWAN_SCRIPT_ARG_DEV_ADDR,
+                               "Device Address" ) },
+        { "CNWKSKEY?", LORAWAN_TAG_CNWKSKEY, UNIT_LORAWAN_SESSION_KEY_LENGTH,
+          LORAWAN_SCRIPT_STEP( "CNWKSKEY=%s", LORAWAN_SCRIPT_ARG_NWK_SKEY,
+                               "Network Session Key" ) },
+        { "CAPPSKEY?", LORAWAN_TAG_CAPPSKEY, UNIT_LORAWAN_SESSION_KEY_LENGTH,
+          LORAWAN_SCRIPT_STEP( "CAPPSKEY=%s", LORAWAN_SCRIPT_ARG_APP_SKEY,
+                               "Application Session Key" ) },
+        LORAWAN_CREDENTIAL_MODE_SETTINGS,
+};
+
+static const lorawan_credential_t *
+_unit_lorawan_credential_table( const unit_lorawan_credentials_t *credentials )
+{
+  return credentials->activation == UNIT_LORAWAN_ACTIVATION_ABP
+             ? _unit_lorawan_abp_credentials
+             : _unit_lorawan_otaa_credentials;
 }
 
-esp_err_t unit_lorawan_get_tx_power( uint8_t *power_index )
+static void
+_unit_lorawan_credential_args( const unit_lorawan_credentials_t *credentials,
+                               const char *args[ LORAWAN_SCRIPT_ARG_COUNT ] )
 {
-  if( !power_index )
+  memset( args, 0, LORAWAN_SCRIPT_ARG_COUNT * sizeof( args[ 0 ] ) );
+  args[ LORAWAN_SCRIPT_ARG_DEV_EUI ] = credentials->dev_eui;
+  args[ LORAWAN_SCRIPT_ARG_APP_EUI ] = credentials->app_eui;
+  args[ LORAWAN_SCRIPT_ARG_APP_KEY ] = credentials->app_key;
+  args[ LORAWAN_SCRIPT_ARG_DEV_ADDR ] = credentials->dev_addr;
+  args[ LORAWAN_SCRIPT_ARG_NWK_SKEY ] = credentials->nwk_skey;
+  args[ LORAWAN_SCRIPT_ARG_APP_SKEY ] = credentials->app_skey;
+  args[ LORAWAN_SCRIPT_ARG_ULDL_MODE ] =
+      _unit_lorawan_uldlmode_str[ DIFFERENT_FREQ_MODE ];
+}
+
+// The value a credential reads back as once its write step has run
+static const char *_unit_lorawan_credential_value(
+    const lorawan_credential_t *credential,
+    const char *const args[ LORAWAN_SCRIPT_ARG_COUNT ] )
+{
+  if( credential->write.arg == LORAWAN_SCRIPT_ARG_NONE )
   {
-    ESP_LOGE( _TAG, "TX power parameter cannot be NULL" );
-    return ESP_ERR_INVALID_ARG;
+    return strchr( credential->write.cmd, '=' ) + 1;
   }
+  return args[ credential->write.arg ];
+}
 
-  ESP_LOGD( _TAG, "Getting current TX power" );
-
-  lorawan_response_t response = { 0 };
-  esp_err_t err = _unit_lorawan_send_at_command(
-      "CTXP?", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+static esp_err_t _unit_lorawan_credentials_validate(
+    const unit_lorawan_credentials_t *credentials )
+{
+  if( !credentials )
+  {
+    ESP_LOGE( _TAG, "Credentials cannot be NULL" );
+    return ESP_ERR_INVALID_ARG;
+  }
+  if( credentials->activation != UNIT_LORAWAN_ACTIVATION_OTAA &&
+      credentials->activation != UNIT_LORAWAN_ACTIVATION_ABP )
+  {
+    ESP_LOGE( _TAG, "Invalid activation mode: %d",
+              (int)credentials->activation );
+    return ESP_ERR_INVALID_ARG;
+  }
 
-  if( err == ESP_OK && response.success && response.response_data )
+  const lorawan_credential_t *table =
+      _unit_lorawan_credential_table( credentials );
+  const char *args[ LORAWAN_SCRIPT_ARG_COUNT ];
+  _unit_lorawan_credential_args( credentials, args );
+  for( size_t i = 0; i < LORAWAN_CREDENTIAL_COUNT; i++ )
   {
-    char *txp_pos = strstr( response.response_data, "+CTXP:" );
-    if( txp_pos )
+    if( !table[ i ].length )
     {
-      int power_value = 0;
-      if( sscanf( txp_pos, "+CTXP:%d", &power_value ) == 1 )
-      {
-        *power_index = (uint8_t)power_value;
-        ESP_LOGI( _TAG, "Current TX power index: %d", *power_index );
-      }
-      else
-      {
-        ESP_LOGE( _TAG, "Failed to parse TX power from response" );
-        err = ESP_FAIL;
-      }
+      continue;
     }
-    else
+    const char *value = args[ table[ i ].write.arg ];
+    size_t length = strnlen( value, table[ i ].length + 1 );
+    bool valid = length == table[ i ].length;
+    for( size_t j = 0; valid && j < length; j++ )
     {
-      ESP_LOGE( _TAG, "TX power data not found in response" );
-      err = ESP_FAIL;
+      valid = isxdigit( (unsigned char)value[ j ] );
+    }
+    if( !valid )
+    {
+      ESP_LOGE( _TAG, "Invalid %s: expected %zu hex characters",
+                table[ i ].write.description, table[ i ].length );
+      return ESP_ERR_INVALID_ARG;
     }
   }
-  else
+  return ESP_OK;
+}
+
+// ABP needs no join request. The module reports status 08 once it holds a
+// session, and AT+CJOIN in ABP mode only activates the stored keys, so no
+// join airtime is spent either way.
+static esp_err_t _unit_lorawan_abp_activate( lorawan_instance_t *lw,
+                                             bool *active )
+{
+  *active = false;
+  if( unit_lorawan_connected_h( lw, active ) == ESP_OK && *active )
   {
-    ESP_LOGE( _TAG, "Failed to get TX power" );
+    ESP_LOGI( lw->tag, "✓ ABP session active" );
+    return ESP_OK;
   }
 
-  _unit_lorawan_cleanup_response( &response );
+  esp_err_t err = unit_lorawan_join_h( lw );
+  if( err != ESP_OK )
+  {
+    ESP_LOGE( lw->tag, "✗ Failed to activate the ABP session" );
+  }
   return err;
 }
 
-esp_err_t unit_lorawan_link_check( uint8_t mode )
+esp_err_t
+unit_lorawan_provision_h( unit_lorawan_handle_t lw,
+                          const unit_lorawan_credentials_t *credentials,
+                          size_t *written )
 {
-  if( mode > 2 )
+  LORAWAN_CHECK_HANDLE( lw );
+  if( written )
   {
-    ESP_LOGE(
-        _TAG,
-        "Invalid link check mode %d (0=disable, 1=once, 2=after every uplink)",
-        mode );
-    return ESP_ERR_INVALID_ARG;
+    *written = 0;
+  }
+  esp_err_t err = _unit_lorawan_credentials_validate( credentials );
+  if( err != ESP_OK )
+  {
+    return err;
   }
 
-  ESP_LOGI( _TAG, "Setting link check mode to %d", mode );
-
-  char cmd[ 16 ];
-  snprintf( cmd, sizeof( cmd ), "CLINKCHECK=%d", mode );
-
-  lorawan_response_t response = { 0 };
-  esp_err_t err = _unit_lorawan_send_at_command(
-      cmd, &response, mode == 1 ? 30000 : UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+  bool abp = credentials->activation == UNIT_LORAWAN_ACTIVATION_ABP;
+  const lorawan_credential_t *table =
+      _unit_lorawan_credential_table( credentials );
+  const char *args[ LORAWAN_SCRIPT_ARG_COUNT ];
+  _unit_lorawan_credential_args( credentials, args );
+  ESP_LOGI( lw->tag, "Provisioning %s credentials (%s %s)",
+            abp ? "ABP" : "OTAA", abp ? "DevAddr" : "DevEUI",
+            abp ? credentials->dev_addr : credentials->dev_eui );
+
+  // Read everything back first, so a unit that already holds these
+  // credentials costs neither writes nor a flash save
+  TickType_t start = xTaskGetTickCount();
+  lorawan_script_step_t steps[ LORAWAN_CREDENTIAL_COUNT ];
+  size_t differing[ LORAWAN_CREDENTIAL_COUNT ];
+  size_t count = 0;
+  for( size_t i = 0; i < LORAWAN_CREDENTIAL_COUNT; i++ )
+  {
+    if( !_unit_lorawan_setting_matches(
+            lw, table[ i ].query, table[ i ].tag,
+            _unit_lorawan_credential_value( &table[ i ], args ) ) )
+    {
+      differing[ count ] = i;
+      steps[ count++ ] = table[ i ].write;
+    }
+  }
 
-  if( err == ESP_OK && response.success )
+  if( count == 0 )
+  {
+    ESP_LOGI( lw->tag, "✓ Module already holds these credentials (%u ms)",
+              pdTICKS_TO_MS( xTaskGetTickCount() - start ) );
+  }
+  else
   {
-    ESP_LOGI( _TAG, "✓ Link check configured successfully" );
+    ESP_LOGI( lw->tag, "Writing %zu of %d credential settings", count,
+              LORAWAN_CREDENTIAL_COUNT );
+    err = _unit_lorawan_run_script( lw, "credentials", steps, count, args,
+                                    NULL );
+    if( err != ESP_OK )
+    {
+      return err;
+    }
+    _unit_lorawan_session_set_joined( lw, false );
+
+    lorawan_response_t response = { 0 };
+    err = _unit_lorawan_send_at_command( lw, "CSAVE", &response,
+                                         UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+    bool saved = err == ESP_OK && response.success;
+    _unit_lorawan_cleanup_response( lw, &response );
+    if( !saved )
+    {
+      ESP_LOGE( lw->tag, "✗ Failed to save credentials to module" );
+      return err != ESP_OK ? err : ESP_FAIL;
+    }
 
-    if( mode == 1 && response.response_data )
+    // Verify what was written in one more back to back pass
+    for( size_t k = 0; k < count; k++ )
     {
-      char *link_result = strstr( response.response_data, "+CLINKCHECK:" );
-      if( link_result )
+      const lorawan_credential_t *credential = &table[ differing[ k ] ];
+      if( !_unit_lorawan_setting_matches(
+              lw, credential->query, credential->tag,
+              _unit_lorawan_credential_value( credential, args ) ) )
       {
-        int result, margin, gateways, rssi, snr;
-        if( sscanf( link_result, "+CLINKCHECK:%d,%d,%d,%d,%d", &result, &margin,
-                    &gateways, &rssi, &snr ) == 5 )
-        {
-          if( result == 0 )
-          {
-            ESP_LOGI( _TAG, "✓ Link check successful:" );
-            ESP_LOGI( _TAG, "  Demod Margin: %d", margin );
-            ESP_LOGI( _TAG, "  Gateways: %d", gateways );
-            ESP_LOGI( _TAG, "  RSSI: %d dBm", rssi );
-            ESP_LOGI( _TAG, "  SNR: %d", snr );
-          }
-          else
-          {
-            ESP_LOGW( _TAG, "✗ Link check failed with result code %d", result );
-          }
-        }
+        ESP_LOGE( lw->tag, "✗ %s did not read back as written",
+                  credential->write.description );
+        err = ESP_ERR_INVALID_RESPONSE;
       }
     }
+    if( err != ESP_OK )
+    {
+      return err;
+    }
+    if( written )
+    {
+      *written = count;
+    }
+    ESP_LOGI( lw->tag, "✓ %zu credential settings written and verified "
+                       "(%u ms)",
+              count, pdTICKS_TO_MS( xTaskGetTickCount() - start ) );
   }
-  else
+
+  if( abp )
   {
-    ESP_LOGE( _TAG, "✗ Failed to configure link check" );
+    bool active;
+    return _unit_lorawan_abp_activate( lw, &active );
   }
-
-  _unit_lorawan_cleanup_response( &response );
-  return err;
+  return ESP_OK;
 }
 
-esp_err_t unit_lorawan_save_config( void )
+// Copies a Kconfig string, refusing one the destination would truncate
+static bool _unit_lorawan_credential_copy( char *destination, size_t size,
+                                           const char *value )
 {
-  ESP_LOGI( _TAG, "Saving LoRaWAN configuration to non-volatile memory" );
-
-  lorawan_response_t response = { 0 };
-  esp_err_t err = _unit_lorawan_send_at_command(
-      "CSAVE", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-
-  if( err == ESP_OK && response.success )
-  {
-    ESP_LOGI( _TAG, "✓ Configuration saved successfully" );
-  }
-  else
+  if( strlen( value ) >= size )
   {
-    ESP_LOGE( _TAG, "✗ Failed to save configuration" );
+    return false;
   }
-
-  _unit_lorawan_cleanup_response( &response );
-  return err;
+  strcpy( destination, value );
+  return true;
 }
 
-esp_err_t unit_lorawan_restore_defaults( void )
+// Credentials built into the image from Kconfig
+static esp_err_t
+_unit_lorawan_kconfig_credentials( unit_lorawan_credentials_t *credentials )
 {
-  ESP_LOGI( _TAG, "Restoring LoRaWAN factory default configuration" );
-
-  lorawan_response_t response = { 0 };
-  esp_err_t err = _unit_lorawan_send_at_command(
-      "CRESTORE", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-
-  if( err == ESP_OK && response.success )
+  memset( credentials, 0, sizeof( *credentials ) );
+  bool fits;
+#ifdef CONFIG_LORAWAN_ABP
+  credentials->activation = UNIT_LORAWAN_ACTIVATION_ABP;
+  snprintf( credentials->dev_addr, sizeof( credentials->dev_addr ), "%08X",
+            (unsigned)CONFIG_LORAWAN_DEV_ADDR );
+  fits = _unit_lorawan_credential_copy( credentials->nwk_skey,
+                                        sizeof( credentials->nwk_skey ),
+                                        CONFIG_LORAWAN_NWK_SKEY ) &&
+         _unit_lorawan_credential_copy( credentials->app_skey,
+                                        sizeof( credentials->app_skey ),
+                                        CONFIG_LORAWAN_APP_SKEY );
+#else
+  credentials->activation = UNIT_LORAWAN_ACTIVATION_OTAA;
+  fits = _unit_lorawan_credential_copy( credentials->dev_eui,
+                                        sizeof( credentials->dev_eui ),
+                                        CONFIG_LORAWAN_DEVICE_EUI ) &&
+         _unit_lorawan_credential_copy( credentials->app_eui,
+                                        sizeof( credentials->app_eui ),
+                                        CONFIG_LORAWAN_APP_EUI ) &&
+         _unit_lorawan_credential_copy( credentials->app_key,
+                                        sizeof( credentials->app_key ),
+                                        CONFIG_LORAWAN_APP_KEY );
+#endif
+  if( !fits )
   {
-    ESP_LOGI( _TAG, "✓ Factory defaults restored successfully" );
-    ESP_LOGI( _TAG, "  Note: You may need to reboot the module for changes to "
-                    "take effect" );
+    ESP_LOGE( _TAG, "Kconfig credential longer than expected" );
+    return ESP_ERR_INVALID_ARG;
   }
-  else
+  return _unit_lorawan_credentials_validate( credentials );
+}
+
+#ifdef CONFIG_LORAWAN_NVS_CREDENTIALS
+static esp_err_t _unit_lorawan_nvs_get_credential( nvs_handle_t handle,
+                                                   const char *key,
+                                                   char *value, size_t size )
+{
+  esp_err_t err = nvs_get_str( handle, key, value, &size );
+  if( err != ESP_OK )
   {
-    ESP_LOGE( _TAG, "✗ Failed to restore factory defaults" );
+    ESP_LOGE( _TAG, "✗ Failed to read credential %s from NVS: %s", key,
+              esp_err_to_name( err ) );
   }
-
-  _unit_lorawan_cleanup_response( &response );
-  return err;
+  return err == ESP_ERR_NVS_INVALID_LENGTH ? ESP_ERR_INVALID_SIZE : err;
 }
+#endif
 
-esp_err_t unit_lorawan_send_raw_command( const char *command, char *response,
-                                         size_t response_size,
-                                         uint32_t timeout_ms )
+esp_err_t
+unit_lorawan_load_credentials( const char *nvs_namespace,
+                               unit_lorawan_credentials_t *credentials )
 {
-  if( !command )
+  if( !credentials )
   {
-    ESP_LOGE( _TAG, "Command cannot be NULL" );
+    ESP_LOGE( _TAG, "Credentials parameter cannot be NULL" );
     return ESP_ERR_INVALID_ARG;
   }
+#ifdef CONFIG_LORAWAN_NVS_CREDENTIALS
+  if( !nvs_namespace )
+  {
+    nvs_namespace = CONFIG_LORAWAN_CREDENTIALS_NAMESPACE;
+  }
+  memset( credentials, 0, sizeof( *credentials ) );
 
-  ESP_LOGI( _TAG, "Sending raw AT command: %s", command );
-
-  lorawan_response_t lorawan_resp = { 0 };
-  esp_err_t err =
-      _unit_lorawan_send_at_command( command, &lorawan_resp, timeout_ms );
+  nvs_handle_t handle;
+  esp_err_t err = nvs_open( nvs_namespace, NVS_READONLY, &handle );
+  if( err != ESP_OK )
+  {
+    ESP_LOGW( _TAG, "⚠ No credentials in NVS namespace %s: %s",
+              nvs_namespace, esp_err_to_name( err ) );
+    return err;
+  }
 
-  if( err == ESP_OK && response && response_size > 0 )
+  // A DevAddr marks an ABP device, anything else must carry OTAA keys
+  size_t length = sizeof( credentials->dev_addr );
+  err = nvs_get_str( handle, UNIT_LORAWAN_NVS_DEV_ADDR_KEY,
+                     credentials->dev_addr, &length );
+  if( err == ESP_OK )
   {
-    // Copy response data if buffer provided
-    if( lorawan_resp.response_data )
+    credentials->activation = UNIT_LORAWAN_ACTIVATION_ABP;
+    err = _unit_lorawan_nvs_get_credential(
+        handle, UNIT_LORAWAN_NVS_NWK_SKEY_KEY, credentials->nwk_skey,
+        sizeof( credentials->nwk_skey ) );
+    if( err == ESP_OK )
     {
-      strncpy( response, lorawan_resp.response_data, response_size - 1 );
-      response[ response_size - 1 ] = '\0';
+      err = _unit_lorawan_nvs_get_credential(
+          handle, UNIT_LORAWAN_NVS_APP_SKEY_KEY, credentials->app_skey,
+          sizeof( credentials->app_skey ) );
     }
-    else
+  }
+  else if( err == ESP_ERR_NVS_NOT_FOUND )
+  {
+    credentials->activation = UNIT_LORAWAN_ACTIVATION_OTAA;
+    err = _unit_lorawan_nvs_get_credential(
+        handle, UNIT_LORAWAN_NVS_DEV_EUI_KEY, credentials->dev_eui,
+        sizeof( credentials->dev_eui ) );
+    if( err == ESP_OK )
     {
-      response[ 0 ] = '\0';
+      err = _unit_lorawan_nvs_get_credential(
+          handle, UNIT_LORAWAN_NVS_APP_EUI_KEY, credentials->app_eui,
+          sizeof( credentials->app_eui ) );
+    }
+    if( err == ESP_OK )
+    {
+      err = _unit_lorawan_nvs_get_credential(
+          handle, UNIT_LORAWAN_NVS_APP_KEY_KEY, credentials->app_key,
+          sizeof( credentials->app_key ) );
     }
   }
+  else
+  {
+    ESP_LOGE( _TAG, "✗ Failed to read credential %s from NVS: %s",
+              UNIT_LORAWAN_NVS_DEV_ADDR_KEY, esp_err_to_name( err ) );
+    err = err == ESP_ERR_NVS_INVALID_LENGTH ? ESP_ERR_INVALID_SIZE : err;
+  }
+  nvs_close( handle );
+  if( err != ESP_OK )
+  {
+    return err;
+  }
 
-  _unit_lorawan_cleanup_response( &lorawan_resp );
+  err = _unit_lorawan_credentials_validate( credentials );
+  if( err == ESP_OK )
+  {
+    ESP_LOGI( _TAG, "✓ Loaded %s credentials from NVS namespace %s",
+              credentials->activation == UNIT_LORAWAN_ACTIVATION_ABP ? "ABP"
+                                                                    : "OTAA",
+              nvs_namespace );
+  }
   return err;
+#else
+  ESP_LOGW( _TAG,
+            "Credential storage disabled (CONFIG_LORAWAN_NVS_CREDENTIALS)" );
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
 }
 
-esp_err_t unit_lorawan_init( void )
+esp_err_t unit_lorawan_provision_from_nvs_h( unit_lorawan_handle_t lw,
+                                             const char *nvs_namespace,
+                                             size_t *written )
 {
-  ESP_LOGI( _TAG, "Initializing LoRaWAN module driver" );
-
-  // Initialize UART for LoRaWAN communication
-  esp_err_t err = core2foraws_expports_uart_begin( UNIT_LORAWAN_DATA_RATE );
+  LORAWAN_CHECK_HANDLE( lw );
+  unit_lorawan_credentials_t credentials;
+  esp_err_t err = unit_lorawan_load_credentials( nvs_namespace, &credentials );
   if( err != ESP_OK )
   {
-    ESP_LOGE( _TAG, "✗ Failed to initialize UART for LoRaWAN communication" );
+    if( written )
+    {
+      *written = 0;
+    }
     return err;
   }
-  ESP_LOGI( _TAG, "✓ UART initialized at %d baud", UNIT_LORAWAN_DATA_RATE );
+  return unit_lorawan_provision_h( lw, &credentials, written );
+}
 
-  // Clear any pending data in UART buffer
-  bool flushed = false;
-  core2foraws_expports_uart_read_flush( &flushed );
-  if( flushed )
+// True when the frequency plan and network parameters init writes are
+// already in the module
+static bool
+_unit_lorawan_network_matches( lorawan_instance_t *lw,
+                               const unit_lorawan_ttn_config_t *config )
+{
+  char mask[ 5 ];
+  _unit_lorawan_sub_band_mask( config->sub_band, mask );
+  if( !_unit_lorawan_setting_matches( lw, "CFREQBANDMASK?",
+                                      LORAWAN_TAG_CFREQBANDMASK, mask ) ||
+      !_unit_lorawan_setting_matches( lw, "CADR?", LORAWAN_TAG_CADR,
+                                      config->adr_enabled ? "1" : "0" ) )
   {
-    ESP_LOGD( _TAG, "✓ UART buffer cleared" );
+    return false;
   }
 
-  // Check if LoRaWAN module is connected
-  bool attached = false;
-  err = unit_lorawan_attached( &attached );
-  if( err != ESP_OK || !attached )
+  // With ADR on the network owns the data rate, so any value is current
+  if( !config->adr_enabled )
   {
-    ESP_LOGE( _TAG, "✗ LoRaWAN module not detected" );
-    ESP_LOGE( _TAG, "  Please check:" );
-    ESP_LOGE( _TAG, "  - Module is properly connected to expansion port C" );
-    ESP_LOGE( _TAG, "  - Module has power (check LED indicators)" );
-    ESP_LOGE( _TAG, "  - UART connections are secure" );
-    return ESP_FAIL;
+    char number[ 4 ];
+    snprintf( number, sizeof( number ), "%d", config->data_rate );
+    return _unit_lorawan_setting_matches( lw, "CDATARATE?",
+                                          LORAWAN_TAG_CDATARATE, number );
   }
+  return true;
+}
 
-  // Set log level to minimal for cleaner operation
-  err = unit_lorawan_log( 1 ); // Error level only
+// Writes the frequency plan and network parameters unless the module holds
+// them already, and saves them. saved is false only when the CSAVE failed.
+static esp_err_t
+_unit_lorawan_apply_network( lorawan_instance_t *lw,
+                             const unit_lorawan_ttn_config_t *config,
+                             bool *saved )
+{
+  *saved = true;
+  if( _unit_lorawan_network_matches( lw, config ) )
+  {
+    ESP_LOGI( lw->tag, "✓ Module already holds the %s network settings",
+              _unit_lorawan_region.name );
+    _unit_lorawan_session_set_adr( lw, config->adr_enabled );
+    if( !config->adr_enabled )
+    {
+      _unit_lorawan_session_set_data_rate( lw, config->data_rate );
+    }
+    return ESP_OK;
+  }
+
+  esp_err_t err = _configure_frequency_plan( lw, config->sub_band );
   if( err != ESP_OK )
   {
-    ESP_LOGW( _TAG, "⚠ Failed to set log level, continuing anyway" );
+    ESP_LOGE( lw->tag, "Failed to configure %s frequency plan",
+              _unit_lorawan_region.name );
+    return err;
+  }
+
+  err = _configure_ttn_network_parameters( lw, config );
+  if( err != ESP_OK )
+  {
+    ESP_LOGE( lw->tag, "Failed to configure TTN network parameters" );
+    return err;
   }
 
-  // Save configuration and reboot module
   lorawan_response_t response = { 0 };
-  err = _unit_lorawan_send_at_command( "CSAVE", &response,
+  err = _unit_lorawan_send_at_command( lw, "CSAVE", &response,
                                        UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-  if( err == ESP_OK && response.success )
+  *saved = err == ESP_OK && response.success;
+  _unit_lorawan_cleanup_response( lw, &response );
+  if( *saved )
   {
-    ESP_LOGI( _TAG, "✓ Configuration saved to module" );
+    ESP_LOGI( lw->tag, "✓ %s network settings saved to module",
+              _unit_lorawan_region.name );
   }
   else
   {
-    ESP_LOGW( _TAG, "⚠ Failed to save configuration" );
+    ESP_LOGW( lw->tag, "⚠ Failed to save %s network settings",
+              _unit_lorawan_region.name );
   }
-  _unit_lorawan_cleanup_response( &response );
-
-  // Reboot module to ensure clean state
-  unit_lorawan_reboot();
-
-  ESP_LOGI( _TAG, "✓ LoRaWAN module driver initialized successfully" );
-  ESP_LOGI( _TAG, "  Ready for OTAA configuration and network joining" );
-
   return ESP_OK;
 }
 
-// TTN US915 configuration functions
-
-static const char *_get_us915_sub_band_mask( uint8_t sub_band )
+// The OTAA credentials of a TTN configuration, already validated
+static void
+_unit_lorawan_ttn_credentials( const unit_lorawan_ttn_config_t *config,
+                               unit_lorawan_credentials_t *credentials )
 {
-  switch( sub_band )
-  {
-  case 1:
-    return ASR6501_US915_SUB_BAND_1_MASK;
-  case 2:
-    return ASR6501_US915_SUB_BAND_2_MASK;
-  case 3:
-    return ASR6501_US915_SUB_BAND_3_MASK;
-  case 4:
-    return ASR6501_US915_SUB_BAND_4_MASK;
-  case 5:
-    return ASR6501_US915_SUB_BAND_5_MASK;
-  case 6:
-    return ASR6501_US915_SUB_BAND_6_MASK;
-  case 7:
-    return ASR6501_US915_SUB_BAND_7_MASK;
-  case 8:
-    return ASR6501_US915_SUB_BAND_8_MASK;
-  default:
-    return ASR6501_US915_SUB_BAND_2_MASK; // Default to TTN sub-band
-  }
+  memset( credentials, 0, sizeof( *credentials ) );
+  credentials->activation = UNIT_LORAWAN_ACTIVATION_OTAA;
+  _unit_lorawan_credential_copy( credentials->dev_eui,
+                                 sizeof( credentials->dev_eui ),
+                                 config->dev_eui );
+  _unit_lorawan_credential_copy( credentials->app_eui,
+                                 sizeof( credentials->app_eui ),
+                                 config->app_eui );
+  _unit_lorawan_credential_copy( credentials->app_key,
+                                 sizeof( credentials->app_key ),
+                                 config->app_key );
 }
 
-static esp_err_t _validate_ttn_config( const unit_lorawan_ttn_config_t *config )
+#ifdef CONFIG_LORAWAN_FAST_BOOT
+// True when everything configure_ttn_us915() writes is already in the module
+static bool
+_unit_lorawan_ttn_config_matches( lorawan_instance_t *lw,
+                                  const unit_lorawan_ttn_config_t *config )
 {
-  if( !config )
-  {
-    ESP_LOGE( _TAG, "TTN configuration cannot be NULL" );
-    return ESP_ERR_INVALID_ARG;
-  }
-
-  // Validate DevEUI (16 hex characters)
-  if( strlen( config->dev_eui ) != UNIT_LORAWAN_EUI_LENGTH )
-  {
-    ESP_LOGE( _TAG, "Invalid DevEUI length: %zu (expected %d)",
-              strlen( config->dev_eui ), UNIT_LORAWAN_EUI_LENGTH );
-    return ESP_ERR_INVALID_ARG;
-  }
-
-  // Validate AppEUI (16 hex characters)
-  if( strlen( config->app_eui ) != UNIT_LORAWAN_EUI_LENGTH )
-  {
-    ESP_LOGE( _TAG, "Invalid AppEUI length: %zu (expected %d)",
-              strlen( config->app_eui ), UNIT_LORAWAN_EUI_LENGTH );
-    return ESP_ERR_INVALID_ARG;
-  }
-
-  // Validate AppKey (32 hex characters)
-  if( strlen( config->app_key ) != UNIT_LORAWAN_APP_KEY_LENGTH )
+  unit_lorawan_credentials_t credentials;
+  _unit_lorawan_ttn_credentials( config, &credentials );
+  const char *args[ LORAWAN_SCRIPT_ARG_COUNT ];
+  _unit_lorawan_credential_args( &credentials, args );
+  for( size_t i = 0; i < LORAWAN_CREDENTIAL_COUNT; i++ )
   {
-    ESP_LOGE( _TAG, "Invalid AppKey length: %zu (expected %d)",
-              strlen( config->app_key ), UNIT_LORAWAN_APP_KEY_LENGTH );
-    return ESP_ERR_INVALID_ARG;
+    const lorawan_credential_t *credential =
+        &_unit_lorawan_otaa_credentials[ i ];
+    if( !_unit_lorawan_setting_matches(
+            lw, credential->query, credential->tag,
+            _unit_lorawan_credential_value( credential, args ) ) )
+    {
+      return false;
+    }
   }
+  return _unit_lorawan_network_matches( lw, config );
+}
+#endif
 
-  // Validate sub-band range (1-8 for US915)
-  if( config->sub_band < UNIT_LORAWAN_US915_SUB_BAND_MIN ||
-      config->sub_band > UNIT_LORAWAN_US915_SUB_BAND_MAX )
+// Provisions the credentials with unit_lorawan_provision_h(), which writes
+// only what differs, saves and verifies it, then the frequency plan and
+// network parameters
+static esp_err_t
+_unit_lorawan_provision_ttn( lorawan_instance_t *lw,
+                             const unit_lorawan_ttn_config_t *config,
+                             const unit_lorawan_credentials_t *credentials )
+{
+  esp_err_t err = unit_lorawan_provision_h( lw, credentials, NULL );
+  if( err != ESP_OK )
   {
-    ESP_LOGE( _TAG, "Invalid US915 sub-band: %d (valid range: %d-%d)",
-              config->sub_band, UNIT_LORAWAN_US915_SUB_BAND_MIN,
-              UNIT_LORAWAN_US915_SUB_BAND_MAX );
-    return ESP_ERR_INVALID_ARG;
+    ESP_LOGE( lw->tag, "Failed to provision %s credentials",
+              credentials->activation == UNIT_LORAWAN_ACTIVATION_ABP ? "ABP"
+                                                                    : "OTAA" );
+    return err;
   }
 
-  // Validate data rate for US915 (0-4)
-  if( config->data_rate > UNIT_LORAWAN_US915_DATA_RATE_MAX )
+  bool saved;
+  err = _unit_lorawan_apply_network( lw, config, &saved );
+  if( err != ESP_OK )
   {
-    ESP_LOGE( _TAG, "Invalid US915 data rate: %d (valid range: %d-%d)",
-              config->data_rate, UNIT_LORAWAN_US915_DATA_RATE_MIN,
-              UNIT_LORAWAN_US915_DATA_RATE_MAX );
-    return ESP_ERR_INVALID_ARG;
+    return err;
   }
-
-  // Validate RX2 data rate (typically 8 for TTN US915)
-  if( config->rx2_data_rate > 15 )
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+  if( saved && credentials->activation == UNIT_LORAWAN_ACTIVATION_OTAA )
   {
-    ESP_LOGE( _TAG, "Invalid RX2 data rate: %d (valid range: 0-15)",
-              config->rx2_data_rate );
-    return ESP_ERR_INVALID_ARG;
+    _unit_lorawan_store_set_provisioned(
+        lw, true, _unit_lorawan_ttn_config_hash( config ) );
   }
-
+#endif
   return ESP_OK;
 }
 
-static esp_err_t _configure_us915_frequency_plan( uint8_t sub_band )
+// Credentials for init: a per-device NVS record wins over Kconfig, so one
+// image serves a whole fleet
+static esp_err_t
+_unit_lorawan_default_credentials( lorawan_instance_t *lw,
+                                   unit_lorawan_credentials_t *credentials )
 {
-  ESP_LOGI( _TAG, "Configuring US915 frequency plan (sub-band %d)", sub_band );
-
-  lorawan_response_t response = { 0 };
-  esp_err_t err = ESP_OK;
-
-  // Set frequency band to US915
-  err = _unit_lorawan_send_at_command( "CFREQBANDMASK=0001", &response,
-                                       UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-  if( err != ESP_OK || !response.success )
+#ifdef CONFIG_LORAWAN_NVS_CREDENTIALS
+  esp_err_t err = unit_lorawan_load_credentials( NULL, credentials );
+  if( err != ESP_ERR_NVS_NOT_FOUND )
   {
-    ESP_LOGE( _TAG, "Failed to set US915 frequency band" );
-    goto cleanup;
+    return err;
   }
-  ESP_LOGD( _TAG, "✓ US915 frequency band set" );
-  _unit_lorawan_cleanup_response( &response );
+  ESP_LOGW( lw->tag, "⚠ No credentials in NVS, using Kconfig values" );
+#endif
+  return _unit_lorawan_kconfig_credentials( credentials );
+}
 
-  // Configure channel mask for specific sub-band
-  const char *sub_band_mask = _get_us915_sub_band_mask( sub_band );
-  char channel_cmd[ 32 ];
-  snprintf( channel_cmd, sizeof( channel_cmd ), "CFREQBANDMASK=%s",
-            sub_band_mask );
+// Provisions the ABP session keys, activating the session without a join,
+// then the frequency plan and network parameters
+static esp_err_t
+_unit_lorawan_configure_abp( lorawan_instance_t *lw,
+                             const unit_lorawan_ttn_config_t *config,
+                             const unit_lorawan_credentials_t *credentials,
+                             unit_lorawan_ttn_join_callback_t join_callback,
+                             void *user_data )
+{
+  ESP_LOGI( lw->tag, "Configuring LoRaWAN ABP session for %s",
+            _unit_lorawan_region.name );
 
-  err = _unit_lorawan_send_at_command( channel_cmd, &response,
-                                       UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-  if( err != ESP_OK || !response.success )
+  bool attached = false;
+  esp_err_t err = unit_lorawan_attached_h( lw, &attached );
+  if( err != ESP_OK || !attached )
   {
-    ESP_LOGE( _TAG, "Failed to configure US915 sub-band %d", sub_band );
-    goto cleanup;
+    ESP_LOGE( lw->tag, "LoRaWAN module not detected or not responding" );
+    return ESP_ERR_INVALID_STATE;
   }
-  ESP_LOGI( _TAG, "✓ US915 sub-band %d configured (channels %d-%d)", sub_band,
-            ( sub_band - 1 ) * 8, ( sub_band - 1 ) * 8 + 7 );
-  _unit_lorawan_cleanup_response( &response );
 
-cleanup:
-  _unit_lorawan_cleanup_response( &response );
-  return err;
-}
+  _unit_lorawan_airtime_set_sub_band(
+      lw, _unit_lorawan_region.sub_band_count ? config->sub_band : 1 );
 
-static void ttn_join_monitor_task( void *pvParameters )
-{
-  typedef struct
+  err = _unit_lorawan_provision_ttn( lw, config, credentials );
+  if( err != ESP_OK )
   {
-    unit_lorawan_ttn_join_callback_t callback;
-    void *user_data;
-    uint16_t timeout_sec;
-  } join_monitor_params_t;
-
-  join_monitor_params_t *monitor_params = (join_monitor_params_t *)pvParameters;
-  bool connected = false;
-  uint16_t elapsed_sec = 0;
-
-  ESP_LOGI( _TAG, "TTN join monitoring started (timeout: %d seconds)",
-            monitor_params->timeout_sec );
+    return err;
+  }
 
-  while( elapsed_sec < monitor_params->timeout_sec )
+  if( join_callback )
   {
-    vTaskDelay( pdMS_TO_TICKS( 1000 ) );
-    elapsed_sec++;
-
-    esp_err_t check_err = unit_lorawan_connected( &connected );
-    if( check_err == ESP_OK && connected )
-    {
-      ESP_LOGI( _TAG, "✓ TTN network join successful after %d seconds",
-                elapsed_sec );
-      monitor_params->callback( true, 0, monitor_params->user_data );
-      break;
-    }
-
-    // Log progress every 10 seconds
-    if( elapsed_sec % 10 == 0 )
+    // An activation still in progress reports through the join watch
+    if( _unit_lorawan_session_joined( lw ) )
     {
-      ESP_LOGI( _TAG, "TTN join in progress... (%d/%d seconds)", elapsed_sec,
-                monitor_params->timeout_sec );
+      xEventGroupSetBits( lw->join.events, LORAWAN_JOIN_ACCEPTED_BIT );
     }
+    _unit_lorawan_join_watch_start( lw, join_callback, user_data,
+                                    config->join_timeout_sec );
   }
 
-  if( !connected )
-  {
-    ESP_LOGE( _TAG, "✗ TTN network join timeout after %d seconds",
-              monitor_params->timeout_sec );
-    ESP_LOGE( _TAG, "Check TTN console, gateway coverage, and credentials" );
-    monitor_params->callback( false, 1,
-                              monitor_params->user_data ); // Timeout error
-  }
-
-  free( monitor_params );
-  vTaskDelete( NULL );
+  ESP_LOGI( lw->tag, "✓ ABP %s configuration completed successfully",
+            _unit_lorawan_region.name );
+  return ESP_OK;
 }
 
-esp_err_t unit_lorawan_configure_ttn_us915(
-    const unit_lorawan_ttn_config_t *config,
-    unit_lorawan_ttn_join_callback_t join_callback, void *user_data )
+// Provisions and joins TTN in the region selected in Kconfig
+static esp_err_t
+_unit_lorawan_configure_ttn( lorawan_instance_t *lw,
+                             const unit_lorawan_ttn_config_t *config,
+                             unit_lorawan_ttn_join_callback_t join_callback,
+                             void *user_data )
 {
-  ESP_LOGI( _TAG, "Configuring LoRaWAN for The Things Network (TTN) US915" );
+  ESP_LOGI( lw->tag, "Configuring LoRaWAN for The Things Network (TTN) %s",
+            _unit_lorawan_region.name );
 
   // Validate configuration
   esp_err_t err = _validate_ttn_config( config );
@@ -1496,117 +7864,164 @@ esp_err_t unit_lorawan_configure_ttn_us915(
 
   // Check if module is attached and responding
   bool attached = false;
-  err = unit_lorawan_attached( &attached );
+  err = unit_lorawan_attached_h( lw, &attached );
   if( err != ESP_OK || !attached )
   {
-    ESP_LOGE( _TAG, "LoRaWAN module not detected or not responding" );
+    ESP_LOGE( lw->tag, "LoRaWAN module not detected or not responding" );
     return ESP_ERR_INVALID_STATE;
   }
 
-  ESP_LOGI( _TAG, "TTN US915 Configuration:" );
-  ESP_LOGI( _TAG, "  DevEUI: %s", config->dev_eui );
-  ESP_LOGI( _TAG, "  AppEUI: %s", config->app_eui );
-  ESP_LOGI( _TAG, "  Sub-band: %d (channels %d-%d)", config->sub_band,
-            ( config->sub_band - 1 ) * 8, ( config->sub_band - 1 ) * 8 + 7 );
-  ESP_LOGI( _TAG, "  Data Rate: DR%d (max %zu bytes payload)",
-            config->data_rate, us915_max_payload_sizes[ config->data_rate ] );
-  ESP_LOGI( _TAG, "  ADR: %s", config->adr_enabled ? "Enabled" : "Disabled" );
-  ESP_LOGI( _TAG, "  RX2: %u Hz, DR%d (configured automatically by stack)",
+  ESP_LOGI( lw->tag, "TTN %s Configuration:", _unit_lorawan_region.name );
+  ESP_LOGI( lw->tag, "  DevEUI: %s", config->dev_eui );
+  ESP_LOGI( lw->tag, "  AppEUI: %s", config->app_eui );
+  if( _unit_lorawan_region.sub_band_count )
+  {
+    ESP_LOGI( lw->tag, "  Sub-band: %d (channels %d-%d)", config->sub_band,
+              ( config->sub_band - 1 ) * UNIT_LORAWAN_SUB_BAND_CHANNELS,
+              config->sub_band * UNIT_LORAWAN_SUB_BAND_CHANNELS - 1 );
+  }
+  ESP_LOGI( lw->tag, "  Data Rate: DR%d (max %zu bytes payload)",
+            config->data_rate,
+            _unit_lorawan_region_max_payload( config->data_rate ) );
+  ESP_LOGI( lw->tag, "  ADR: %s",
+            config->adr_enabled ? "Enabled" : "Disabled" );
+  ESP_LOGI( lw->tag, "  RX2: %u Hz, DR%d (configured automatically by stack)",
             config->rx2_frequency, config->rx2_data_rate );
 
-  // Configure US915 frequency plan
-  err = _configure_us915_frequency_plan( config->sub_band );
-  if( err != ESP_OK )
+  // Uplinks draw on this sub-band's airtime budget from now on, regions
+  // without sub-bands share one budget
+  _unit_lorawan_airtime_set_sub_band(
+      lw, _unit_lorawan_region.sub_band_count ? config->sub_band : 1 );
+
+  unit_lorawan_credentials_t credentials;
+  _unit_lorawan_ttn_credentials( config, &credentials );
+  bool provisioned = false;
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+  // A matching stored record stands in for reading every setting back
+  bool trusted = _unit_lorawan_store_provisioned(
+      lw, _unit_lorawan_ttn_config_hash( config ) );
+  provisioned = trusted;
+#endif
+#ifdef CONFIG_LORAWAN_FAST_BOOT
+  if( !provisioned )
   {
-    ESP_LOGE( _TAG, "Failed to configure US915 frequency plan" );
-    return err;
+    provisioned = _unit_lorawan_ttn_config_matches( lw, config );
   }
+#endif
 
-  // Configure OTAA credentials
-  err =
-      unit_lorawan_configOTTA( (char *)config->dev_eui, (char *)config->app_eui,
-                               (char *)config->app_key, DIFFERENT_FREQ_MODE );
-  if( err != ESP_OK )
+  if( provisioned )
   {
-    ESP_LOGE( _TAG, "Failed to configure OTAA credentials" );
-    return err;
+    ESP_LOGI( lw->tag,
+              "✓ Module already provisioned, skipping reconfiguration" );
+    _unit_lorawan_session_set_adr( lw, config->adr_enabled );
   }
-
-  // Configure TTN-specific network parameters
-  err = _configure_ttn_network_parameters( config );
-  if( err != ESP_OK )
+  else
   {
-    ESP_LOGE( _TAG, "Failed to configure TTN network parameters" );
-    return err;
+    err = _unit_lorawan_provision_ttn( lw, config, &credentials );
+    if( err != ESP_OK )
+    {
+      return err;
+    }
   }
 
-  // Save configuration to module
-  lorawan_response_t response = { 0 };
-  err = _unit_lorawan_send_at_command( "CSAVE", &response,
-                                       UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
-  if( err == ESP_OK && response.success )
+  // A module that kept its session from before the host reset needs no join
+  bool joined = false;
+  if( provisioned && unit_lorawan_connected_h( lw, &joined ) == ESP_OK &&
+      joined )
   {
-    ESP_LOGI( _TAG, "✓ TTN configuration saved to module" );
+    ESP_LOGI( lw->tag, "✓ Module already joined, skipping network join" );
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+    _unit_lorawan_store_save( lw );
+#endif
+    if( join_callback )
+    {
+      xEventGroupSetBits( lw->join.events, LORAWAN_JOIN_ACCEPTED_BIT );
+      _unit_lorawan_join_watch_start( lw, join_callback, user_data,
+                                      config->join_timeout_sec );
+    }
+    ESP_LOGI( lw->tag, "✓ TTN %s configuration completed successfully",
+              _unit_lorawan_region.name );
+    return ESP_OK;
   }
-  else
+
+#ifdef CONFIG_LORAWAN_NVS_SESSION
+  // Before spending a join on the stored record, make sure the module still
+  // holds what it describes
+  if( trusted && !_unit_lorawan_ttn_config_matches( lw, config ) )
   {
-    ESP_LOGW( _TAG, "⚠ Failed to save TTN configuration" );
+    ESP_LOGW( lw->tag,
+              "⚠ Module differs from the stored session, reprovisioning" );
+    err = _unit_lorawan_provision_ttn( lw, config, &credentials );
+    if( err != ESP_OK )
+    {
+      return err;
+    }
   }
-  _unit_lorawan_cleanup_response( &response );
+#endif
 
   // Initiate network join
-  ESP_LOGI( _TAG, "Initiating TTN network join..." );
-  err = unit_lorawan_join();
+  ESP_LOGI( lw->tag, "Initiating TTN network join..." );
+  err = unit_lorawan_join_h( lw );
   if( err != ESP_OK )
   {
-    ESP_LOGE( _TAG, "Failed to initiate TTN network join" );
+    ESP_LOGE( lw->tag, "Failed to initiate TTN network join" );
     return err;
   }
 
-  // If callback provided, create async join monitoring task
+  // If callback provided, let the driver task watch for the join result
   if( join_callback )
   {
-    typedef struct
-    {
-      unit_lorawan_ttn_join_callback_t callback;
-      void *user_data;
-      uint16_t timeout_sec;
-    } join_monitor_params_t;
-
-    join_monitor_params_t *params = malloc( sizeof( join_monitor_params_t ) );
-    if( params )
-    {
-      params->callback = join_callback;
-      params->user_data = user_data;
-      params->timeout_sec = config->join_timeout_sec;
-
-      // Create monitoring task
-      xTaskCreate( ttn_join_monitor_task, "ttn_join_monitor", 4096, params, 3,
-                   NULL );
-    }
-    else
-    {
-      ESP_LOGW( _TAG, "Failed to allocate memory for join monitoring task" );
-    }
+    _unit_lorawan_join_watch_start( lw, join_callback, user_data,
+                                    config->join_timeout_sec );
   }
 
-  ESP_LOGI( _TAG, "✓ TTN US915 configuration completed successfully" );
-  ESP_LOGI( _TAG, "  Join process initiated - %s",
+  ESP_LOGI( lw->tag, "✓ TTN %s configuration completed successfully",
+            _unit_lorawan_region.name );
+  ESP_LOGI( lw->tag, "  Join process initiated - %s",
             join_callback ? "callback will notify of result"
                           : "use unit_lorawan_connected() to check status" );
 
-  return ESP_OK;
+  return ESP_OK;
+}
+
+esp_err_t unit_lorawan_configure_ttn_us915_h(
+    unit_lorawan_handle_t lw, const unit_lorawan_ttn_config_t *config,
+    unit_lorawan_ttn_join_callback_t join_callback, void *user_data )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+#ifdef CONFIG_LORAWAN_REGION_EU868
+  ESP_LOGE( lw->tag,
+            "✗ Built for EU868, use unit_lorawan_configure_ttn_eu868()" );
+  return ESP_ERR_NOT_SUPPORTED;
+#else
+  return _unit_lorawan_configure_ttn( lw, config, join_callback, user_data );
+#endif
+}
+
+esp_err_t unit_lorawan_configure_ttn_eu868_h(
+    unit_lorawan_handle_t lw, const unit_lorawan_ttn_config_t *config,
+    unit_lorawan_ttn_join_callback_t join_callback, void *user_data )
+{
+  LORAWAN_CHECK_HANDLE( lw );
+#ifdef CONFIG_LORAWAN_REGION_EU868
+  return _unit_lorawan_configure_ttn( lw, config, join_callback, user_data );
+#else
+  ESP_LOGE( lw->tag,
+            "✗ Built for US915, use unit_lorawan_configure_ttn_us915()" );
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
 }
 
-esp_err_t unit_lorawan_config_otaa_from_kconfig( void )
+esp_err_t unit_lorawan_config_otaa_from_kconfig_h( unit_lorawan_handle_t lw )
 {
+  LORAWAN_CHECK_HANDLE( lw );
 #ifdef CONFIG_LORAWAN_OTAA
-  ESP_LOGI( _TAG, "Configuring OTAA from Kconfig values" );
+  ESP_LOGI( lw->tag, "Configuring OTAA from Kconfig values" );
 
   // Validate Kconfig values
   if( strlen( CONFIG_LORAWAN_DEVICE_EUI ) != UNIT_LORAWAN_EUI_LENGTH )
   {
-    ESP_LOGE( _TAG,
+    ESP_LOGE( lw->tag,
               "Invalid CONFIG_LORAWAN_DEVICE_EUI length: %zu (expected %d)",
               strlen( CONFIG_LORAWAN_DEVICE_EUI ), UNIT_LORAWAN_EUI_LENGTH );
     return ESP_ERR_INVALID_ARG;
@@ -1614,14 +8029,16 @@ esp_err_t unit_lorawan_config_otaa_from_kconfig( void )
 
   if( strlen( CONFIG_LORAWAN_APP_EUI ) != UNIT_LORAWAN_EUI_LENGTH )
   {
-    ESP_LOGE( _TAG, "Invalid CONFIG_LORAWAN_APP_EUI length: %zu (expected %d)",
+    ESP_LOGE( lw->tag,
+              "Invalid CONFIG_LORAWAN_APP_EUI length: %zu (expected %d)",
               strlen( CONFIG_LORAWAN_APP_EUI ), UNIT_LORAWAN_EUI_LENGTH );
     return ESP_ERR_INVALID_ARG;
   }
 
   if( strlen( CONFIG_LORAWAN_APP_KEY ) != UNIT_LORAWAN_APP_KEY_LENGTH )
   {
-    ESP_LOGE( _TAG, "Invalid CONFIG_LORAWAN_APP_KEY length: %zu (expected %d)",
+    ESP_LOGE( lw->tag,
+              "Invalid CONFIG_LORAWAN_APP_KEY length: %zu (expected %d)",
               strlen( CONFIG_LORAWAN_APP_KEY ), UNIT_LORAWAN_APP_KEY_LENGTH );
     return ESP_ERR_INVALID_ARG;
   }
@@ -1636,95 +8053,119 @@ esp_err_t unit_lorawan_config_otaa_from_kconfig( void )
                            // TTN)
 #endif
 
-  esp_err_t err = unit_lorawan_configOTTA( CONFIG_LORAWAN_DEVICE_EUI,
-                                           CONFIG_LORAWAN_APP_EUI,
-                                           CONFIG_LORAWAN_APP_KEY, mode );
+  esp_err_t err = unit_lorawan_configOTTA_h( lw, CONFIG_LORAWAN_DEVICE_EUI,
+                                             CONFIG_LORAWAN_APP_EUI,
+                                             CONFIG_LORAWAN_APP_KEY, mode );
 
   if( err == ESP_OK )
   {
-    ESP_LOGI( _TAG, "✓ OTAA configured from Kconfig:" );
-    ESP_LOGI( _TAG, "  DevEUI: %s", CONFIG_LORAWAN_DEVICE_EUI );
-    ESP_LOGI( _TAG, "  AppEUI: %s", CONFIG_LORAWAN_APP_EUI );
+    ESP_LOGI( lw->tag, "✓ OTAA configured from Kconfig:" );
+    ESP_LOGI( lw->tag, "  DevEUI: %s", CONFIG_LORAWAN_DEVICE_EUI );
+    ESP_LOGI( lw->tag, "  AppEUI: %s", CONFIG_LORAWAN_APP_EUI );
 #ifdef CONFIG_LORAWAN_ULDL_MODE
-    ESP_LOGI( _TAG, "  Mode: %s",
+    ESP_LOGI( lw->tag, "  Mode: %s",
               CONFIG_LORAWAN_ULDL_MODE ? "Same frequency"
                                        : "Different frequency" );
 #else
-    ESP_LOGI( _TAG, "  Mode: Different frequency (default)" );
+    ESP_LOGI( lw->tag, "  Mode: Different frequency (default)" );
 #endif
   }
 
   return err;
 #else
-  ESP_LOGE( _TAG, "CONFIG_LORAWAN_OTAA not enabled in Kconfig" );
+  ESP_LOGE( lw->tag, "CONFIG_LORAWAN_OTAA not enabled in Kconfig" );
   return ESP_ERR_INVALID_ARG;
 #endif
 }
 
-esp_err_t unit_lorawan_config_abp_from_kconfig( void )
+esp_err_t unit_lorawan_config_abp_from_kconfig_h( unit_lorawan_handle_t lw )
 {
+  LORAWAN_CHECK_HANDLE( lw );
 #ifdef CONFIG_LORAWAN_ABP
-  ESP_LOGW( _TAG, "ABP configuration from Kconfig not fully implemented yet" );
-  ESP_LOGW( _TAG, "ABP support is experimental - use OTAA for production" );
+  ESP_LOGI( lw->tag, "Configuring ABP from Kconfig values" );
+
+  unit_lorawan_credentials_t credentials;
+  esp_err_t err = _unit_lorawan_kconfig_credentials( &credentials );
+  if( err != ESP_OK )
+  {
+    return err;
+  }
 
-  // TODO: Implement ABP configuration
-  ESP_LOGI( _TAG, "ABP Kconfig values:" );
-  ESP_LOGI( _TAG, "  DevAddr: 0x%08X", CONFIG_LORAWAN_DEV_ADDR );
-  ESP_LOGI( _TAG, "  AppSKey: %s", CONFIG_LORAWAN_APP_SKEY );
-  ESP_LOGI( _TAG, "  NwkSKey: %s", CONFIG_LORAWAN_NWK_SKEY );
+#ifdef CONFIG_LORAWAN_ULDL_MODE
+  unit_lorwan_uldlmode mode =
+      CONFIG_LORAWAN_ULDL_MODE ? SAME_FREQ_MODE : DIFFERENT_FREQ_MODE;
+#else
+  unit_lorwan_uldlmode mode = DIFFERENT_FREQ_MODE;
+#endif
 
-  return ESP_ERR_NOT_SUPPORTED;
+  err = unit_lorawan_config_abp_h( lw, credentials.dev_addr,
+                                   credentials.nwk_skey,
+                                   credentials.app_skey, mode );
+  if( err == ESP_OK )
+  {
+    ESP_LOGI( lw->tag, "✓ ABP configured from Kconfig:" );
+    ESP_LOGI( lw->tag, "  DevAddr: %s", credentials.dev_addr );
+  }
+
+  return err;
 #else
-  ESP_LOGE( _TAG, "CONFIG_LORAWAN_ABP not enabled in Kconfig" );
+  ESP_LOGE( lw->tag, "CONFIG_LORAWAN_ABP not enabled in Kconfig" );
   return ESP_ERR_INVALID_ARG;
 #endif
 }
 
 esp_err_t
-unit_lorawan_init_with_config( unit_lorawan_ttn_join_callback_t join_callback,
-                               void *user_data )
+unit_lorawan_init_with_config_h( unit_lorawan_handle_t lw,
+                                 unit_lorawan_ttn_join_callback_t join_callback,
+                                 void *user_data )
 {
-  ESP_LOGI( _TAG, "Initializing LoRaWAN with Kconfig configuration" );
+  LORAWAN_CHECK_HANDLE( lw );
+  ESP_LOGI( lw->tag, "Initializing LoRaWAN with Kconfig configuration" );
 
   // Initialize the basic LoRaWAN driver
-  esp_err_t err = unit_lorawan_init();
+  esp_err_t err = unit_lorawan_init_h( lw );
   if( err != ESP_OK )
   {
-    ESP_LOGE( _TAG, "Failed to initialize LoRaWAN driver" );
+    ESP_LOGE( lw->tag, "Failed to initialize LoRaWAN driver" );
     return err;
   }
 
-#ifdef CONFIG_LORAWAN_REGION_US915
-  ESP_LOGI( _TAG, "Configuring for US915 region" );
+  ESP_LOGI( lw->tag, "Configuring for %s region", _unit_lorawan_region.name );
+
+  unit_lorawan_credentials_t credentials;
+  err = _unit_lorawan_default_credentials( lw, &credentials );
+  if( err != ESP_OK )
+  {
+    ESP_LOGE( lw->tag, "Failed to load LoRaWAN credentials" );
+    return err;
+  }
+  bool abp = credentials.activation == UNIT_LORAWAN_ACTIVATION_ABP;
 
-  // Create TTN configuration from Kconfig values
+  // Create TTN configuration from Kconfig values, ABP leaves the OTAA
+  // credentials empty
   unit_lorawan_ttn_config_t ttn_config = {
-#ifdef CONFIG_LORAWAN_OTAA
-      .dev_eui = CONFIG_LORAWAN_DEVICE_EUI,
-      .app_eui = CONFIG_LORAWAN_APP_EUI,
-      .app_key = CONFIG_LORAWAN_APP_KEY,
-#else
-      .dev_eui = "0000000000000000", // Placeholder for ABP
-      .app_eui = "0000000000000000",
-      .app_key = "00000000000000000000000000000000",
-#endif
+      .dev_eui = credentials.dev_eui,
+      .app_eui = credentials.app_eui,
+      .app_key = credentials.app_key,
 #ifdef CONFIG_LORAWAN_US915_SUB_BAND
       .sub_band = CONFIG_LORAWAN_US915_SUB_BAND,
 #else
       .sub_band = UNIT_LORAWAN_TTN_US915_SUB_BAND_DEFAULT,
 #endif
-#ifdef CONFIG_LORAWAN_US915_DATA_RATE
+#if defined( CONFIG_LORAWAN_US915_DATA_RATE )
       .data_rate = CONFIG_LORAWAN_US915_DATA_RATE,
+#elif defined( CONFIG_LORAWAN_EU868_DATA_RATE )
+      .data_rate = CONFIG_LORAWAN_EU868_DATA_RATE,
 #else
-      .data_rate = UNIT_LORAWAN_TTN_US915_DATA_RATE_DEFAULT,
+      .data_rate = _unit_lorawan_region.data_rate_default,
 #endif
 #ifdef CONFIG_LORAWAN_ADR_ENABLED
       .adr_enabled = CONFIG_LORAWAN_ADR_ENABLED,
 #else
       .adr_enabled = UNIT_LORAWAN_TTN_US915_ADR_ENABLED,
 #endif
-      .rx2_frequency = UNIT_LORAWAN_TTN_US915_RX2_FREQUENCY,
-      .rx2_data_rate = UNIT_LORAWAN_TTN_US915_RX2_DATA_RATE,
+      .rx2_frequency = _unit_lorawan_region.rx2_frequency,
+      .rx2_data_rate = _unit_lorawan_region.rx2_data_rate,
 #ifdef CONFIG_LORAWAN_JOIN_TIMEOUT_SEC
       .join_timeout_sec = CONFIG_LORAWAN_JOIN_TIMEOUT_SEC
 #else
@@ -1732,146 +8173,478 @@ unit_lorawan_init_with_config( unit_lorawan_ttn_join_callback_t join_callback,
 #endif
   };
 
-  // Configure TTN US915 with Kconfig values
-  err =
-      unit_lorawan_configure_ttn_us915( &ttn_config, join_callback, user_data );
+  // Configure TTN with Kconfig values
+  if( abp )
+  {
+    err = _unit_lorawan_configure_abp( lw, &ttn_config, &credentials,
+                                       join_callback, user_data );
+  }
+  else
+  {
+    err = _unit_lorawan_configure_ttn( lw, &ttn_config, join_callback,
+                                       user_data );
+  }
   if( err != ESP_OK )
   {
-    ESP_LOGE( _TAG, "Failed to configure TTN US915 with Kconfig values" );
+    ESP_LOGE( lw->tag, "Failed to configure TTN %s with Kconfig values",
+              _unit_lorawan_region.name );
     return err;
   }
 
   // Apply additional Kconfig settings
-  ESP_LOGI( _TAG, "Applying additional Kconfig settings..." );
+  ESP_LOGI( lw->tag, "Applying additional Kconfig settings..." );
 
   // Set TX power from Kconfig
 #ifdef CONFIG_LORAWAN_TX_POWER_INDEX
-  err = unit_lorawan_set_tx_power( CONFIG_LORAWAN_TX_POWER_INDEX );
+  err = unit_lorawan_set_tx_power_h( lw, CONFIG_LORAWAN_TX_POWER_INDEX );
   if( err != ESP_OK )
   {
-    ESP_LOGW( _TAG, "Failed to set TX power from Kconfig, using default" );
+    ESP_LOGW( lw->tag, "Failed to set TX power from Kconfig, using default" );
   }
 #endif
 
   // Set retries from Kconfig
 #ifdef CONFIG_LORAWAN_CONFIRMED_RETRIES
-  err = unit_lorawan_set_retries( 1, CONFIG_LORAWAN_CONFIRMED_RETRIES );
+  err = unit_lorawan_set_retries_h( lw, 1, CONFIG_LORAWAN_CONFIRMED_RETRIES );
   if( err != ESP_OK )
   {
-    ESP_LOGW( _TAG, "Failed to set retries from Kconfig, using default" );
+    ESP_LOGW( lw->tag, "Failed to set retries from Kconfig, using default" );
   }
 #endif
 
-  ESP_LOGI( _TAG, "✓ LoRaWAN configured from Kconfig:" );
-  ESP_LOGI( _TAG, "  Region: US915" );
+  ESP_LOGI( lw->tag, "✓ LoRaWAN configured from Kconfig:" );
+  ESP_LOGI( lw->tag, "  Region: %s", _unit_lorawan_region.name );
 #ifdef CONFIG_LORAWAN_US915_SUB_BAND
-  ESP_LOGI( _TAG, "  Sub-band: %d (channels %d-%d)",
+  ESP_LOGI( lw->tag, "  Sub-band: %d (channels %d-%d)",
             CONFIG_LORAWAN_US915_SUB_BAND,
             ( CONFIG_LORAWAN_US915_SUB_BAND - 1 ) * 8,
             ( CONFIG_LORAWAN_US915_SUB_BAND - 1 ) * 8 + 7 );
 #endif
-#ifdef CONFIG_LORAWAN_US915_DATA_RATE
-  ESP_LOGI( _TAG, "  Data Rate: DR%d", CONFIG_LORAWAN_US915_DATA_RATE );
-#endif
+  ESP_LOGI( lw->tag, "  Data Rate: DR%d", ttn_config.data_rate );
 #ifdef CONFIG_LORAWAN_ADR_ENABLED
-  ESP_LOGI( _TAG, "  ADR: %s",
+  ESP_LOGI( lw->tag, "  ADR: %s",
             CONFIG_LORAWAN_ADR_ENABLED ? "Enabled" : "Disabled" );
 #endif
 #ifdef CONFIG_LORAWAN_TX_POWER_INDEX
-  ESP_LOGI( _TAG, "  TX Power Index: %d", CONFIG_LORAWAN_TX_POWER_INDEX );
+  ESP_LOGI( lw->tag, "  TX Power Index: %d", CONFIG_LORAWAN_TX_POWER_INDEX );
 #endif
 #ifdef CONFIG_LORAWAN_CONFIRMED_RETRIES
-  ESP_LOGI( _TAG, "  Confirmed Retries: %d", CONFIG_LORAWAN_CONFIRMED_RETRIES );
-#endif
-
-#ifdef CONFIG_LORAWAN_OTAA
-  ESP_LOGI( _TAG, "  Activation: OTAA" );
-#else
-  ESP_LOGI( _TAG, "  Activation: ABP (experimental)" );
+  ESP_LOGI( lw->tag, "  Confirmed Retries: %d",
+            CONFIG_LORAWAN_CONFIRMED_RETRIES );
 #endif
 
-#else
-  ESP_LOGE( _TAG, "Unsupported region in Kconfig" );
-  return ESP_ERR_NOT_SUPPORTED;
-#endif
+  ESP_LOGI( lw->tag, "  Activation: %s", abp ? "ABP" : "OTAA" );
 
   return ESP_OK;
 }
 
-esp_err_t unit_lorawan_get_data_rate_info( uint8_t *current_data_rate,
-                                           size_t *max_payload_size )
+esp_err_t unit_lorawan_get_data_rate_info_h( unit_lorawan_handle_t lw,
+                                             uint8_t *current_data_rate,
+                                             size_t *max_payload_size )
 {
+  LORAWAN_CHECK_HANDLE( lw );
   if( !current_data_rate || !max_payload_size )
   {
-    ESP_LOGE( _TAG, "Data rate and payload size parameters cannot be NULL" );
+    ESP_LOGE( lw->tag, "Data rate and payload size parameters cannot be NULL" );
     return ESP_ERR_INVALID_ARG;
   }
 
-  ESP_LOGD( _TAG, "Querying current data rate and payload size" );
+  ESP_LOGD( lw->tag, "Querying current data rate and payload size" );
 
   lorawan_response_t response = { 0 };
   esp_err_t err = _unit_lorawan_send_at_command(
-      "CDATARATE?", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
+      lw, "CDATARATE?", &response, UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
 
   if( err == ESP_OK && response.success && response.response_data )
   {
-    char *cdatarate_pos = strstr( response.response_data, "+CDATARATE:" );
-    if( cdatarate_pos )
+    if( response.result.tag == LORAWAN_TAG_CDATARATE )
     {
-      int dr_value = 0;
-      if( sscanf( cdatarate_pos, "+CDATARATE:%d", &dr_value ) == 1 )
+      if( response.result.field_count >= 1 )
       {
+        int dr_value = (int)response.result.fields[ 0 ];
         *current_data_rate = (uint8_t)dr_value;
 
-        // Get max payload size for US915 data rates
-        if( dr_value >= 0 && dr_value <= 4 )
+        // Get max payload size for the region's data rates
+        if( dr_value >= 0 && dr_value <= _unit_lorawan_region.data_rate_max )
         {
-          *max_payload_size = us915_max_payload_sizes[ dr_value ];
-          ESP_LOGI( _TAG, "Current data rate: DR%d, max payload: %zu bytes",
+          *max_payload_size = _unit_lorawan_region_max_payload( dr_value );
+          ESP_LOGI( lw->tag, "Current data rate: DR%d, max payload: %zu bytes",
                     dr_value, *max_payload_size );
         }
         else
         {
-          ESP_LOGW( _TAG,
+          ESP_LOGW( lw->tag,
                     "Unknown data rate %d, using conservative payload limit",
                     dr_value );
-          *max_payload_size = UNIT_LORAWAN_US915_MAX_PAYLOAD_DR0;
+          *max_payload_size = _unit_lorawan_region_max_payload( 0 );
         }
       }
       else
       {
-        ESP_LOGE( _TAG, "Failed to parse data rate from CDATARATE response" );
+        ESP_LOGE( lw->tag,
+                  "Failed to parse data rate from CDATARATE response" );
         err = ESP_FAIL;
       }
     }
     else
     {
-      ESP_LOGE( _TAG, "CDATARATE data not found in response: %s",
+      ESP_LOGE( lw->tag, "CDATARATE data not found in response: %s",
                 response.response_data );
       err = ESP_FAIL;
     }
   }
   else
   {
-    ESP_LOGW( _TAG, "Failed to query current data rate with CDATARATE" );
-    _unit_lorawan_cleanup_response( &response );
+    ESP_LOGW( lw->tag, "Failed to query current data rate with CDATARATE" );
+    _unit_lorawan_cleanup_response( lw, &response );
 
     // Try alternative query
-    err = _unit_lorawan_send_at_command( "CSTATUS?", &response,
+    err = _unit_lorawan_send_at_command( lw, "CSTATUS?", &response,
                                          UNIT_LORAWAN_RESPONSE_TIMEOUT_MS );
     if( err == ESP_OK && response.success )
     {
-      ESP_LOGW( _TAG, "Using default data rate DR2 due to query failure" );
-      *current_data_rate = UNIT_LORAWAN_TTN_US915_DATA_RATE_DEFAULT;
+      *current_data_rate = _unit_lorawan_region.data_rate_default;
       *max_payload_size =
-          us915_max_payload_sizes[ UNIT_LORAWAN_TTN_US915_DATA_RATE_DEFAULT ];
+          _unit_lorawan_region_max_payload( *current_data_rate );
+      ESP_LOGW( lw->tag, "Using default data rate DR%d due to query failure",
+                *current_data_rate );
     }
     else
     {
-      ESP_LOGE( _TAG, "All data rate query attempts failed" );
+      ESP_LOGE( lw->tag, "All data rate query attempts failed" );
     }
   }
 
-  _unit_lorawan_cleanup_response( &response );
+  _unit_lorawan_cleanup_response( lw, &response );
   return err;
 }
+
+// Handle-less API, run on the module on expansion port C
+
+esp_err_t unit_lorawan_log( uint8_t level )
+{
+  return unit_lorawan_log_h( &_unit_lorawan_default, level );
+}
+
+esp_err_t unit_lorawan_read_events( unit_lorawan_log_record_t *records,
+                                    size_t max_records, size_t *count,
+                                    uint32_t *lost )
+{
+  return unit_lorawan_read_events_h( &_unit_lorawan_default, records,
+                                     max_records, count, lost );
+}
+
+esp_err_t unit_lorawan_connected( bool *state )
+{
+  return unit_lorawan_connected_h( &_unit_lorawan_default, state );
+}
+
+esp_err_t unit_lorawan_join( void )
+{
+  return unit_lorawan_join_h( &_unit_lorawan_default );
+}
+
+esp_err_t unit_lorawan_configOTTA( char *devEUI, char *appEUI, char *appKey,
+                                   unit_lorwan_uldlmode mode )
+{
+  return unit_lorawan_configOTTA_h( &_unit_lorawan_default, devEUI, appEUI,
+                                    appKey, mode );
+}
+
+esp_err_t unit_lorawan_config_abp( const char *dev_addr, const char *nwk_skey,
+                                   const char *app_skey,
+                                   unit_lorwan_uldlmode mode )
+{
+  return unit_lorawan_config_abp_h( &_unit_lorawan_default, dev_addr,
+                                    nwk_skey, app_skey, mode );
+}
+
+esp_err_t unit_lorawan_reboot( void )
+{
+  return unit_lorawan_reboot_h( &_unit_lorawan_default );
+}
+
+esp_err_t unit_lorawan_attached( bool *state )
+{
+  return unit_lorawan_attached_h( &_unit_lorawan_default, state );
+}
+
+esp_err_t unit_lorawan_send_ex( const uint8_t *buf, size_t len,
+                                const unit_lorawan_tx_opts_t *opts )
+{
+  return unit_lorawan_send_ex_h( &_unit_lorawan_default, buf, len, opts );
+}
+
+esp_err_t unit_lorawan_send( char *message, size_t length )
+{
+  return unit_lorawan_send_h( &_unit_lorawan_default, message, length );
+}
+
+esp_err_t unit_lorawan_send_async( const char *message, size_t length,
+                                   unit_lorawan_tx_callback_t callback,
+                                   void *user_data )
+{
+  return unit_lorawan_send_async_h( &_unit_lorawan_default, message, length,
+                                    callback, user_data );
+}
+
+esp_err_t unit_lorawan_send_async_ex( const uint8_t *buf, size_t len,
+                                      const unit_lorawan_tx_opts_t *opts,
+                                      unit_lorawan_tx_callback_t callback,
+                                      void *user_data )
+{
+  return unit_lorawan_send_async_ex_h( &_unit_lorawan_default, buf, len, opts,
+                                       callback, user_data );
+}
+
+esp_err_t unit_lorawan_send_encoded( const unit_lorawan_schema_t *schema,
+                                     const int32_t *values, size_t records,
+                                     const unit_lorawan_tx_opts_t *opts,
+                                     size_t *sent )
+{
+  return unit_lorawan_send_encoded_h( &_unit_lorawan_default, schema, values,
+                                      records, opts, sent );
+}
+
+esp_err_t unit_lorawan_aggregator_configure(
+    const unit_lorawan_aggregator_config_t *config )
+{
+  return unit_lorawan_aggregator_configure_h( &_unit_lorawan_default, config );
+}
+
+esp_err_t unit_lorawan_aggregate( const uint8_t *record, size_t length )
+{
+  return unit_lorawan_aggregate_h( &_unit_lorawan_default, record, length );
+}
+
+esp_err_t unit_lorawan_aggregate_flush( void )
+{
+  return unit_lorawan_aggregate_flush_h( &_unit_lorawan_default );
+}
+
+esp_err_t unit_lorawan_get_next_tx_delay( size_t length, uint32_t *delay_ms )
+{
+  return unit_lorawan_get_next_tx_delay_h( &_unit_lorawan_default, length,
+                                           delay_ms );
+}
+
+esp_err_t unit_lorawan_get_airtime_budget( uint32_t *remaining_ms )
+{
+  return unit_lorawan_get_airtime_budget_h( &_unit_lorawan_default,
+                                            remaining_ms );
+}
+
+esp_err_t unit_lorawan_set_rx2_frequency( uint32_t frequency )
+{
+  return unit_lorawan_set_rx2_frequency_h( &_unit_lorawan_default, frequency );
+}
+
+esp_err_t unit_lorawan_set_rx2_data_rate( uint8_t data_rate )
+{
+  return unit_lorawan_set_rx2_data_rate_h( &_unit_lorawan_default, data_rate );
+}
+
+esp_err_t unit_lorawan_get_channel_rssi( uint8_t freq_band_idx,
+                                         int16_t *rssi_values,
+                                         size_t *channel_count )
+{
+  return unit_lorawan_get_channel_rssi_h( &_unit_lorawan_default, freq_band_idx,
+                                          rssi_values, channel_count );
+}
+
+esp_err_t
+unit_lorawan_survey_configure( const unit_lorawan_survey_config_t *config )
+{
+  return unit_lorawan_survey_configure_h( &_unit_lorawan_default, config );
+}
+
+esp_err_t unit_lorawan_get_survey( uint8_t sub_band,
+                                   unit_lorawan_sub_band_survey_t *survey )
+{
+  return unit_lorawan_get_survey_h( &_unit_lorawan_default, sub_band, survey );
+}
+
+esp_err_t
+unit_lorawan_get_spool_status( unit_lorawan_spool_status_t *status )
+{
+  return unit_lorawan_get_spool_status_h( &_unit_lorawan_default, status );
+}
+
+esp_err_t unit_lorawan_survey_recommend( uint8_t *sub_band )
+{
+  return unit_lorawan_survey_recommend_h( &_unit_lorawan_default, sub_band );
+}
+
+esp_err_t unit_lorawan_set_data_rate( uint8_t data_rate )
+{
+  return unit_lorawan_set_data_rate_h( &_unit_lorawan_default, data_rate );
+}
+
+esp_err_t unit_lorawan_set_retries( uint8_t message_type, uint8_t retries )
+{
+  return unit_lorawan_set_retries_h( &_unit_lorawan_default, message_type,
+                                     retries );
+}
+
+esp_err_t unit_lorawan_set_tx_power( uint8_t power_index )
+{
+  return unit_lorawan_set_tx_power_h( &_unit_lorawan_default, power_index );
+}
+
+esp_err_t unit_lorawan_get_tx_power( uint8_t *power_index )
+{
+  return unit_lorawan_get_tx_power_h( &_unit_lorawan_default, power_index );
+}
+
+esp_err_t unit_lorawan_link_check( uint8_t mode )
+{
+  return unit_lorawan_link_check_h( &_unit_lorawan_default, mode );
+}
+
+esp_err_t unit_lorawan_get_rssi( int16_t *rssi )
+{
+  return unit_lorawan_get_rssi_h( &_unit_lorawan_default, rssi );
+}
+
+esp_err_t unit_lorawan_get_link_quality( uint32_t window_ms,
+                                         unit_lorawan_link_quality_t *quality )
+{
+  return unit_lorawan_get_link_quality_h( &_unit_lorawan_default, window_ms,
+                                          quality );
+}
+
+esp_err_t unit_lorawan_get_adr_hint( uint32_t window_ms,
+                                     unit_lorawan_adr_hint_t *hint )
+{
+  return unit_lorawan_get_adr_hint_h( &_unit_lorawan_default, window_ms,
+                                      hint );
+}
+
+esp_err_t unit_lorawan_apply_adr_hint( const unit_lorawan_adr_hint_t *hint )
+{
+  return unit_lorawan_apply_adr_hint_h( &_unit_lorawan_default, hint );
+}
+
+esp_err_t unit_lorawan_save_config( void )
+{
+  return unit_lorawan_save_config_h( &_unit_lorawan_default );
+}
+
+esp_err_t unit_lorawan_save_session( void )
+{
+  return unit_lorawan_save_session_h( &_unit_lorawan_default );
+}
+
+esp_err_t unit_lorawan_set_low_power( bool enable )
+{
+  return unit_lorawan_set_low_power_h( &_unit_lorawan_default, enable );
+}
+
+esp_err_t unit_lorawan_get_low_power( bool *enabled )
+{
+  return unit_lorawan_get_low_power_h( &_unit_lorawan_default, enabled );
+}
+
+esp_err_t unit_lorawan_get_stats( unit_lorawan_stats_t *stats )
+{
+  return unit_lorawan_get_stats_h( &_unit_lorawan_default, stats );
+}
+
+esp_err_t unit_lorawan_reset_stats( void )
+{
+  return unit_lorawan_reset_stats_h( &_unit_lorawan_default );
+}
+
+esp_err_t unit_lorawan_set_transport(
+    const unit_lorawan_transport_t *transport )
+{
+  return unit_lorawan_set_transport_h( &_unit_lorawan_default, transport );
+}
+
+esp_err_t unit_lorawan_restore_defaults( void )
+{
+  return unit_lorawan_restore_defaults_h( &_unit_lorawan_default );
+}
+
+esp_err_t unit_lorawan_send_raw_command( const char *command, char *response,
+                                         size_t response_size,
+                                         uint32_t timeout_ms )
+{
+  return unit_lorawan_send_raw_command_h( &_unit_lorawan_default, command,
+                                          response, response_size, timeout_ms );
+}
+
+esp_err_t unit_lorawan_set_downlink_callback(
+    unit_lorawan_downlink_callback_t callback, void *user_data )
+{
+  return unit_lorawan_set_downlink_callback_h( &_unit_lorawan_default, callback,
+                                               user_data );
+}
+
+esp_err_t unit_lorawan_set_event_callback(
+    unit_lorawan_event_callback_t callback, void *user_data )
+{
+  return unit_lorawan_set_event_callback_h( &_unit_lorawan_default, callback,
+                                            user_data );
+}
+
+esp_err_t unit_lorawan_init( void )
+{
+  return unit_lorawan_init_h( &_unit_lorawan_default );
+}
+
+esp_err_t unit_lorawan_configure_ttn_us915(
+    const unit_lorawan_ttn_config_t *config,
+    unit_lorawan_ttn_join_callback_t join_callback, void *user_data )
+{
+  return unit_lorawan_configure_ttn_us915_h( &_unit_lorawan_default, config,
+                                             join_callback, user_data );
+}
+
+esp_err_t unit_lorawan_configure_ttn_eu868(
+    const unit_lorawan_ttn_config_t *config,
+    unit_lorawan_ttn_join_callback_t join_callback, void *user_data )
+{
+  return unit_lorawan_configure_ttn_eu868_h( &_unit_lorawan_default, config,
+                                             join_callback, user_data );
+}
+
+esp_err_t unit_lorawan_config_otaa_from_kconfig( void )
+{
+  return unit_lorawan_config_otaa_from_kconfig_h( &_unit_lorawan_default );
+}
+
+esp_err_t unit_lorawan_config_abp_from_kconfig( void )
+{
+  return unit_lorawan_config_abp_from_kconfig_h( &_unit_lorawan_default );
+}
+
+esp_err_t unit_lorawan_provision( const unit_lorawan_credentials_t *credentials,
+                                  size_t *written )
+{
+  return unit_lorawan_provision_h( &_unit_lorawan_default, credentials,
+                                   written );
+}
+
+esp_err_t unit_lorawan_provision_from_nvs( const char *nvs_namespace,
+                                           size_t *written )
+{
+  return unit_lorawan_provision_from_nvs_h( &_unit_lorawan_default,
+                                            nvs_namespace, written );
+}
+
+esp_err_t
+unit_lorawan_init_with_config( unit_lorawan_ttn_join_callback_t join_callback,
+                               void *user_data )
+{
+  return unit_lorawan_init_with_config_h( &_unit_lorawan_default, join_callback,
+                                          user_data );
+}
+
+esp_err_t unit_lorawan_get_data_rate_info( uint8_t *current_data_rate,
+                                           size_t *max_payload_size )
+{
+  return unit_lorawan_get_data_rate_info_h( &_unit_lorawan_default,
+                                            current_data_rate,
+                                            max_payload_size );
+}